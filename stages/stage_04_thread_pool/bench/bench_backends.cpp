@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "queue.hpp"
+#include "queue_bench_kit.hpp"
+
+// Runs the shared queue benchmark kit over every BoundedQueueBackend: the
+// bounded queue on each wait backend, its Fifo admission, Direct handoff and
+// ShortestWork variants, and the plain BoundedQueue. Each row reports
+// throughput with untimed push / wait_pop, with push_for / wait_pop_for, and
+// a ping-pong round trip between two threads.
+
+namespace {
+
+using Item = std::uint64_t;
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_backends [items] [producers] [consumers] [capacity] [round_trips]\n";
+}
+
+auto bounded(WaitBackend backend,
+    PushAdmission admission = PushAdmission::Unordered,
+    ConsumerHandoff handoff = ConsumerHandoff::ViaQueue,
+    PopOrder pop_order = PopOrder::Fifo) {
+    return [=](std::size_t capacity) {
+        return std::make_unique<BoundedBlockingQueue<Item>>(capacity, admission, handoff, backend, pop_order);
+    };
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QueueBenchParams prm;
+
+    if (argc > 6) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.items = std::stoull(argv[1]);
+        if (argc >= 3) prm.producers = std::max<std::size_t>(std::stoull(argv[2]), 1);
+        if (argc >= 4) prm.consumers = std::max<std::size_t>(std::stoull(argv[3]), 1);
+        if (argc >= 5) prm.capacity = std::stoull(argv[4]);
+        if (argc >= 6) prm.round_trips = std::max<std::uint64_t>(std::stoull(argv[5]), 1);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "items=" << prm.items
+            << " producers=" << prm.producers
+            << " consumers=" << prm.consumers
+            << " capacity=" << prm.capacity
+            << " round_trips=" << prm.round_trips << "\n\n";
+
+        std::cout << "backend                 untimed_items/s  timed_items/s  round_trip_us\n";
+        run_queue_bench("CondVar", bounded(WaitBackend::CondVar), prm);
+        run_queue_bench("Semaphore", bounded(WaitBackend::Semaphore), prm);
+        run_queue_bench("AtomicWait", bounded(WaitBackend::AtomicWait), prm);
+        run_queue_bench("CondVar+Fifo", bounded(WaitBackend::CondVar, PushAdmission::Fifo), prm);
+        run_queue_bench("CondVar+Direct",
+            bounded(WaitBackend::CondVar, PushAdmission::Unordered, ConsumerHandoff::Direct), prm);
+        run_queue_bench("CondVar+ShortestWork",
+            bounded(WaitBackend::CondVar, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, PopOrder::ShortestWork), prm);
+        run_queue_bench("BoundedQueue", [](std::size_t capacity) {
+            return std::make_unique<BoundedQueue<Item>>(capacity);
+        }, prm);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
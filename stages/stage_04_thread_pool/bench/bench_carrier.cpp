@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mock_carrier.hpp"
+#include "pipeline.hpp"
+
+// Deliver through a MockCarrier on loopback whose replies take tens of
+// milliseconds. A backlog of orders is submitted at once and drained;
+// compares many Deliver threads with one request each against few threads
+// with a window of outstanding requests: throughput, lead time, threads.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t orders = 1000;
+    std::chrono::milliseconds latency{ 50 };
+    LatencyShape shape = LatencyShape::Fixed;
+    double spread = 0.5;
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_carrier [orders] [latency_ms] [fixed|uniform|exp|lognormal] [spread]\n";
+}
+
+LatencyShape parse_shape(const std::string& name) {
+    if (name == "fixed") return LatencyShape::Fixed;
+    if (name == "uniform") return LatencyShape::Uniform;
+    if (name == "exp") return LatencyShape::Exponential;
+    if (name == "lognormal") return LatencyShape::LogNormal;
+    throw std::invalid_argument("unknown shape");
+}
+
+std::int64_t percentile(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    const auto k = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+void run(const Params& prm, std::uint16_t port, std::size_t workers, std::size_t window) {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = prm.orders;
+    cfg.q_prepare_capacity = prm.orders;
+    cfg.q_pack_capacity = prm.orders;
+    cfg.deliver_workers = workers;
+    cfg.carrier_port = port;
+    cfg.carrier_window = window;
+
+    Pipeline pipeline(cfg);
+    pipeline.start();
+
+    const auto t0 = Clock::now();
+    for (std::size_t i = 0; i < prm.orders; ++i) (void)pipeline.submit(Order(static_cast<OrderId>(i + 1)));
+    pipeline.shutdown();
+    const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    std::vector<std::int64_t> lead_ms;
+    lead_ms.reserve(prm.orders);
+    for (const auto& o : pipeline.delivered_orders()) {
+        lead_ms.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(o.delivered_time - o.accepted_time).count());
+    }
+
+    const auto m = pipeline.metrics();
+    const auto delivered = lead_ms.size();
+    const auto p50 = percentile(lead_ms, 0.50);
+    const auto p99 = percentile(lead_ms, 0.99);
+
+    std::printf("%7zu %6zu %9zu %10.0f %9lld %9lld %11zu\n", workers, window, delivered,
+        static_cast<double>(delivered) / secs,
+        static_cast<long long>(p50),
+        static_cast<long long>(p99),
+        m.carrier_max_outstanding);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 5) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.orders = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) prm.latency = std::chrono::milliseconds{ std::stoll(argv[2]) };
+        if (argc >= 4) prm.shape = parse_shape(argv[3]);
+        if (argc >= 5) prm.spread = std::stod(argv[4]);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "orders=" << prm.orders
+            << " latency_ms=" << prm.latency.count()
+            << " spread=" << prm.spread << "\n\n";
+
+        MockCarrier carrier(CarrierLatency{ prm.shape, prm.latency, prm.spread });
+        carrier.start();
+
+        // workers x window: request-per-thread first, then windowed.
+        const std::pair<std::size_t, std::size_t> runs[] = { { 8, 1 }, { 64, 1 }, { 1, 64 }, { 4, 64 }, { 1, 256 } };
+
+        std::cout << "workers window delivered orders/s    p50_ms    p99_ms outstanding\n";
+        for (const auto& [workers, window] : runs) run(prm, carrier.port(), workers, window);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
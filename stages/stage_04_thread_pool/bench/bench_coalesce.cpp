@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "pipeline.hpp"
+
+// One pipeline fed at a fixed rate by customers who place short bursts of
+// orders; a few customers are mid-burst at any time, so their orders arrive
+// interleaved. Every Prepare invocation costs a fixed unit of work, however
+// many orders it carries. Compares coalescing windows: stage invocations
+// made and saved, per-order lead time, and how long orders were held.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t orders = 20000;
+    double rate = 4000; // orders per second, open loop; ~80% of Prepare at the defaults
+    std::size_t sessions = 8; // customers mid-burst at any time
+    std::size_t max_burst = 4; // orders per burst, 1..max_burst
+    std::chrono::microseconds unit{ 200 };
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_coalesce [orders] [rate_per_s] [sessions] [max_burst] [unit_us]\n";
+}
+
+std::int64_t percentile(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    const auto k = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+std::int64_t mean(const std::vector<std::int64_t>& v) {
+    if (v.empty()) return 0;
+    std::int64_t sum = 0;
+    for (const auto x : v) sum += x;
+    return sum / static_cast<std::int64_t>(v.size());
+}
+
+// Customer of each order: `sessions` bursts run side by side, each step
+// takes the next order of a random one, and a finished burst is replaced
+// by a new customer's.
+std::vector<std::uint64_t> burst_customers(const Params& prm) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::size_t> burst_len(1, prm.max_burst);
+    std::uniform_int_distribution<std::size_t> pick(0, prm.sessions - 1);
+
+    std::uint64_t next_customer = 1;
+    std::vector<std::pair<std::uint64_t, std::size_t>> active(prm.sessions);
+    for (auto& s : active) s = { next_customer++, burst_len(rng) };
+
+    std::vector<std::uint64_t> customers(prm.orders);
+    for (auto& c : customers) {
+        auto& s = active[pick(rng)];
+        c = s.first;
+        if (--s.second == 0) s = { next_customer++, burst_len(rng) };
+    }
+    return customers;
+}
+
+void run(const Params& prm, const std::vector<std::uint64_t>& customers, std::chrono::milliseconds window) {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = prm.orders;
+    cfg.q_prepare_capacity = prm.orders;
+    cfg.q_pack_capacity = prm.orders;
+    cfg.push_timeout = std::chrono::milliseconds{ 1000 };
+    cfg.coalesce_window = window;
+    cfg.prepare_work = [&](const Order&) { std::this_thread::sleep_for(prm.unit); };
+
+    Pipeline pipeline(cfg);
+    pipeline.start();
+
+    // Open loop: order i is due at t0 + i / rate, whatever the pipeline does.
+    const auto t0 = Clock::now();
+    for (std::size_t i = 0; i < prm.orders; ++i) {
+        const auto due = t0 + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(i) / prm.rate));
+        if (Clock::now() < due) std::this_thread::sleep_until(due);
+        Order o(static_cast<OrderId>(i + 1));
+        o.customer = customers[i];
+        (void)pipeline.submit(std::move(o));
+    }
+    pipeline.shutdown();
+
+    std::vector<std::int64_t> lead_us;
+    lead_us.reserve(prm.orders);
+    const auto lead_of = [](const Order& o) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(o.delivered_time - o.accepted_time).count();
+    };
+    for (const auto& o : pipeline.delivered_orders()) {
+        lead_us.push_back(lead_of(o));
+        for (const auto& m : pipeline.merged_orders(o)) lead_us.push_back(lead_of(m));
+    }
+
+    const auto m = pipeline.metrics();
+    const auto delivered = lead_us.size();
+    const auto lead_mean = mean(lead_us);
+    const auto lead_p99 = percentile(lead_us, 0.99);
+
+    std::printf("%9lld %9zu %9llu %9llu %9lld %9lld %9lld %9lld\n",
+        static_cast<long long>(window.count()), delivered,
+        static_cast<unsigned long long>(m.prepared_count + m.packed_count + m.delivered_count),
+        static_cast<unsigned long long>(3 * m.coalesced_orders),
+        static_cast<long long>(lead_mean),
+        static_cast<long long>(lead_p99),
+        static_cast<long long>(m.coalesce_hold.percentile(0.50).count()),
+        static_cast<long long>(m.coalesce_hold.percentile(0.99).count()));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 6) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.orders = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) prm.rate = std::max(std::stod(argv[2]), 1.0);
+        if (argc >= 4) prm.sessions = std::max<std::size_t>(std::stoull(argv[3]), 1);
+        if (argc >= 5) prm.max_burst = std::max<std::size_t>(std::stoull(argv[4]), 1);
+        if (argc >= 6) prm.unit = std::chrono::microseconds{ std::stoll(argv[5]) };
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "orders=" << prm.orders
+            << " rate_per_s=" << prm.rate
+            << " sessions=" << prm.sessions
+            << " max_burst=" << prm.max_burst
+            << " unit_us=" << prm.unit.count() << "\n\n";
+
+        const auto customers = burst_customers(prm);
+
+        // calls = Prepare + Pack + Deliver invocations. Hold percentiles are
+        // histogram bucket bounds (powers of two).
+        std::cout << "window_ms delivered     calls     saved   mean_us    p99_us  hold_p50  hold_p99\n";
+        for (const int ms : { 0, 1, 5, 20 }) run(prm, customers, std::chrono::milliseconds{ ms });
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.hpp"
+
+// Scaling of the thread-per-core engine against the shared DownstreamFirst
+// pool at the same thread count. One producer per thread submits a share of
+// the orders; reports throughput and speedup over the 1-thread run.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_cores [orders] [max_threads]\n";
+}
+
+double run(std::size_t orders, std::size_t threads, SchedulingPolicy policy) {
+    Pipeline::Config cfg{};
+    cfg.scheduling = policy;
+    cfg.cores = threads;
+    cfg.shared_workers = threads;
+    cfg.push_timeout = std::chrono::milliseconds{ 1000 };
+
+    Pipeline p(cfg);
+    p.start();
+
+    const auto t0 = Clock::now();
+    std::atomic<std::uint64_t> next{ 1 };
+    std::vector<std::thread> producers;
+    for (std::size_t i = 0; i < threads; ++i) {
+        producers.emplace_back([&] {
+            for (auto id = next++; id <= orders; id = next++) {
+                (void)p.submit(Order(static_cast<OrderId>(id)));
+            }
+        });
+    }
+    for (auto& t : producers) t.join();
+    p.shutdown();
+
+    const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    return static_cast<double>(p.metrics().delivered_count) / secs;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t orders = 400000;
+    std::size_t max_threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+    if (argc > 3) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) orders = std::stoull(argv[1]);
+        if (argc >= 3) max_threads = std::max<std::size_t>(std::stoull(argv[2]), 1);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    std::cout << "orders=" << orders << " hardware_concurrency=" << std::thread::hardware_concurrency() << "\n";
+    std::cout << "threads  ThreadPerCore/s  speedup  DownstreamFirst/s  speedup\n";
+
+    double base_core = 0;
+    double base_shared = 0;
+    for (std::size_t n = 1; n <= max_threads; n *= 2) {
+        const double core = run(orders, n, SchedulingPolicy::ThreadPerCore);
+        const double shared = run(orders, n, SchedulingPolicy::DownstreamFirst);
+        if (n == 1) {
+            base_core = core;
+            base_shared = shared;
+        }
+        std::printf("%7zu  %15.0f  %7.2f  %17.0f  %7.2f\n", n, core, core / base_core, shared, shared / base_shared);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "queue.hpp"
+
+// Producers hammer a small queue drained by one paced consumer, so most
+// push_for calls block. Reports per-producer admissions, timeouts and wait
+// percentiles for both admission modes.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t producers = 8;
+    std::chrono::milliseconds duration{ 1000 };
+    std::chrono::microseconds service{ 200 };
+    std::chrono::milliseconds push_timeout{ 2 };
+    std::size_t capacity = 4;
+};
+
+struct ProducerResult {
+    std::uint64_t admitted = 0;
+    std::uint64_t timeouts = 0;
+    std::vector<std::int64_t> waits_us; // every push_for call, admitted or not
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_fairness [producers] [duration_ms] [service_us] [push_timeout_ms] [capacity]\n";
+}
+
+std::int64_t percentile(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    const auto k = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+void spin_for(std::chrono::microseconds d) {
+    const auto until = Clock::now() + d;
+    while (Clock::now() < until) {
+    }
+}
+
+std::vector<ProducerResult> run(const Params& prm, PushAdmission admission) {
+    BoundedBlockingQueue<std::uint64_t> q(prm.capacity, admission);
+    std::atomic<bool> stop{ false };
+    std::vector<ProducerResult> results(prm.producers);
+
+    std::thread consumer([&] {
+        std::uint64_t v = 0;
+        while (q.wait_pop_for(v, std::chrono::milliseconds{ 10 }) || !q.closed()) {
+            spin_for(prm.service);
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < prm.producers; ++p) {
+        producers.emplace_back([&, p] {
+            auto& r = results[p];
+            while (!stop.load(std::memory_order_relaxed)) {
+                const auto t0 = Clock::now();
+                const bool ok = q.push_for(p, prm.push_timeout);
+                r.waits_us.push_back(
+                    std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count());
+                if (ok) ++r.admitted;
+                else ++r.timeouts;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(prm.duration);
+    stop = true;
+    q.close();
+
+    for (auto& t : producers) t.join();
+    consumer.join();
+    return results;
+}
+
+// 1.0 when every producer got the same share, 1/n when one got everything.
+double jain_index(const std::vector<ProducerResult>& rs) {
+    double sum = 0;
+    double sq = 0;
+    for (const auto& r : rs) {
+        const auto x = static_cast<double>(r.admitted);
+        sum += x;
+        sq += x * x;
+    }
+    return sq == 0 ? 1.0 : (sum * sum) / (static_cast<double>(rs.size()) * sq);
+}
+
+void report(const char* name, std::vector<ProducerResult> rs) {
+    std::cout << "\n== " << name << " ==\n";
+    std::cout << "producer  admitted  timeouts   p50_us   p99_us   max_us\n";
+
+    std::vector<double> p99s;
+    std::uint64_t min_timeouts = UINT64_MAX;
+    std::uint64_t max_timeouts = 0;
+
+    for (std::size_t i = 0; i < rs.size(); ++i) {
+        auto& r = rs[i];
+        const auto p50 = percentile(r.waits_us, 0.50);
+        const auto p99 = percentile(r.waits_us, 0.99);
+        const auto max = r.waits_us.empty() ? 0 : *std::max_element(r.waits_us.begin(), r.waits_us.end());
+
+        p99s.push_back(static_cast<double>(p99));
+        min_timeouts = std::min(min_timeouts, r.timeouts);
+        max_timeouts = std::max(max_timeouts, r.timeouts);
+
+        std::printf("%8zu %9llu %9llu %8lld %8lld %8lld\n", i,
+            static_cast<unsigned long long>(r.admitted),
+            static_cast<unsigned long long>(r.timeouts),
+            static_cast<long long>(p50),
+            static_cast<long long>(p99),
+            static_cast<long long>(max));
+    }
+
+    double mean = 0;
+    for (const auto x : p99s) mean += x;
+    mean /= static_cast<double>(p99s.size());
+    double var = 0;
+    for (const auto x : p99s) var += (x - mean) * (x - mean);
+    var /= static_cast<double>(p99s.size());
+
+    std::printf("jain_index(admitted)=%.4f  timeouts[min..max]=%llu..%llu  p99 mean=%.0fus stddev=%.0fus\n",
+        jain_index(rs),
+        static_cast<unsigned long long>(min_timeouts),
+        static_cast<unsigned long long>(max_timeouts),
+        mean,
+        std::sqrt(var));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 6) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.producers = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) prm.duration = std::chrono::milliseconds{ std::stoll(argv[2]) };
+        if (argc >= 4) prm.service = std::chrono::microseconds{ std::stoll(argv[3]) };
+        if (argc >= 5) prm.push_timeout = std::chrono::milliseconds{ std::stoll(argv[4]) };
+        if (argc >= 6) prm.capacity = std::stoull(argv[5]);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "producers=" << prm.producers
+            << " duration_ms=" << prm.duration.count()
+            << " service_us=" << prm.service.count()
+            << " push_timeout_ms=" << prm.push_timeout.count()
+            << " capacity=" << prm.capacity << "\n";
+
+        report("Unordered", run(prm, PushAdmission::Unordered));
+        report("Fifo", run(prm, PushAdmission::Fifo));
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flight_recorder.hpp"
+
+// Cost of FlightRecorder::record() per event with 1..N threads recording at
+// once, and the time to dump every ring to a file.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t events = 2000000; // per thread
+    std::size_t max_threads = 4;
+    std::string path = (std::filesystem::temp_directory_path() / "ops_bench_flight.bin").string();
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_flight [events_per_thread] [max_threads] [dump_path]\n";
+}
+
+double ns_per_event(std::size_t threads, std::size_t events) {
+    std::vector<std::thread> ts;
+    std::vector<double> ns(threads);
+    for (std::size_t t = 0; t < threads; ++t) {
+        ts.emplace_back([&, t] {
+            FlightRecorder::record(FlightEvent::WorkerStart, 0, 0, t); // takes the ring outside the timing
+            const auto t0 = Clock::now();
+            for (std::size_t i = 0; i < events; ++i) {
+                FlightRecorder::record(FlightEvent::SubmitTimeout, 0, i);
+            }
+            ns[t] = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / static_cast<double>(events);
+        });
+    }
+    for (auto& th : ts) th.join();
+
+    double sum = 0;
+    for (const double v : ns) sum += v;
+    return sum / static_cast<double>(threads);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.events = std::stoull(argv[1]);
+        if (argc >= 3) prm.max_threads = std::stoull(argv[2]);
+        if (argc >= 4) prm.path = argv[3];
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "events/thread=" << prm.events << " ring=" << FlightRecorder::kRingRecords << " records\n\n";
+
+        std::cout << "threads   ns/event\n";
+        for (std::size_t t = 1; t <= prm.max_threads; t *= 2) {
+            std::printf("%7zu %10.1f\n", t, ns_per_event(t, prm.events));
+        }
+
+        const auto t0 = Clock::now();
+        if (!FlightRecorder::dump(prm.path)) throw std::runtime_error("cannot write " + prm.path);
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        const auto records = FlightRecorder::read_dump(prm.path).size();
+        std::printf("\ndump: %zu records, %.2f ms\n", records, ms);
+
+        std::filesystem::remove(prm.path);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "queue.hpp"
+
+// One producer sends timestamped items to one consumer with a gap between
+// sends, so the consumer is usually idle in wait_pop_for when an item
+// arrives. Reports push-to-pop latency for both handoff modes.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_handoff [items] [gap_us]\n";
+}
+
+void spin_for(std::chrono::microseconds d) {
+    const auto until = Clock::now() + d;
+    while (Clock::now() < until) {
+    }
+}
+
+std::vector<std::int64_t> run(std::size_t items, std::chrono::microseconds gap, ConsumerHandoff handoff) {
+    BoundedBlockingQueue<Clock::time_point> q(256, PushAdmission::Unordered, handoff);
+    std::vector<std::int64_t> latency_ns;
+    latency_ns.reserve(items);
+
+    std::thread consumer([&] {
+        Clock::time_point sent;
+        for (;;) {
+            if (q.wait_pop_for(sent, std::chrono::milliseconds{ 50 })) {
+                latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count());
+            }
+            else if (q.closed()) {
+                break;
+            }
+        }
+    });
+
+    for (std::size_t i = 0; i < items; ++i) {
+        (void)q.push(Clock::now());
+        spin_for(gap);
+    }
+    q.close();
+    consumer.join();
+
+    return latency_ns;
+}
+
+void report(const char* name, std::vector<std::int64_t> v) {
+    if (v.empty()) return;
+    std::sort(v.begin(), v.end());
+    auto at = [&](double p) { return v[static_cast<std::size_t>(p * static_cast<double>(v.size() - 1))]; };
+
+    std::printf("%-9s items=%zu  p50=%lldns  p90=%lldns  p99=%lldns  max=%lldns\n", name, v.size(),
+        static_cast<long long>(at(0.50)),
+        static_cast<long long>(at(0.90)),
+        static_cast<long long>(at(0.99)),
+        static_cast<long long>(v.back()));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t items = 20000;
+    std::chrono::microseconds gap{ 50 };
+
+    if (argc > 3) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) items = std::stoull(argv[1]);
+        if (argc >= 3) gap = std::chrono::microseconds{ std::stoll(argv[2]) };
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    std::cout << "items=" << items << " gap_us=" << gap.count() << "\n";
+    report("ViaQueue", run(items, gap, ConsumerHandoff::ViaQueue));
+    report("Direct", run(items, gap, ConsumerHandoff::Direct));
+    return 0;
+}
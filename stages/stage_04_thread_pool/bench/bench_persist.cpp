@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "pipeline.hpp"
+
+// Runs the same load with q_in in memory and with q_in mirrored into a
+// file-backed ring under each flush policy, and reports the throughput cost
+// and the number of msync calls.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t orders = 200000;
+    std::size_t capacity = 1024;
+    std::string path = (std::filesystem::temp_directory_path() / "ops_bench_q_in.ring").string();
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_persist [orders] [q_in_capacity] [ring_path]\n";
+}
+
+void run(const char* name, const Params& prm, bool persistent, PersistSync sync, std::size_t batch) {
+    std::filesystem::remove(prm.path);
+
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = prm.capacity;
+    cfg.push_timeout = std::chrono::milliseconds{ 1000 };
+    if (persistent) {
+        cfg.q_in_path = prm.path;
+        cfg.q_in_sync = sync;
+        cfg.q_in_sync_batch = batch;
+    }
+
+    const auto t0 = Clock::now();
+    std::uint64_t accepted = 0;
+    std::uint64_t syncs = 0;
+    {
+        Pipeline p(cfg);
+        p.start();
+        for (std::size_t i = 1; i <= prm.orders; ++i) {
+            if (p.submit(Order(static_cast<OrderId>(i)))) ++accepted;
+        }
+        p.shutdown();
+        syncs = p.metrics().q_in_sync_count;
+    }
+    const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    std::printf("%-18s %10llu %14.0f %10llu\n", name,
+        static_cast<unsigned long long>(accepted),
+        static_cast<double>(accepted) / secs,
+        static_cast<unsigned long long>(syncs));
+
+    std::filesystem::remove(prm.path);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.orders = std::stoull(argv[1]);
+        if (argc >= 3) prm.capacity = std::stoull(argv[2]);
+        if (argc >= 4) prm.path = argv[3];
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "orders=" << prm.orders
+            << " q_in_capacity=" << prm.capacity
+            << " ring=" << prm.path << "\n\n";
+
+        std::cout << "q_in                 accepted       orders/s     msyncs\n";
+        run("memory", prm, false, PersistSync::None, 0);
+        run("mmap, no msync", prm, true, PersistSync::None, 0);
+        run("mmap, msync/1024", prm, true, PersistSync::PerBatch, 1024);
+        run("mmap, msync/64", prm, true, PersistSync::PerBatch, 64);
+        run("mmap, msync/1", prm, true, PersistSync::PerBatch, 1);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
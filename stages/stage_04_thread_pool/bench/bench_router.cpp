@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline_router.hpp"
+
+// Several pipeline instances behind a PipelineRouter, fed at a fixed rate
+// with orders whose Prepare cost is either light or heavy. Compares hashing
+// by order id with power of two choices on both load signals: lead time
+// percentiles and how unevenly the orders were spread.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t orders = 20000;
+    std::size_t instances = 4;
+    double rate = 6000; // orders per second, open loop
+    std::size_t heavy_pct = 10;
+    std::chrono::microseconds light{ 100 };
+    std::chrono::microseconds heavy{ 2000 };
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_router [orders] [instances] [rate_per_s] [heavy_pct] [light_us] [heavy_us]\n";
+}
+
+std::int64_t percentile(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    const auto k = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+void run(const char* name, const Params& prm, const std::vector<bool>& heavy, RoutePolicy policy, RouteLoad load) {
+    Pipeline::Config instance{};
+    instance.q_in_capacity = prm.orders;
+    instance.q_prepare_capacity = prm.orders;
+    instance.q_pack_capacity = prm.orders;
+    instance.push_timeout = std::chrono::milliseconds{ 1000 };
+    instance.prepare_work = [&](const Order& o) {
+        std::this_thread::sleep_for(heavy[o.id % heavy.size()] ? prm.heavy : prm.light);
+    };
+
+    PipelineRouter::Config cfg;
+    cfg.instances.assign(prm.instances, instance);
+    cfg.policy = policy;
+    cfg.load = load;
+
+    PipelineRouter router(cfg);
+    router.start();
+
+    // Open loop: order i is due at t0 + i / rate, whatever the pipeline does.
+    const auto t0 = Clock::now();
+    for (std::size_t i = 0; i < prm.orders; ++i) {
+        const auto due = t0 + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(i) / prm.rate));
+        if (Clock::now() < due) std::this_thread::sleep_until(due);
+        (void)router.submit(Order(static_cast<OrderId>(i + 1)));
+    }
+    router.shutdown();
+
+    std::vector<std::int64_t> lead_us;
+    lead_us.reserve(prm.orders);
+    for (std::size_t i = 0; i < router.size(); ++i) {
+        for (const auto& o : router.instance(i).delivered_orders()) {
+            lead_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(o.delivered_time - o.accepted_time).count());
+        }
+    }
+
+    const auto routed = router.routed();
+    const auto [lo, hi] = std::minmax_element(routed.begin(), routed.end());
+    const auto delivered = lead_us.size();
+    const auto p50 = percentile(lead_us, 0.50);
+    const auto p99 = percentile(lead_us, 0.99);
+    const auto max = lead_us.empty() ? 0 : *std::max_element(lead_us.begin(), lead_us.end());
+
+    std::printf("%-16s %9zu %9lld %9lld %9lld %8llu..%llu\n", name, delivered,
+        static_cast<long long>(p50),
+        static_cast<long long>(p99),
+        static_cast<long long>(max),
+        static_cast<unsigned long long>(*lo),
+        static_cast<unsigned long long>(*hi));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 7) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.orders = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) prm.instances = std::max<std::size_t>(std::stoull(argv[2]), 1);
+        if (argc >= 4) prm.rate = std::max(std::stod(argv[3]), 1.0);
+        if (argc >= 5) prm.heavy_pct = std::min<std::size_t>(std::stoull(argv[4]), 100);
+        if (argc >= 6) prm.light = std::chrono::microseconds{ std::stoll(argv[5]) };
+        if (argc >= 7) prm.heavy = std::chrono::microseconds{ std::stoll(argv[6]) };
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "orders=" << prm.orders
+            << " instances=" << prm.instances
+            << " rate_per_s=" << prm.rate
+            << " heavy_pct=" << prm.heavy_pct
+            << " light_us=" << prm.light.count()
+            << " heavy_us=" << prm.heavy.count() << "\n\n";
+
+        // Same costs for every run; independent of the id hash used for routing.
+        std::vector<bool> heavy(prm.orders + 1);
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<std::size_t> pct(0, 99);
+        for (std::size_t i = 0; i < heavy.size(); ++i) heavy[i] = pct(rng) < prm.heavy_pct;
+
+        std::cout << "routing          delivered    p50_us    p99_us    max_us   routed[min..max]\n";
+        run("hash", prm, heavy, RoutePolicy::Hash, RouteLoad::InFlight);
+        run("p2c in-flight", prm, heavy, RoutePolicy::PowerOfTwo, RouteLoad::InFlight);
+        run("p2c q_in depth", prm, heavy, RoutePolicy::PowerOfTwo, RouteLoad::QueueDepth);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
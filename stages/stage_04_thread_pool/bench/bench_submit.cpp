@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.hpp"
+
+// Multi-producer submit() scaling. Workers are paused and q_in holds every
+// order, so only the producer side is timed: the intake gate, the WIP check
+// and the push. For reference, the same producers also take a shared
+// lifecycle mutex around a state check, the gate submit() does without.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_submit [orders_per_producer] [max_producers]\n";
+}
+
+template <typename Body>
+double timed_producers(std::size_t producers, Body body) {
+    std::vector<std::thread> ts;
+    std::atomic<bool> go{ false };
+    for (std::size_t i = 0; i < producers; ++i) {
+        ts.emplace_back([&, i] {
+            while (!go.load()) std::this_thread::yield();
+            body(i);
+        });
+    }
+    const auto t0 = Clock::now();
+    go.store(true);
+    for (auto& t : ts) t.join();
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+double submits_per_sec(std::size_t per_producer, std::size_t producers) {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = per_producer * producers;
+    cfg.push_timeout = std::chrono::milliseconds{ 1000 };
+
+    Pipeline p(cfg);
+    p.start();
+    (void)p.pause();
+
+    const double secs = timed_producers(producers, [&](std::size_t i) {
+        const auto base = static_cast<OrderId>(i * per_producer + 1);
+        for (std::size_t n = 0; n < per_producer; ++n) (void)p.submit(Order(base + n));
+    });
+
+    (void)p.resume();
+    p.shutdown();
+    return static_cast<double>(p.metrics().accepted_count) / secs;
+}
+
+double mutex_checks_per_sec(std::size_t per_producer, std::size_t producers) {
+    std::mutex lifecycle;
+    std::atomic<PipelineState> state{ PipelineState::Running };
+    std::atomic<std::uint64_t> passed{ 0 };
+
+    const double secs = timed_producers(producers, [&](std::size_t) {
+        std::uint64_t ok = 0;
+        for (std::size_t n = 0; n < per_producer; ++n) {
+            std::lock_guard lock(lifecycle);
+            if (state.load(std::memory_order_relaxed) == PipelineState::Running) ++ok;
+        }
+        passed += ok;
+    });
+    return static_cast<double>(passed.load()) / secs;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t per_producer = 200000;
+    std::size_t max_producers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+    if (argc > 3) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) per_producer = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) max_producers = std::max<std::size_t>(std::stoull(argv[2]), 1);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    std::cout << "orders/producer=" << per_producer << " hardware_concurrency=" << std::thread::hardware_concurrency() << "\n";
+    std::cout << "producers    submit/s  speedup  mutex check/s  speedup\n";
+
+    double base_submit = 0;
+    double base_mutex = 0;
+    for (std::size_t n = 1; n <= max_producers; n *= 2) {
+        const double submit = submits_per_sec(per_producer, n);
+        const double mutex = mutex_checks_per_sec(per_producer, n);
+        if (n == 1) {
+            base_submit = submit;
+            base_mutex = mutex;
+        }
+        std::printf("%9zu  %10.0f  %7.2f  %13.0f  %7.2f\n", n, submit, submit / base_submit, mutex, mutex / base_mutex);
+    }
+    return 0;
+}
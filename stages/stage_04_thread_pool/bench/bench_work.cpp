@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "pipeline.hpp"
+
+// One pipeline with a single Prepare worker, fed at a fixed rate with orders
+// whose cost is heavy-tailed: most take one unit of work, a few take ten or
+// a hundred. Compares FIFO queues with shortest-work-first order: mean and
+// p99 lead time for all orders and for the light ones alone, and how many
+// pops aging forced.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Params {
+    std::size_t orders = 10000;
+    double rate = 2800; // orders per second, open loop; ~80% of one worker at the defaults
+    std::chrono::microseconds unit{ 100 };
+    std::chrono::milliseconds aging{ 50 };
+};
+
+void print_usage() {
+    std::cerr << "Usage: ops_bench_work [orders] [rate_per_s] [unit_us] [aging_ms]\n";
+}
+
+std::int64_t percentile(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    const auto k = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+    return v[k];
+}
+
+std::int64_t mean(const std::vector<std::int64_t>& v) {
+    if (v.empty()) return 0;
+    std::int64_t sum = 0;
+    for (const auto x : v) sum += x;
+    return sum / static_cast<std::int64_t>(v.size());
+}
+
+void run(const char* name, const Params& prm, const std::vector<std::uint32_t>& work, PopOrder order) {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = prm.orders;
+    cfg.q_prepare_capacity = prm.orders;
+    cfg.q_pack_capacity = prm.orders;
+    cfg.push_timeout = std::chrono::milliseconds{ 1000 };
+    cfg.queue_order = order;
+    cfg.work_aging = prm.aging;
+    cfg.prepare_work = [&](const Order& o) { std::this_thread::sleep_for(prm.unit * o.work); };
+
+    Pipeline pipeline(cfg);
+    pipeline.start();
+
+    // Open loop: order i is due at t0 + i / rate, whatever the pipeline does.
+    const auto t0 = Clock::now();
+    for (std::size_t i = 0; i < prm.orders; ++i) {
+        const auto due = t0 + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(i) / prm.rate));
+        if (Clock::now() < due) std::this_thread::sleep_until(due);
+        Order o(static_cast<OrderId>(i + 1));
+        o.work = work[i];
+        (void)pipeline.submit(std::move(o));
+    }
+    pipeline.shutdown();
+
+    std::vector<std::int64_t> all_us;
+    std::vector<std::int64_t> light_us;
+    all_us.reserve(prm.orders);
+    for (const auto& o : pipeline.delivered_orders()) {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(o.delivered_time - o.accepted_time).count();
+        all_us.push_back(us);
+        if (o.work == 1) light_us.push_back(us);
+    }
+
+    const auto m = pipeline.metrics();
+    const auto delivered = all_us.size();
+    const auto all_mean = mean(all_us);
+    const auto light_mean = mean(light_us);
+    const auto all_p99 = percentile(all_us, 0.99);
+    const auto light_p99 = percentile(light_us, 0.99);
+
+    std::printf("%-14s %9zu %9lld %9lld %9lld %9lld %9llu\n", name, delivered,
+        static_cast<long long>(all_mean),
+        static_cast<long long>(all_p99),
+        static_cast<long long>(light_mean),
+        static_cast<long long>(light_p99),
+        static_cast<unsigned long long>(m.aged_pop_count));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Params prm;
+
+    if (argc > 5) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) prm.orders = std::max<std::size_t>(std::stoull(argv[1]), 1);
+        if (argc >= 3) prm.rate = std::max(std::stod(argv[2]), 1.0);
+        if (argc >= 4) prm.unit = std::chrono::microseconds{ std::stoll(argv[3]) };
+        if (argc >= 5) prm.aging = std::chrono::milliseconds{ std::stoll(argv[4]) };
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::cout << "orders=" << prm.orders
+            << " rate_per_s=" << prm.rate
+            << " unit_us=" << prm.unit.count()
+            << " aging_ms=" << prm.aging.count() << "\n\n";
+
+        // 90% one unit, 9% ten, 1% a hundred; the same draw for every run.
+        std::vector<std::uint32_t> work(prm.orders);
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<int> pct(0, 99);
+        for (auto& w : work) {
+            const int p = pct(rng);
+            w = p < 90 ? 1 : (p < 99 ? 10 : 100);
+        }
+
+        std::cout << "queue order    delivered   mean_us    p99_us light_mean light_p99 aged_pops\n";
+        run("fifo", prm, work, PopOrder::Fifo);
+        run("shortest-work", prm, work, PopOrder::ShortestWork);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "queue.hpp"
+
+// Throughput and round-trip measurements written against BoundedQueueBackend
+// only, so every queue that models the concept is measured the same way.
+// `make(capacity)` returns a std::unique_ptr to a fresh queue.
+
+struct QueueBenchParams {
+    std::uint64_t items = 200000;
+    std::size_t producers = 2;
+    std::size_t consumers = 2;
+    std::size_t capacity = 64;
+    std::uint64_t round_trips = 20000;
+};
+
+// Items per second through one queue, either with untimed push / wait_pop or
+// with push_for / wait_pop_for.
+template <typename Make>
+double queue_throughput(Make make, const QueueBenchParams& prm, bool timed) {
+    using Clock = std::chrono::steady_clock;
+    auto q = make(prm.capacity);
+    const std::uint64_t per_producer = prm.items / prm.producers;
+    std::atomic<bool> done{ false };
+
+    const auto t0 = Clock::now();
+
+    std::vector<std::thread> consumers;
+    for (std::size_t c = 0; c < prm.consumers; ++c) {
+        consumers.emplace_back([&] {
+            std::uint64_t v = 0;
+            if (timed) {
+                // `done` is read before the pop: once it is set the queue is
+                // closed, so a failed pop means it is also drained.
+                for (;;) {
+                    const bool last = done.load(std::memory_order_acquire);
+                    if (q->wait_pop_for(v, std::chrono::milliseconds{ 50 })) continue;
+                    if (last) break;
+                }
+            }
+            else {
+                while (q->wait_pop(v)) {
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < prm.producers; ++p) {
+        producers.emplace_back([&] {
+            for (std::uint64_t i = 0; i < per_producer; ++i) {
+                if (timed) {
+                    while (!q->push_for(i, std::chrono::milliseconds{ 50 })) {
+                    }
+                }
+                else {
+                    (void)q->push(i);
+                }
+            }
+        });
+    }
+
+    for (auto& t : producers) t.join();
+    q->close();
+    done.store(true, std::memory_order_release);
+    for (auto& t : consumers) t.join();
+
+    const std::chrono::duration<double> elapsed = Clock::now() - t0;
+    return static_cast<double>(per_producer * prm.producers) / elapsed.count();
+}
+
+// Mean microseconds for one item to go A -> B and back through two queues of
+// capacity 1, every hop a wake-up.
+template <typename Make>
+double queue_round_trip_us(Make make, const QueueBenchParams& prm) {
+    using Clock = std::chrono::steady_clock;
+    auto ping = make(1);
+    auto pong = make(1);
+
+    std::thread echo([&] {
+        std::uint64_t v = 0;
+        while (ping->wait_pop(v)) (void)pong->push(v);
+    });
+
+    const auto t0 = Clock::now();
+    std::uint64_t v = 0;
+    for (std::uint64_t i = 0; i < prm.round_trips; ++i) {
+        (void)ping->push(i);
+        (void)pong->wait_pop(v);
+    }
+    const std::chrono::duration<double, std::micro> elapsed = Clock::now() - t0;
+
+    ping->close();
+    echo.join();
+    return elapsed.count() / static_cast<double>(prm.round_trips);
+}
+
+// One table row: untimed and timed throughput, then the round trip.
+template <typename Make>
+void run_queue_bench(const char* name, Make make, const QueueBenchParams& prm) {
+    using Q = typename decltype(make(std::size_t{ 1 }))::element_type;
+    static_assert(BoundedQueueBackend<Q, std::uint64_t>, "the kit only measures BoundedQueueBackend queues");
+
+    const double untimed = queue_throughput(make, prm, false);
+    const double timed = queue_throughput(make, prm, true);
+    const double rtt = queue_round_trip_us(make, prm);
+    std::printf("%-22s %16.0f %14.0f %14.2f\n", name, untimed, timed, rtt);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <thread>
+
+#include "pipeline.hpp"
+
+// Optional admin endpoint for a running Pipeline: one thread serving a Unix
+// domain socket. A client sends one command per line and gets one reply
+// line back, "OK ..." or "ERR <reason>":
+//
+//   metrics                         accepted= prepared= packed= delivered= submit_timeouts= in_flight= state=
+//   depths                          q_in= q_prepare= q_pack=
+//   pause | resume
+//   workers <prepare> <pack> <deliver>
+//   capacity <q_in> <q_prepare> <q_pack>
+//   shutdown                        starts a graceful shutdown; the owner still joins
+//
+// The admin thread only calls the Pipeline's runtime control API, which
+// reaches workers through their mailboxes, so it never waits on a worker.
+// Clients are served one at a time. POSIX only: start() throws elsewhere.
+class AdminServer {
+public:
+    AdminServer(Pipeline& pipeline, std::string socket_path);
+    ~AdminServer();
+
+    AdminServer(const AdminServer&) = delete;
+    AdminServer& operator=(const AdminServer&) = delete;
+
+    // Binds the socket (replacing a stale one) and starts serving; throws
+    // std::runtime_error when it cannot.
+    void start();
+    void stop() noexcept;
+
+    // The reply to one command line, as sent back over the socket.
+    std::string execute(const std::string& line);
+
+    // Client side: sends `command` to the server at `socket_path` and returns
+    // the reply line; throws std::runtime_error when the server is unreachable.
+    static std::string request(const std::string& socket_path, const std::string& command);
+
+private:
+    void serve(const std::stop_token& st);
+    void serve_client(int fd, const std::stop_token& st);
+
+    Pipeline& pipeline_;
+    std::string path_;
+    int listen_fd_ = -1;
+    std::jthread thread_;
+};
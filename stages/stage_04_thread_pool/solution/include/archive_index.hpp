@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "order.hpp"
+#include "order_sort.hpp"
+
+// Sparse min/max index over an append-only order archive (delivered orders
+// in completion order). Every block of `block_size` consecutive records keeps
+// min/max of each OrderKey. The index only stores positions, so it applies to
+// any contiguous record storage, in memory or mapped from a file.
+//
+// The archive is close to sorted by time (and by id when ids are issued
+// sequentially), so a running max of block maxima and a running min of block
+// minima from the back are both monotone. Two binary searches on those bound
+// the candidate blocks; only blocks overlapping the query are then scanned.
+// The minima from the back are kept as steps, the blocks whose minimum is
+// below that of every later block, so an append never rewrites earlier ones.
+class SparseBlockIndex {
+public:
+    static constexpr std::size_t kDefaultBlockSize = 1024;
+
+    using Range = std::pair<std::size_t, std::size_t>; // [first, last) archive positions
+
+    explicit SparseBlockIndex(std::size_t block_size = kDefaultBlockSize);
+
+    // Indexes the record at position size(). Amortized O(1).
+    void append(const Order& o);
+    void clear() noexcept;
+
+    std::size_t size() const noexcept { return size_; }
+    std::size_t block_size() const noexcept { return block_size_; }
+    std::size_t block_count() const noexcept;
+
+    // Coalesced archive ranges that may hold records with key in [lo, hi].
+    std::vector<Range> candidate_ranges(OrderKey key, std::uint64_t lo, std::uint64_t hi) const;
+
+private:
+    struct Column {
+        std::vector<std::uint64_t> min;
+        std::vector<std::uint64_t> max;
+        std::vector<std::uint64_t> prefix_max; // max(max[0..b])
+        // Blocks whose min is below every later block's, ascending in both;
+        // min(min[b..]) is the step_min of the first step_block >= b.
+        std::vector<std::size_t> step_block;
+        std::vector<std::uint64_t> step_min;
+
+        void add(std::uint64_t key, bool new_block);
+    };
+
+    const Column& column(OrderKey key) const noexcept;
+
+    std::size_t block_size_;
+    std::size_t size_ = 0;
+    std::array<Column, 3> columns_; // OrderKey::Id, AcceptedTime, DeliveredTime
+};
+
+// Archive positions of records with `key` in [lo, hi], ascending.
+std::vector<std::size_t> find_in_range(std::span<const Order> archive,
+    const SparseBlockIndex& index,
+    OrderKey key,
+    std::uint64_t lo,
+    std::uint64_t hi);
+
+// Archive position of the record with `id`, if present.
+std::optional<std::size_t> find_by_id(std::span<const Order> archive,
+    const SparseBlockIndex& index,
+    OrderId id);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cluster_wire.hpp"
+#include "hash_ring.hpp"
+
+struct ClusterEndpoint {
+    std::string name; // the node's place on the ring; every client must use the same names
+    std::string host = "127.0.0.1";
+    std::uint16_t port = 0;
+};
+
+// Thin client for a ring of ClusterNodes.
+//
+// submit() only appends the id to the batch of the node that owns it on the
+// HashRing; a batch goes out as one Submit frame once it holds batch_size
+// ids, or on flush(). Sending is synchronous: the client waits for each
+// node's reply, which counts the accepted ids and returns the refused ones,
+// for at most reply_timeout; only Shutdown waits out the node's drain.
+//
+// add_node() and remove_node() re-route the ids still waiting in batches,
+// so nothing is sent to a node that no longer owns it; consistent hashing
+// keeps the share of ids that change owner close to 1/N. A node that drops
+// the connection or misses the reply deadline leaves the ring at once, so
+// later ids go to the next owner; its name stays taken until remove_node().
+// Not thread-safe: one client per producer thread.
+class ClusterClient {
+public:
+    static constexpr std::chrono::milliseconds kDefaultReplyTimeout{ 10000 };
+
+    explicit ClusterClient(std::size_t batch_size = 256, std::size_t vnodes = HashRing::kDefaultVnodes,
+        std::chrono::milliseconds reply_timeout = kDefaultReplyTimeout);
+    ~ClusterClient();
+
+    ClusterClient(const ClusterClient&) = delete;
+    ClusterClient& operator=(const ClusterClient&) = delete;
+
+    // Connects; throws std::runtime_error when the node is unreachable or
+    // the name is taken.
+    void add_node(const ClusterEndpoint& node);
+    // Drops the connection without sending to the node again, so a dead
+    // node can be removed too.
+    void remove_node(const std::string& name);
+    // Both re-route pending ids, and throw like submit() if a batch they
+    // fill cannot be sent; every re-routed id is still batched or refused.
+
+    // Throw std::runtime_error when a node drops the connection or does not
+    // reply in time, or when no node is left on the ring; the ids of the
+    // batch in flight, or the id without an owner, are then counted as
+    // refused.
+    void submit(OrderId id);
+    void flush();
+
+    ClusterNodeStats stats(const std::string& name);
+    // Asks the node to drain its Pipeline and returns its final stats; the
+    // node stays on the ring until remove_node().
+    ClusterNodeStats shutdown_node(const std::string& name);
+
+    const HashRing& ring() const noexcept;
+    std::uint64_t accepted() const noexcept;
+    std::uint64_t batches_sent() const noexcept;
+
+    // Refused ids since the last call, for the caller to retry or drop.
+    std::vector<OrderId> take_refused();
+
+private:
+    struct Link {
+        ClusterEndpoint endpoint;
+        int fd = -1;
+        std::vector<OrderId> batch;
+    };
+
+    Link& link_of(const std::string& name);
+    void send_batch(Link& link);
+    ClusterNodeStats request_stats(Link& link, ClusterMsg type);
+    ClusterFrame exchange(Link& link, ClusterMsg type, const std::vector<std::uint8_t>& payload);
+    void drop(Link& link);
+    void reroute_pending();
+    void resubmit(const std::vector<OrderId>& ids);
+
+    std::size_t batch_size_;
+    std::chrono::milliseconds reply_timeout_;
+    HashRing ring_;
+    std::map<std::string, Link> links_;
+    std::uint64_t accepted_ = 0;
+    std::uint64_t batches_ = 0;
+    std::vector<OrderId> refused_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cluster_wire.hpp"
+#include "pipeline.hpp"
+
+// One member of a pipeline cluster: serves a running Pipeline to
+// ClusterClients over TCP (cluster_wire.hpp). Every submitted batch is
+// passed to Pipeline::submit() order by order until one is refused, and the
+// reply names the refused ids, that one and the rest of the batch, so
+// backpressure reaches the client as refusals.
+//
+// An accept thread plus one thread per connection; each polls with a
+// timeout, so stop() never has to interrupt a system call. POSIX only:
+// start() throws elsewhere.
+class ClusterNode {
+public:
+    ClusterNode(Pipeline& pipeline, std::string host = "127.0.0.1", std::uint16_t port = 0);
+    ~ClusterNode();
+
+    ClusterNode(const ClusterNode&) = delete;
+    ClusterNode& operator=(const ClusterNode&) = delete;
+
+    // Listens (port 0 picks a free one, see port()); throws
+    // std::runtime_error when it cannot.
+    void start();
+    void stop() noexcept;
+
+    std::uint16_t port() const noexcept;
+
+    // Blocks until a client has sent Shutdown, by which time the Pipeline
+    // has drained; the owner then stops the node.
+    void wait_for_shutdown();
+
+    ClusterNodeStats stats() const;
+
+private:
+    // One connection's thread; `done` is its last write, after which the
+    // accept thread may join and drop it.
+    struct Client {
+        std::atomic<bool> done{ false };
+        std::jthread thread;
+    };
+
+    void serve(const std::stop_token& st);
+    void serve_client(int fd, const std::stop_token& st);
+    ClusterFrame handle(const ClusterFrame& request);
+
+    Pipeline& pipeline_;
+    std::string host_;
+    std::uint16_t port_;
+    int listen_fd_ = -1;
+    std::jthread thread_;
+
+    std::mutex clients_mutex_;
+    std::vector<std::unique_ptr<Client>> clients_; // finished ones are reaped on accept
+
+    std::mutex shutdown_mutex_;
+    std::condition_variable shutdown_cv_;
+    bool shutdown_requested_ = false;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "order.hpp"
+
+// Messages between ClusterClient and ClusterNode over TCP, and between a
+// Deliver worker and its carrier service (MockCarrier).
+//
+// Every message is one frame: a 4-byte payload length, a 1-byte type, then
+// the payload. Integers are little-endian on the wire whatever the host.
+//
+//   Submit    client -> node   u32 count, then `count` order records (u64 id)
+//             node -> client   u32 accepted, u32 refused, then the refused u64 ids
+//   Stats     client -> node   empty
+//             node -> client   ClusterNodeStats, five u64
+//   Shutdown  client -> node   empty; the node drains its Pipeline first
+//             node -> client   ClusterNodeStats after the drain
+//   Deliver   worker -> carrier  u64 tag, u64 order id
+//             carrier -> worker  the same two u64 once delivered; replies
+//                                may overtake each other, the tag pairs them
+enum class ClusterMsg : std::uint8_t {
+    Submit = 1,
+    Stats = 2,
+    Shutdown = 3,
+    Deliver = 4
+};
+
+struct ClusterNodeStats {
+    std::uint64_t accepted = 0;
+    std::uint64_t delivered = 0;
+    std::uint64_t submit_timeouts = 0;
+    std::uint64_t in_flight = 0;
+    std::uint64_t state = 0; // PipelineState
+};
+
+struct ClusterFrame {
+    ClusterMsg type = ClusterMsg::Stats;
+    std::vector<std::uint8_t> payload;
+};
+
+struct ClusterSubmitReply {
+    std::uint32_t accepted = 0;
+    std::vector<OrderId> refused;
+};
+
+// Framing, encoding and the POSIX socket calls shared by both ends. The
+// socket functions throw std::runtime_error on _WIN32.
+struct ClusterWire {
+    static constexpr std::size_t kHeaderBytes = 5;
+    static constexpr std::size_t kRecordBytes = 8;
+    static constexpr std::size_t kMaxPayload = std::size_t{ 1 } << 20; // larger frames drop the connection
+    static constexpr std::size_t kMaxBatch = (kMaxPayload - 4) / kRecordBytes;
+
+    static std::vector<std::uint8_t> encode_submit(const std::vector<OrderId>& ids);
+    static bool decode_submit(const std::vector<std::uint8_t>& payload, std::vector<OrderId>& ids);
+    static std::vector<std::uint8_t> encode_submit_reply(const ClusterSubmitReply& reply);
+    static bool decode_submit_reply(const std::vector<std::uint8_t>& payload, ClusterSubmitReply& reply);
+    static std::vector<std::uint8_t> encode_stats(const ClusterNodeStats& stats);
+    static bool decode_stats(const std::vector<std::uint8_t>& payload, ClusterNodeStats& stats);
+    static std::vector<std::uint8_t> encode_deliver(std::uint64_t tag, OrderId id);
+    static bool decode_deliver(const std::vector<std::uint8_t>& payload, std::uint64_t& tag, OrderId& id);
+
+    // A listening IPv4 socket on host:port (0 = any free port); `bound`
+    // gets the port actually used.
+    static int listen(const std::string& host, std::uint16_t port, std::uint16_t& bound);
+    static int accept(int listen_fd) noexcept; // -1 when nothing to accept
+    static int connect(const std::string& host, std::uint16_t port);
+    static void close(int fd) noexcept;
+
+    // False when the peer is gone or misbehaves, or once `st` is stopped;
+    // waiting is sliced so a stop is seen within a poll interval.
+    static bool send(int fd, ClusterMsg type, const std::vector<std::uint8_t>& payload);
+    static bool receive(int fd, ClusterFrame& frame, const std::stop_token& st = {});
+    // The same, also false when the frame has not fully arrived within
+    // `timeout`; the stream is then out of step and should be closed.
+    static bool receive_for(int fd, ClusterFrame& frame, std::chrono::milliseconds timeout);
+
+    // True once a receive would not block: data has arrived or the peer
+    // hung up. Waits at most `timeout`.
+    static bool readable(int fd, std::chrono::milliseconds timeout) noexcept;
+    // The same, but a readable `wake_fd` (see Doorbell) also ends the wait.
+    static bool readable(int fd, int wake_fd, std::chrono::milliseconds timeout) noexcept;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+// Gives std::atomic wait() a deadline. std::atomic has no timed wait, so a
+// waiter arms a timer on the counter it is about to wait on; one shared
+// thread bumps that counter and calls notify_all() once the deadline passes,
+// and the waiter wakes exactly as it would for a real event.
+//
+// A waiter disarms its timer after waking. The thread fires timers under the
+// same mutex, so once disarm() returns the counter is no longer touched and
+// may be destroyed.
+class DeadlineWaker {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Timer = std::pair<Clock::time_point, std::uint64_t>;
+
+    static DeadlineWaker& instance();
+
+    Timer arm(std::atomic<std::uint32_t>& seq, Clock::time_point deadline);
+    void disarm(const Timer& timer);
+
+private:
+    DeadlineWaker();
+
+    void run(std::stop_token st);
+
+    std::mutex mutex_;
+    std::condition_variable_any cv_;
+    std::map<Timer, std::atomic<std::uint32_t>*> timers_; // earliest deadline first
+    std::uint64_t next_id_ = 0;
+    std::jthread thread_; // last: started after, and joined before, the members above
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+// A file descriptor that poll() sees as readable from ring() until clear(),
+// so a thread sleeping on sockets can also be woken by another thread.
+// eventfd on Linux, a non-blocking pipe on other POSIX systems; on _WIN32
+// fd() is -1 and ring() / clear() do nothing.
+class Doorbell {
+public:
+    // Throws std::runtime_error when the descriptors cannot be created.
+    Doorbell();
+    ~Doorbell();
+
+    Doorbell(const Doorbell&) = delete;
+    Doorbell& operator=(const Doorbell&) = delete;
+
+    int fd() const noexcept {
+        return read_fd_;
+    }
+
+    void ring() noexcept;
+    void clear() noexcept;
+
+private:
+    int read_fd_ = -1;
+    int write_fd_ = -1; // the same descriptor as read_fd_ for an eventfd
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What a flight record describes; `a` and `b` depend on the event.
+enum class FlightEvent : std::uint16_t {
+    StateChange = 1, // a = old PipelineState, b = new PipelineState
+    QueueClosed,     // a = queue: 0 q_in, 1 q_prepare, 2 q_pack
+    Escalate,        // forced stop: every queue closed, stop requested
+    SubmitTimeout,   // a = order id
+    WorkerStart,     // a = stage (3 = shared / core), b = worker index
+    WorkerExit,      // a = stage (3 = shared / core), b = worker index
+    WorkerException, // a = worker index, b = first 8 bytes of what()
+    Dump             // the pipeline failed and is writing Config::flight_dump_path
+};
+
+struct FlightRecord {
+    std::uint64_t time_ns = 0; // steady_clock
+    std::uint32_t thread = 0;  // recorder-assigned, unique per thread for the process
+    FlightEvent event{};
+    std::uint16_t source = 0;  // pipeline instance
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+};
+
+// Always-on, process-wide record of rare pipeline events, kept for
+// post-mortems.
+//
+// Every thread appends fixed-size binary records to its own ring of
+// kRingRecords entries, overwriting the oldest; record() takes no lock and
+// does not allocate after the thread's first event. A dump copies every ring
+// into a file without stopping the writers (records overwritten while being
+// copied are left out) and uses only async-signal-safe calls, so it also
+// runs from the SIGUSR1 handler. ops_flight_decode renders a dump as one
+// timeline.
+class FlightRecorder {
+public:
+    static constexpr std::size_t kRingRecords = 1024; // per thread, power of two
+    static constexpr std::size_t kMaxThreads = 256;   // rings are reused after a thread exits
+
+    static void record(FlightEvent event, std::uint16_t source, std::uint64_t a = 0, std::uint64_t b = 0) noexcept;
+
+    // Writes every ring to `path`; false when the file cannot be written.
+    static bool dump(const char* path) noexcept;
+    static bool dump(const std::string& path) noexcept {
+        return dump(path.c_str());
+    }
+
+    // Dumps to `path` on SIGUSR1. False where the signal does not exist.
+    static bool dump_on_signal(const std::string& path);
+
+    // Events from threads that found all kMaxThreads rings taken.
+    static std::uint64_t dropped() noexcept;
+
+    // Records of a dump, unordered; throws std::runtime_error on a bad file.
+    static std::vector<FlightRecord> read_dump(const std::string& path);
+
+    // Packs the first 8 bytes of `text` into a record argument.
+    static std::uint64_t text_word(const char* text) noexcept;
+
+    // One timeline line for `r`, without the timestamp and thread.
+    static std::string describe(const FlightRecord& r);
+};
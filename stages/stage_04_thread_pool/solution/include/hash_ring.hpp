@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "order.hpp"
+
+// Consistent hashing of order ids onto named nodes.
+//
+// Every node is placed on a 64-bit ring at `vnodes` points derived from its
+// name; an id belongs to the node owning the first point at or after the
+// id's hash. Adding a node moves to it only the ids that now fall just
+// before its points, about 1/N of all; removing one hands its ids to the
+// next points and leaves every other id where it was. The placement depends
+// only on the names, so every client with the same node set routes alike.
+class HashRing {
+public:
+    static constexpr std::size_t kDefaultVnodes = 128;
+
+    explicit HashRing(std::size_t vnodes = kDefaultVnodes);
+
+    // False when the name is already on the ring / not on it.
+    bool add(const std::string& node);
+    bool remove(const std::string& node);
+
+    // Throws std::logic_error on an empty ring.
+    const std::string& owner(OrderId id) const;
+
+    bool contains(const std::string& node) const noexcept;
+    std::vector<std::string> nodes() const;
+    std::size_t size() const noexcept;
+
+private:
+    struct Point {
+        std::uint64_t hash;
+        std::uint32_t node; // into nodes_
+    };
+
+    void rebuild();
+
+    std::size_t vnodes_;
+    std::vector<std::string> nodes_; // sorted
+    std::vector<Point> points_;      // sorted by hash
+};
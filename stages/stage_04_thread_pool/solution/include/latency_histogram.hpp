@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Log2 histogram of durations in microseconds: bucket 0 counts [0, 1us),
+// bucket i counts [2^(i-1), 2^i) us, the last bucket everything longer.
+struct LatencyHistogram {
+    static constexpr std::size_t kBuckets = 24; // the last finite bound is ~4.2s
+
+    std::array<std::uint64_t, kBuckets> buckets{};
+
+    static std::size_t bucket_of(std::chrono::nanoseconds d) noexcept {
+        const auto us = d.count() <= 0 ? 0 : static_cast<std::uint64_t>(d.count() / 1000);
+        return std::min<std::size_t>(static_cast<std::size_t>(std::bit_width(us)), kBuckets - 1);
+    }
+
+    // Exclusive upper bound of bucket i.
+    static std::chrono::microseconds upper_bound(std::size_t i) noexcept {
+        return std::chrono::microseconds{ std::int64_t{ 1 } << i };
+    }
+
+    std::uint64_t count() const noexcept {
+        std::uint64_t n = 0;
+        for (const auto b : buckets) n += b;
+        return n;
+    }
+
+    // Upper bound of the bucket holding the p-th sample (0 when empty).
+    std::chrono::microseconds percentile(double p) const noexcept {
+        const std::uint64_t n = count();
+        if (n == 0) return std::chrono::microseconds{ 0 };
+
+        const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) return upper_bound(i);
+        }
+        return upper_bound(kBuckets - 1);
+    }
+};
+
+// LatencyHistogram that several threads record into without a lock.
+class AtomicLatencyHistogram {
+public:
+    void record(std::chrono::nanoseconds d) noexcept {
+        buckets_[LatencyHistogram::bucket_of(d)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram snapshot() const noexcept {
+        LatencyHistogram h;
+        for (std::size_t i = 0; i < LatencyHistogram::kBuckets; ++i) {
+            h.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return h;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::kBuckets> buckets_{};
+};
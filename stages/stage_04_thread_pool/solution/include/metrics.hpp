@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "latency_histogram.hpp"
+
+struct Metrics {
+    std::uint64_t accepted_count = 0;
+    std::uint64_t prepared_count = 0;
+    std::uint64_t packed_count = 0;
+    std::uint64_t delivered_count = 0;
+
+    std::chrono::nanoseconds total_lead_time{ 0 };
+
+    // submit() calls that could not place an order into q_in within push_timeout
+    // (queue full or closed, or the WIP cap reached).
+    std::uint64_t submit_timeout_count = 0;
+
+    // Orders in flight at the snapshot, and submits that had to wait for a
+    // delivery to get under the CONWIP cap (Config::wip_limit).
+    std::uint64_t wip_in_flight = 0;
+    std::uint64_t wip_wait_count = 0;
+
+    // Worker threads actually started per stage (the pool size for every
+    // stage under the shared scheduling policies), or the counts last set
+    // by Pipeline::set_workers().
+    std::uint64_t prepare_workers_used = 0;
+    std::uint64_t pack_workers_used = 0;
+    std::uint64_t deliver_workers_used = 0;
+
+    // Input queue: accepted by submit() / taken by Prepare / peak depth.
+    std::uint64_t q_in_push = 0;
+    std::uint64_t q_in_pop = 0;
+    std::size_t q_in_max_size = 0;
+    std::uint64_t q_in_recovered = 0;  // resumed from Config::q_in_path at start(), part of q_in_push
+    std::uint64_t q_in_sync_count = 0; // msync calls on the persistent q_in
+    LatencyHistogram q_in_wakeup;      // notify -> Prepare worker running (QueueStats::wakeup)
+
+    // Prepare -> Pack queue.
+    std::uint64_t q_prepare_push = 0;
+    std::uint64_t q_prepare_pop = 0;
+    std::size_t q_prepare_max_size = 0;
+    std::uint64_t q_prepare_handoff = 0; // pushes handed directly to an idle Pack worker
+    LatencyHistogram q_prepare_wakeup;
+
+    // Pack -> Deliver queue.
+    std::uint64_t q_pack_push = 0;
+    std::uint64_t q_pack_pop = 0;
+    std::size_t q_pack_max_size = 0;
+    std::uint64_t q_pack_handoff = 0; // pushes handed directly to an idle Deliver worker
+    LatencyHistogram q_pack_wakeup;
+
+    // PopOrder::ShortestWork: pops in any queue that took an order that had
+    // waited work_aging or longer ahead of a lighter one.
+    std::uint64_t aged_pop_count = 0;
+
+    // Reorder buffer (Config::reorder_window): orders passed to the ordered
+    // sink, sequence numbers that never came back delivered, submits that
+    // found the window full, delivered orders held for an earlier one (now
+    // and at most), and how long they were held (head-of-line wait).
+    std::uint64_t reorder_released = 0;
+    std::uint64_t reorder_skipped = 0;
+    std::uint64_t reorder_window_waits = 0;
+    std::size_t reorder_depth = 0;
+    std::size_t reorder_max_depth = 0;
+    LatencyHistogram reorder_wait;
+
+    // Coalescing (Config::coalesce_window): groups released towards Prepare,
+    // orders that joined an earlier order's group (each saved one Prepare,
+    // one Pack and one Deliver invocation), orders held now, and how long
+    // each order was held before its group was released. Submits refused
+    // because held and queued orders already filled q_in (or the coalescer
+    // was closed) are counted in coalesce_refused_count, not as timeouts.
+    std::uint64_t coalesce_groups = 0;
+    std::uint64_t coalesced_orders = 0;
+    std::size_t coalesce_held = 0;
+    std::uint64_t coalesce_refused_count = 0;
+    LatencyHistogram coalesce_hold;
+
+    // Deliver through a carrier (Config::carrier_port): requests sent, the
+    // most outstanding on one worker's connection, and request -> reply.
+    std::uint64_t carrier_requests = 0;
+    std::size_t carrier_max_outstanding = 0;
+    LatencyHistogram carrier_rtt;
+};
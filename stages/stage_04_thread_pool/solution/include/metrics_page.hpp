@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class MetricsPageKind : std::uint8_t {
+    Counter, // only grows; readers show a rate
+    Gauge    // a level at publish time
+};
+
+struct MetricsPageField {
+    std::string name; // at most MetricsPage::kNameBytes - 1 characters
+    MetricsPageKind kind = MetricsPageKind::Counter;
+};
+
+// A page of named 64-bit values in a shared file mapping: one writer
+// publishes, any number of processes read, and neither side waits for the
+// other. A seqlock word is odd while the writer is storing values; a reader
+// copies the values and retries if the word was odd or moved meanwhile.
+//
+// The page is versioned and self-describing: field names and kinds are
+// stored in it, so a reader needs only the layout version, and new fields
+// can be appended without breaking older readers.
+struct MetricsPage {
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kMaxFields = 64;
+    static constexpr std::size_t kNameBytes = 32;
+    static constexpr std::size_t kBytes = 4096;
+};
+
+class MetricsPageWriter {
+public:
+    // Creates or overwrites the page at `path`.
+    MetricsPageWriter(const std::string& path, const std::vector<MetricsPageField>& fields);
+    ~MetricsPageWriter();
+
+    MetricsPageWriter(const MetricsPageWriter&) = delete;
+    MetricsPageWriter& operator=(const MetricsPageWriter&) = delete;
+
+    // `values` holds one value per field, in field order. Single writer.
+    void publish(const std::uint64_t* values) noexcept;
+
+    std::size_t field_count() const noexcept;
+
+private:
+    struct Mapping;
+    std::unique_ptr<Mapping> map_;
+    std::size_t fields_;
+};
+
+struct MetricsPageSample {
+    std::uint64_t publishes = 0;    // since the page was created
+    std::uint64_t published_ns = 0; // system_clock, comparable across processes
+    std::uint64_t writer_pid = 0;
+    std::vector<MetricsPageField> fields;
+    std::vector<std::uint64_t> values;
+
+    // Value of the field called `name`, 0 when the page has no such field.
+    std::uint64_t value(std::string_view name) const noexcept;
+};
+
+class MetricsPageReader {
+public:
+    // Maps `path` read-only; throws std::runtime_error unless it holds a
+    // complete page of this layout version.
+    explicit MetricsPageReader(const std::string& path);
+    ~MetricsPageReader();
+
+    MetricsPageReader(const MetricsPageReader&) = delete;
+    MetricsPageReader& operator=(const MetricsPageReader&) = delete;
+
+    // A consistent copy of the values; never blocks the writer.
+    MetricsPageSample read() const;
+
+private:
+    struct Mapping;
+    std::unique_ptr<Mapping> map_;
+    std::vector<MetricsPageField> fields_;
+};
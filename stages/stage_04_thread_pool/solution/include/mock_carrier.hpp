@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cluster_wire.hpp"
+
+enum class LatencyShape {
+    Fixed,       // always `mean`
+    Uniform,     // [mean * (1 - spread), mean * (1 + spread)]
+    Exponential, // memoryless, long tail; `spread` unused
+    LogNormal    // `spread` is the sigma of the underlying normal; the mean stays `mean`
+};
+
+// How long MockCarrier takes to answer one request.
+struct CarrierLatency {
+    LatencyShape shape = LatencyShape::Fixed;
+    std::chrono::microseconds mean{ 50000 };
+    double spread = 0.5;
+
+    std::chrono::microseconds sample(std::mt19937_64& rng) const;
+};
+
+struct MockCarrierStats {
+    std::uint64_t connections = 0;
+    std::uint64_t requests = 0;
+    std::uint64_t replies = 0;
+};
+
+// Stand-in for a carrier API on loopback, for tests and benchmarks: answers
+// every ClusterMsg::Deliver request after a latency drawn from
+// CarrierLatency, with any number of requests pending per connection, so
+// replies come back in completion order rather than request order.
+//
+// One thread per connection keeps its pending replies in a heap by due
+// time and polls the socket until the earliest one is due; delays are
+// therefore accurate to about a millisecond. POSIX only: start() throws
+// elsewhere.
+class MockCarrier {
+public:
+    explicit MockCarrier(CarrierLatency latency, std::string host = "127.0.0.1", std::uint16_t port = 0);
+    ~MockCarrier();
+
+    MockCarrier(const MockCarrier&) = delete;
+    MockCarrier& operator=(const MockCarrier&) = delete;
+
+    // Listens (port 0 picks a free one, see port()); throws
+    // std::runtime_error when it cannot.
+    void start();
+    void stop() noexcept;
+
+    std::uint16_t port() const noexcept;
+    MockCarrierStats stats() const noexcept;
+
+private:
+    // One connection's thread; `done` is its last write, after which the
+    // accept thread may join and drop it.
+    struct Client {
+        std::atomic<bool> done{ false };
+        std::jthread thread;
+    };
+
+    void serve(const std::stop_token& st);
+    void serve_client(int fd, std::uint64_t seed, const std::stop_token& st);
+
+    CarrierLatency latency_;
+    std::string host_;
+    std::uint16_t port_;
+    int listen_fd_ = -1;
+    std::jthread thread_;
+
+    std::mutex clients_mutex_;
+    std::vector<std::unique_ptr<Client>> clients_; // finished ones are reaped on accept
+
+    std::atomic<std::uint64_t> connections_{ 0 };
+    std::atomic<std::uint64_t> requests_{ 0 };
+    std::atomic<std::uint64_t> replies_{ 0 };
+};
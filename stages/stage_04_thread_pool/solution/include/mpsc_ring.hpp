@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free ring for any number of producer threads and one consumer
+// thread. A producer claims the next slot by advancing tail_ with a CAS,
+// fills it and marks it full; the consumer takes slots in claim order. A
+// claimed slot that is not full yet holds the consumer back until its
+// producer is done, so items leave in the order their slots were claimed.
+// Capacity is exact; the buffer is rounded up to a power of two.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(std::size_t capacity)
+        : capacity_(std::max<std::size_t>(capacity, 1)),
+          mask_(std::bit_ceil(capacity_) - 1),
+          slots_(mask_ + 1) {
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Any thread. `value` is moved from only on success.
+    bool try_push(T&& value) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        do {
+            // The consumer frees a slot before it advances head_, so with
+            // fewer than capacity_ claims outstanding the slot is free.
+            if (tail - head_.load(std::memory_order_acquire) >= capacity_) return false;
+        } while (!tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed));
+
+        Slot& slot = slots_[tail & mask_];
+        slot.value.emplace(std::move(value));
+        slot.full.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool try_pop(T& out) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[head & mask_];
+        if (!slot.full.load(std::memory_order_acquire)) return false;
+
+        out = std::move(*slot.value);
+        slot.value.reset();
+        slot.full.store(false, std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: whether try_pop() would succeed now.
+    bool ready() const noexcept {
+        return slots_[head_.load(std::memory_order_relaxed) & mask_].full.load(std::memory_order_acquire);
+    }
+
+    // Claimed minus taken slots, including claims still being filled; exact
+    // from the consumer when no producer is active, a snapshot otherwise.
+    std::size_t size() const noexcept {
+        const std::size_t head = head_.load(std::memory_order_acquire);
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    // Lifetime counts: every claim is pushed exactly once, so read popped()
+    // first and pushed() never trails it.
+    std::size_t pushed() const noexcept {
+        return tail_.load(std::memory_order_acquire);
+    }
+
+    std::size_t popped() const noexcept {
+        return head_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot {
+        std::atomic<bool> full{ false };
+        std::optional<T> value;
+    };
+
+    alignas(64) std::atomic<std::size_t> head_{ 0 }; // next slot to pop; consumer only
+
+    alignas(64) std::atomic<std::size_t> tail_{ 0 }; // next slot to claim
+
+    alignas(64) const std::size_t capacity_;
+    const std::size_t mask_;
+    std::vector<Slot> slots_;
+};
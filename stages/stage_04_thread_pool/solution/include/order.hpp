@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+enum class OrderStatus {
+    Accepted,
+    Prepared,
+    Packed,
+    Delivered,
+    Rejected,   // not admitted by submit()
+    Canceled    // admitted, but dropped by a forced stop
+};
+
+using OrderId = std::uint64_t;
+
+class Order {
+public:
+    explicit Order(OrderId id_)
+        : id(id_),
+          status(OrderStatus::Accepted),
+          accepted_time(std::chrono::steady_clock::now()) {
+    }
+
+    // Forward steps only: Accepted -> Prepared -> Packed -> Delivered.
+    // Rejected is reachable from Accepted, Canceled from any non-final status.
+    void advance_to(OrderStatus new_status) {
+        const auto now = std::chrono::steady_clock::now();
+
+        switch (new_status) {
+        case OrderStatus::Prepared:
+            require(status == OrderStatus::Accepted);
+            prepared_time = now;
+            break;
+        case OrderStatus::Packed:
+            require(status == OrderStatus::Prepared);
+            packed_time = now;
+            break;
+        case OrderStatus::Delivered:
+            require(status == OrderStatus::Packed);
+            delivered_time = now;
+            break;
+        case OrderStatus::Rejected:
+            require(status == OrderStatus::Accepted);
+            break;
+        case OrderStatus::Canceled:
+            require(!is_final());
+            break;
+        case OrderStatus::Accepted:
+        default:
+            require(false);
+            break;
+        }
+
+        status = new_status;
+    }
+
+    // Orders this one carries through the stages: itself and the merged ones.
+    std::size_t group_size() const noexcept {
+        return 1 + static_cast<std::size_t>(merged);
+    }
+
+    bool is_final() const noexcept {
+        return status == OrderStatus::Delivered
+            || status == OrderStatus::Rejected
+            || status == OrderStatus::Canceled;
+    }
+
+public:
+    OrderId id;
+    OrderStatus status;
+
+    std::chrono::steady_clock::time_point accepted_time;
+    std::chrono::steady_clock::time_point prepared_time;
+    std::chrono::steady_clock::time_point packed_time;
+    std::chrono::steady_clock::time_point delivered_time;
+
+    // Worker that ran each step: its index within the stage, or within the
+    // shared pool / cores under the other scheduling policies.
+    std::uint16_t prepared_by = 0;
+    std::uint16_t packed_by = 0;
+    std::uint16_t delivered_by = 0;
+
+    // Submit sequence number under Pipeline::Config::reorder_window
+    // (ReorderBuffer); 0 when the pipeline does not reorder.
+    std::uint64_t seq = 0;
+
+    // Estimated processing cost in the caller's units, for the
+    // PopOrder::ShortestWork queues; only its power-of-two bucket matters.
+    std::uint32_t work = 1;
+
+    // Same-customer orders merged into this one by the OrderCoalescer, which
+    // keeps their records (Pipeline::merged_orders()); kept out of Order so
+    // that it stays trivially copyable on the queues.
+    std::uint32_t merged = 0;
+
+    // Key for Pipeline::Config::coalesce_window: orders of one customer that
+    // arrive within the window share a pass through the stages. 0 = never
+    // coalesced.
+    std::uint64_t customer = 0;
+
+private:
+    static void require(bool ok) {
+        if (!ok) throw std::logic_error("Order: invalid status transition");
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "order.hpp"
+
+struct CoalesceStats {
+    std::uint64_t groups = 0;    // released towards Prepare
+    std::uint64_t coalesced = 0; // orders that rode in an earlier order's group
+    std::size_t held = 0;        // orders waiting for their group to be released
+    LatencyHistogram hold;       // held -> group released, per order
+};
+
+// Holds orders per customer key so that orders of one customer arriving
+// close together go through the stages as one group.
+//
+// The first order of a customer opens a group and becomes its lead; the
+// lead counts the later ones in Order::merged and adds up their work. A
+// group is released by take_due() once it has been open for `window`, or
+// by hold() itself when it reaches max_group orders. Each merged order
+// saves one Prepare, one Pack and one Deliver invocation and pays for it
+// with the time it was held.
+//
+// Only the lead travels. The merged orders stay here, and follow() copies
+// the lead's status, stage times and workers onto them as it moves, so
+// every order keeps its own record; once the lead is delivered or canceled
+// follow() hands them back and forgets the group.
+//
+// The key space is split into shards, each a map under its own mutex, so
+// threads working for different customers rarely meet.
+class OrderCoalescer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t kShards = 16;
+
+    OrderCoalescer(std::chrono::milliseconds window, std::size_t max_group);
+
+    OrderCoalescer(const OrderCoalescer&) = delete;
+    OrderCoalescer& operator=(const OrderCoalescer&) = delete;
+
+    // Takes the order into its customer's group; false once closed or with
+    // `limit` orders already held, and the order is left as it was. When the
+    // group fills up its lead is moved into `full` for the caller to release.
+    bool hold(Order&& order, std::size_t limit, std::optional<Order>& full);
+
+    // Leads of the groups open for the window or longer at `now`.
+    std::vector<Order> take_due(Clock::time_point now);
+    std::vector<Order> take_all();
+
+    // Refuses every hold() from now on; what is held stays for take_all().
+    void close() noexcept;
+
+    // Brings the merged orders of a released lead up to it, then calls
+    // `each` on every one of them. Returns them, and drops the group, once
+    // the lead is final; nothing before that.
+    std::vector<Order> follow(const Order& lead, const std::function<void(const Order&)>& each = {});
+
+    // The merged orders of a released lead that is not final yet, in
+    // arrival order.
+    std::vector<Order> merged_of(const Order& lead) const;
+
+    CoalesceStats stats() const;
+
+    std::chrono::milliseconds window() const noexcept {
+        return window_;
+    }
+
+private:
+    struct Group {
+        Order lead;
+        std::vector<Order> merged;
+        Clock::time_point opened;
+        std::vector<Clock::time_point> arrived; // per order, lead first
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::uint64_t, Group> open;           // by customer
+        std::unordered_map<OrderId, std::vector<Order>> released; // merged orders by lead id, until final
+        bool closed = false;
+    };
+
+    Shard& shard_of(std::uint64_t customer) noexcept;
+    const Shard& shard_of(std::uint64_t customer) const noexcept;
+    Order release(Group&& group, Clock::time_point now);
+
+    std::chrono::milliseconds window_;
+    std::size_t max_group_;
+    std::array<Shard, kShards> shards_;
+
+    std::atomic<std::size_t> held_{ 0 };
+    std::atomic<std::uint64_t> groups_{ 0 };
+    std::atomic<std::uint64_t> coalesced_{ 0 };
+    AtomicLatencyHistogram hold_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "order.hpp"
+
+// Sort keys of a delivered order view. Time keys are steady_clock ticks.
+enum class OrderKey {
+    Id,
+    AcceptedTime,
+    DeliveredTime
+};
+
+// Index permutation into an order vector: orders[perm[0]], orders[perm[1]], ...
+using OrderIndex = std::vector<std::size_t>;
+
+// Unsigned 64-bit key preserving the order of `key` on `o`.
+std::uint64_t order_key(const Order& o, OrderKey key) noexcept;
+
+// Key of a steady_clock time point, comparable with the time keys above.
+std::uint64_t time_key(std::chrono::steady_clock::time_point t) noexcept;
+
+// Stable parallel LSD radix sort of 64-bit keys; returns the sorting permutation.
+// Byte passes on which all keys agree are skipped. threads == 0 uses
+// hardware_concurrency; small inputs are sorted on the calling thread.
+OrderIndex radix_sort_permutation(const std::vector<std::uint64_t>& keys, std::size_t threads = 0);
+
+// Same as above, keyed directly on `orders` without copying them.
+OrderIndex sort_orders(const std::vector<Order>& orders, OrderKey key, std::size_t threads = 0);
+
+// Stable k-way merge of index runs that are each already sorted by `key`
+// (e.g. Pipeline::delivered_segments() for OrderKey::DeliveredTime).
+// Ties are resolved by run order.
+OrderIndex merge_sorted_runs(const std::vector<Order>& orders,
+    const std::vector<OrderIndex>& runs,
+    OrderKey key);
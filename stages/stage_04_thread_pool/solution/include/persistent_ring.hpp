@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "order.hpp"
+#include "queue.hpp"
+
+// When the mapped ring is forced to stable storage.
+enum class PersistSync {
+    None,    // never: survives a process crash, not an OS crash or power loss
+    PerBatch // msync after every sync_batch pushes and pops, and on close
+};
+
+// File-backed image of an order queue: a ring of order records in a shared
+// memory mapping, with persistent head / tail sequence numbers and a commit
+// word per slot. Attached to a BoundedBlockingQueue as its journal, it is
+// updated under the queue mutex, so the file always holds exactly the orders
+// still waiting in the queue. Under PersistSync::PerBatch the msync itself
+// runs in sync(), after the queue has released its mutex, and covers only
+// the pages changed since the previous one.
+//
+// A push writes the record, then sets the slot's commit word to seq + 1,
+// then advances tail; a pop advances head. Reopening the file takes head as
+// persisted and walks forward while commit words match, so a crash between
+// any two of these stores loses nothing that was acknowledged. With
+// PersistSync::PerBatch after an OS crash, head may lag by up to a batch and
+// a few orders come back twice (at-least-once).
+//
+// A slot keeps what an order carries while it waits: id, customer, work,
+// seq, merged and accepted_time. accepted_time is stored as steady_clock
+// time, which is meaningful within one boot; a resumed order whose stored
+// time lies in the future (the machine restarted) is accepted anew.
+class PersistentOrderRing final : public QueueJournal<Order> {
+public:
+    // Opens or creates `path`. An existing ring must have the same capacity.
+    PersistentOrderRing(const std::string& path, std::size_t capacity,
+        PersistSync sync = PersistSync::PerBatch, std::size_t sync_batch = 64);
+    ~PersistentOrderRing() override;
+
+    PersistentOrderRing(const PersistentOrderRing&) = delete;
+    PersistentOrderRing& operator=(const PersistentOrderRing&) = delete;
+
+    // Orders pushed and not yet popped, oldest first, with status Accepted.
+    std::vector<Order> pending() const;
+
+    void on_push(const Order& order) noexcept override;
+    void on_pop() noexcept override;
+    void sync() noexcept override;
+
+    // Forces the mapping to stable storage now, whatever the policy.
+    void flush() noexcept;
+
+    std::size_t size() const noexcept;
+    std::size_t capacity() const noexcept;
+    std::uint64_t sync_count() const noexcept;
+
+private:
+    struct Header;
+    struct Slot;
+
+    void map_file(const std::string& path);
+    void unmap_file() noexcept;
+    void format();
+    void recover();
+    void sync_bytes(std::size_t offset, std::size_t bytes) noexcept;
+
+    Slot& slot_of(std::uint64_t seq) const noexcept;
+
+    std::size_t capacity_;
+    PersistSync sync_;
+    std::size_t sync_batch_;
+    std::atomic<std::uint64_t> sync_count_{ 0 };
+
+    // PerBatch: changes since the last sync and the slots they wrote.
+    mutable std::mutex dirty_mutex_;
+    std::size_t unsynced_ = 0;
+    std::uint64_t dirty_first_ = 0; // first pushed seq, valid while dirty_count_ > 0
+    std::uint64_t dirty_count_ = 0; // consecutive pushed seqs from dirty_first_
+
+    void* base_ = nullptr;
+    std::size_t bytes_ = 0;
+    Header* header_ = nullptr;
+    Slot* slots_ = nullptr;
+
+#if defined(_WIN32)
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
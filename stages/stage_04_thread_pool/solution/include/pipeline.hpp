@@ -0,0 +1,519 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "archive_index.hpp"
+#include "doorbell.hpp"
+#include "metrics.hpp"
+#include "metrics_page.hpp"
+#include "order.hpp"
+#include "order_coalescer.hpp"
+#include "order_sort.hpp"
+#include "persistent_ring.hpp"
+#include "pressure.hpp"
+#include "reorder_buffer.hpp"
+#include "slowest_orders.hpp"
+#include "queue.hpp"
+#include "mpsc_ring.hpp"
+#include "status_census.hpp"
+
+enum class PipelineState {
+    Created,
+    Running,
+    Draining,
+    Stopped,
+    Failed
+};
+
+// How worker threads are assigned to stages.
+//
+// The shared policies run one pool of shared_workers threads, each able to
+// serve every stage; a worker takes the highest-priority stage that has work.
+// DownstreamFirst finishes orders already in flight before admitting new ones,
+// which keeps q_prepare and q_pack shallow and lead time short.
+//
+// ThreadPerCore is shared-nothing: submit() routes each order by id to one of
+// `cores` threads through that core's own lock-free MPSC intake ring, and the
+// core runs Prepare, Pack and Deliver back to back. Each core thread is pinned
+// to one CPU (Config::pin_cores) and counts its stages on its own cache line;
+// metrics() sums the cores on read. Delivered orders are published to the
+// archive in batches; q_prepare and q_pack are not used.
+enum class SchedulingPolicy {
+    Dedicated,       // *_workers threads per stage, each serving only its stage
+    UpstreamFirst,   // shared pool, Prepare > Pack > Deliver
+    DownstreamFirst, // shared pool, Deliver > Pack > Prepare
+    ThreadPerCore    // one run-to-completion thread per core, sharded by order id
+};
+
+// Outcome of one stage when the pipeline stopped.
+// abandoned: accepted orders that never completed this stage, either still
+// queued in front of it or held by one of its workers at the forced stop.
+struct StageReport {
+    std::uint64_t completed = 0;
+    std::uint64_t abandoned = 0;
+};
+
+struct ShutdownReport {
+    bool drained = false; // every accepted order was delivered, no escalation needed
+    std::uint64_t delivered = 0;
+
+    StageReport prepare;
+    StageReport pack;
+    StageReport deliver;
+
+    std::uint64_t abandoned_total() const noexcept {
+        return prepare.abandoned + pack.abandoned + deliver.abandoned;
+    }
+};
+
+class Pipeline {
+public:
+    struct Config {
+        std::size_t q_in_capacity = 256;
+        std::size_t q_prepare_capacity = 256;
+        std::size_t q_pack_capacity = 256;
+
+        std::size_t prepare_workers = 1;
+        std::size_t pack_workers = 1;
+        std::size_t deliver_workers = 1;
+
+        std::chrono::milliseconds push_timeout{ 100 };
+        std::chrono::milliseconds pop_timeout{ 50 };
+
+        bool status_census = false; // maintain per-status id bitmaps (status_snapshot())
+        bool wakeup_stats = false;  // record consumer wake-up delays per queue (Metrics::q_*_wakeup)
+        bool fair_submit = false;   // admit submitters blocked on a full q_in in arrival order
+        bool direct_handoff = false; // hand orders straight to idle Pack/Deliver workers
+
+        // How threads block on q_in / q_prepare / q_pack. fair_submit and
+        // direct_handoff take effect only with WaitBackend::CondVar.
+        WaitBackend queue_backend = WaitBackend::CondVar;
+
+        // Which waiting order q_in / q_prepare / q_pack hand out next.
+        // ShortestWork takes the lightest by Order::work (power-of-two
+        // buckets) so a heavy order no longer holds up the light ones behind
+        // it; an order that has waited work_aging goes first regardless, so
+        // heavy orders are delayed, not starved. Not available with
+        // q_in_path; ThreadPerCore intake rings stay FIFO.
+        PopOrder queue_order = PopOrder::Fifo;
+        std::chrono::milliseconds work_aging{ 50 };
+
+        SchedulingPolicy scheduling = SchedulingPolicy::Dedicated;
+        std::size_t shared_workers = 3;     // pool size for the shared policies
+        std::size_t starvation_limit = 32;  // shared policies: picks in a row that may pass over waiting work
+        std::size_t cores = 0;              // ThreadPerCore: core threads, 0 = hardware concurrency;
+                                            // each core's intake ring holds q_in_capacity orders
+        bool pin_cores = true;              // ThreadPerCore: pin core i to the i-th allowed CPU (Linux)
+
+        // CONWIP: at most this many accepted, not yet delivered orders across
+        // all queues and workers; 0 disables the cap. A submit at the cap
+        // waits for a delivery within push_timeout like any other backpressure.
+        std::size_t wip_limit = 0;
+
+        // Non-empty: q_in is mirrored into a file-backed ring at this path
+        // (PersistentOrderRing). Orders accepted but not yet taken by Prepare
+        // survive a crash or a forced stop and are resumed by the next
+        // start(). Not available with ThreadPerCore.
+        std::string q_in_path;
+        PersistSync q_in_sync = PersistSync::PerBatch;
+        std::size_t q_in_sync_batch = 64; // pushes and pops per msync under PerBatch
+
+        // Called by Prepare for every order before it advances; stands in for
+        // the real per-order processing cost in benchmarks and tests.
+        std::function<void(const Order&)> prepare_work;
+
+        // Keep the this many delivered orders with the highest lead time
+        // (slowest_orders()); 0 disables the tracker.
+        std::size_t slowest_orders = 0;
+
+        // Non-empty: the flight recorder (FlightRecorder) is dumped here when
+        // the pipeline goes to Failed. Recording itself is always on.
+        std::string flight_dump_path;
+
+        // Dedicated: upper bound for set_workers() per stage, raised to the
+        // stage's configured count. Deliver runs and slowest_orders shards
+        // are sized for it.
+        std::size_t max_stage_workers = 0;
+
+        // Non-empty: a MetricsPage at this path (e.g. under /dev/shm) gets a
+        // copy of metrics(), queue depths and the state every
+        // metrics_page_interval and at shutdown, for external readers such
+        // as ops_metrics_top. One snapshot per interval however many read.
+        std::string metrics_page_path;
+        std::chrono::milliseconds metrics_page_interval{ 100 };
+
+        // Non-zero: delivered orders are put back into submit order by a
+        // ReorderBuffer holding this many orders and passed to ordered_sink,
+        // while the stages still run in parallel. A submit that finds the
+        // window full waits within push_timeout like any other backpressure.
+        // Not available with ThreadPerCore or q_in_path.
+        std::size_t reorder_window = 0;
+        std::function<void(const Order&)> ordered_sink;
+
+        // Non-zero: orders with a customer key (Order::customer) are held by
+        // an OrderCoalescer for up to this long, checked every quarter
+        // window, and a customer's orders go through Prepare, Pack and
+        // Deliver as one group of at most coalesce_max_group. The stage
+        // counters and delivered_orders() then count groups, each led by its
+        // first order; merged_orders() has the rest, each with its own
+        // status and times. Not available with ThreadPerCore, q_in_path or
+        // reorder_window.
+        std::chrono::milliseconds coalesce_window{ 0 };
+        std::size_t coalesce_max_group = 16;
+
+        // Non-zero port: Deliver hands every order to the carrier service at
+        // carrier_host:carrier_port (ClusterMsg::Deliver, e.g. MockCarrier)
+        // and completes it when the reply comes back. Each Deliver worker
+        // has its own connection with up to carrier_window requests
+        // outstanding, so a slow carrier calls for a deeper window rather
+        // than more threads. A lost connection fails the pipeline.
+        // SchedulingPolicy::Dedicated only.
+        std::string carrier_host = "127.0.0.1";
+        std::uint16_t carrier_port = 0;
+        std::size_t carrier_window = 16;
+    };
+
+    Pipeline();
+    explicit Pipeline(Config cfg);
+    ~Pipeline() noexcept;
+
+    void start();
+    void shutdown();
+    void shutdown_now();
+
+    // Graceful shutdown bounded by `deadline`: drains until every accepted
+    // order is delivered or the deadline expires, then escalates to a forced
+    // stop for whatever is left. Returns the same report on repeated calls.
+    ShutdownReport shutdown_for(std::chrono::milliseconds deadline);
+
+    bool is_running() const noexcept;
+    bool is_stopped() const noexcept;
+    PipelineState state() const noexcept;
+
+    // False if the order was not accepted within push_timeout. With
+    // coalescing it is also false when the coalescer refuses the order, or
+    // when the group the order filled up found no room in q_in in time and
+    // was canceled along with it.
+    bool submit(Order order);
+
+    // Same as submit(order), and reports the intake pressure right after it;
+    // Saturated when the order was refused.
+    bool submit(Order order, Pressure& pressure);
+
+    // Current intake pressure; lock-free, cheap enough to call per submit.
+    Pressure pressure() const noexcept;
+
+    Metrics metrics() const;
+
+    // Load signals for routing, read without locks: orders waiting in q_in
+    // (or in the core rings) and orders accepted but not yet delivered or
+    // abandoned.
+    std::size_t q_in_depth() const noexcept;
+    std::size_t in_flight() const noexcept;
+
+    // ThreadPerCore: the CPU each core thread is pinned to, -1 where it is
+    // not (yet) pinned. Empty under the other policies.
+    std::vector<int> core_cpus() const;
+
+    // A copy of the orders delivered so far; Deliver workers keep appending
+    // while the pipeline runs.
+    std::vector<Order> delivered_orders() const;
+
+    // Indices into delivered_orders(), one run per Deliver worker (per pool
+    // worker or core under the other policies). Each run is in that worker's
+    // completion order and therefore sorted by delivered_time.
+    std::vector<std::vector<std::size_t>> delivered_segments() const;
+
+    // Positions in delivered_orders() whose `key` time (AcceptedTime or
+    // DeliveredTime) lies in [from, to], answered through the sparse block index.
+    std::vector<std::size_t> delivered_between(OrderKey key,
+        std::chrono::steady_clock::time_point from,
+        std::chrono::steady_clock::time_point to) const;
+
+    std::optional<std::size_t> find_delivered(OrderId id) const;
+
+    // The orders that went through the stages inside `lead`'s group
+    // (Config::coalesce_window), with their own ids and accepted times and
+    // the group's status and stage times; empty if `lead` led no group or
+    // its group was canceled.
+    std::vector<Order> merged_orders(const Order& lead) const;
+
+    // The Config::slowest_orders slowest deliveries so far, slowest first,
+    // with their stage timestamps and workers; empty when disabled.
+    std::vector<SlowOrder> slowest_orders() const;
+
+    // Ids per OrderStatus, and only a count of the delivered ones; requires
+    // cfg.status_census. Updates are batched per worker, so orders still in a
+    // worker's unflushed batch show their previous status.
+    StatusSnapshot status_snapshot() const;
+
+    // Tag of this instance's flight records (FlightRecord::source).
+    std::uint16_t flight_source() const noexcept;
+
+    // Runtime control, safe from any thread while Running (AdminServer).
+    // Workers are never waited for: each has a mailbox that it reads between
+    // orders, so a command takes effect within about one pop_timeout.
+    //
+    // pause() stops every worker from taking new orders; submits still queue
+    // up to the capacities. Any shutdown resumes. Not with ThreadPerCore.
+    bool pause();
+    bool resume();
+    bool paused() const noexcept;
+
+    // Dedicated only: starts workers or asks the highest-numbered ones to
+    // retire after their current order. Each count in [1, max(configured
+    // count, Config::max_stage_workers)]. Returns false if workers still
+    // retiring hold the indexes new ones would need, and, without waiting,
+    // while a start, stop or another resize is in progress.
+    bool set_workers(std::size_t prepare, std::size_t pack, std::size_t deliver);
+
+    // Rebounds q_in / q_prepare / q_pack. Orders above a lowered bound stay
+    // queued. Not with ThreadPerCore or WaitBackend::Semaphore; q_in cannot
+    // outgrow a q_in_path file.
+    bool set_capacities(std::size_t q_in, std::size_t q_prepare, std::size_t q_pack);
+
+    // Lock-free depths of q_in (or the core rings), q_prepare and q_pack.
+    std::array<std::size_t, 3> queue_depths() const noexcept;
+
+    // Starts a graceful shutdown without waiting for it: submits are refused
+    // from now on and the stages drain. shutdown() still has to be called to
+    // join the workers. Returns false, without waiting, while a start, stop
+    // or resize is in progress; true once draining, or if not running.
+    bool begin_shutdown();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+private:
+    enum class Stage : std::size_t { Prepare = 0, Pack = 1, Deliver = 2 };
+    static constexpr std::size_t kStages = 3;
+
+    using Clock = std::chrono::steady_clock;
+
+    // A worker's mailbox and bookkeeping; outlives the worker until it is
+    // reaped after its exit, so posting never races with the exit.
+    struct WorkerControl {
+        static constexpr std::uint32_t kCheck = 1;  // re-read paused_
+        static constexpr std::uint32_t kRetire = 2; // exit after the current order
+
+        Stage stage{};
+        std::size_t index = 0;
+        bool retiring = false; // workers_mutex_
+        bool exited = false;   // workers_mutex_
+        std::atomic<std::uint32_t> mail{ 0 };
+
+        void post(std::uint32_t bits) noexcept {
+            mail.fetch_or(bits);
+            mail.notify_one();
+        }
+    };
+
+    ShutdownReport stop(std::optional<Clock::time_point> deadline);
+    void escalate() noexcept;
+    void join_workers() noexcept;
+    void reap_workers() noexcept;
+    void cancel_queued();
+    ShutdownReport make_report() const;
+    void add_core_counts(Metrics& m) const noexcept;
+
+    // ThreadPerCore: everything one core touches on its hot path, grouped by
+    // writer so submitters and the core thread do not share cache lines.
+    struct alignas(64) Core {
+        explicit Core(std::size_t capacity) : ring(capacity) {}
+
+        MpscRing<Order> ring;
+
+        // Written by submitters.
+        alignas(64) std::atomic<std::size_t> pushing{ 0 }; // submitters past the closed check
+        std::atomic<std::size_t> producers_waiting{ 0 };
+        std::atomic<std::size_t> max_size{ 0 };
+        std::mutex space_mutex;           // only for waiting on a full ring
+        std::condition_variable space_cv; // submitters waiting for a free slot
+        std::atomic<bool> closed{ false };
+
+        alignas(64) std::atomic<bool> sleeping{ false };
+        std::atomic<std::uint32_t> doorbell{ 0 }; // rung when the core may be asleep
+        std::atomic<int> cpu{ -1 };               // pinned CPU, -1 if not pinned
+
+        // Written by the core thread only; metrics() sums them over cores.
+        alignas(64) std::atomic<std::uint64_t> prepared{ 0 };
+        std::atomic<std::uint64_t> packed{ 0 };
+        std::atomic<std::uint64_t> delivered{ 0 };
+        std::atomic<std::int64_t> lead_time_ns{ 0 };
+    };
+
+    // ThreadPerCore: delivered orders not yet published to delivered_.
+    struct CoreTally {
+        std::vector<Order> delivered;
+    };
+
+    static constexpr std::size_t kCorePublishBatch = 256;
+
+    bool submit_to_core(Order&& order, Clock::time_point deadline);
+    void close_intake() noexcept;
+    static void ring_doorbell(Core& core) noexcept;
+
+    void resume_persisted_intake();
+
+    // Intake gate. submit() counts itself into a stripe and only then reads
+    // state_; stop() changes state_ and only then waits for every stripe to
+    // empty. Those four accesses are seq_cst, so a submitter either sees the
+    // state change and backs out, or is waited for; submitters never share a
+    // lock or a counter. stop() sleeps on gate_exits_, which the last
+    // submitter out of a stripe bumps only while gate_waiting_ is set, for
+    // at least kGateGrace even when its deadline has already passed.
+    static constexpr std::size_t kGateStripes = 16;
+    static constexpr std::chrono::milliseconds kGateGrace{ 100 };
+
+    struct alignas(64) GateStripe {
+        std::atomic<std::size_t> inside{ 0 };
+    };
+
+    std::atomic<std::size_t>& enter_gate() noexcept;
+    void leave_gate(std::atomic<std::size_t>& inside) noexcept;
+    void wait_gate_empty(std::optional<Clock::time_point> deadline);
+
+    bool acquire_wip(Clock::time_point deadline);
+    void release_wip(std::size_t n = 1) noexcept;
+    void wake_wip_waiters() noexcept;
+
+    // State owned by one worker thread for its whole life.
+    struct WorkerContext {
+        Stage stage{};         // dedicated: its stage; shared: the stage being served
+        std::size_t index = 0; // within the stage, or within the shared pool
+        bool shared = false;
+        std::array<bool, kStages> retired{}; // shared: stages it will not serve again
+        std::size_t passed_over = 0;         // shared: picks in a row that skipped waiting work
+        CoreTally tally;                     // ThreadPerCore only
+        StatusCensus::Batch census;
+        WorkerControl* control = nullptr;
+    };
+
+    void run_coalescer(const std::stop_token& st);
+    void drain_coalescer(std::optional<Clock::time_point> deadline);
+    bool release_group(Order& group, std::optional<Clock::time_point> deadline, const std::stop_token& st = {});
+    void cancel_group(Order& group);
+    std::vector<Order> follow_group(WorkerContext& w, const Order& lead);
+
+    void spawn_worker(WorkerContext ctx);
+    void publish_metrics_page();
+    void run_metrics_publisher(const std::stop_token& st);
+    bool read_mail(WorkerContext& w, const std::stop_token& st);
+    void post_all(std::uint32_t bits) noexcept;
+    std::size_t stage_worker_limit(Stage stage) const noexcept;
+
+    void worker_loop(WorkerContext w, std::stop_token st) noexcept;
+    void run_stage(WorkerContext& w, const std::stop_token& st);
+    void run_carrier(WorkerContext& w, const std::stop_token& st);
+    void run_shared(WorkerContext& w, const std::stop_token& st);
+    bool pick_shared(WorkerContext& w, Order& order);
+    bool process_shared(WorkerContext& w, Order& order, const std::stop_token& st);
+    bool forward_shared(WorkerContext& w, Stage next, const Order& order, const std::stop_token& st);
+    void retire_drained(WorkerContext& w);
+    void run_core(WorkerContext& w, const std::stop_token& st);
+    void park_core(Core& core);
+    void run_to_completion(WorkerContext& w, Core& c, Order& order, const std::stop_token& st);
+    void publish_tally(WorkerContext& w);
+    bool forward(BoundedBlockingQueue<Order>& out, const Order& order, const std::stop_token& st);
+    void wake_carriers(bool all = false) noexcept;
+    void complete(WorkerContext& w, Order& order);
+    void abandon(WorkerContext& w, Stage stage, Order& order);
+    void note_status(WorkerContext& w, const Order& order);
+    void flush_status(WorkerContext& w);
+    void retire_locked(Stage stage) noexcept;
+    void on_worker_exit(WorkerContext& w) noexcept;
+    void fail() noexcept;
+    void set_state(PipelineState s) noexcept;
+    bool advance_state(PipelineState from, PipelineState to) noexcept;
+    void record_transition(PipelineState from, PipelineState to) noexcept;
+
+    BoundedBlockingQueue<Order>& input_of(Stage stage) noexcept;
+    BoundedBlockingQueue<Order>* output_of(Stage stage) noexcept;
+
+    Config cfg_;
+    std::uint16_t flight_source_;
+
+    std::unique_ptr<PersistentOrderRing> q_in_file_; // outlives q_in_, which writes to it
+    BoundedBlockingQueue<Order> q_in_;
+    BoundedBlockingQueue<Order> q_prepare_;
+    BoundedBlockingQueue<Order> q_pack_;
+    std::vector<std::unique_ptr<Core>> cores_; // ThreadPerCore only
+
+    mutable std::atomic<std::int64_t> depth_avg_{ 0 }; // moving average of q_in_depth(), x16, for pressure()
+
+    std::atomic<std::size_t> wip_{ 0 };         // with a cap: accepted, not yet delivered or abandoned
+    std::atomic<std::size_t> wip_waiters_{ 0 }; // submitters parked on the cap
+    std::mutex wip_mutex_;
+    std::condition_variable wip_cv_;
+
+    std::atomic<PipelineState> state_{ PipelineState::Created };
+    std::array<GateStripe, kGateStripes> gate_; // submitters past the state check
+    std::atomic<bool> gate_waiting_{ false };
+    std::atomic<std::uint32_t> gate_exits_{ 0 };
+    std::atomic<bool> failed_{ false };
+    std::mutex lifecycle_mutex_; // start / shutdown* are serialized
+    ShutdownReport report_;
+
+    std::stop_source stop_source_;
+    std::vector<std::jthread> workers_;                    // lifecycle_mutex_
+    std::vector<std::unique_ptr<WorkerControl>> controls_; // same order as workers_; workers_mutex_
+    std::atomic<bool> paused_{ false };
+
+    std::array<std::size_t, kStages> active_workers_{};
+    std::size_t live_workers_ = 0;
+    std::mutex workers_mutex_;
+    std::condition_variable workers_cv_; // signaled when a worker exits
+
+    static constexpr std::size_t kDeliveredChunk = 4096; // orders delivered_orders() copies per lock hold
+
+    mutable std::mutex metrics_mutex_; // metrics_, delivered_*, abandoned_
+    Metrics metrics_;
+    std::vector<Order> delivered_;
+    std::vector<std::vector<std::size_t>> delivered_segments_;
+    SparseBlockIndex delivered_index_;
+    std::unordered_map<OrderId, std::vector<Order>> delivered_merged_; // by lead id, coalescing only
+    std::array<std::uint64_t, kStages> abandoned_{};
+    mutable std::mutex delivered_copy_mutex_; // delivered_orders() callers copy one at a time
+    std::atomic<std::uint64_t> finished_{ 0 }; // orders delivered or canceled, merged ones too; written under metrics_mutex_
+
+    std::unique_ptr<MetricsPageWriter> metrics_page_;
+    std::jthread metrics_publisher_;
+    std::mutex publisher_mutex_;
+    std::condition_variable_any publisher_cv_; // interval sleep, cut short by stop
+
+    std::unique_ptr<ReorderBuffer> reorder_;
+
+    std::unique_ptr<OrderCoalescer> coalescer_;
+    std::jthread coalescer_thread_; // releases groups whose window is over
+    std::vector<Order> stranded_groups_; // due groups a stop cut short; coalescer thread until joined
+    std::mutex coalescer_mutex_;
+    std::condition_variable_any coalescer_cv_; // tick sleep, cut short by stop
+
+    // Deliver through a carrier (Config::carrier_port).
+    struct alignas(64) CarrierBell {
+        Doorbell doorbell;                 // rung by pushes to q_pack
+        std::atomic<bool> waiting{ false }; // its worker is asleep on it; a ring claims it
+    };
+    std::vector<std::unique_ptr<CarrierBell>> carrier_bells_; // by Deliver worker index
+    std::atomic<std::size_t> carrier_waiting_{ 0 }; // carrier workers asleep on their bells
+    std::atomic<std::uint64_t> carrier_requests_{ 0 };
+    std::atomic<std::size_t> carrier_max_outstanding_{ 0 };
+    AtomicLatencyHistogram carrier_rtt_;
+
+    mutable StatusCensus census_;
+    std::unique_ptr<SlowestOrders> slowest_; // one shard per delivering worker
+};
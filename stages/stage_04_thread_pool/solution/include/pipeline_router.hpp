@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "order.hpp"
+#include "pipeline.hpp"
+
+// Where an unkeyed submit goes.
+enum class RoutePolicy {
+    Hash,      // by order id, like a keyed submit
+    PowerOfTwo // the less loaded of two instances sampled at random
+};
+
+// Load signal compared by PowerOfTwo; both are read without locks.
+enum class RouteLoad {
+    QueueDepth, // orders waiting in the instance's q_in
+    InFlight    // orders accepted and not yet delivered by the instance
+};
+
+// Front for several independent Pipeline instances.
+//
+// Keyed submits always hash the key, so every order with that key goes to
+// the same instance. Unkeyed submits follow the policy: hashing spreads
+// orders evenly by count, but a shard that draws expensive orders falls
+// behind; power of two choices looks at two random instances and takes the
+// less loaded one, which keeps queues even at the cost of two atomic loads.
+class PipelineRouter {
+public:
+    struct Config {
+        std::vector<Pipeline::Config> instances{ 2 }; // one Pipeline per entry
+        RoutePolicy policy = RoutePolicy::PowerOfTwo;
+        RouteLoad load = RouteLoad::InFlight;
+    };
+
+    PipelineRouter();
+    explicit PipelineRouter(Config cfg);
+
+    void start();
+    void shutdown();
+    void shutdown_now();
+
+    bool submit(Order order);
+    bool submit(Order order, std::uint64_t key);
+
+    std::size_t size() const noexcept;
+    Pipeline& instance(std::size_t i);
+    const Pipeline& instance(std::size_t i) const;
+
+    // Submits routed to each instance, accepted or not.
+    std::vector<std::uint64_t> routed() const;
+
+    PipelineRouter(const PipelineRouter&) = delete;
+    PipelineRouter& operator=(const PipelineRouter&) = delete;
+
+private:
+    struct Shard {
+        explicit Shard(Pipeline::Config cfg) : pipeline(std::move(cfg)) {}
+
+        Pipeline pipeline;
+        std::atomic<std::uint64_t> routed{ 0 };
+    };
+
+    std::size_t pick_hashed(std::uint64_t key) const noexcept;
+    std::size_t pick_two() const noexcept;
+    std::size_t load_of(const Shard& shard) const noexcept;
+    bool submit_to(std::size_t i, Order&& order);
+
+    Config cfg_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
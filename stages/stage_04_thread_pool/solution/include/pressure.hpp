@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <thread>
+
+// How close the pipeline's intake is to refusing work, from q_in occupancy
+// (and the WIP cap, when set) adjusted by whether the queue is growing or
+// shrinking. Producers react to it long before push_timeout expires.
+enum class Pressure {
+    Low,      // plenty of room, not filling
+    Elevated, // filling up or a quarter full; hold the rate
+    High,     // half full or filling fast; back off
+    Saturated // nearly full, or the submit was refused
+};
+
+// Client-side AIMD pacer for one producer thread: the send rate grows by a
+// fixed step while pressure is Low and is cut by a factor on High or
+// Saturated, at most once per decrease_interval so that one burst of
+// signals counts as one congestion event.
+class AimdPacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        double initial_rate = 1000; // orders per second
+        double min_rate = 10;
+        double max_rate = 1e6;
+        double increase = 50;       // added per Low signal
+        double decrease = 0.5;      // rate multiplier on High
+        double saturated_decrease = 0.25;
+        std::chrono::milliseconds decrease_interval{ 10 };
+    };
+
+    AimdPacer() : AimdPacer(Config{}) {}
+
+    explicit AimdPacer(Config cfg)
+        : cfg_(cfg),
+          rate_(std::clamp(cfg.initial_rate, cfg.min_rate, cfg.max_rate)),
+          next_(Clock::now()) {
+    }
+
+    // Sleeps until the next send slot. Slots are spaced 1/rate apart and do
+    // not accumulate while the producer is slow, so there are no bursts.
+    void pace() {
+        const auto now = Clock::now();
+        if (next_ > now) std::this_thread::sleep_until(next_);
+        next_ = std::max(next_, now) + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / rate_));
+    }
+
+    void on_pressure(Pressure p) {
+        switch (p) {
+        case Pressure::Low:
+            rate_ = std::min(rate_ + cfg_.increase, cfg_.max_rate);
+            break;
+        case Pressure::Elevated:
+            break;
+        case Pressure::High:
+            cut(cfg_.decrease);
+            break;
+        case Pressure::Saturated:
+            cut(cfg_.saturated_decrease);
+            break;
+        }
+    }
+
+    double rate() const noexcept {
+        return rate_;
+    }
+
+private:
+    void cut(double factor) {
+        const auto now = Clock::now();
+        if (last_cut_ && now < *last_cut_ + cfg_.decrease_interval) return;
+        last_cut_ = now;
+        rate_ = std::max(rate_ * factor, cfg_.min_rate);
+    }
+
+    Config cfg_;
+    double rate_;
+    Clock::time_point next_;
+    std::optional<Clock::time_point> last_cut_;
+};
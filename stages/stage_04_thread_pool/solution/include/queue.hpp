@@ -0,0 +1,1035 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <semaphore>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "deadline_waker.hpp"
+#include "latency_histogram.hpp"
+#include "order.hpp"
+
+// Stage 00/01: unbounded thread-safe FIFO of orders.
+class OrderQueue {
+public:
+    void push(Order order) {
+        std::lock_guard lock(mutex_);
+        queue_.push(std::move(order));
+    }
+
+    Order pop() {
+        std::lock_guard lock(mutex_);
+        if (queue_.empty()) throw std::out_of_range("OrderQueue: pop on empty queue");
+        Order order = std::move(queue_.front());
+        queue_.pop();
+        return order;
+    }
+
+    bool try_pop(Order& out) {
+        std::lock_guard lock(mutex_);
+        if (queue_.empty()) return false;
+        out = std::move(queue_.front());
+        queue_.pop();
+        return true;
+    }
+
+    bool empty() const {
+        std::lock_guard lock(mutex_);
+        return queue_.empty();
+    }
+
+private:
+    std::queue<Order> queue_;
+    mutable std::mutex mutex_;
+};
+
+// Stage 02: unbounded blocking queue with close().
+template <typename T>
+class BlockingQueue {
+public:
+    void push(T value) {
+        {
+            std::lock_guard lock(mutex_);
+            if (closed_) throw std::logic_error("BlockingQueue: push after close");
+            queue_.push(std::move(value));
+        }
+        cv_.notify_one();
+    }
+
+    bool wait_pop(T& out) {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [&] { return closed_ || !queue_.empty(); });
+        return pop_locked(out);
+    }
+
+    template <class Rep, class Period>
+    bool wait_pop_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock lock(mutex_);
+        cv_.wait_for(lock, timeout, [&] { return closed_ || !queue_.empty(); });
+        return pop_locked(out);
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool closed() const {
+        std::lock_guard lock(mutex_);
+        return closed_;
+    }
+
+    bool empty() const {
+        std::lock_guard lock(mutex_);
+        return queue_.empty();
+    }
+
+private:
+    bool pop_locked(T& out) {
+        if (queue_.empty()) return false;
+        out = std::move(queue_.front());
+        queue_.pop();
+        return true;
+    }
+
+    std::queue<T> queue_;
+    bool closed_ = false;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// Lifetime counters of a bounded queue, read as one consistent snapshot.
+struct QueueStats {
+    std::uint64_t push_count = 0;
+    std::uint64_t pop_count = 0;
+    std::size_t max_size = 0;
+    std::uint64_t handoff_count = 0; // pushes handed straight to an idle consumer
+    std::uint64_t aged_pops = 0;     // PopOrder::ShortestWork: pops that took an aged item first
+
+    // Wake-up delay of consumers that slept on an empty queue: from the
+    // notifying push to the consumer running again (CondVar backend).
+    LatencyHistogram wakeup;
+};
+
+// Order in which producers blocked on a full queue get a free slot.
+enum class PushAdmission {
+    Unordered, // whichever waiter the condition variable wakes first
+    Fifo       // blocked producers are admitted in arrival order
+};
+
+// How a push reaches a consumer that is already waiting on an empty queue.
+enum class ConsumerHandoff {
+    ViaQueue, // store, notify, the consumer re-locks and pops
+    Direct    // move the value into the waiting consumer's exchange slot
+};
+
+// Which stored item a pop takes.
+enum class PopOrder {
+    Fifo,        // the oldest
+    ShortestWork // the lightest by work weight, unless an item has waited too long
+};
+
+// Work weight of a queued item: Order::work for anything that has a `work`
+// member, 1 otherwise (so ShortestWork degrades to FIFO).
+template <typename T>
+std::uint32_t work_weight(const T& value) noexcept {
+    if constexpr (requires { value.work; }) return static_cast<std::uint32_t>(value.work);
+    else return 1;
+}
+
+// Storage of a BoundedBlockingQueue, used under its mutex.
+//
+// Fifo keeps one FIFO. ShortestWork keeps a FIFO per power-of-two weight
+// bucket ([0,1], [2,3], [4,7], ...) and pops from the lightest non-empty one,
+// which approximates shortest-remaining-work-first without a heap: push and
+// pop are O(1) in the number of items. Within a bucket order stays FIFO.
+// Aging prevents starvation: when the head of a heavier bucket has waited
+// at least `aging`, the oldest such head goes first instead.
+template <typename T>
+class QueueStorage {
+public:
+    static constexpr std::size_t kBuckets = 16;
+
+    QueueStorage(PopOrder order, std::chrono::steady_clock::duration aging)
+        : order_(order),
+          aging_(aging) {
+    }
+
+    void push(T&& value) {
+        Entry e{ std::move(value), {} };
+        std::size_t b = 0;
+        if (order_ == PopOrder::ShortestWork) {
+            b = std::min<std::size_t>(static_cast<std::size_t>(std::bit_width(work_weight(e.value) >> 1)), kBuckets - 1);
+            e.stored_at = std::chrono::steady_clock::now();
+        }
+        buckets_[b].push_back(std::move(e));
+        last_ = b;
+        ++size_;
+    }
+
+    // Returns true when aging picked the item over a lighter one.
+    bool pop(T& out) {
+        std::size_t b = 0;
+        while (buckets_[b].empty()) ++b;
+
+        bool aged = false;
+        if (order_ == PopOrder::ShortestWork && aging_.count() > 0) {
+            const auto cutoff = std::chrono::steady_clock::now() - aging_;
+            auto oldest = cutoff;
+            for (std::size_t h = b + 1; h < kBuckets; ++h) {
+                if (!buckets_[h].empty() && buckets_[h].front().stored_at <= oldest) {
+                    oldest = buckets_[h].front().stored_at;
+                    b = h;
+                    aged = true;
+                }
+            }
+        }
+
+        out = std::move(buckets_[b].front().value);
+        buckets_[b].pop_front();
+        --size_;
+        return aged;
+    }
+
+    // The item stored by the last push.
+    const T& back() const {
+        return buckets_[last_].back().value;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    PopOrder order() const noexcept {
+        return order_;
+    }
+
+private:
+    struct Entry {
+        T value;
+        std::chrono::steady_clock::time_point stored_at; // ShortestWork only
+    };
+
+    PopOrder order_;
+    std::chrono::steady_clock::duration aging_;
+    std::array<std::deque<Entry>, kBuckets> buckets_; // Fifo uses the first
+    std::size_t last_ = 0;
+    std::size_t size_ = 0;
+};
+
+// Mirror of a bounded queue's storage, kept in step under the queue mutex:
+// on_push for every item stored, on_pop for every item taken from storage.
+// Items handed directly to a waiting consumer never reach either hook. Both
+// run under the queue mutex; sync() follows them once the mutex is released,
+// for work too slow to do under it.
+template <typename T>
+class QueueJournal {
+public:
+    virtual ~QueueJournal() = default;
+
+    virtual void on_push(const T& value) noexcept = 0;
+    virtual void on_pop() noexcept = 0;
+    virtual void sync() noexcept {}
+};
+
+// How blocked producers and consumers sleep and are woken. The storage is
+// always a QueueStorage under the queue mutex; only the waiting differs.
+enum class WaitBackend {
+    CondVar,   // condition variables on the queue mutex
+    Semaphore, // std::counting_semaphore for free slots and for items
+    AtomicWait // std::atomic wait/notify on event counters
+};
+
+// Stage 03: bounded blocking queue with backpressure and timeouts.
+//
+// In PushAdmission::Fifo mode every producer that cannot push immediately
+// parks in its own slot at the tail of a waiting line; a pop wakes only the
+// head of the line, and newcomers never overtake parked producers. A producer
+// that times out leaves the line without affecting the order of the others.
+//
+// In ConsumerHandoff::Direct mode a consumer that finds the queue empty
+// advertises an exchange slot and sleeps on the slot's own condition variable.
+// A producer that sees an idle consumer moves the value into the slot and
+// signals it, so the item never touches the queue storage and the consumer
+// does not re-lock the queue mutex to pop it. The storage is used only when
+// nobody is waiting, which keeps FIFO order: consumers only wait while the
+// queue is empty.
+//
+// WaitBackend::Semaphore blocks on a free-slot and an item semaphore and
+// takes the mutex only around the storage; timed waiters line up for a token
+// on their own condition variable instead, since the semaphore's timed
+// acquire wakes late. WaitBackend::AtomicWait sleeps on event counters bumped
+// after every push and pop; a timed wait arms the shared DeadlineWaker, which
+// bumps the counter at the deadline. close() wakes every waiter in all
+// backends. Fifo admission and Direct handoff are CondVar features and are
+// ignored by the other backends.
+//
+// With the CondVar backend and record_wakeups(true), a push that has a
+// sleeping consumer to wake stamps the time, and the woken consumer records
+// how long it took to run again (stats().wakeup). With several pushes in a
+// row the latest stamp is used, so under bursts the delay is underestimated
+// rather than inflated. Off by default: the stamp is a clock read under the
+// mutex on every such push.
+//
+// PopOrder::ShortestWork makes every backend pop the lightest stored item
+// first (QueueStorage); a Direct handoff only happens on an empty queue, so
+// it never overtakes a stored item either way.
+template <typename T>
+class BoundedBlockingQueue {
+public:
+    explicit BoundedBlockingQueue(std::size_t capacity,
+        PushAdmission admission = PushAdmission::Unordered,
+        ConsumerHandoff handoff = ConsumerHandoff::ViaQueue,
+        WaitBackend backend = WaitBackend::CondVar,
+        PopOrder pop_order = PopOrder::Fifo,
+        std::chrono::steady_clock::duration aging = std::chrono::milliseconds{ 50 })
+        : queue_(pop_order, aging),
+          capacity_(std::max<std::size_t>(capacity, 1)),
+          admission_(backend == WaitBackend::CondVar ? admission : PushAdmission::Unordered),
+          handoff_(backend == WaitBackend::CondVar ? handoff : ConsumerHandoff::ViaQueue),
+          backend_(backend),
+          free_slots_(backend == WaitBackend::Semaphore ? static_cast<std::ptrdiff_t>(capacity_) : 0) {
+    }
+
+    BoundedBlockingQueue(const BoundedBlockingQueue&) = delete;
+    BoundedBlockingQueue& operator=(const BoundedBlockingQueue&) = delete;
+
+    bool push(T value) {
+        if (backend_ == WaitBackend::Semaphore) return push_sem(std::move(value), std::nullopt);
+        if (backend_ == WaitBackend::AtomicWait) return push_atomic(std::move(value), std::nullopt);
+
+        std::unique_lock lock(mutex_);
+        if (admission_ == PushAdmission::Fifo) return push_in_line(lock, std::move(value), std::nullopt);
+
+        cv_not_full_.wait(lock, [&] { return closed_ || queue_.size() < capacity_; });
+        return push_locked(lock, std::move(value));
+    }
+
+    template <class Rep, class Period>
+    bool push_for(T value, const std::chrono::duration<Rep, Period>& timeout) {
+        if (backend_ == WaitBackend::Semaphore) return push_sem(std::move(value), deadline_after(timeout));
+        if (backend_ == WaitBackend::AtomicWait) return push_atomic(std::move(value), deadline_after(timeout));
+
+        std::unique_lock lock(mutex_);
+        if (admission_ == PushAdmission::Fifo) return push_in_line(lock, std::move(value), deadline_after(timeout));
+
+        cv_not_full_.wait_for(lock, timeout, [&] { return closed_ || queue_.size() < capacity_; });
+        return push_locked(lock, std::move(value));
+    }
+
+    bool try_pop(T& out) {
+        if (backend_ == WaitBackend::Semaphore) {
+            return items_.try_acquire() && take_sem(out);
+        }
+
+        std::unique_lock lock(mutex_);
+        return pop_locked(lock, out);
+    }
+
+    bool wait_pop(T& out) {
+        if (backend_ == WaitBackend::Semaphore) return pop_sem(out, std::nullopt);
+        if (backend_ == WaitBackend::AtomicWait) return pop_atomic(out, std::nullopt);
+
+        std::unique_lock lock(mutex_);
+        if (handoff_ == ConsumerHandoff::Direct) return pop_or_exchange(lock, out, std::nullopt);
+
+        wait_for_item(lock, std::nullopt);
+        return pop_locked(lock, out);
+    }
+
+    template <class Rep, class Period>
+    bool wait_pop_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
+        if (backend_ == WaitBackend::Semaphore) return pop_sem(out, deadline_after(timeout));
+        if (backend_ == WaitBackend::AtomicWait) return pop_atomic(out, deadline_after(timeout));
+
+        std::unique_lock lock(mutex_);
+        if (handoff_ == ConsumerHandoff::Direct) return pop_or_exchange(lock, out, deadline_after(timeout));
+
+        wait_for_item(lock, deadline_after(timeout));
+        return pop_locked(lock, out);
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex_);
+            closed_ = true;
+            for (auto* slot : parked_) slot->cv.notify_one();
+            for (const auto& slot : idle_) slot->signal(); // filled stays false
+            idle_.clear();
+            for (const auto& slot : space_line_) slot->signal(false);
+            for (const auto& slot : item_line_) slot->signal(false);
+            space_line_.clear();
+            item_line_.clear();
+        }
+        cv_not_empty_.notify_all();
+        cv_not_full_.notify_all();
+
+        // Every waiter counted here gets a token; it sees closed_ after
+        // acquiring it, and a token taken by someone else is passed on.
+        // Waiters not counted yet see closed_ before blocking.
+        if (backend_ == WaitBackend::Semaphore) {
+            free_slots_.release(static_cast<std::ptrdiff_t>(push_waiters_.load()));
+            items_.release(static_cast<std::ptrdiff_t>(pop_waiters_.load()));
+        }
+        if (backend_ == WaitBackend::AtomicWait) {
+            bump(space_seq_, push_waiters_, true);
+            bump(items_seq_, pop_waiters_, true);
+        }
+    }
+
+    bool closed() const {
+        std::lock_guard lock(mutex_);
+        return closed_;
+    }
+
+    bool empty() const {
+        std::lock_guard lock(mutex_);
+        return queue_.empty();
+    }
+
+    std::size_t capacity() const {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+
+    // Changes the bound at runtime. Items above a lowered bound stay; pushes
+    // wait until the queue drains below it. The Semaphore backend's bound is
+    // its token count and cannot be changed: returns false.
+    bool set_capacity(std::size_t capacity) {
+        if (backend_ == WaitBackend::Semaphore) return false;
+        {
+            std::lock_guard lock(mutex_);
+            capacity_.store(std::max<std::size_t>(capacity, 1), std::memory_order_relaxed);
+            wake_line_head();
+        }
+        cv_not_full_.notify_all();
+        if (backend_ == WaitBackend::AtomicWait) bump(space_seq_, push_waiters_, true);
+        return true;
+    }
+
+    std::size_t size() const {
+        std::lock_guard lock(mutex_);
+        return queue_.size();
+    }
+
+    // Stored items as last published by a push or pop; reads no lock, so it
+    // may trail size() by operations still in progress.
+    std::size_t depth() const noexcept {
+        return depth_.load(std::memory_order_relaxed);
+    }
+
+    // stats().push_count as last published by a push; reads no lock either.
+    std::uint64_t pushed() const noexcept {
+        return pushed_.load(std::memory_order_relaxed);
+    }
+
+    QueueStats stats() const {
+        std::unique_lock lock(mutex_);
+        QueueStats st = stats_;
+        lock.unlock();
+
+        st.wakeup = wakeup_.snapshot();
+        return st;
+    }
+
+    void record_wakeups(bool on) {
+        std::lock_guard lock(mutex_);
+        record_wakeups_ = on;
+    }
+
+    // Starts mirroring storage changes into `journal` (nullptr stops it).
+    // Items already stored are assumed to be in the journal, which pops in
+    // FIFO order: throws std::logic_error under PopOrder::ShortestWork.
+    void attach_journal(QueueJournal<T>* journal) {
+        if (journal && queue_.order() != PopOrder::Fifo) {
+            throw std::logic_error("BoundedBlockingQueue: a journal needs PopOrder::Fifo");
+        }
+        std::lock_guard lock(mutex_);
+        journal_.store(journal, std::memory_order_relaxed);
+    }
+
+    PushAdmission admission() const noexcept {
+        return admission_;
+    }
+
+    PopOrder pop_order() const noexcept {
+        return queue_.order();
+    }
+
+    WaitBackend backend() const noexcept {
+        return backend_;
+    }
+
+    ConsumerHandoff handoff() const noexcept {
+        return handoff_;
+    }
+
+    // Consumers currently waiting in a Direct exchange slot.
+    std::size_t idle_consumers() const {
+        std::lock_guard lock(mutex_);
+        return idle_.size();
+    }
+
+    // Producers currently parked in the Fifo waiting line.
+    std::size_t waiting_producers() const {
+        std::lock_guard lock(mutex_);
+        return parked_.size();
+    }
+
+private:
+    using Deadline = std::optional<std::chrono::steady_clock::time_point>;
+
+    template <class Rep, class Period>
+    static std::chrono::steady_clock::time_point deadline_after(const std::chrono::duration<Rep, Period>& timeout) {
+        return std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+    }
+
+    struct ParkingSlot {
+        std::condition_variable cv;
+    };
+
+    struct ExchangeSlot {
+        explicit ExchangeSlot(T& target) : out(target) {}
+
+        // Notifies outside the slot mutex so the woken owner does not block
+        // on it again; the caller's reference keeps the slot alive meanwhile.
+        void signal() {
+            {
+                std::lock_guard lock(mutex);
+                done = true;
+            }
+            cv.notify_one();
+        }
+
+        T& out; // written only while the slot is listed in idle_
+        bool filled = false;
+        std::chrono::steady_clock::time_point filled_at; // set with filled while recording wake-ups
+        bool done = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    using ExchangeSlotPtr = std::shared_ptr<ExchangeSlot>;
+
+    // Either hands the value to the longest-idle consumer (returned, to be
+    // signalled after unlocking) or stores it in the queue.
+    ExchangeSlotPtr store_locked(T&& value) {
+        ++stats_.push_count;
+        pushed_.store(stats_.push_count, std::memory_order_relaxed);
+
+        if (!idle_.empty()) {
+            ExchangeSlotPtr slot = std::move(idle_.front());
+            idle_.pop_front();
+            slot->out = std::move(value);
+            slot->filled = true;
+            if (record_wakeups_) slot->filled_at = std::chrono::steady_clock::now();
+            ++stats_.pop_count;
+            ++stats_.handoff_count;
+            return slot;
+        }
+
+        queue_.push(std::move(value));
+        stats_.max_size = std::max(stats_.max_size, queue_.size());
+        if (record_wakeups_ && sleeping_consumers_ > 0) {
+            notified_at_ = std::chrono::steady_clock::now();
+            ++notify_seq_;
+        }
+        depth_.store(queue_.size(), std::memory_order_relaxed);
+        if (auto* journal = journal_.load(std::memory_order_relaxed)) journal->on_push(queue_.back());
+        return nullptr;
+    }
+
+    // CondVar wait on an empty queue. A push that stamped a notify while we
+    // slept bumps notify_seq_; only such wake-ups are recorded, not timeouts
+    // or spurious ones.
+    void wait_for_item(std::unique_lock<std::mutex>& lock, Deadline deadline) {
+        const auto ready = [&] { return closed_ || !queue_.empty(); };
+        if (ready()) return;
+
+        const std::uint64_t seen = notify_seq_;
+        ++sleeping_consumers_;
+        if (deadline) cv_not_empty_.wait_until(lock, *deadline, ready);
+        else cv_not_empty_.wait(lock, ready);
+        --sleeping_consumers_;
+
+        if (notify_seq_ != seen && !queue_.empty()) {
+            wakeup_.record(std::chrono::steady_clock::now() - notified_at_);
+        }
+    }
+
+    void wake_consumer(const ExchangeSlotPtr& slot) {
+        if (slot) slot->signal();
+        else cv_not_empty_.notify_one();
+    }
+
+    bool push_locked(std::unique_lock<std::mutex>& lock, T&& value) {
+        if (closed_ || queue_.size() >= capacity_) return false;
+
+        const ExchangeSlotPtr consumer = store_locked(std::move(value));
+
+        lock.unlock();
+        wake_consumer(consumer);
+        sync_journal();
+        return true;
+    }
+
+    bool push_in_line(std::unique_lock<std::mutex>& lock,
+        T&& value,
+        Deadline deadline) {
+        if (closed_ || (parked_.empty() && queue_.size() < capacity_)) return push_locked(lock, std::move(value));
+
+        ParkingSlot slot;
+        parked_.push_back(&slot);
+
+        auto admitted = [&] { return closed_ || (parked_.front() == &slot && queue_.size() < capacity_); };
+        if (deadline) slot.cv.wait_until(lock, *deadline, admitted);
+        else slot.cv.wait(lock, admitted);
+
+        // Only the head may take a free slot: a waiter further back that timed
+        // out just leaves, even if there is room, so it never overtakes the
+        // head that was woken for that room and has not run yet.
+        const bool pushed = !closed_ && parked_.front() == &slot && queue_.size() < capacity_;
+        parked_.erase(std::find(parked_.begin(), parked_.end(), &slot));
+
+        const ExchangeSlotPtr consumer = pushed ? store_locked(std::move(value)) : nullptr;
+        wake_line_head(); // there may still be room for the next one in line
+
+        lock.unlock();
+        if (pushed) {
+            wake_consumer(consumer);
+            sync_journal();
+        }
+        return pushed;
+    }
+
+    bool pop_or_exchange(std::unique_lock<std::mutex>& lock,
+        T& out,
+        Deadline deadline) {
+        if (closed_ || !queue_.empty()) return pop_locked(lock, out);
+
+        const auto slot = std::make_shared<ExchangeSlot>(out);
+        idle_.push_back(slot);
+        lock.unlock();
+
+        std::unique_lock slot_lock(slot->mutex);
+        const auto done = [&] { return slot->done; };
+        if (!deadline) slot->cv.wait(slot_lock, done);
+        else if (!slot->cv.wait_until(slot_lock, *deadline, done)) {
+            slot_lock.unlock(); // never hold a slot mutex while taking mutex_
+
+            lock.lock();
+            const auto it = std::find(idle_.begin(), idle_.end(), slot);
+            if (it != idle_.end()) {
+                idle_.erase(it);
+                return pop_locked(lock, out);
+            }
+            lock.unlock();
+
+            // A producer or close() took the slot just as we timed out and
+            // may already have written `out`: wait for its signal.
+            slot_lock.lock();
+            slot->cv.wait(slot_lock, done);
+        }
+
+        if (slot->filled && slot->filled_at != std::chrono::steady_clock::time_point{}) {
+            wakeup_.record(std::chrono::steady_clock::now() - slot->filled_at);
+        }
+        return slot->filled;
+    }
+
+    // Called under the lock: slots live on their owners' stacks and may be
+    // gone as soon as the mutex is released.
+    void wake_line_head() {
+        if (!parked_.empty() && queue_.size() < capacity_) parked_.front()->cv.notify_one();
+    }
+
+    // Semaphore backend, timed waits: a waiter that finds no token lines up
+    // in a TokenSlot, and a release under the mutex hands its token to the
+    // oldest slot before the semaphore. Untimed waiters block in the
+    // semaphore itself and are served once no timed waiter is lined up.
+    struct TokenSlot {
+        // Notifies outside the slot mutex, like ExchangeSlot::signal().
+        void signal(bool grant) {
+            {
+                std::lock_guard lock(mutex);
+                granted = grant;
+                done = true;
+            }
+            cv.notify_one();
+        }
+
+        bool granted = false;
+        bool done = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    using TokenSlotPtr = std::shared_ptr<TokenSlot>;
+
+    // Called under the lock. Releasing to the semaphore under the lock too
+    // keeps a timed waiter from lining up between the check and the release.
+    TokenSlotPtr release_token_locked(std::counting_semaphore<>& sem, std::deque<TokenSlotPtr>& line) {
+        if (line.empty()) {
+            sem.release();
+            return nullptr;
+        }
+        TokenSlotPtr slot = std::move(line.front());
+        line.pop_front();
+        return slot;
+    }
+
+    // One token of `sem`, or false on timeout or once closed. An untimed
+    // waiter registers under the mutex, and close() reads the counts after
+    // setting closed_ under the same mutex, so it is either counted or sees
+    // the close.
+    bool acquire_token(std::counting_semaphore<>& sem,
+        std::deque<TokenSlotPtr>& line,
+        std::atomic<std::size_t>& waiters,
+        Deadline deadline) {
+        if (sem.try_acquire()) return true;
+
+        std::unique_lock lock(mutex_);
+        if (closed_) return false;
+        if (!deadline) {
+            waiters.fetch_add(1);
+            lock.unlock();
+            sem.acquire();
+            waiters.fetch_sub(1);
+            return true;
+        }
+        if (sem.try_acquire()) return true; // released before we took the lock
+
+        const auto slot = std::make_shared<TokenSlot>();
+        line.push_back(slot);
+        lock.unlock();
+
+        std::unique_lock slot_lock(slot->mutex);
+        const auto done = [&] { return slot->done; };
+        if (!slot->cv.wait_until(slot_lock, *deadline, done)) {
+            slot_lock.unlock(); // never hold a slot mutex while taking mutex_
+
+            lock.lock();
+            const auto it = std::find(line.begin(), line.end(), slot);
+            if (it != line.end()) {
+                line.erase(it);
+                return false;
+            }
+            lock.unlock();
+
+            // A release or close() took the slot just as we timed out.
+            slot_lock.lock();
+            slot->cv.wait(slot_lock, done);
+        }
+        return slot->granted;
+    }
+
+    bool push_sem(T&& value, Deadline deadline) {
+        if (!acquire_token(free_slots_, space_line_, push_waiters_, deadline)) return false;
+
+        std::unique_lock lock(mutex_);
+        if (closed_) {
+            free_slots_.release(); // may be one of close()'s: pass it on to a blocked pusher
+            return false;
+        }
+        (void)store_locked(std::move(value));
+        const TokenSlotPtr popper = release_token_locked(items_, item_line_);
+        lock.unlock();
+
+        if (popper) popper->signal(true);
+        sync_journal();
+        return true;
+    }
+
+    // After close every queued item already has a token, so a popper that
+    // gets none finds the queue drained by the others.
+    bool pop_sem(T& out, Deadline deadline) {
+        return acquire_token(items_, item_line_, pop_waiters_, deadline) && take_sem(out);
+    }
+
+    // Holding an item token. After close() the token may carry no item; it
+    // is passed on, since whoever took it may not be the waiter close()
+    // released it for.
+    bool take_sem(T& out) {
+        std::unique_lock lock(mutex_);
+        if (queue_.empty()) {
+            items_.release();
+            return false;
+        }
+
+        if (queue_.pop(out)) ++stats_.aged_pops;
+        ++stats_.pop_count;
+        depth_.store(queue_.size(), std::memory_order_relaxed);
+        if (auto* journal = journal_.load(std::memory_order_relaxed)) journal->on_pop();
+        const TokenSlotPtr pusher = release_token_locked(free_slots_, space_line_);
+        lock.unlock();
+
+        if (pusher) pusher->signal(true);
+        sync_journal();
+        return true;
+    }
+
+    // AtomicWait backend. The counter value is read under the mutex before
+    // sleeping and bumped after the state change, so a change between the
+    // unlock and the wait is never missed.
+    bool push_atomic(T&& value, Deadline deadline) {
+        std::unique_lock lock(mutex_);
+        while (!closed_ && queue_.size() >= capacity_) {
+            const auto seen = space_seq_.load();
+            lock.unlock();
+            const bool changed = await_change(space_seq_, push_waiters_, seen, deadline);
+            lock.lock();
+            if (!changed) break;
+        }
+        if (closed_ || queue_.size() >= capacity_) return false;
+
+        (void)store_locked(std::move(value));
+        lock.unlock();
+
+        bump(items_seq_, pop_waiters_, false);
+        sync_journal();
+        return true;
+    }
+
+    bool pop_atomic(T& out, Deadline deadline) {
+        std::unique_lock lock(mutex_);
+        while (!closed_ && queue_.empty()) {
+            const auto seen = items_seq_.load();
+            lock.unlock();
+            const bool changed = await_change(items_seq_, pop_waiters_, seen, deadline);
+            lock.lock();
+            if (!changed) break;
+        }
+        return pop_locked(lock, out);
+    }
+
+    // True once `seq` moved on from `seen`, false only if the deadline had
+    // already passed. The waker's bump at the deadline looks like any other
+    // event: the caller re-checks and comes back here to find it expired.
+    static bool await_change(std::atomic<std::uint32_t>& seq,
+        std::atomic<std::size_t>& waiters,
+        std::uint32_t seen,
+        Deadline deadline) {
+        if (deadline && std::chrono::steady_clock::now() >= *deadline) return false;
+
+        std::optional<DeadlineWaker::Timer> timer;
+        if (deadline) timer = DeadlineWaker::instance().arm(seq, *deadline);
+        waiters.fetch_add(1);
+        seq.wait(seen);
+        waiters.fetch_sub(1);
+        if (timer) DeadlineWaker::instance().disarm(*timer);
+        return true;
+    }
+
+    static void bump(std::atomic<std::uint32_t>& seq, const std::atomic<std::size_t>& waiters, bool all) {
+        seq.fetch_add(1);
+        if (waiters.load() == 0) return;
+        if (all) seq.notify_all();
+        else seq.notify_one();
+    }
+
+    bool pop_locked(std::unique_lock<std::mutex>& lock, T& out) {
+        if (queue_.empty()) return false;
+
+        if (queue_.pop(out)) ++stats_.aged_pops;
+        ++stats_.pop_count;
+        depth_.store(queue_.size(), std::memory_order_relaxed);
+        if (auto* journal = journal_.load(std::memory_order_relaxed)) journal->on_pop();
+
+        if (backend_ == WaitBackend::AtomicWait) {
+            lock.unlock();
+            bump(space_seq_, push_waiters_, false);
+        }
+        else if (admission_ == PushAdmission::Fifo) {
+            wake_line_head();
+            lock.unlock();
+        }
+        else {
+            lock.unlock();
+            cv_not_full_.notify_one();
+        }
+        sync_journal();
+        return true;
+    }
+
+    // Called after unlocking by every operation that may have called a
+    // journal hook.
+    void sync_journal() noexcept {
+        if (auto* journal = journal_.load(std::memory_order_acquire)) journal->sync();
+    }
+
+    QueueStorage<T> queue_;
+    std::atomic<std::size_t> capacity_; // changed under mutex_, read unlocked by capacity()
+    PushAdmission admission_;
+    ConsumerHandoff handoff_;
+    bool closed_ = false;
+    QueueStats stats_;
+    std::deque<ParkingSlot*> parked_; // Fifo waiting line, head is served next
+    std::deque<ExchangeSlotPtr> idle_; // Direct handoff: consumers waiting on an empty queue
+    WaitBackend backend_;
+    std::atomic<QueueJournal<T>*> journal_{ nullptr }; // set under mutex_, read unlocked by sync_journal()
+    std::atomic<std::size_t> depth_{ 0 }; // queue_.size(), readable without the mutex
+    std::atomic<std::uint64_t> pushed_{ 0 }; // stats_.push_count, likewise
+
+    // Wake-up delay instrumentation (CondVar backend).
+    bool record_wakeups_ = false;
+    std::size_t sleeping_consumers_ = 0; // in wait_for_item
+    std::uint64_t notify_seq_ = 0;
+    std::chrono::steady_clock::time_point notified_at_;
+    AtomicLatencyHistogram wakeup_;
+
+    // Semaphore and AtomicWait backends.
+    std::counting_semaphore<> free_slots_;
+    std::counting_semaphore<> items_{ 0 };
+    std::atomic<std::uint32_t> space_seq_{ 0 };
+    std::atomic<std::uint32_t> items_seq_{ 0 };
+    std::atomic<std::size_t> push_waiters_{ 0 }; // Semaphore: untimed waiters only; AtomicWait: all
+    std::atomic<std::size_t> pop_waiters_{ 0 };
+    std::deque<TokenSlotPtr> space_line_; // Semaphore: timed pushers waiting for a free slot
+    std::deque<TokenSlotPtr> item_line_;  // Semaphore: timed poppers waiting for an item
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_not_empty_;
+    std::condition_variable cv_not_full_;
+};
+
+// Stage 04: bounded queue with blocking and non-blocking operations.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity)
+        : capacity_(std::max<std::size_t>(capacity, 1)) {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool push(T value) {
+        std::unique_lock lock(mutex_);
+        cv_not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+        return push_locked(lock, std::move(value));
+    }
+
+    bool try_push(T value) {
+        std::unique_lock lock(mutex_);
+        return push_locked(lock, std::move(value));
+    }
+
+    template <class Rep, class Period>
+    bool push_for(T value, const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock lock(mutex_);
+        cv_not_full_.wait_for(lock, timeout, [&] { return closed_ || items_.size() < capacity_; });
+        return push_locked(lock, std::move(value));
+    }
+
+    bool pop(T& out) {
+        std::unique_lock lock(mutex_);
+        cv_not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+        return pop_locked(lock, out);
+    }
+
+    bool wait_pop(T& out) {
+        return pop(out);
+    }
+
+    template <class Rep, class Period>
+    bool wait_pop_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock lock(mutex_);
+        cv_not_empty_.wait_for(lock, timeout, [&] { return closed_ || !items_.empty(); });
+        return pop_locked(lock, out);
+    }
+
+    bool try_pop(T& out) {
+        std::unique_lock lock(mutex_);
+        return pop_locked(lock, out);
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex_);
+            closed_ = true;
+        }
+        cv_not_empty_.notify_all();
+        cv_not_full_.notify_all();
+    }
+
+    bool closed() const {
+        std::lock_guard lock(mutex_);
+        return closed_;
+    }
+
+    std::size_t size() const {
+        std::lock_guard lock(mutex_);
+        return items_.size();
+    }
+
+    std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+private:
+    bool push_locked(std::unique_lock<std::mutex>& lock, T&& value) {
+        if (closed_ || items_.size() >= capacity_) return false;
+        items_.push_back(std::move(value));
+        lock.unlock();
+        cv_not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop_locked(std::unique_lock<std::mutex>& lock, T& out) {
+        if (items_.empty()) return false;
+        out = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        cv_not_full_.notify_one();
+        return true;
+    }
+
+    std::deque<T> items_;
+    std::size_t capacity_;
+    bool closed_ = false;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_not_empty_;
+    std::condition_variable cv_not_full_;
+};
+
+// What a pipeline stage needs from the queue in front of it: push blocks
+// while the queue is full and push_for gives up after the timeout; wait_pop
+// blocks while it is empty and wait_pop_for gives up after the timeout;
+// close() wakes every waiter, after it pushes return false and pops drain
+// what is left, then return false. Items come out in push order (or in the
+// configured PopOrder) and none is lost or duplicated. The conformance tests
+// and ops_bench_backends are written against this concept only.
+template <typename Q, typename T>
+concept BoundedQueueBackend = requires(Q& q, T value, T& out, std::chrono::milliseconds timeout) {
+    { q.push(std::move(value)) } -> std::same_as<bool>;
+    { q.push_for(std::move(value), timeout) } -> std::same_as<bool>;
+    { q.wait_pop(out) } -> std::same_as<bool>;
+    { q.wait_pop_for(out, timeout) } -> std::same_as<bool>;
+    q.close();
+    { std::as_const(q).size() } -> std::convertible_to<std::size_t>;
+};
+
+static_assert(BoundedQueueBackend<BoundedBlockingQueue<Order>, Order>);
+static_assert(BoundedQueueBackend<BoundedQueue<Order>, Order>);
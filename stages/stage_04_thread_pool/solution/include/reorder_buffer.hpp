@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "order.hpp"
+
+struct ReorderStats {
+    std::uint64_t released = 0;     // handed to the sink
+    std::uint64_t skipped = 0;      // numbered, then refused or abandoned
+    std::uint64_t window_waits = 0; // admit() calls that found the window full
+    std::size_t depth = 0;          // delivered orders held for an earlier one now
+    std::size_t max_depth = 0;
+    LatencyHistogram wait;          // delivered -> released (head-of-line wait)
+};
+
+// Puts delivered orders back into submit order.
+//
+// admit() numbers orders 1, 2, 3, ... as they are accepted, but only while
+// fewer than `window` numbered orders are unreleased; beyond that it waits,
+// which is the backpressure. Every number then comes back exactly once:
+// release() for a delivered order, skip() for one that was never delivered.
+// As soon as the lowest outstanding number is back, the complete prefix
+// goes to the sink in order.
+//
+// The sink runs outside the lock, on one thread at a time: a thread that
+// completes the prefix while another is emitting leaves the orders to it.
+class ReorderBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Sink = std::function<void(const Order&)>;
+
+    ReorderBuffer(std::size_t window, Sink sink);
+
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+
+    // The next sequence number, or 0 when the window stayed full until
+    // `deadline` or the buffer was closed.
+    std::uint64_t admit(Clock::time_point deadline);
+
+    void release(const Order& order); // order.seq from admit()
+    void skip(std::uint64_t seq);
+
+    // Wakes and refuses every admit(), now and later.
+    void close() noexcept;
+
+    // Emits whatever is held, in order, passing over numbers that never came
+    // back. For after the workers are gone; returns the orders emitted.
+    std::size_t flush();
+
+    ReorderStats stats() const;
+
+    std::size_t window() const noexcept {
+        return slots_.size();
+    }
+
+private:
+    enum class Slot : std::uint8_t { Empty, Pending, Delivered, Skipped };
+
+    struct Entry {
+        Slot slot = Slot::Empty;
+        std::optional<Order> order;
+    };
+
+    Entry& entry(std::uint64_t seq) noexcept {
+        return slots_[seq % slots_.size()];
+    }
+
+    void emit(std::unique_lock<std::mutex>& lock, bool past_holes);
+
+    Sink sink_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable window_cv_; // admit() waiting for the head to move
+    std::vector<Entry> slots_;
+    std::uint64_t head_ = 1; // lowest number not yet released or skipped
+    std::uint64_t next_ = 1; // next number admit() hands out
+    bool emitting_ = false;
+    bool closed_ = false;
+    ReorderStats stats_;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Compressed bitmap of 64-bit ids in the style of Roaring: ids are split into
+// a 48-bit key and a 16-bit low part; each key owns a container that is a
+// sorted uint16 array while sparse and a 65536-bit bitset once it holds more
+// than kArrayMax values.
+//
+// Containers are shared between copies and cloned on first write, so a copy
+// is O(number of containers) and serves as a cheap point-in-time snapshot.
+// Ownership is decided by a frozen flag rather than by use_count(): copying
+// freezes every shared container without touching the source bitmap itself,
+// and a frozen container is cloned before it is written. use_count() only
+// settles the case where every copy is gone, and the container is then
+// unfrozen and written in place, so a dropped snapshot costs no clones. A
+// single bitmap is not thread-safe; copies may be read while the original
+// is modified by another thread as long as copying and modification are
+// serialized by the caller. Copying the same bitmap from several threads
+// at once is safe.
+class RoaringBitmap {
+public:
+    static constexpr std::size_t kArrayMax = 4096;
+
+    RoaringBitmap() noexcept = default;
+    RoaringBitmap(const RoaringBitmap& other);
+    RoaringBitmap& operator=(const RoaringBitmap& other);
+    RoaringBitmap(RoaringBitmap&&) noexcept = default;
+    RoaringBitmap& operator=(RoaringBitmap&&) noexcept = default;
+
+    bool add(std::uint64_t id);
+    bool remove(std::uint64_t id);
+    bool contains(std::uint64_t id) const noexcept;
+
+    std::uint64_t cardinality() const noexcept { return cardinality_; }
+    bool empty() const noexcept { return cardinality_ == 0; }
+    std::size_t container_count() const noexcept { return entries_.size(); }
+
+    void clear() noexcept;
+
+    static RoaringBitmap intersect(const RoaringBitmap& a, const RoaringBitmap& b);
+    static std::uint64_t intersect_cardinality(const RoaringBitmap& a, const RoaringBitmap& b);
+
+    // Calls fn(id) for every id in ascending order.
+    template <class F>
+    void for_each(F&& fn) const;
+
+    std::vector<std::uint64_t> to_vector() const;
+
+private:
+    struct Container {
+        std::vector<std::uint16_t> array; // sorted, used while !bitset
+        std::vector<std::uint64_t> words; // 1024 words once converted
+        std::uint32_t cardinality = 0;
+        std::atomic<bool> frozen{ false }; // shared by a copy; clone before writing
+
+        Container() = default;
+        Container(const Container& other); // an unfrozen clone
+        Container(Container&& other) noexcept;
+
+        bool is_bitset() const noexcept { return !words.empty(); }
+        bool contains(std::uint16_t low) const noexcept;
+        bool add(std::uint16_t low);
+        bool remove(std::uint16_t low);
+        void to_bitset();
+        void to_array();
+
+        template <class F>
+        void for_each(std::uint64_t base, F& fn) const;
+    };
+
+    struct Entry {
+        std::uint64_t key;
+        std::shared_ptr<Container> container;
+    };
+
+    static std::uint64_t key_of(std::uint64_t id) noexcept { return id >> 16; }
+    static std::uint16_t low_of(std::uint64_t id) noexcept { return static_cast<std::uint16_t>(id & 0xFFFF); }
+
+    std::size_t find(std::uint64_t key) const noexcept; // lower bound
+    Container& writable(std::size_t pos);
+
+    static Container intersect(const Container& a, const Container& b);
+    static std::uint32_t intersect_cardinality(const Container& a, const Container& b);
+
+    std::vector<Entry> entries_; // sorted by key
+    std::uint64_t cardinality_ = 0;
+};
+
+template <class F>
+void RoaringBitmap::Container::for_each(std::uint64_t base, F& fn) const {
+    if (!is_bitset()) {
+        for (const auto low : array) fn(base | low);
+        return;
+    }
+    for (std::size_t w = 0; w < words.size(); ++w) {
+        std::uint64_t word = words[w];
+        while (word != 0) {
+            const int bit = std::countr_zero(word);
+            fn(base | (w * 64 + static_cast<std::uint64_t>(bit)));
+            word &= word - 1;
+        }
+    }
+}
+
+template <class F>
+void RoaringBitmap::for_each(F&& fn) const {
+    for (const auto& e : entries_) e.container->for_each(e.key << 16, fn);
+}
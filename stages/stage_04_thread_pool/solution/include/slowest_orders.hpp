@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "order.hpp"
+
+// One delivered order kept by SlowestOrders, with everything needed to see
+// where its time went and which workers it passed through.
+struct SlowOrder {
+    OrderId id = 0;
+    std::chrono::nanoseconds lead_time{ 0 };
+
+    std::chrono::steady_clock::time_point accepted_time;
+    std::chrono::steady_clock::time_point prepared_time;
+    std::chrono::steady_clock::time_point packed_time;
+    std::chrono::steady_clock::time_point delivered_time;
+
+    std::uint16_t prepared_by = 0;
+    std::uint16_t packed_by = 0;
+    std::uint16_t delivered_by = 0;
+};
+
+// The K delivered orders with the highest lead time.
+//
+// Each delivering worker owns a shard: a min-heap of at most K entries and
+// the lead time at its root. An order at or below that threshold is
+// dropped after one comparison, without touching the shard's mutex, which
+// is only taken to change the heap or to copy it. A snapshot merges the
+// shards and keeps the overall K slowest.
+class SlowestOrders {
+public:
+    SlowestOrders(std::size_t k, std::size_t shards);
+
+    // Called only by the worker that owns `shard`.
+    void offer(std::size_t shard, const Order& order) {
+        Shard& s = *shards_[shard];
+        const auto lead = order.delivered_time - order.accepted_time;
+        if (s.full && lead <= s.threshold) return;
+        insert(s, order, lead);
+    }
+
+    // Slowest first.
+    std::vector<SlowOrder> snapshot() const;
+
+    std::size_t k() const noexcept {
+        return k_;
+    }
+
+private:
+    struct alignas(64) Shard {
+        // Owner-only, read without the lock.
+        bool full = false;
+        std::chrono::steady_clock::duration threshold{ 0 };
+
+        mutable std::mutex mutex; // heap
+        std::vector<SlowOrder> heap;
+    };
+
+    void insert(Shard& s, const Order& order, std::chrono::steady_clock::duration lead);
+
+    std::size_t k_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "order.hpp"
+#include "roaring_bitmap.hpp"
+
+inline constexpr std::size_t kOrderStatusCount = 6;
+
+// Point-in-time copy of the census; cheap to take and safe to read while
+// the pipeline keeps running. Delivered orders are only counted, so the
+// Delivered bitmap stays empty.
+struct StatusSnapshot {
+    std::array<RoaringBitmap, kOrderStatusCount> by_status;
+    std::uint64_t delivered = 0;
+
+    const RoaringBitmap& operator[](OrderStatus s) const noexcept {
+        return by_status[static_cast<std::size_t>(s)];
+    }
+
+    std::uint64_t count(OrderStatus s) const noexcept {
+        return s == OrderStatus::Delivered ? delivered : (*this)[s].cardinality();
+    }
+};
+
+// Set of order ids per OrderStatus, one compressed bitmap each.
+//
+// Updates carry only the new status and are applied with "furthest status
+// wins" semantics (Accepted < Prepared < Packed < Delivered/Canceled), so
+// batches from different threads may be applied in any order. Workers
+// collect updates in a local Batch and apply it under one lock; producers
+// go through striped buffers. A snapshot flushes the stripes and copies the
+// bitmaps copy-on-write, so the lock is held for O(containers), not O(ids).
+//
+// Delivered ids leave the bitmaps and only add to a count, which keeps the
+// census as large as the orders in flight. Every delivered order reports
+// Accepted, Prepared and Packed first, so an id that overtook some of them
+// is remembered with the ones still missing until they arrive and are
+// dropped. A cancel may come after any step, so canceled ids keep their
+// bitmap to turn late updates away; they only come from forced stops and
+// deadlines.
+class StatusCensus {
+public:
+    struct Update {
+        OrderId id;
+        OrderStatus status;
+    };
+
+    using Batch = std::vector<Update>;
+
+    static constexpr std::size_t kBatchSize = 256;
+
+    void apply(const Batch& batch);
+
+    // Thread-safe single update for callers without their own Batch.
+    void record(OrderId id, OrderStatus status);
+
+    StatusSnapshot snapshot();
+
+private:
+    static constexpr std::size_t kStripes = 16;
+
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        Batch pending;
+    };
+
+    void apply_locked(const Update& u);
+    void flush_stripes();
+
+    std::array<Stripe, kStripes> stripes_;
+
+    std::mutex mutex_;
+    StatusSnapshot state_;
+    std::unordered_map<OrderId, std::uint8_t> missing_; // steps not seen yet, by rank bit; kRetired once delivered
+};
@@ -0,0 +1,34 @@
+// Sends one command to a Pipeline's AdminServer socket and prints the reply.
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "admin_server.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: ops_admin <socket_path> <metrics|depths|pause|resume|workers P K D|capacity I P K|shutdown>\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    std::string command = argv[2];
+    for (int i = 3; i < argc; ++i) command += std::string(" ") + argv[i];
+
+    try {
+        const std::string reply = AdminServer::request(argv[1], command);
+        std::cout << reply << "\n";
+        return reply.rfind("OK", 0) == 0 ? 0 : 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,237 @@
+#include "admin_server.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr int kPollMs = 100;             // how often the admin thread checks for stop
+    constexpr std::size_t kMaxLine = 256;    // longer command lines drop the client
+
+    const char* state_name(PipelineState s) {
+        switch (s) {
+        case PipelineState::Created:  return "Created";
+        case PipelineState::Running:  return "Running";
+        case PipelineState::Draining: return "Draining";
+        case PipelineState::Stopped:  return "Stopped";
+        case PipelineState::Failed:   return "Failed";
+        }
+        return "?";
+    }
+
+    // Exactly three positive counts, nothing after them.
+    bool read_three(std::istringstream& in, std::size_t (&out)[3]) {
+        for (auto& v : out) {
+            long long n = 0;
+            if (!(in >> n) || n <= 0) return false;
+            v = static_cast<std::size_t>(n);
+        }
+        std::string extra;
+        return !(in >> extra);
+    }
+
+#if !defined(_WIN32)
+    sockaddr_un address_of(const std::string& path) {
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("AdminServer: bad socket path '" + path + "'");
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return addr;
+    }
+
+    bool send_all(int fd, const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+} // namespace
+
+AdminServer::AdminServer(Pipeline& pipeline, std::string socket_path)
+    : pipeline_(pipeline),
+      path_(std::move(socket_path)) {
+}
+
+AdminServer::~AdminServer() {
+    stop();
+}
+
+std::string AdminServer::execute(const std::string& line) {
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+
+    if (cmd == "metrics") {
+        const Metrics m = pipeline_.metrics();
+        std::ostringstream out;
+        out << "OK accepted=" << m.accepted_count
+            << " prepared=" << m.prepared_count
+            << " packed=" << m.packed_count
+            << " delivered=" << m.delivered_count
+            << " submit_timeouts=" << m.submit_timeout_count
+            << " in_flight=" << pipeline_.in_flight()
+            << " state=" << state_name(pipeline_.state());
+        return out.str();
+    }
+    if (cmd == "depths") {
+        const auto d = pipeline_.queue_depths();
+        std::ostringstream out;
+        out << "OK q_in=" << d[0] << " q_prepare=" << d[1] << " q_pack=" << d[2];
+        return out.str();
+    }
+    if (cmd == "pause") return pipeline_.pause() ? "OK" : "ERR cannot pause";
+    if (cmd == "resume") return pipeline_.resume() ? "OK" : "ERR cannot resume";
+    if (cmd == "workers") {
+        std::size_t n[3]{};
+        if (!read_three(in, n)) return "ERR usage: workers <prepare> <pack> <deliver>";
+        if (pipeline_.set_workers(n[0], n[1], n[2])) return "OK";
+        return pipeline_.state() == PipelineState::Running ? "ERR workers rejected" : "ERR busy";
+    }
+    if (cmd == "capacity") {
+        std::size_t n[3]{};
+        if (!read_three(in, n)) return "ERR usage: capacity <q_in> <q_prepare> <q_pack>";
+        return pipeline_.set_capacities(n[0], n[1], n[2]) ? "OK" : "ERR capacity rejected";
+    }
+    if (cmd == "shutdown") {
+        return pipeline_.begin_shutdown() ? "OK" : "ERR busy";
+    }
+    return "ERR unknown command '" + cmd + "'";
+}
+
+#if defined(_WIN32)
+
+void AdminServer::start() {
+    throw std::runtime_error("AdminServer: Unix domain sockets are not supported on this platform");
+}
+
+void AdminServer::stop() noexcept {
+}
+
+std::string AdminServer::request(const std::string&, const std::string&) {
+    throw std::runtime_error("AdminServer: Unix domain sockets are not supported on this platform");
+}
+
+void AdminServer::serve(const std::stop_token&) {
+}
+
+void AdminServer::serve_client(int, const std::stop_token&) {
+}
+
+#else
+
+void AdminServer::start() {
+    if (thread_.joinable()) return;
+
+    const sockaddr_un addr = address_of(path_);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("AdminServer: socket() failed");
+
+    ::unlink(path_.c_str());
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 4) != 0) {
+        ::close(fd);
+        throw std::runtime_error("AdminServer: cannot listen on " + path_);
+    }
+
+    listen_fd_ = fd;
+    thread_ = std::jthread([this](std::stop_token st) { serve(st); });
+}
+
+void AdminServer::stop() noexcept {
+    if (!thread_.joinable()) return;
+    thread_.request_stop();
+    thread_.join();
+
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    ::unlink(path_.c_str());
+}
+
+// Polls with a timeout instead of blocking in accept()/recv(), so stop()
+// never has to interrupt a system call.
+void AdminServer::serve(const std::stop_token& st) {
+    while (!st.stop_requested()) {
+        pollfd p{ listen_fd_, POLLIN, 0 };
+        if (::poll(&p, 1, kPollMs) <= 0) continue;
+
+        const int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        serve_client(client, st);
+        ::close(client);
+    }
+}
+
+void AdminServer::serve_client(int fd, const std::stop_token& st) {
+    std::string pending;
+    char buf[256];
+
+    while (!st.stop_requested()) {
+        pollfd p{ fd, POLLIN, 0 };
+        const int ready = ::poll(&p, 1, kPollMs);
+        if (ready < 0 && errno != EINTR) return;
+        if (ready <= 0) continue;
+
+        const auto n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        pending.append(buf, static_cast<std::size_t>(n));
+
+        for (auto eol = pending.find('\n'); eol != std::string::npos; eol = pending.find('\n')) {
+            std::string line = pending.substr(0, eol);
+            pending.erase(0, eol + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+
+            std::string reply;
+            try {
+                reply = execute(line);
+            }
+            catch (const std::exception& e) {
+                reply = std::string("ERR ") + e.what();
+            }
+            if (!send_all(fd, reply + "\n")) return;
+        }
+        if (pending.size() > kMaxLine) return;
+    }
+}
+
+std::string AdminServer::request(const std::string& socket_path, const std::string& command) {
+    const sockaddr_un addr = address_of(socket_path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("AdminServer: socket() failed");
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || !send_all(fd, command + "\n")) {
+        ::close(fd);
+        throw std::runtime_error("AdminServer: cannot reach " + socket_path);
+    }
+
+    std::string reply;
+    char c = 0;
+    for (;;) {
+        const auto n = ::recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || c == '\n') break;
+        reply.push_back(c);
+    }
+    ::close(fd);
+    return reply;
+}
+
+#endif
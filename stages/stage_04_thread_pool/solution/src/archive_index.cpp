@@ -0,0 +1,128 @@
+#include "archive_index.hpp"
+
+#include <algorithm>
+
+SparseBlockIndex::SparseBlockIndex(std::size_t block_size)
+    : block_size_(std::max<std::size_t>(block_size, 1)) {
+}
+
+void SparseBlockIndex::Column::add(std::uint64_t key, bool new_block) {
+    if (new_block) {
+        min.push_back(key);
+        max.push_back(key);
+        prefix_max.push_back(prefix_max.empty() ? key : std::max(prefix_max.back(), key));
+    }
+    else {
+        min.back() = std::min(min.back(), key);
+        max.back() = std::max(max.back(), key);
+        prefix_max.back() = std::max(prefix_max.back(), key);
+    }
+
+    // The last block is always a step. Steps it now undercuts bound no suffix
+    // any more; each block is pushed and popped at most once.
+    const std::size_t b = min.size() - 1;
+    if (!step_block.empty() && step_block.back() == b) {
+        step_block.pop_back();
+        step_min.pop_back();
+    }
+    while (!step_min.empty() && step_min.back() >= min.back()) {
+        step_block.pop_back();
+        step_min.pop_back();
+    }
+    step_block.push_back(b);
+    step_min.push_back(min.back());
+}
+
+void SparseBlockIndex::append(const Order& o) {
+    const bool new_block = size_ % block_size_ == 0;
+
+    columns_[0].add(order_key(o, OrderKey::Id), new_block);
+    columns_[1].add(order_key(o, OrderKey::AcceptedTime), new_block);
+    columns_[2].add(order_key(o, OrderKey::DeliveredTime), new_block);
+
+    ++size_;
+}
+
+void SparseBlockIndex::clear() noexcept {
+    for (auto& c : columns_) {
+        c.min.clear();
+        c.max.clear();
+        c.prefix_max.clear();
+        c.step_block.clear();
+        c.step_min.clear();
+    }
+    size_ = 0;
+}
+
+std::size_t SparseBlockIndex::block_count() const noexcept {
+    return columns_[0].min.size();
+}
+
+const SparseBlockIndex::Column& SparseBlockIndex::column(OrderKey key) const noexcept {
+    switch (key) {
+    case OrderKey::AcceptedTime:  return columns_[1];
+    case OrderKey::DeliveredTime: return columns_[2];
+    case OrderKey::Id:
+    default:                      return columns_[0];
+    }
+}
+
+std::vector<SparseBlockIndex::Range> SparseBlockIndex::candidate_ranges(OrderKey key,
+    std::uint64_t lo,
+    std::uint64_t hi) const {
+    std::vector<Range> ranges;
+    if (lo > hi || size_ == 0) return ranges;
+
+    const Column& c = column(key);
+
+    // Blocks before `first` only hold keys < lo, blocks from `last` on only keys > hi.
+    const auto first = static_cast<std::size_t>(
+        std::lower_bound(c.prefix_max.begin(), c.prefix_max.end(), lo) - c.prefix_max.begin());
+    // Every block up to the last step with min <= hi may hold a key <= hi.
+    const auto steps = static_cast<std::size_t>(
+        std::upper_bound(c.step_min.begin(), c.step_min.end(), hi) - c.step_min.begin());
+    const std::size_t last = steps == 0 ? 0 : c.step_block[steps - 1] + 1;
+
+    for (std::size_t b = first; b < last; ++b) {
+        if (c.max[b] < lo || c.min[b] > hi) continue;
+
+        const std::size_t begin = b * block_size_;
+        const std::size_t end = std::min(begin + block_size_, size_);
+
+        if (!ranges.empty() && ranges.back().second == begin) ranges.back().second = end;
+        else ranges.emplace_back(begin, end);
+    }
+
+    return ranges;
+}
+
+std::vector<std::size_t> find_in_range(std::span<const Order> archive,
+    const SparseBlockIndex& index,
+    OrderKey key,
+    std::uint64_t lo,
+    std::uint64_t hi) {
+    std::vector<std::size_t> out;
+
+    for (const auto& [begin, end] : index.candidate_ranges(key, lo, hi)) {
+        const std::size_t stop = std::min(end, archive.size());
+        for (std::size_t i = begin; i < stop; ++i) {
+            const std::uint64_t k = order_key(archive[i], key);
+            if (k >= lo && k <= hi) out.push_back(i);
+        }
+    }
+
+    return out;
+}
+
+std::optional<std::size_t> find_by_id(std::span<const Order> archive,
+    const SparseBlockIndex& index,
+    OrderId id) {
+    const auto key = static_cast<std::uint64_t>(id);
+    for (const auto& [begin, end] : index.candidate_ranges(OrderKey::Id, key, key)) {
+        const std::size_t stop = std::min(end, archive.size());
+        for (std::size_t i = begin; i < stop; ++i) {
+            if (archive[i].id == id) return i;
+        }
+    }
+    return std::nullopt;
+}
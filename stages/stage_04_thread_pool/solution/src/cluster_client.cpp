@@ -0,0 +1,176 @@
+#include "cluster_client.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+ClusterClient::ClusterClient(std::size_t batch_size, std::size_t vnodes, std::chrono::milliseconds reply_timeout)
+    : batch_size_(std::clamp<std::size_t>(batch_size, 1, ClusterWire::kMaxBatch)),
+      reply_timeout_(reply_timeout),
+      ring_(vnodes) {
+}
+
+ClusterClient::~ClusterClient() {
+    for (auto& [name, link] : links_) ClusterWire::close(link.fd);
+}
+
+void ClusterClient::add_node(const ClusterEndpoint& node) {
+    if (links_.contains(node.name)) throw std::runtime_error("ClusterClient: node '" + node.name + "' already added");
+
+    Link link;
+    link.endpoint = node;
+    link.fd = ClusterWire::connect(node.host, node.port);
+    links_.emplace(node.name, std::move(link));
+    ring_.add(node.name);
+    reroute_pending();
+}
+
+void ClusterClient::remove_node(const std::string& name) {
+    const auto it = links_.find(name);
+    if (it == links_.end()) throw std::runtime_error("ClusterClient: no node '" + name + "'");
+
+    std::vector<OrderId> pending = std::move(it->second.batch);
+    ClusterWire::close(it->second.fd);
+    ring_.remove(name);
+    links_.erase(it);
+
+    if (ring_.size() == 0) {
+        refused_.insert(refused_.end(), pending.begin(), pending.end());
+        return;
+    }
+    resubmit(pending);
+}
+
+void ClusterClient::submit(OrderId id) {
+    if (ring_.size() == 0) {
+        refused_.push_back(id);
+        throw std::runtime_error("ClusterClient: no node left on the ring");
+    }
+    Link& link = link_of(ring_.owner(id));
+    link.batch.push_back(id);
+    if (link.batch.size() >= batch_size_) send_batch(link);
+}
+
+void ClusterClient::flush() {
+    for (auto& [name, link] : links_) {
+        if (!link.batch.empty()) send_batch(link);
+    }
+}
+
+ClusterNodeStats ClusterClient::stats(const std::string& name) {
+    return request_stats(link_of(name), ClusterMsg::Stats);
+}
+
+ClusterNodeStats ClusterClient::shutdown_node(const std::string& name) {
+    Link& link = link_of(name);
+    if (!link.batch.empty()) send_batch(link);
+    return request_stats(link, ClusterMsg::Shutdown);
+}
+
+const HashRing& ClusterClient::ring() const noexcept {
+    return ring_;
+}
+
+std::uint64_t ClusterClient::accepted() const noexcept {
+    return accepted_;
+}
+
+std::uint64_t ClusterClient::batches_sent() const noexcept {
+    return batches_;
+}
+
+std::vector<OrderId> ClusterClient::take_refused() {
+    return std::exchange(refused_, {});
+}
+
+ClusterClient::Link& ClusterClient::link_of(const std::string& name) {
+    const auto it = links_.find(name);
+    if (it == links_.end()) throw std::runtime_error("ClusterClient: no node '" + name + "'");
+    return it->second;
+}
+
+void ClusterClient::send_batch(Link& link) {
+    std::vector<OrderId> batch = std::move(link.batch);
+    link.batch.clear();
+
+    ClusterFrame reply;
+    try {
+        reply = exchange(link, ClusterMsg::Submit, ClusterWire::encode_submit(batch));
+    }
+    catch (...) {
+        refused_.insert(refused_.end(), batch.begin(), batch.end());
+        throw;
+    }
+
+    ClusterSubmitReply r;
+    if (!ClusterWire::decode_submit_reply(reply.payload, r) || r.accepted + r.refused.size() != batch.size()) {
+        refused_.insert(refused_.end(), batch.begin(), batch.end());
+        throw std::runtime_error("ClusterClient: malformed reply from '" + link.endpoint.name + "'");
+    }
+    ++batches_;
+    accepted_ += r.accepted;
+    refused_.insert(refused_.end(), r.refused.begin(), r.refused.end());
+}
+
+ClusterNodeStats ClusterClient::request_stats(Link& link, ClusterMsg type) {
+    const ClusterFrame reply = exchange(link, type, {});
+    ClusterNodeStats s;
+    if (!ClusterWire::decode_stats(reply.payload, s)) {
+        throw std::runtime_error("ClusterClient: malformed reply from '" + link.endpoint.name + "'");
+    }
+    return s;
+}
+
+ClusterFrame ClusterClient::exchange(Link& link, ClusterMsg type, const std::vector<std::uint8_t>& payload) {
+    ClusterFrame reply;
+    const bool sent = ClusterWire::send(link.fd, type, payload);
+    const bool replied = sent
+        && (type == ClusterMsg::Shutdown ? ClusterWire::receive(link.fd, reply)
+                                         : ClusterWire::receive_for(link.fd, reply, reply_timeout_));
+    if (!replied || reply.type != type) {
+        drop(link);
+        throw std::runtime_error("ClusterClient: lost node '" + link.endpoint.name + "'");
+    }
+    return reply;
+}
+
+// The node leaves the ring, so no id is routed to it any more. The ids it
+// still had batched (a Stats request fails with a batch pending) are
+// refused; those of a batch in flight are refused by send_batch().
+void ClusterClient::drop(Link& link) {
+    ClusterWire::close(link.fd);
+    link.fd = -1;
+    refused_.insert(refused_.end(), link.batch.begin(), link.batch.end());
+    link.batch.clear();
+    (void)ring_.remove(link.endpoint.name);
+}
+
+// Called after the ring changed: ids whose owner moved follow it. Full
+// batches go out, which may happen while moving ids into them.
+void ClusterClient::reroute_pending() {
+    std::vector<OrderId> moved;
+    for (auto& [name, link] : links_) {
+        const auto stays = std::stable_partition(link.batch.begin(), link.batch.end(),
+            [&](OrderId id) { return ring_.owner(id) == name; });
+        moved.insert(moved.end(), stays, link.batch.end());
+        link.batch.erase(stays, link.batch.end());
+    }
+    resubmit(moved);
+}
+
+// A batch that cannot go out is counted as refused by send_batch(); the
+// remaining ids still go to their owners, and the first failure is rethrown
+// once every id is batched, sent or refused.
+void ClusterClient::resubmit(const std::vector<OrderId>& ids) {
+    std::exception_ptr failure;
+    for (const OrderId id : ids) {
+        try {
+            submit(id);
+        }
+        catch (...) {
+            if (!failure) failure = std::current_exception();
+        }
+    }
+    if (failure) std::rethrow_exception(failure);
+}
@@ -0,0 +1,163 @@
+#include "cluster_node.hpp"
+
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
+
+namespace {
+
+    constexpr int kPollMs = 100; // how often the accept thread checks for stop
+
+} // namespace
+
+ClusterNode::ClusterNode(Pipeline& pipeline, std::string host, std::uint16_t port)
+    : pipeline_(pipeline),
+      host_(std::move(host)),
+      port_(port) {
+}
+
+ClusterNode::~ClusterNode() {
+    stop();
+}
+
+std::uint16_t ClusterNode::port() const noexcept {
+    return port_;
+}
+
+void ClusterNode::wait_for_shutdown() {
+    std::unique_lock lock(shutdown_mutex_);
+    shutdown_cv_.wait(lock, [&] { return shutdown_requested_; });
+}
+
+ClusterNodeStats ClusterNode::stats() const {
+    const Metrics m = pipeline_.metrics();
+    ClusterNodeStats s;
+    s.accepted = m.accepted_count;
+    s.delivered = m.delivered_count;
+    s.submit_timeouts = m.submit_timeout_count;
+    s.in_flight = pipeline_.in_flight();
+    s.state = static_cast<std::uint64_t>(pipeline_.state());
+    return s;
+}
+
+ClusterFrame ClusterNode::handle(const ClusterFrame& request) {
+    ClusterFrame reply;
+    reply.type = request.type;
+
+    switch (request.type) {
+    case ClusterMsg::Submit: {
+        std::vector<OrderId> ids;
+        if (!ClusterWire::decode_submit(request.payload, ids)) throw std::runtime_error("ClusterNode: malformed batch");
+
+        // Once one order is refused the rest are refused without trying, so
+        // a batch waits out push_timeout at most once and its reply stays
+        // within the client's deadline.
+        ClusterSubmitReply r;
+        for (const OrderId id : ids) {
+            if (r.refused.empty() && pipeline_.submit(Order(id))) ++r.accepted;
+            else r.refused.push_back(id);
+        }
+        reply.payload = ClusterWire::encode_submit_reply(r);
+        break;
+    }
+    case ClusterMsg::Stats:
+        reply.payload = ClusterWire::encode_stats(stats());
+        break;
+    case ClusterMsg::Shutdown:
+        pipeline_.shutdown();
+        reply.payload = ClusterWire::encode_stats(stats());
+        break;
+    default:
+        throw std::runtime_error("ClusterNode: unknown message type");
+    }
+    return reply;
+}
+
+#if defined(_WIN32)
+
+void ClusterNode::start() {
+    throw std::runtime_error("ClusterNode: TCP sockets are not supported on this platform");
+}
+
+void ClusterNode::stop() noexcept {
+}
+
+void ClusterNode::serve(const std::stop_token&) {
+}
+
+void ClusterNode::serve_client(int, const std::stop_token&) {
+}
+
+#else
+
+void ClusterNode::start() {
+    if (thread_.joinable()) return;
+
+    listen_fd_ = ClusterWire::listen(host_, port_, port_);
+    thread_ = std::jthread([this](std::stop_token st) { serve(st); });
+}
+
+void ClusterNode::stop() noexcept {
+    if (!thread_.joinable()) return;
+    thread_.request_stop();
+    thread_.join();
+
+    std::vector<std::unique_ptr<Client>> clients;
+    {
+        std::lock_guard lock(clients_mutex_);
+        clients.swap(clients_);
+    }
+    clients.clear(); // jthread: request_stop + join
+
+    ClusterWire::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void ClusterNode::serve(const std::stop_token& st) {
+    while (!st.stop_requested()) {
+        pollfd p{ listen_fd_, POLLIN, 0 };
+        if (::poll(&p, 1, kPollMs) <= 0) continue;
+
+        const int client = ClusterWire::accept(listen_fd_);
+        if (client < 0) continue;
+
+        std::lock_guard lock(clients_mutex_);
+        std::erase_if(clients_, [](const auto& c) { return c->done.load(); });
+        Client& c = *clients_.emplace_back(std::make_unique<Client>());
+        c.thread = std::jthread([this, client, &c](std::stop_token cst) {
+            serve_client(client, cst);
+            ClusterWire::close(client);
+            c.done.store(true);
+        });
+    }
+}
+
+// One request, one reply, until the client hangs up. A malformed request
+// drops the connection; the client sees it as a lost node.
+void ClusterNode::serve_client(int fd, const std::stop_token& st) {
+    ClusterFrame request;
+    while (ClusterWire::receive(fd, request, st)) {
+        ClusterFrame reply;
+        try {
+            reply = handle(request);
+        }
+        catch (const std::exception&) {
+            return;
+        }
+        if (!ClusterWire::send(fd, reply.type, reply.payload)) return;
+
+        if (request.type == ClusterMsg::Shutdown) {
+            {
+                std::lock_guard lock(shutdown_mutex_);
+                shutdown_requested_ = true;
+            }
+            shutdown_cv_.notify_all();
+        }
+    }
+}
+
+#endif
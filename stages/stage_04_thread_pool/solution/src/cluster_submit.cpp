@@ -0,0 +1,84 @@
+// Submits orders 1..N to a ring of ops_node processes through ClusterClient
+// and prints how they spread, optionally shutting the nodes down after.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cluster_client.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void print_usage() {
+    std::cerr << "Usage: ops_cluster_submit <orders> <batch_size> <port>[,<port>...] [shutdown]\n";
+}
+
+std::vector<std::uint16_t> parse_ports(const std::string& list) {
+    std::vector<std::uint16_t> ports;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) ports.push_back(static_cast<std::uint16_t>(std::stoul(item)));
+    return ports;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 5 || (argc == 5 && std::string(argv[4]) != "shutdown")) {
+        print_usage();
+        return 1;
+    }
+
+    std::uint64_t orders = 0;
+    std::size_t batch = 0;
+    std::vector<std::uint16_t> ports;
+    try {
+        orders = std::stoull(argv[1]);
+        batch = std::stoull(argv[2]);
+        ports = parse_ports(argv[3]);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        ClusterClient client(batch);
+        std::vector<std::string> names;
+        for (const auto port : ports) {
+            // Named by address, so every client builds the same ring.
+            ClusterEndpoint ep;
+            ep.port = port;
+            ep.name = ep.host + ":" + std::to_string(port);
+            client.add_node(ep);
+            names.push_back(ep.name);
+        }
+
+        const auto t0 = Clock::now();
+        for (std::uint64_t id = 1; id <= orders; ++id) client.submit(id);
+        client.flush();
+        const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+        std::printf("accepted %llu of %llu in %llu batches, %.0f orders/s\n",
+            static_cast<unsigned long long>(client.accepted()), static_cast<unsigned long long>(orders),
+            static_cast<unsigned long long>(client.batches_sent()), static_cast<double>(orders) / secs);
+
+        const bool shutdown = argc == 5;
+        for (const auto& name : names) {
+            const auto s = shutdown ? client.shutdown_node(name) : client.stats(name);
+            std::printf("%-22s accepted=%llu delivered=%llu submit_timeouts=%llu\n", name.c_str(),
+                static_cast<unsigned long long>(s.accepted), static_cast<unsigned long long>(s.delivered),
+                static_cast<unsigned long long>(s.submit_timeouts));
+        }
+        return client.take_refused().empty() ? 0 : 3;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,319 @@
+#include "cluster_wire.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr int kPollMs = 100; // how often a stoppable receive checks its token
+
+    void put_u32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+
+    void put_u64(std::vector<std::uint8_t>& out, std::uint64_t v) {
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+
+    // Reads fixed-width fields off a payload; every get fails once past the end.
+    class Cursor {
+    public:
+        explicit Cursor(const std::vector<std::uint8_t>& bytes) : bytes_(bytes) {}
+
+        bool get_u32(std::uint32_t& v) {
+            std::uint64_t w = 0;
+            if (!get(4, w)) return false;
+            v = static_cast<std::uint32_t>(w);
+            return true;
+        }
+
+        bool get_u64(std::uint64_t& v) {
+            return get(8, v);
+        }
+
+        bool at_end() const noexcept {
+            return pos_ == bytes_.size();
+        }
+
+        std::size_t left() const noexcept {
+            return bytes_.size() - pos_;
+        }
+
+    private:
+        bool get(std::size_t n, std::uint64_t& v) {
+            if (left() < n) return false;
+            v = 0;
+            for (std::size_t i = 0; i < n; ++i) v |= std::uint64_t{ bytes_[pos_ + i] } << (8 * i);
+            pos_ += n;
+            return true;
+        }
+
+        const std::vector<std::uint8_t>& bytes_;
+        std::size_t pos_ = 0;
+    };
+
+    bool get_ids(Cursor& in, std::uint32_t count, std::vector<OrderId>& ids) {
+        if (in.left() != std::size_t{ count } * ClusterWire::kRecordBytes) return false;
+        ids.resize(count);
+        for (auto& id : ids) (void)in.get_u64(id);
+        return true;
+    }
+
+#if !defined(_WIN32)
+    sockaddr_in address_of(const std::string& host, std::uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            throw std::runtime_error("ClusterWire: bad IPv4 address '" + host + "'");
+        }
+        return addr;
+    }
+
+    void set_nodelay(int fd) noexcept {
+        int one = 1;
+        (void)::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    bool write_all(int fd, const std::uint8_t* data, std::size_t size) {
+        std::size_t sent = 0;
+        while (sent < size) {
+            const auto n = ::send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    // Without a stop token or a deadline it blocks in recv() like a plain read.
+    bool read_all(int fd, std::uint8_t* data, std::size_t size, const std::stop_token& st,
+        std::optional<std::chrono::steady_clock::time_point> deadline) {
+        std::size_t got = 0;
+        while (got < size) {
+            if (st.stop_possible() || deadline) {
+                if (st.stop_requested()) return false;
+                int wait_ms = kPollMs;
+                if (deadline) {
+                    const auto left = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+                    if (left.count() <= 0) return false;
+                    wait_ms = static_cast<int>(std::min<std::int64_t>(left.count(), kPollMs));
+                }
+                pollfd p{ fd, POLLIN, 0 };
+                const int ready = ::poll(&p, 1, wait_ms);
+                if (ready < 0 && errno != EINTR) return false;
+                if (ready <= 0) continue;
+            }
+            const auto n = ::recv(fd, data + got, size - got, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            got += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool receive_until(int fd, ClusterFrame& frame, const std::stop_token& st,
+        std::optional<std::chrono::steady_clock::time_point> deadline) {
+        std::uint8_t header[ClusterWire::kHeaderBytes];
+        if (!read_all(fd, header, sizeof(header), st, deadline)) return false;
+
+        std::uint32_t size = 0;
+        for (int i = 0; i < 4; ++i) size |= std::uint32_t{ header[i] } << (8 * i);
+        if (size > ClusterWire::kMaxPayload) return false;
+
+        frame.type = static_cast<ClusterMsg>(header[4]);
+        frame.payload.resize(size);
+        return read_all(fd, frame.payload.data(), size, st, deadline);
+    }
+#endif
+
+} // namespace
+
+std::vector<std::uint8_t> ClusterWire::encode_submit(const std::vector<OrderId>& ids) {
+    std::vector<std::uint8_t> out;
+    out.reserve(4 + ids.size() * kRecordBytes);
+    put_u32(out, static_cast<std::uint32_t>(ids.size()));
+    for (const OrderId id : ids) put_u64(out, id);
+    return out;
+}
+
+bool ClusterWire::decode_submit(const std::vector<std::uint8_t>& payload, std::vector<OrderId>& ids) {
+    Cursor in(payload);
+    std::uint32_t count = 0;
+    return in.get_u32(count) && get_ids(in, count, ids);
+}
+
+std::vector<std::uint8_t> ClusterWire::encode_submit_reply(const ClusterSubmitReply& reply) {
+    std::vector<std::uint8_t> out;
+    out.reserve(8 + reply.refused.size() * kRecordBytes);
+    put_u32(out, reply.accepted);
+    put_u32(out, static_cast<std::uint32_t>(reply.refused.size()));
+    for (const OrderId id : reply.refused) put_u64(out, id);
+    return out;
+}
+
+bool ClusterWire::decode_submit_reply(const std::vector<std::uint8_t>& payload, ClusterSubmitReply& reply) {
+    Cursor in(payload);
+    std::uint32_t refused = 0;
+    return in.get_u32(reply.accepted) && in.get_u32(refused) && get_ids(in, refused, reply.refused);
+}
+
+std::vector<std::uint8_t> ClusterWire::encode_stats(const ClusterNodeStats& stats) {
+    std::vector<std::uint8_t> out;
+    out.reserve(40);
+    put_u64(out, stats.accepted);
+    put_u64(out, stats.delivered);
+    put_u64(out, stats.submit_timeouts);
+    put_u64(out, stats.in_flight);
+    put_u64(out, stats.state);
+    return out;
+}
+
+bool ClusterWire::decode_stats(const std::vector<std::uint8_t>& payload, ClusterNodeStats& stats) {
+    Cursor in(payload);
+    return in.get_u64(stats.accepted) && in.get_u64(stats.delivered) && in.get_u64(stats.submit_timeouts)
+        && in.get_u64(stats.in_flight) && in.get_u64(stats.state) && in.at_end();
+}
+
+std::vector<std::uint8_t> ClusterWire::encode_deliver(std::uint64_t tag, OrderId id) {
+    std::vector<std::uint8_t> out;
+    out.reserve(16);
+    put_u64(out, tag);
+    put_u64(out, id);
+    return out;
+}
+
+bool ClusterWire::decode_deliver(const std::vector<std::uint8_t>& payload, std::uint64_t& tag, OrderId& id) {
+    Cursor in(payload);
+    return in.get_u64(tag) && in.get_u64(id) && in.at_end();
+}
+
+#if defined(_WIN32)
+
+int ClusterWire::listen(const std::string&, std::uint16_t, std::uint16_t&) {
+    throw std::runtime_error("ClusterWire: TCP sockets are not supported on this platform");
+}
+
+int ClusterWire::accept(int) noexcept {
+    return -1;
+}
+
+int ClusterWire::connect(const std::string&, std::uint16_t) {
+    throw std::runtime_error("ClusterWire: TCP sockets are not supported on this platform");
+}
+
+void ClusterWire::close(int) noexcept {
+}
+
+bool ClusterWire::send(int, ClusterMsg, const std::vector<std::uint8_t>&) {
+    return false;
+}
+
+bool ClusterWire::receive(int, ClusterFrame&, const std::stop_token&) {
+    return false;
+}
+
+bool ClusterWire::receive_for(int, ClusterFrame&, std::chrono::milliseconds) {
+    return false;
+}
+
+bool ClusterWire::readable(int, std::chrono::milliseconds) noexcept {
+    return false;
+}
+
+bool ClusterWire::readable(int, int, std::chrono::milliseconds) noexcept {
+    return false;
+}
+
+#else
+
+int ClusterWire::listen(const std::string& host, std::uint16_t port, std::uint16_t& bound) {
+    sockaddr_in addr = address_of(host, port);
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("ClusterWire: socket() failed");
+
+    int one = 1;
+    (void)::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0
+        || ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        ::close(fd);
+        throw std::runtime_error("ClusterWire: cannot listen on " + host + ":" + std::to_string(port));
+    }
+    bound = ntohs(addr.sin_port);
+    return fd;
+}
+
+int ClusterWire::accept(int listen_fd) noexcept {
+    const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd >= 0) set_nodelay(fd);
+    return fd;
+}
+
+int ClusterWire::connect(const std::string& host, std::uint16_t port) {
+    const sockaddr_in addr = address_of(host, port);
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("ClusterWire: socket() failed");
+
+    int rc = 0;
+    do {
+        rc = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    } while (rc != 0 && errno == EINTR);
+    if (rc != 0) {
+        ::close(fd);
+        throw std::runtime_error("ClusterWire: cannot connect to " + host + ":" + std::to_string(port));
+    }
+    set_nodelay(fd);
+    return fd;
+}
+
+void ClusterWire::close(int fd) noexcept {
+    if (fd >= 0) ::close(fd);
+}
+
+// Header and payload in one buffer: one send, one segment for small frames.
+bool ClusterWire::send(int fd, ClusterMsg type, const std::vector<std::uint8_t>& payload) {
+    if (payload.size() > kMaxPayload) return false;
+
+    std::vector<std::uint8_t> frame;
+    frame.reserve(kHeaderBytes + payload.size());
+    put_u32(frame, static_cast<std::uint32_t>(payload.size()));
+    frame.push_back(static_cast<std::uint8_t>(type));
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return write_all(fd, frame.data(), frame.size());
+}
+
+bool ClusterWire::receive(int fd, ClusterFrame& frame, const std::stop_token& st) {
+    return receive_until(fd, frame, st, std::nullopt);
+}
+
+bool ClusterWire::receive_for(int fd, ClusterFrame& frame, std::chrono::milliseconds timeout) {
+    return receive_until(fd, frame, {}, std::chrono::steady_clock::now() + timeout);
+}
+
+
+bool ClusterWire::readable(int fd, std::chrono::milliseconds timeout) noexcept {
+    pollfd p{ fd, POLLIN, 0 };
+    const int ready = ::poll(&p, 1, static_cast<int>(timeout.count()));
+    return ready > 0;
+}
+
+bool ClusterWire::readable(int fd, int wake_fd, std::chrono::milliseconds timeout) noexcept {
+    pollfd p[2]{ { fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+    if (::poll(p, 2, static_cast<int>(timeout.count())) <= 0) return false;
+    return p[0].revents != 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include "deadline_waker.hpp"
+
+DeadlineWaker& DeadlineWaker::instance() {
+    static DeadlineWaker waker;
+    return waker;
+}
+
+DeadlineWaker::DeadlineWaker()
+    : thread_([this](std::stop_token st) { run(st); }) {
+}
+
+DeadlineWaker::Timer DeadlineWaker::arm(std::atomic<std::uint32_t>& seq, Clock::time_point deadline) {
+    std::lock_guard lock(mutex_);
+    const Timer timer{ deadline, next_id_++ };
+    const bool earliest = timers_.empty() || timer < timers_.begin()->first;
+    timers_.emplace(timer, &seq);
+    if (earliest) cv_.notify_one();
+    return timer;
+}
+
+void DeadlineWaker::disarm(const Timer& timer) {
+    std::lock_guard lock(mutex_);
+    timers_.erase(timer);
+}
+
+void DeadlineWaker::run(std::stop_token st) {
+    std::unique_lock lock(mutex_);
+    while (!st.stop_requested()) {
+        if (timers_.empty()) {
+            cv_.wait(lock, st, [&] { return !timers_.empty(); });
+            continue;
+        }
+
+        const auto next = timers_.begin()->first.first;
+        if (Clock::now() < next) {
+            // Woken early by an earlier timer, or by the deadline itself.
+            cv_.wait_until(lock, st, next, [&] { return !timers_.empty() && timers_.begin()->first.first < next; });
+            continue;
+        }
+
+        const auto now = Clock::now();
+        while (!timers_.empty() && timers_.begin()->first.first <= now) {
+            std::atomic<std::uint32_t>& seq = *timers_.begin()->second;
+            timers_.erase(timers_.begin());
+            seq.fetch_add(1);
+            seq.notify_all();
+        }
+    }
+}
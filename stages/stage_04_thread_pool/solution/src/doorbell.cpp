@@ -0,0 +1,62 @@
+#include "doorbell.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+Doorbell::Doorbell() = default;
+Doorbell::~Doorbell() = default;
+
+void Doorbell::ring() noexcept {
+}
+
+void Doorbell::clear() noexcept {
+}
+
+#else
+
+Doorbell::Doorbell() {
+#if defined(__linux__)
+    read_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    write_fd_ = read_fd_;
+    if (read_fd_ < 0) throw std::runtime_error("Doorbell: eventfd() failed");
+#else
+    int fds[2];
+    if (::pipe(fds) != 0) throw std::runtime_error("Doorbell: pipe() failed");
+    for (const int fd : fds) {
+        (void)::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        (void)::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+#endif
+}
+
+Doorbell::~Doorbell() {
+    if (write_fd_ != read_fd_) ::close(write_fd_);
+    ::close(read_fd_);
+}
+
+// A full pipe or a saturated counter already reads as rung.
+void Doorbell::ring() noexcept {
+    const std::uint64_t one = 1;
+    const auto written = ::write(write_fd_, &one, sizeof(one));
+    (void)written;
+}
+
+void Doorbell::clear() noexcept {
+    std::uint64_t buf[8];
+    while (::read(read_fd_, buf, sizeof(buf)) > 0) {
+    }
+}
+
+#endif
@@ -0,0 +1,68 @@
+// Renders a FlightRecorder dump as one timeline: the per-thread rings are
+// merged by timestamp, times are relative to the oldest record.
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "flight_recorder.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: ops_flight_decode <dump_file> [pipeline]\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        print_usage();
+        return 1;
+    }
+
+    std::string path = argv[1];
+    int only_source = -1;
+    try {
+        if (argc == 3) only_source = std::stoi(argv[2]);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    std::vector<FlightRecord> records;
+    try {
+        records = FlightRecorder::read_dump(path);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    if (only_source >= 0) {
+        std::erase_if(records, [&](const FlightRecord& r) { return r.source != only_source; });
+    }
+    std::stable_sort(records.begin(), records.end(), [](const FlightRecord& a, const FlightRecord& b) {
+        return a.time_ns < b.time_ns;
+    });
+
+    std::map<std::uint32_t, std::size_t> per_thread;
+    for (const auto& r : records) ++per_thread[r.thread];
+    std::printf("%zu records from %zu threads\n\n", records.size(), per_thread.size());
+    if (records.empty()) return 0;
+
+    std::printf("%14s  %6s  %8s  %s\n", "time_us", "thread", "pipeline", "event");
+    const std::uint64_t t0 = records.front().time_ns;
+    for (const auto& r : records) {
+        std::printf("%14.3f  %6u  %8u  %s\n",
+            static_cast<double>(r.time_ns - t0) / 1000.0,
+            static_cast<unsigned>(r.thread),
+            static_cast<unsigned>(r.source),
+            FlightRecorder::describe(r).c_str());
+    }
+    return 0;
+}
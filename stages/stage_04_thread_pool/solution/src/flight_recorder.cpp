@@ -0,0 +1,286 @@
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr std::uint64_t kMagic = 0x3130544C4653504FULL; // "OPSFLT01"
+    constexpr std::uint32_t kVersion = 1;
+    constexpr std::size_t kWords = 4; // per record: time, thread|event|source, a, b
+    constexpr std::size_t kRing = FlightRecorder::kRingRecords;
+
+    static_assert((kRing & (kRing - 1)) == 0, "kRingRecords must be a power of two");
+
+    struct DumpHeader {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t record_bytes;
+    };
+
+    using Ref = std::atomic_ref<std::uint64_t>;
+
+    // The owner bumps `started`, writes the words, then publishes `finished`.
+    // A reader trusts records below `finished` and drops any that a later
+    // `started` shows may have been overwritten under it.
+    struct Ring {
+        std::atomic<bool> owned{ false };
+        std::atomic<std::uint64_t> started{ 0 };
+        std::atomic<std::uint64_t> finished{ 0 };
+        std::uint64_t words[kRing * kWords]{};
+    };
+
+    // Rings are never freed: a dump may run at any time, even from a signal.
+    std::array<std::atomic<Ring*>, FlightRecorder::kMaxThreads> g_rings{};
+    std::atomic<std::uint32_t> g_next_thread{ 1 };
+    std::atomic<std::uint64_t> g_dropped{ 0 };
+
+    char g_signal_path[512]{};
+
+    Ring* acquire_ring() noexcept {
+        for (auto& slot : g_rings) {
+            Ring* r = slot.load(std::memory_order_acquire);
+            if (r == nullptr) {
+                auto* fresh = new (std::nothrow) Ring;
+                if (fresh == nullptr) return nullptr;
+                fresh->owned.store(true, std::memory_order_relaxed);
+                if (slot.compare_exchange_strong(r, fresh, std::memory_order_acq_rel)) return fresh;
+                delete fresh;
+            }
+            bool owned = false;
+            if (r->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) return r;
+        }
+        return nullptr;
+    }
+
+    // A thread keeps its ring until it exits; the next new thread reuses it,
+    // so the last events of a finished thread stay around until then.
+    struct ThreadRing {
+        Ring* ring = acquire_ring();
+        std::uint32_t id = g_next_thread.fetch_add(1, std::memory_order_relaxed);
+
+        ThreadRing() = default;
+        ThreadRing(const ThreadRing&) = delete;
+        ThreadRing& operator=(const ThreadRing&) = delete;
+
+        ~ThreadRing() {
+            if (ring != nullptr) ring->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    std::uint64_t now_ns() noexcept {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Plain file descriptors: open/write/close are async-signal-safe.
+    int open_dump(const char* path) noexcept {
+#if defined(_WIN32)
+        return ::_open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        return ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    }
+
+    bool write_all(int fd, const void* data, std::size_t n) noexcept {
+        const auto* p = static_cast<const char*>(data);
+        while (n > 0) {
+#if defined(_WIN32)
+            const int w = ::_write(fd, p, static_cast<unsigned>(n));
+#else
+            const auto w = ::write(fd, p, n);
+#endif
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        return true;
+    }
+
+    bool close_dump(int fd) noexcept {
+#if defined(_WIN32)
+        return ::_close(fd) == 0;
+#else
+        return ::close(fd) == 0;
+#endif
+    }
+
+    // Copies one ring in small chunks, so the signal handler's stack use
+    // stays bounded.
+    bool write_ring(int fd, Ring& r) noexcept {
+        constexpr std::size_t kChunk = 64;
+        std::uint64_t chunk[kChunk * kWords];
+
+        const std::uint64_t end = r.finished.load(std::memory_order_acquire);
+        for (std::uint64_t i = end > kRing ? end - kRing : 0; i < end; i += kChunk) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(kChunk, end - i));
+            for (std::size_t j = 0; j < n; ++j) {
+                std::uint64_t* w = &r.words[((i + j) & (kRing - 1)) * kWords];
+                for (std::size_t k = 0; k < kWords; ++k) {
+                    chunk[j * kWords + k] = Ref(w[k]).load(std::memory_order_relaxed);
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const std::uint64_t started = r.started.load(std::memory_order_relaxed);
+            const std::uint64_t first_intact = started > kRing ? started - kRing : 0;
+            const std::size_t skip = static_cast<std::size_t>(std::min<std::uint64_t>(
+                first_intact > i ? first_intact - i : 0, n));
+
+            if (!write_all(fd, chunk + skip * kWords, (n - skip) * kWords * sizeof(std::uint64_t))) return false;
+        }
+        return true;
+    }
+
+#if defined(SIGUSR1)
+    void on_dump_signal(int) {
+        const int saved = errno;
+        (void)FlightRecorder::dump(g_signal_path);
+        errno = saved;
+    }
+#endif
+
+    std::string first_bytes(std::uint64_t word) {
+        char text[sizeof(word) + 1]{};
+        std::memcpy(text, &word, sizeof(word));
+        return text;
+    }
+
+} // namespace
+
+void FlightRecorder::record(FlightEvent event, std::uint16_t source, std::uint64_t a, std::uint64_t b) noexcept {
+    thread_local const ThreadRing local;
+    Ring* r = local.ring;
+    if (r == nullptr) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const std::uint64_t n = r->started.load(std::memory_order_relaxed);
+    r->started.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::uint64_t* w = &r->words[(n & (kRing - 1)) * kWords];
+    Ref(w[0]).store(now_ns(), std::memory_order_relaxed);
+    Ref(w[1]).store(std::uint64_t{ local.id } << 32 | std::uint64_t{ static_cast<std::uint16_t>(event) } << 16 | source,
+        std::memory_order_relaxed);
+    Ref(w[2]).store(a, std::memory_order_relaxed);
+    Ref(w[3]).store(b, std::memory_order_relaxed);
+
+    r->finished.store(n + 1, std::memory_order_release);
+}
+
+bool FlightRecorder::dump(const char* path) noexcept {
+    const int fd = open_dump(path);
+    if (fd < 0) return false;
+
+    const DumpHeader header{ kMagic, kVersion, static_cast<std::uint32_t>(kWords * sizeof(std::uint64_t)) };
+    bool ok = write_all(fd, &header, sizeof(header));
+    for (const auto& slot : g_rings) {
+        Ring* r = slot.load(std::memory_order_acquire);
+        if (r != nullptr && ok) ok = write_ring(fd, *r);
+    }
+    return close_dump(fd) && ok;
+}
+
+bool FlightRecorder::dump_on_signal(const std::string& path) {
+#if defined(SIGUSR1)
+    if (path.size() >= sizeof(g_signal_path)) throw std::invalid_argument("FlightRecorder: dump path too long");
+    std::memcpy(g_signal_path, path.c_str(), path.size() + 1);
+
+    struct sigaction sa {};
+    sa.sa_handler = on_dump_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGUSR1, &sa, nullptr) == 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+std::uint64_t FlightRecorder::dropped() noexcept {
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+std::vector<FlightRecord> FlightRecorder::read_dump(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("FlightRecorder: cannot open " + path);
+
+    DumpHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kMagic) {
+        throw std::runtime_error("FlightRecorder: " + path + " is not a flight dump");
+    }
+    if (header.version != kVersion || header.record_bytes != kWords * sizeof(std::uint64_t)) {
+        throw std::runtime_error("FlightRecorder: " + path + " has an unsupported layout");
+    }
+
+    // A dump cut short (the process died while writing it) loses only its
+    // last partial record.
+    std::vector<FlightRecord> out;
+    std::uint64_t w[kWords];
+    while (in.read(reinterpret_cast<char*>(w), sizeof(w))) {
+        FlightRecord r;
+        r.time_ns = w[0];
+        r.thread = static_cast<std::uint32_t>(w[1] >> 32);
+        r.event = static_cast<FlightEvent>(static_cast<std::uint16_t>(w[1] >> 16));
+        r.source = static_cast<std::uint16_t>(w[1]);
+        r.a = w[2];
+        r.b = w[3];
+        out.push_back(r);
+    }
+    return out;
+}
+
+std::uint64_t FlightRecorder::text_word(const char* text) noexcept {
+    std::uint64_t word = 0;
+    if (text != nullptr) std::memcpy(&word, text, ::strnlen(text, sizeof(word)));
+    return word;
+}
+
+std::string FlightRecorder::describe(const FlightRecord& r) {
+    static constexpr const char* kStates[] = { "Created", "Running", "Draining", "Stopped", "Failed" };
+    static constexpr const char* kQueues[] = { "q_in", "q_prepare", "q_pack" };
+    static constexpr const char* kStages[] = { "Prepare", "Pack", "Deliver", "shared" };
+
+    const auto name = [](const auto& names, std::uint64_t i) -> std::string {
+        return i < std::size(names) ? names[i] : std::to_string(i);
+    };
+
+    switch (r.event) {
+    case FlightEvent::StateChange:
+        return "state " + name(kStates, r.a) + " -> " + name(kStates, r.b);
+    case FlightEvent::QueueClosed:
+        return "close " + name(kQueues, r.a);
+    case FlightEvent::Escalate:
+        return "escalate";
+    case FlightEvent::SubmitTimeout:
+        return "submit timeout, order " + std::to_string(r.a);
+    case FlightEvent::WorkerStart:
+        return "worker start " + name(kStages, r.a) + " #" + std::to_string(r.b);
+    case FlightEvent::WorkerExit:
+        return "worker exit " + name(kStages, r.a) + " #" + std::to_string(r.b);
+    case FlightEvent::WorkerException:
+        return "worker #" + std::to_string(r.a) + " threw \"" + first_bytes(r.b) + "\"";
+    case FlightEvent::Dump:
+        return "dump";
+    }
+    return "event " + std::to_string(static_cast<unsigned>(r.event));
+}
@@ -0,0 +1,82 @@
+#include "hash_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+    // splitmix64 finalizer: sequential ids spread over the whole ring.
+    std::uint64_t mix(std::uint64_t x) noexcept {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // FNV-1a of the name, then mixed with the point's index.
+    std::uint64_t point_hash(const std::string& node, std::size_t i) noexcept {
+        std::uint64_t h = 0xCBF29CE484222325ULL;
+        for (const char c : node) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001B3ULL;
+        }
+        return mix(h ^ mix(i));
+    }
+
+} // namespace
+
+HashRing::HashRing(std::size_t vnodes)
+    : vnodes_(std::max<std::size_t>(vnodes, 1)) {
+}
+
+bool HashRing::add(const std::string& node) {
+    const auto it = std::lower_bound(nodes_.begin(), nodes_.end(), node);
+    if (it != nodes_.end() && *it == node) return false;
+    nodes_.insert(it, node);
+    rebuild();
+    return true;
+}
+
+bool HashRing::remove(const std::string& node) {
+    const auto it = std::lower_bound(nodes_.begin(), nodes_.end(), node);
+    if (it == nodes_.end() || *it != node) return false;
+    nodes_.erase(it);
+    rebuild();
+    return true;
+}
+
+const std::string& HashRing::owner(OrderId id) const {
+    if (points_.empty()) throw std::logic_error("HashRing: no nodes");
+
+    const std::uint64_t h = mix(id);
+    auto it = std::lower_bound(points_.begin(), points_.end(), h,
+        [](const Point& p, std::uint64_t v) { return p.hash < v; });
+    if (it == points_.end()) it = points_.begin(); // wrap around
+    return nodes_[it->node];
+}
+
+bool HashRing::contains(const std::string& node) const noexcept {
+    return std::binary_search(nodes_.begin(), nodes_.end(), node);
+}
+
+std::vector<std::string> HashRing::nodes() const {
+    return nodes_;
+}
+
+std::size_t HashRing::size() const noexcept {
+    return nodes_.size();
+}
+
+// Points are recomputed from the names, so the ring depends only on the
+// node set, not on the order nodes were added in. Equal hashes (unlikely)
+// are broken by name, for the same reason.
+void HashRing::rebuild() {
+    points_.clear();
+    points_.reserve(nodes_.size() * vnodes_);
+    for (std::uint32_t n = 0; n < nodes_.size(); ++n) {
+        for (std::size_t i = 0; i < vnodes_; ++i) points_.push_back(Point{ point_hash(nodes_[n], i), n });
+    }
+    std::sort(points_.begin(), points_.end(), [](const Point& a, const Point& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.node < b.node;
+    });
+}
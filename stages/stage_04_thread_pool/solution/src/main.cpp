@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "admin_server.hpp"
+#include "flight_recorder.hpp"
+#include "order.hpp"
+#include "pipeline.hpp"
+#include "metrics.hpp"
+#include "pressure.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: ops_app [orders_count] [shutdown|shutdown_now|shutdown_for [deadline_ms]|paced [producers]|admin [socket_path]]\n";
+}
+
+const char* to_string(PipelineState s) {
+    switch (s) {
+    case PipelineState::Created:  return "Created";
+    case PipelineState::Running:  return "Running";
+    case PipelineState::Draining: return "Draining";
+    case PipelineState::Stopped:  return "Stopped";
+    case PipelineState::Failed:   return "Failed";
+    default:                      return "Unknown";
+    }
+}
+
+struct PacedResult {
+    std::uint64_t accepted = 0;
+    std::uint64_t timeouts = 0;
+    double seconds = 0;
+    double rate_mean = 0; // accepted per second over 50ms windows, after a 100ms warm-up
+    double rate_cv = 0;   // their coefficient of variation
+    double pacer_rate = 0; // AIMD runs: final rate summed over producers
+};
+
+// Producers share `orders` submits against a pipeline whose Prepare costs
+// ~100us per order, either as fast as submit() lets them or paced by AIMD
+// from the pressure level each submit reports.
+PacedResult run_producers(std::size_t orders, std::size_t producers, bool paced) {
+    Pipeline::Config cfg;
+    cfg.q_in_capacity = 128;
+    cfg.q_prepare_capacity = 128;
+    cfg.q_pack_capacity = 128;
+    cfg.prepare_workers = 2;
+    cfg.pack_workers = 2;
+    cfg.deliver_workers = 2;
+    cfg.push_timeout = std::chrono::milliseconds{ 2 };
+    cfg.pop_timeout = std::chrono::milliseconds{ 20 };
+    cfg.prepare_work = [](const Order&) { std::this_thread::sleep_for(std::chrono::microseconds{ 100 }); };
+
+    Pipeline pipeline(cfg);
+    pipeline.start();
+
+    std::atomic<std::uint64_t> next_id{ 1 };
+    std::atomic<std::uint64_t> timeouts{ 0 };
+    std::atomic<bool> done{ false };
+    std::vector<double> final_rates(producers, 0.0);
+
+    // Accepted orders per 50ms window while the producers run.
+    std::vector<double> windows;
+    std::thread sampler([&] {
+        std::uint64_t last = 0;
+        while (!done.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+            const auto now = pipeline.metrics().accepted_count;
+            windows.push_back(static_cast<double>(now - last) / 0.05);
+            last = now;
+        }
+    });
+
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            AimdPacer::Config pc;
+            pc.initial_rate = 2000.0 / static_cast<double>(producers);
+            pc.increase = 20;
+            AimdPacer pacer(pc);
+
+            for (auto id = next_id++; id <= orders; id = next_id++) {
+                if (paced) pacer.pace();
+                Pressure pressure = Pressure::Low;
+                if (!pipeline.submit(Order{ static_cast<OrderId>(id) }, pressure)) ++timeouts;
+                if (paced) pacer.on_pressure(pressure);
+            }
+            final_rates[p] = paced ? pacer.rate() : 0.0;
+        });
+    }
+    for (auto& t : threads) t.join();
+    const auto t1 = std::chrono::steady_clock::now();
+    done = true;
+    sampler.join();
+    pipeline.shutdown();
+
+    PacedResult r;
+    r.accepted = pipeline.metrics().accepted_count;
+    r.timeouts = timeouts.load();
+    r.seconds = std::chrono::duration<double>(t1 - t0).count();
+    // Steady state only: the first 100ms include the pacer's ramp-up, the
+    // last window straddles the end.
+    if (windows.size() > 3) windows.erase(windows.begin(), windows.begin() + 2);
+    if (windows.size() > 1) windows.pop_back();
+    double sum = 0;
+    for (const auto w : windows) sum += w;
+    r.rate_mean = windows.empty() ? 0 : sum / static_cast<double>(windows.size());
+    double var = 0;
+    for (const auto w : windows) var += (w - r.rate_mean) * (w - r.rate_mean);
+    if (!windows.empty() && r.rate_mean > 0) r.rate_cv = std::sqrt(var / static_cast<double>(windows.size())) / r.rate_mean;
+    for (const auto x : final_rates) r.pacer_rate += x;
+    return r;
+}
+
+int run_paced_scenario(std::size_t orders, std::size_t producers) {
+    std::cout << "Mode: paced\n";
+    std::cout << "Orders: " << orders << ", producers: " << producers << "\n\n";
+    std::cout << "run        accepted  timeouts   wall_ms  accepted/s  window_cv  pacer_rate\n";
+
+    for (const bool paced : { false, true }) {
+        const auto r = run_producers(orders, producers, paced);
+        std::printf("%-9s %9llu %9llu %9lld %11.0f %10.3f %11.0f\n",
+            paced ? "aimd" : "unpaced",
+            static_cast<unsigned long long>(r.accepted),
+            static_cast<unsigned long long>(r.timeouts),
+            static_cast<long long>(r.seconds * 1000),
+            r.rate_mean,
+            r.rate_cv,
+            r.pacer_rate);
+    }
+    return 0;
+}
+
+// Feeds about one order per millisecond while an AdminServer accepts
+// commands (ops_admin <socket> ...), until the orders run out or a
+// "shutdown" command stops the intake. The metrics page next to the socket
+// can be watched with ops_metrics_top.
+int run_admin_scenario(std::size_t orders, const std::string& socket_path) {
+    Pipeline::Config cfg;
+    cfg.prepare_workers = 2;
+    cfg.pack_workers = 2;
+    cfg.deliver_workers = 2;
+    cfg.max_stage_workers = 8;
+    cfg.pop_timeout = std::chrono::milliseconds{ 20 };
+    cfg.prepare_work = [](const Order&) { std::this_thread::sleep_for(std::chrono::microseconds{ 200 }); };
+    cfg.metrics_page_path = socket_path + ".metrics";
+
+    Pipeline pipeline(cfg);
+    pipeline.start();
+    AdminServer admin(pipeline, socket_path);
+    admin.start();
+
+    std::cout << "Mode: admin\n";
+    std::cout << "Admin socket: " << socket_path << "\n";
+    std::cout << "Metrics page: " << cfg.metrics_page_path << "\n";
+    std::cout << "Try: ops_admin " << socket_path << " depths\n";
+    std::cout << "     ops_metrics_top " << cfg.metrics_page_path << "\n\n";
+
+    std::size_t submitted_ok = 0;
+    std::size_t submit_failed = 0;
+    for (std::size_t id = 1; id <= orders && pipeline.is_running(); ++id) {
+        if (pipeline.submit(Order{ static_cast<OrderId>(id) })) ++submitted_ok;
+        else ++submit_failed;
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+
+    const ShutdownReport report = pipeline.shutdown_for(std::chrono::milliseconds{ 30000 });
+    admin.stop();
+
+    std::cout << "Submit ok: " << submitted_ok << "\n";
+    std::cout << "Submit failed: " << submit_failed << "\n";
+    std::cout << "Delivered: " << report.delivered << "\n";
+    std::cout << "Pipeline state: " << to_string(pipeline.state()) << "\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t orders_count = 5000;
+    std::string mode = "shutdown"; // shutdown | shutdown_now | shutdown_for | paced | admin
+    std::chrono::milliseconds deadline{ 30000 };
+    std::size_t producers = 4;
+    std::string socket_path = "ops_admin.sock";
+
+    // Usage:
+    //   ops_app
+    //   ops_app [orders_count]
+    //   ops_app [orders_count] [shutdown|shutdown_now]
+    //   ops_app [orders_count] shutdown_for [deadline_ms]
+    //   ops_app [orders_count] paced [producers]
+    //   ops_app [orders_count] admin [socket_path]
+    if (argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) {
+            orders_count = static_cast<std::size_t>(std::stoull(argv[1]));
+        }
+        if (argc >= 3) {
+            mode = argv[2];
+        }
+        if (argc == 4 && mode == "paced") {
+            producers = std::max<std::size_t>(static_cast<std::size_t>(std::stoull(argv[3])), 1);
+        }
+        else if (argc == 4 && mode == "admin") {
+            socket_path = argv[3];
+        }
+        else if (argc == 4) {
+            deadline = std::chrono::milliseconds{ std::stoll(argv[3]) };
+        }
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    if (mode != "shutdown" && mode != "shutdown_now" && mode != "shutdown_for" && mode != "paced" && mode != "admin") {
+        print_usage();
+        return 1;
+    }
+    if (argc == 4 && mode != "shutdown_for" && mode != "paced" && mode != "admin") {
+        print_usage();
+        return 1;
+    }
+
+    if (mode == "paced") {
+        try {
+            return run_paced_scenario(orders_count, producers);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "paced run failed: " << e.what() << "\n";
+            return 2;
+        }
+    }
+
+    if (mode == "admin") {
+        try {
+            return run_admin_scenario(orders_count, socket_path);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "admin run failed: " << e.what() << "\n";
+            return 2;
+        }
+    }
+
+    Pipeline::Config cfg;
+
+    cfg.q_in_capacity = 128;
+    cfg.q_prepare_capacity = 128;
+    cfg.q_pack_capacity = 128;
+
+    cfg.prepare_workers = 2;
+    cfg.pack_workers = 2;
+    cfg.deliver_workers = 2;
+
+    cfg.push_timeout = std::chrono::milliseconds{ 50 };
+    cfg.pop_timeout  = std::chrono::milliseconds{ 20 };
+    cfg.slowest_orders = 5;
+    cfg.wakeup_stats = true;
+    cfg.flight_dump_path = "ops_flight.bin";
+
+    // `kill -USR1 <pid>` writes the same dump while the run is going.
+    (void)FlightRecorder::dump_on_signal(cfg.flight_dump_path);
+
+    Pipeline pipeline(cfg);
+
+    try {
+        pipeline.start();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "start failed: " << e.what() << "\n";
+        return 2;
+    }
+    catch (...) {
+        std::cerr << "start failed with unknown exception\n";
+        return 2;
+    }
+
+    std::uint64_t next_id = 1;
+
+    std::size_t submitted_ok = 0;
+    std::size_t submit_failed = 0;
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < orders_count; ++i) {
+        const bool ok = pipeline.submit(Order{ static_cast<OrderId>(next_id++) });
+        if (ok) ++submitted_ok;
+        else ++submit_failed;
+    }
+
+    ShutdownReport report;
+    if (mode == "shutdown") {
+        pipeline.shutdown();
+    }
+    else if (mode == "shutdown_now") {
+        pipeline.shutdown_now();
+    }
+    else {
+        report = pipeline.shutdown_for(deadline);
+    }
+
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const Metrics m = pipeline.metrics();
+    const auto& delivered = pipeline.delivered_orders();
+
+    std::cout << "Mode: " << mode << "\n";
+    std::cout << "Requested submits: " << orders_count << "\n";
+    std::cout << "Submit ok: " << submitted_ok << "\n";
+    std::cout << "Submit failed: " << submit_failed << "\n\n";
+
+    std::cout << "Pipeline state: " << to_string(pipeline.state()) << "\n\n";
+
+    std::cout << "Accepted:  " << m.accepted_count << "\n";
+    std::cout << "Prepared:  " << m.prepared_count << "\n";
+    std::cout << "Packed:    " << m.packed_count << "\n";
+    std::cout << "Delivered: " << m.delivered_count << "\n";
+    std::cout << "Delivered vector size: " << delivered.size() << "\n\n";
+
+    std::cout << "submit_timeout_count: " << m.submit_timeout_count << "\n";
+    std::cout << "wip in flight / waits: " << m.wip_in_flight << " / " << m.wip_wait_count << "\n";
+    std::cout << "workers used (prepare/pack/deliver): "
+              << m.prepare_workers_used << "/"
+              << m.pack_workers_used << "/"
+              << m.deliver_workers_used << "\n\n";
+
+    std::cout << "q_in      push/pop/max: " << m.q_in_push << "/" << m.q_in_pop
+              << "/" << m.q_in_max_size << "\n";
+    std::cout << "q_prepare push/pop/max: " << m.q_prepare_push << "/" << m.q_prepare_pop
+              << "/" << m.q_prepare_max_size << "\n";
+    std::cout << "q_pack    push/pop/max: " << m.q_pack_push << "/" << m.q_pack_pop
+              << "/" << m.q_pack_max_size << "\n";
+    std::cout << "direct handoffs (q_prepare/q_pack): " << m.q_prepare_handoff << "/"
+              << m.q_pack_handoff << "\n";
+
+    // Bucket upper bounds: "<= 8us" means the wake-up took 4..8us.
+    const auto wakeup = [](const char* name, const LatencyHistogram& h) {
+        std::cout << name << " wakeups: " << h.count()
+                  << ", p50 <= " << h.percentile(0.50).count() << "us"
+                  << ", p99 <= " << h.percentile(0.99).count() << "us\n";
+    };
+    wakeup("q_in     ", m.q_in_wakeup);
+    wakeup("q_prepare", m.q_prepare_wakeup);
+    wakeup("q_pack   ", m.q_pack_wakeup);
+    std::cout << "\n";
+
+    using namespace std::chrono;
+    std::cout << "Total lead time (ms): "
+              << duration_cast<milliseconds>(m.total_lead_time).count()
+              << "\n";
+
+    std::cout << "Wall time (ms): "
+              << duration_cast<milliseconds>(t1 - t0).count()
+              << "\n\n";
+
+    // Per hop: time since the previous step, and the worker that ran it.
+    std::cout << "Slowest orders (us): id lead = prepare@worker + pack@worker + deliver@worker\n";
+    for (const auto& e : pipeline.slowest_orders()) {
+        const auto us = [](auto d) { return duration_cast<microseconds>(d).count(); };
+        std::cout << "  " << e.id << " " << us(e.lead_time)
+                  << " = " << us(e.prepared_time - e.accepted_time) << "@" << e.prepared_by
+                  << " + " << us(e.packed_time - e.prepared_time) << "@" << e.packed_by
+                  << " + " << us(e.delivered_time - e.packed_time) << "@" << e.delivered_by << "\n";
+    }
+    std::cout << "\n";
+
+    if (mode == "shutdown_for") {
+        std::cout << "Deadline (ms): " << deadline.count() << "\n";
+        std::cout << "Drained: " << (report.drained ? "yes" : "no") << "\n";
+        std::cout << "stage    completed/abandoned\n";
+        std::cout << "prepare  " << report.prepare.completed << "/" << report.prepare.abandoned << "\n";
+        std::cout << "pack     " << report.pack.completed << "/" << report.pack.abandoned << "\n";
+        std::cout << "deliver  " << report.deliver.completed << "/" << report.deliver.abandoned << "\n\n";
+    }
+
+    if (mode == "shutdown" || (mode == "shutdown_for" && report.drained)) {
+        if (m.delivered_count != m.accepted_count) {
+            std::cout << "WARN: delivered_count != accepted_count in shutdown mode\n";
+        }
+        if (delivered.size() != static_cast<std::size_t>(m.delivered_count)) {
+            std::cout << "WARN: delivered_orders size mismatch metrics\n";
+        }
+        if (!(m.q_in_push == m.q_in_pop &&
+              m.q_prepare_push == m.q_prepare_pop &&
+              m.q_pack_push == m.q_pack_pop)) {
+            std::cout << "WARN: queue push/pop counters mismatch after shutdown\n";
+        }
+    }
+    else {
+        if (m.delivered_count > m.packed_count ||
+            m.packed_count > m.prepared_count ||
+            m.prepared_count > m.accepted_count) {
+            std::cout << "WARN: stage counters are inconsistent after shutdown_now\n";
+        }
+        if (delivered.size() != static_cast<std::size_t>(m.delivered_count)) {
+            std::cout << "WARN: delivered_orders size mismatch metrics after shutdown_now\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include "metrics_page.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr std::uint64_t kMagic = 0x45474150534D504FULL; // "OPMSPAGE"
+
+    struct Page {
+        std::uint64_t magic; // written last by the writer
+        std::uint32_t version;
+        std::uint32_t field_count;
+        std::uint64_t writer_pid;
+
+        alignas(64) std::uint64_t seq; // seqlock: odd while values are being written
+        std::uint64_t published_ns;
+        alignas(64) std::uint64_t values[MetricsPage::kMaxFields];
+
+        std::uint8_t kinds[MetricsPage::kMaxFields];
+        char names[MetricsPage::kMaxFields][MetricsPage::kNameBytes];
+    };
+
+    static_assert(sizeof(Page) <= MetricsPage::kBytes);
+
+    using Ref = std::atomic_ref<std::uint64_t>;
+
+    [[noreturn]] void fail(const std::string& path, const char* what) {
+        throw std::runtime_error("MetricsPage: " + path + ": " + what);
+    }
+
+    std::uint64_t current_pid() noexcept {
+#if defined(_WIN32)
+        return ::GetCurrentProcessId();
+#else
+        return static_cast<std::uint64_t>(::getpid());
+#endif
+    }
+
+    // The page file mapped whole, read-write for the writer or read-only.
+    struct FileMapping {
+        FileMapping(const std::string& path, bool writer) {
+#if defined(_WIN32)
+            file = ::CreateFileA(path.c_str(), writer ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, writer ? CREATE_ALWAYS : OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                file = nullptr;
+                fail(path, "cannot open");
+            }
+            mapping = ::CreateFileMappingA(file, nullptr, writer ? PAGE_READWRITE : PAGE_READONLY,
+                0, static_cast<DWORD>(MetricsPage::kBytes), nullptr);
+            if (mapping) base = ::MapViewOfFile(mapping, writer ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, MetricsPage::kBytes);
+            if (!base) {
+                close();
+                fail(path, "cannot map");
+            }
+#else
+            fd = ::open(path.c_str(), writer ? O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+            if (fd < 0) fail(path, "cannot open");
+
+            struct stat st{};
+            const bool sized = writer
+                ? ::ftruncate(fd, static_cast<off_t>(MetricsPage::kBytes)) == 0
+                : ::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= MetricsPage::kBytes;
+            if (!sized) {
+                close();
+                fail(path, "not a metrics page");
+            }
+
+            void* p = ::mmap(nullptr, MetricsPage::kBytes, writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                close();
+                fail(path, "cannot map");
+            }
+            base = p;
+#endif
+        }
+
+        ~FileMapping() {
+            close();
+        }
+
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        Page& page() const noexcept {
+            return *static_cast<Page*>(base);
+        }
+
+        void close() noexcept {
+#if defined(_WIN32)
+            if (base) ::UnmapViewOfFile(base);
+            if (mapping) ::CloseHandle(mapping);
+            if (file) ::CloseHandle(file);
+            mapping = nullptr;
+            file = nullptr;
+#else
+            if (base) ::munmap(base, MetricsPage::kBytes);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+            base = nullptr;
+        }
+
+        void* base = nullptr;
+#if defined(_WIN32)
+        void* file = nullptr;
+        void* mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+
+} // namespace
+
+struct MetricsPageWriter::Mapping : FileMapping {
+    using FileMapping::FileMapping;
+};
+
+struct MetricsPageReader::Mapping : FileMapping {
+    using FileMapping::FileMapping;
+};
+
+MetricsPageWriter::MetricsPageWriter(const std::string& path, const std::vector<MetricsPageField>& fields)
+    : fields_(fields.size()) {
+    if (fields.size() > MetricsPage::kMaxFields) fail(path, "too many fields");
+    map_ = std::make_unique<Mapping>(path, true);
+
+    // The file was just truncated, so everything reads zero until the magic
+    // is set; readers refuse the page before that.
+    Page& p = map_->page();
+    p.version = MetricsPage::kVersion;
+    p.field_count = static_cast<std::uint32_t>(fields.size());
+    p.writer_pid = current_pid();
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        const std::size_t n = std::min(fields[i].name.size(), MetricsPage::kNameBytes - 1);
+        std::memcpy(p.names[i], fields[i].name.data(), n);
+        p.kinds[i] = static_cast<std::uint8_t>(fields[i].kind);
+    }
+    Ref(p.magic).store(kMagic, std::memory_order_release);
+}
+
+MetricsPageWriter::~MetricsPageWriter() = default;
+
+void MetricsPageWriter::publish(const std::uint64_t* values) noexcept {
+    Page& p = map_->page();
+    const std::uint64_t seq = Ref(p.seq).load(std::memory_order_relaxed);
+
+    Ref(p.seq).store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    Ref(p.published_ns).store(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), std::memory_order_relaxed);
+    for (std::size_t i = 0; i < fields_; ++i) Ref(p.values[i]).store(values[i], std::memory_order_relaxed);
+
+    Ref(p.seq).store(seq + 2, std::memory_order_release);
+}
+
+std::size_t MetricsPageWriter::field_count() const noexcept {
+    return fields_;
+}
+
+std::uint64_t MetricsPageSample::value(std::string_view name) const noexcept {
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i].name == name) return values[i];
+    }
+    return 0;
+}
+
+MetricsPageReader::MetricsPageReader(const std::string& path)
+    : map_(std::make_unique<Mapping>(path, false)) {
+    Page& p = map_->page();
+    if (Ref(p.magic).load(std::memory_order_acquire) != kMagic) fail(path, "not a metrics page");
+    if (p.version != MetricsPage::kVersion) fail(path, "unsupported page version");
+
+    const std::size_t n = std::min<std::size_t>(p.field_count, MetricsPage::kMaxFields);
+    fields_.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        fields_[i].name.assign(p.names[i], ::strnlen(p.names[i], MetricsPage::kNameBytes));
+        fields_[i].kind = static_cast<MetricsPageKind>(p.kinds[i]);
+    }
+}
+
+MetricsPageReader::~MetricsPageReader() = default;
+
+MetricsPageSample MetricsPageReader::read() const {
+    Page& p = map_->page();
+
+    MetricsPageSample s;
+    s.fields = fields_;
+    s.writer_pid = p.writer_pid;
+    s.values.resize(fields_.size());
+
+    for (;;) {
+        const std::uint64_t before = Ref(p.seq).load(std::memory_order_acquire);
+        if (before % 2 != 0) {
+            std::this_thread::yield(); // the writer is mid-publish
+            continue;
+        }
+
+        s.published_ns = Ref(p.published_ns).load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < s.values.size(); ++i) {
+            s.values[i] = Ref(p.values[i]).load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (Ref(p.seq).load(std::memory_order_relaxed) == before) {
+            s.publishes = before / 2;
+            return s;
+        }
+    }
+}
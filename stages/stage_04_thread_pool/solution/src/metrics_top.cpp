@@ -0,0 +1,80 @@
+// Prints a Pipeline's MetricsPage (Config::metrics_page_path) every interval:
+// counters with their rate since the previous sample, gauges as they are.
+// Reading the page costs the pipeline nothing.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "metrics_page.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: ops_metrics_top <page_path> [interval_ms] [samples]\n";
+}
+
+void print_sample(const MetricsPageSample& now, const std::optional<MetricsPageSample>& prev) {
+    const double secs = prev && now.published_ns > prev->published_ns
+        ? static_cast<double>(now.published_ns - prev->published_ns) / 1e9
+        : 0.0;
+
+    std::printf("--- writer pid %llu, publish #%llu\n",
+        static_cast<unsigned long long>(now.writer_pid),
+        static_cast<unsigned long long>(now.publishes));
+    for (std::size_t i = 0; i < now.fields.size(); ++i) {
+        const auto& f = now.fields[i];
+        const auto v = now.values[i];
+        if (f.kind == MetricsPageKind::Counter && secs > 0 && i < prev->values.size()) {
+            const double rate = static_cast<double>(v - prev->values[i]) / secs;
+            std::printf("%-20s %16llu %14.1f/s\n", f.name.c_str(), static_cast<unsigned long long>(v), rate);
+        }
+        else {
+            std::printf("%-20s %16llu\n", f.name.c_str(), static_cast<unsigned long long>(v));
+        }
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    std::chrono::milliseconds interval{ 1000 };
+    std::uint64_t samples = 0; // 0 = until interrupted
+    try {
+        if (argc >= 3) interval = std::chrono::milliseconds{ std::stoll(argv[2]) };
+        if (argc >= 4) samples = std::stoull(argv[3]);
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        const MetricsPageReader reader(argv[1]);
+        std::optional<MetricsPageSample> prev;
+        for (std::uint64_t n = 0; samples == 0 || n < samples; ++n) {
+            if (n != 0) std::this_thread::sleep_for(interval);
+            auto sample = reader.read();
+            print_sample(sample, prev);
+            prev = std::move(sample);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    return 0;
+}
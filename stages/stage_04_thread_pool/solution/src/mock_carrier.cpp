@@ -0,0 +1,175 @@
+#include "mock_carrier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
+
+namespace {
+
+    constexpr int kPollMs = 100; // how often the accept thread checks for stop
+
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingReply {
+        Clock::time_point due;
+        std::uint64_t tag = 0;
+        OrderId id = 0;
+
+        bool operator>(const PendingReply& other) const noexcept {
+            return due > other.due;
+        }
+    };
+
+} // namespace
+
+std::chrono::microseconds CarrierLatency::sample(std::mt19937_64& rng) const {
+    const double m = static_cast<double>(mean.count());
+    double us = m;
+
+    switch (shape) {
+    case LatencyShape::Fixed:
+        break;
+    case LatencyShape::Uniform: {
+        const double s = std::clamp(spread, 0.0, 1.0);
+        us = std::uniform_real_distribution<double>(m * (1 - s), m * (1 + s))(rng);
+        break;
+    }
+    case LatencyShape::Exponential:
+        if (m > 0) us = std::exponential_distribution<double>(1.0 / m)(rng);
+        break;
+    case LatencyShape::LogNormal:
+        // E[X] = exp(mu + sigma^2 / 2), so mu is chosen to keep the mean.
+        if (m > 0) {
+            const double sigma = std::max(spread, 0.0);
+            us = std::lognormal_distribution<double>(std::log(m) - sigma * sigma / 2, sigma)(rng);
+        }
+        break;
+    }
+    return std::chrono::microseconds{ static_cast<std::int64_t>(std::max(us, 0.0)) };
+}
+
+MockCarrier::MockCarrier(CarrierLatency latency, std::string host, std::uint16_t port)
+    : latency_(latency),
+      host_(std::move(host)),
+      port_(port) {
+}
+
+MockCarrier::~MockCarrier() {
+    stop();
+}
+
+std::uint16_t MockCarrier::port() const noexcept {
+    return port_;
+}
+
+MockCarrierStats MockCarrier::stats() const noexcept {
+    MockCarrierStats s;
+    s.connections = connections_.load();
+    s.requests = requests_.load();
+    s.replies = replies_.load();
+    return s;
+}
+
+#if defined(_WIN32)
+
+void MockCarrier::start() {
+    throw std::runtime_error("MockCarrier: TCP sockets are not supported on this platform");
+}
+
+void MockCarrier::stop() noexcept {
+}
+
+void MockCarrier::serve(const std::stop_token&) {
+}
+
+void MockCarrier::serve_client(int, std::uint64_t, const std::stop_token&) {
+}
+
+#else
+
+void MockCarrier::start() {
+    if (thread_.joinable()) return;
+
+    listen_fd_ = ClusterWire::listen(host_, port_, port_);
+    thread_ = std::jthread([this](std::stop_token st) { serve(st); });
+}
+
+void MockCarrier::stop() noexcept {
+    if (!thread_.joinable()) return;
+    thread_.request_stop();
+    thread_.join();
+
+    std::vector<std::unique_ptr<Client>> clients;
+    {
+        std::lock_guard lock(clients_mutex_);
+        clients.swap(clients_);
+    }
+    clients.clear(); // jthread: request_stop + join
+
+    ClusterWire::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void MockCarrier::serve(const std::stop_token& st) {
+    while (!st.stop_requested()) {
+        pollfd p{ listen_fd_, POLLIN, 0 };
+        if (::poll(&p, 1, kPollMs) <= 0) continue;
+
+        const int client = ClusterWire::accept(listen_fd_);
+        if (client < 0) continue;
+
+        // Each connection draws its own latencies, reproducibly.
+        const std::uint64_t seed = connections_.fetch_add(1) + 1;
+        std::lock_guard lock(clients_mutex_);
+        std::erase_if(clients_, [](const auto& c) { return c->done.load(); });
+        Client& c = *clients_.emplace_back(std::make_unique<Client>());
+        c.thread = std::jthread([this, client, seed, &c](std::stop_token cst) {
+            serve_client(client, seed, cst);
+            ClusterWire::close(client);
+            c.done.store(true);
+        });
+    }
+}
+
+// Until the client hangs up or sends something other than Deliver.
+void MockCarrier::serve_client(int fd, std::uint64_t seed, const std::stop_token& st) {
+    std::mt19937_64 rng(seed);
+    std::priority_queue<PendingReply, std::vector<PendingReply>, std::greater<>> pending;
+
+    while (!st.stop_requested()) {
+        auto wait = std::chrono::milliseconds{ kPollMs };
+        if (!pending.empty()) {
+            const auto until_due = std::chrono::ceil<std::chrono::milliseconds>(pending.top().due - Clock::now());
+            wait = std::clamp(until_due, std::chrono::milliseconds{ 0 }, wait);
+        }
+
+        if (ClusterWire::readable(fd, wait)) {
+            ClusterFrame request;
+            PendingReply r;
+            if (!ClusterWire::receive(fd, request) || request.type != ClusterMsg::Deliver
+                || !ClusterWire::decode_deliver(request.payload, r.tag, r.id)) {
+                return;
+            }
+            r.due = Clock::now() + latency_.sample(rng);
+            pending.push(r);
+            requests_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const auto now = Clock::now();
+        while (!pending.empty() && pending.top().due <= now) {
+            const PendingReply r = pending.top();
+            pending.pop();
+            if (!ClusterWire::send(fd, ClusterMsg::Deliver, ClusterWire::encode_deliver(r.tag, r.id))) return;
+            replies_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,68 @@
+// One cluster node: a Pipeline served over TCP by ClusterNode. Prints the
+// port it listens on, serves until a client sends Shutdown, then exits.
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "cluster_node.hpp"
+#include "pipeline.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: ops_node [port (0 = any free)] [workers_per_stage] [host]\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::uint16_t port = 0;
+    std::size_t workers = 2;
+    std::string host = "127.0.0.1";
+
+    if (argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        if (argc >= 2) port = static_cast<std::uint16_t>(std::stoul(argv[1]));
+        if (argc >= 3) workers = std::stoull(argv[2]);
+        if (argc >= 4) host = argv[3];
+    }
+    catch (...) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        Pipeline::Config cfg;
+        cfg.prepare_workers = workers;
+        cfg.pack_workers = workers;
+        cfg.deliver_workers = workers;
+        cfg.q_in_capacity = 1024;
+        cfg.pop_timeout = std::chrono::milliseconds{ 20 };
+
+        Pipeline pipeline(cfg);
+        pipeline.start();
+        ClusterNode node(pipeline, host, port);
+        node.start();
+
+        // The first line is read by whoever started the node to learn the port.
+        std::cout << "listening " << host << ":" << node.port() << std::endl;
+
+        node.wait_for_shutdown();
+        node.stop();
+
+        const auto s = node.stats();
+        std::cout << "accepted=" << s.accepted << " delivered=" << s.delivered
+                  << " submit_timeouts=" << s.submit_timeouts << std::endl;
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,143 @@
+#include "order_coalescer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+OrderCoalescer::OrderCoalescer(std::chrono::milliseconds window, std::size_t max_group)
+    : window_(window),
+      max_group_(std::max<std::size_t>(max_group, 1)) {
+}
+
+bool OrderCoalescer::hold(Order&& order, std::size_t limit, std::optional<Order>& full) {
+    const auto now = Clock::now();
+    Shard& shard = shard_of(order.customer);
+
+    std::unique_lock lock(shard.mutex);
+    if (shard.closed) return false;
+
+    // Shards count into one total, so the limit holds across them.
+    std::size_t held = held_.load(std::memory_order_relaxed);
+    do {
+        if (held >= limit) return false;
+    } while (!held_.compare_exchange_weak(held, held + 1, std::memory_order_relaxed));
+
+    auto it = shard.open.find(order.customer);
+    if (it == shard.open.end()) {
+        const std::uint64_t customer = order.customer;
+        it = shard.open.emplace(customer, Group{ std::move(order), {}, now, { now } }).first;
+    }
+    else {
+        Group& group = it->second;
+        group.lead.work += order.work;
+        ++group.lead.merged;
+        group.merged.push_back(std::move(order));
+        group.arrived.push_back(now);
+    }
+    if (it->second.lead.group_size() < max_group_) return true;
+
+    Group filled = std::move(it->second);
+    shard.open.erase(it);
+    lock.unlock();
+    full.emplace(release(std::move(filled), now));
+    return true;
+}
+
+std::vector<Order> OrderCoalescer::take_due(Clock::time_point now) {
+    std::vector<Group> due;
+    for (auto& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        for (auto it = shard.open.begin(); it != shard.open.end();) {
+            if (it->second.opened + window_ > now) {
+                ++it;
+                continue;
+            }
+            due.push_back(std::move(it->second));
+            it = shard.open.erase(it);
+        }
+    }
+
+    // Oldest first, so customers are released in the order they showed up.
+    std::sort(due.begin(), due.end(), [](const Group& a, const Group& b) { return a.opened < b.opened; });
+
+    std::vector<Order> leads;
+    leads.reserve(due.size());
+    for (auto& g : due) leads.push_back(release(std::move(g), now));
+    return leads;
+}
+
+std::vector<Order> OrderCoalescer::take_all() {
+    return take_due(Clock::time_point::max());
+}
+
+void OrderCoalescer::close() noexcept {
+    for (auto& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        shard.closed = true;
+    }
+}
+
+std::vector<Order> OrderCoalescer::follow(const Order& lead, const std::function<void(const Order&)>& each) {
+    Shard& shard = shard_of(lead.customer);
+    std::lock_guard lock(shard.mutex);
+
+    const auto it = shard.released.find(lead.id);
+    if (it == shard.released.end()) return {};
+
+    for (auto& m : it->second) {
+        m.status = lead.status;
+        m.prepared_time = lead.prepared_time;
+        m.packed_time = lead.packed_time;
+        m.delivered_time = lead.delivered_time;
+        m.prepared_by = lead.prepared_by;
+        m.packed_by = lead.packed_by;
+        m.delivered_by = lead.delivered_by;
+        if (each) each(m);
+    }
+    if (!lead.is_final()) return {};
+
+    std::vector<Order> done = std::move(it->second);
+    shard.released.erase(it);
+    return done;
+}
+
+std::vector<Order> OrderCoalescer::merged_of(const Order& lead) const {
+    const Shard& shard = shard_of(lead.customer);
+    std::lock_guard lock(shard.mutex);
+
+    const auto it = shard.released.find(lead.id);
+    return it == shard.released.end() ? std::vector<Order>{} : it->second;
+}
+
+CoalesceStats OrderCoalescer::stats() const {
+    CoalesceStats s;
+    s.groups = groups_.load(std::memory_order_relaxed);
+    s.coalesced = coalesced_.load(std::memory_order_relaxed);
+    s.held = held_.load(std::memory_order_relaxed);
+    s.hold = hold_.snapshot();
+    return s;
+}
+
+OrderCoalescer::Shard& OrderCoalescer::shard_of(std::uint64_t customer) noexcept {
+    return shards_[std::hash<std::uint64_t>{}(customer) % kShards];
+}
+
+const OrderCoalescer::Shard& OrderCoalescer::shard_of(std::uint64_t customer) const noexcept {
+    return shards_[std::hash<std::uint64_t>{}(customer) % kShards];
+}
+
+Order OrderCoalescer::release(Group&& group, Clock::time_point now) {
+    // take_all() passes time_point::max(); the hold then ends now.
+    const auto end = std::min(now, Clock::now());
+    for (const auto t : group.arrived) hold_.record(end - t);
+
+    const std::size_t n = group.lead.group_size();
+    if (n > 1) {
+        Shard& shard = shard_of(group.lead.customer);
+        std::lock_guard lock(shard.mutex);
+        shard.released.emplace(group.lead.id, std::move(group.merged));
+    }
+    coalesced_.fetch_add(n - 1, std::memory_order_relaxed);
+    groups_.fetch_add(1, std::memory_order_relaxed);
+    held_.fetch_sub(n, std::memory_order_relaxed);
+    return std::move(group.lead);
+}
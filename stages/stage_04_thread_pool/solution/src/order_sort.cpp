@@ -0,0 +1,187 @@
+#include "order_sort.hpp"
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+    constexpr std::size_t kDigitBits = 8;
+    constexpr std::size_t kBuckets = std::size_t{ 1 } << kDigitBits;
+    constexpr std::size_t kPasses = 64 / kDigitBits;
+
+    // Below this many items per thread the fan-out costs more than it saves.
+    constexpr std::size_t kMinItemsPerThread = std::size_t{ 1 } << 16;
+
+    struct KeyIndex {
+        std::uint64_t key;
+        std::size_t index;
+    };
+
+    using Histogram = std::array<std::size_t, kBuckets>;
+
+    std::size_t digit_of(std::uint64_t key, std::size_t pass) noexcept {
+        return static_cast<std::size_t>((key >> (pass * kDigitBits)) & (kBuckets - 1));
+    }
+
+    std::size_t thread_count(std::size_t n, std::size_t requested) {
+        if (requested == 0) requested = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        return std::clamp<std::size_t>(n / kMinItemsPerThread, 1, requested);
+    }
+
+    // Threads split [0, n) into contiguous ranges. Each pass is
+    // histogram -> (thread 0) exclusive prefix over (digit, thread) -> scatter,
+    // which keeps the sort stable across thread boundaries.
+    template <class KeyOf>
+    OrderIndex radix_sort_impl(std::size_t n, const KeyOf& key_of, std::size_t requested_threads) {
+        OrderIndex perm(n);
+        if (n == 0) return perm;
+
+        const std::size_t threads = thread_count(n, requested_threads);
+
+        std::vector<KeyIndex> a(n);
+        std::vector<KeyIndex> b(n);
+
+        std::vector<Histogram> hist(threads);
+        std::vector<std::uint64_t> differing(threads, 0);
+        std::vector<std::size_t> passes;
+        passes.reserve(kPasses);
+
+        std::barrier sync(static_cast<std::ptrdiff_t>(threads));
+        bool aborted = false; // a helper could not be started; set before the first barrier completes
+
+        auto work = [&](std::size_t t) {
+            const std::size_t begin = n * t / threads;
+            const std::size_t end = n * (t + 1) / threads;
+
+            const std::uint64_t first = key_of(0);
+            std::uint64_t diff = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+                const std::uint64_t k = key_of(i);
+                a[i] = KeyIndex{ k, i };
+                diff |= k ^ first;
+            }
+            differing[t] = diff;
+            sync.arrive_and_wait();
+            if (aborted) return;
+
+            if (t == 0) {
+                std::uint64_t all = 0;
+                for (const auto d : differing) all |= d;
+                for (std::size_t p = 0; p < kPasses; ++p) {
+                    if (digit_of(all, p) != 0) passes.push_back(p);
+                }
+            }
+            sync.arrive_and_wait();
+
+            KeyIndex* src = a.data();
+            KeyIndex* dst = b.data();
+
+            for (const std::size_t pass : passes) {
+                auto& h = hist[t];
+                h.fill(0);
+                for (std::size_t i = begin; i < end; ++i) ++h[digit_of(src[i].key, pass)];
+                sync.arrive_and_wait();
+
+                if (t == 0) {
+                    std::size_t running = 0;
+                    for (std::size_t d = 0; d < kBuckets; ++d) {
+                        for (auto& th : hist) {
+                            const std::size_t count = th[d];
+                            th[d] = running;
+                            running += count;
+                        }
+                    }
+                }
+                sync.arrive_and_wait();
+
+                for (std::size_t i = begin; i < end; ++i) {
+                    dst[h[digit_of(src[i].key, pass)]++] = src[i];
+                }
+                sync.arrive_and_wait();
+
+                std::swap(src, dst);
+            }
+
+            for (std::size_t i = begin; i < end; ++i) perm[i] = src[i].index;
+        };
+
+        std::vector<std::jthread> helpers;
+        helpers.reserve(threads - 1);
+        try {
+            for (std::size_t t = 1; t < threads; ++t) helpers.emplace_back(work, t);
+        }
+        catch (...) {
+            // The helpers already running wait at the first barrier: drop
+            // this thread and the ones never started, let them see `aborted`
+            // and leave, then sort here alone.
+            aborted = true;
+            for (std::size_t t = helpers.size(); t < threads; ++t) sync.arrive_and_drop();
+            helpers.clear();
+            return radix_sort_impl(n, key_of, 1);
+        }
+        work(0);
+        helpers.clear(); // joins: the helpers may still be filling their part of perm
+
+        return perm;
+    }
+
+} // namespace
+
+std::uint64_t time_key(std::chrono::steady_clock::time_point t) noexcept {
+    // Flip the sign bit so signed tick counts sort as unsigned.
+    const auto ticks = static_cast<std::uint64_t>(t.time_since_epoch().count());
+    return ticks ^ (std::uint64_t{ 1 } << 63);
+}
+
+std::uint64_t order_key(const Order& o, OrderKey key) noexcept {
+    switch (key) {
+    case OrderKey::AcceptedTime:  return time_key(o.accepted_time);
+    case OrderKey::DeliveredTime: return time_key(o.delivered_time);
+    case OrderKey::Id:
+    default:                      return static_cast<std::uint64_t>(o.id);
+    }
+}
+
+OrderIndex radix_sort_permutation(const std::vector<std::uint64_t>& keys, std::size_t threads) {
+    return radix_sort_impl(keys.size(), [&](std::size_t i) { return keys[i]; }, threads);
+}
+
+OrderIndex sort_orders(const std::vector<Order>& orders, OrderKey key, std::size_t threads) {
+    return radix_sort_impl(orders.size(), [&](std::size_t i) { return order_key(orders[i], key); }, threads);
+}
+
+OrderIndex merge_sorted_runs(const std::vector<Order>& orders,
+    const std::vector<OrderIndex>& runs,
+    OrderKey key) {
+    // (key, run, position in run); std::greater turns the heap into a min-heap.
+    using Head = std::tuple<std::uint64_t, std::size_t, std::size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+
+    std::size_t total = 0;
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        total += runs[r].size();
+        if (!runs[r].empty()) heads.emplace(order_key(orders[runs[r][0]], key), r, 0);
+    }
+
+    OrderIndex merged;
+    merged.reserve(total);
+
+    while (!heads.empty()) {
+        const auto [k, r, pos] = heads.top();
+        heads.pop();
+        (void)k;
+
+        merged.push_back(runs[r][pos]);
+        if (pos + 1 < runs[r].size()) {
+            heads.emplace(order_key(orders[runs[r][pos + 1]], key), r, pos + 1);
+        }
+    }
+
+    return merged;
+}
@@ -0,0 +1,305 @@
+#include "persistent_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr std::uint64_t kMagic = 0x474E49524E495153ULL; // "SQINRING"
+    constexpr std::uint32_t kVersion = 2;
+    constexpr std::size_t kHeaderBytes = 4096; // slots start on their own page
+
+    using Ref = std::atomic_ref<std::uint64_t>;
+
+    [[noreturn]] void fail(const std::string& path, const char* what) {
+        throw std::runtime_error("PersistentOrderRing: " + path + ": " + what);
+    }
+
+} // namespace
+
+// Written last when a file is formatted, so a torn format is redone.
+struct PersistentOrderRing::Header {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t slot_bytes;
+    std::uint64_t capacity;
+
+    alignas(64) std::uint64_t head; // sequence of the oldest pending slot
+    alignas(64) std::uint64_t tail; // sequence the next push takes
+};
+
+struct PersistentOrderRing::Slot {
+    std::uint64_t commit; // seq + 1 once the fields below hold the order pushed at seq
+    std::uint64_t id;
+    std::uint64_t customer;
+    std::uint64_t seq;
+    std::uint64_t accepted_ns; // steady_clock time since its epoch
+    std::uint64_t work_merged; // work | merged << 32
+};
+
+PersistentOrderRing::PersistentOrderRing(const std::string& path, std::size_t capacity,
+    PersistSync sync, std::size_t sync_batch)
+    : capacity_(std::max<std::size_t>(capacity, 1)),
+      sync_(sync),
+      sync_batch_(std::max<std::size_t>(sync_batch, 1)),
+      bytes_(kHeaderBytes + capacity_ * sizeof(Slot)) {
+    static_assert(sizeof(Header) <= kHeaderBytes);
+    map_file(path);
+
+    header_ = static_cast<Header*>(base_);
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(base_) + kHeaderBytes);
+
+    if (Ref(header_->magic).load() != kMagic) {
+        format();
+        return;
+    }
+    if (header_->version != kVersion || header_->slot_bytes != sizeof(Slot) || header_->capacity != capacity_) {
+        unmap_file();
+        fail(path, "existing ring has a different layout or capacity");
+    }
+    recover();
+}
+
+PersistentOrderRing::~PersistentOrderRing() {
+    if (sync_ == PersistSync::PerBatch) flush();
+    unmap_file();
+}
+
+void PersistentOrderRing::format() {
+    header_->version = kVersion;
+    header_->slot_bytes = sizeof(Slot);
+    header_->capacity = capacity_;
+    Ref(header_->head).store(0);
+    Ref(header_->tail).store(0);
+    for (std::size_t i = 0; i < capacity_; ++i) Ref(slots_[i].commit).store(0);
+
+    if (sync_ == PersistSync::PerBatch) flush();
+    Ref(header_->magic).store(kMagic);
+    if (sync_ == PersistSync::PerBatch) flush();
+}
+
+void PersistentOrderRing::recover() {
+    const std::uint64_t head = Ref(header_->head).load();
+    std::uint64_t tail = head;
+    while (tail - head < capacity_ && Ref(slot_of(tail).commit).load() == tail + 1) ++tail;
+
+    // The crash may have hit between a commit and the tail store.
+    Ref(header_->tail).store(tail);
+}
+
+std::vector<Order> PersistentOrderRing::pending() const {
+    using namespace std::chrono;
+
+    const std::uint64_t head = Ref(header_->head).load(std::memory_order_acquire);
+    const std::uint64_t tail = Ref(header_->tail).load(std::memory_order_acquire);
+    const auto now = steady_clock::now();
+
+    std::vector<Order> orders;
+    orders.reserve(static_cast<std::size_t>(tail - head));
+    for (std::uint64_t seq = head; seq != tail; ++seq) {
+        Slot& slot = slot_of(seq);
+        Order& order = orders.emplace_back(Ref(slot.id).load());
+        order.customer = Ref(slot.customer).load();
+        order.seq = Ref(slot.seq).load();
+
+        const std::uint64_t work_merged = Ref(slot.work_merged).load();
+        order.work = static_cast<std::uint32_t>(work_merged);
+        order.merged = static_cast<std::uint32_t>(work_merged >> 32);
+
+        const auto since_epoch = nanoseconds{ static_cast<std::int64_t>(Ref(slot.accepted_ns).load()) };
+        const steady_clock::time_point accepted{ duration_cast<steady_clock::duration>(since_epoch) };
+        if (accepted <= now) order.accepted_time = accepted;
+    }
+    return orders;
+}
+
+void PersistentOrderRing::on_push(const Order& order) noexcept {
+    const std::uint64_t seq = Ref(header_->tail).load(std::memory_order_relaxed);
+    Slot& slot = slot_of(seq);
+
+    const auto accepted = std::chrono::duration_cast<std::chrono::nanoseconds>(order.accepted_time.time_since_epoch());
+    Ref(slot.id).store(order.id, std::memory_order_relaxed);
+    Ref(slot.customer).store(order.customer, std::memory_order_relaxed);
+    Ref(slot.seq).store(order.seq, std::memory_order_relaxed);
+    Ref(slot.accepted_ns).store(static_cast<std::uint64_t>(accepted.count()), std::memory_order_relaxed);
+    Ref(slot.work_merged).store(order.work | static_cast<std::uint64_t>(order.merged) << 32, std::memory_order_relaxed);
+    Ref(slot.commit).store(seq + 1, std::memory_order_release);
+    Ref(header_->tail).store(seq + 1, std::memory_order_release);
+
+    if (sync_ != PersistSync::PerBatch) return;
+    std::lock_guard lock(dirty_mutex_);
+    if (dirty_count_ == 0) dirty_first_ = seq;
+    ++dirty_count_; // pushes arrive in seq order under the queue mutex
+    ++unsynced_;
+}
+
+void PersistentOrderRing::on_pop() noexcept {
+    const std::uint64_t head = Ref(header_->head).load(std::memory_order_relaxed);
+    Ref(header_->head).store(head + 1, std::memory_order_release);
+
+    if (sync_ != PersistSync::PerBatch) return;
+    std::lock_guard lock(dirty_mutex_);
+    ++unsynced_;
+}
+
+// Outside the queue mutex: takes the dirty range and syncs the slots it
+// covers, then the header that publishes them.
+void PersistentOrderRing::sync() noexcept {
+    if (sync_ != PersistSync::PerBatch) return;
+
+    std::uint64_t first = 0;
+    std::uint64_t count = 0;
+    {
+        std::lock_guard lock(dirty_mutex_);
+        if (unsynced_ < sync_batch_) return;
+        first = dirty_first_;
+        count = dirty_count_;
+        unsynced_ = 0;
+        dirty_count_ = 0;
+    }
+
+    if (count >= capacity_) {
+        sync_bytes(kHeaderBytes, capacity_ * sizeof(Slot));
+    }
+    else if (count > 0) {
+        const auto from = static_cast<std::size_t>(first % capacity_);
+        const auto n = static_cast<std::size_t>(count);
+        const std::size_t before_wrap = std::min(n, capacity_ - from);
+        sync_bytes(kHeaderBytes + from * sizeof(Slot), before_wrap * sizeof(Slot));
+        if (n > before_wrap) sync_bytes(kHeaderBytes, (n - before_wrap) * sizeof(Slot));
+    }
+    sync_bytes(0, sizeof(Header));
+    sync_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PersistentOrderRing::flush() noexcept {
+    sync_bytes(0, bytes_);
+    {
+        std::lock_guard lock(dirty_mutex_);
+        unsynced_ = 0;
+        dirty_count_ = 0;
+    }
+    sync_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::size_t PersistentOrderRing::size() const noexcept {
+    const std::uint64_t head = Ref(header_->head).load(std::memory_order_acquire);
+    return static_cast<std::size_t>(Ref(header_->tail).load(std::memory_order_acquire) - head);
+}
+
+std::size_t PersistentOrderRing::capacity() const noexcept {
+    return capacity_;
+}
+
+std::uint64_t PersistentOrderRing::sync_count() const noexcept {
+    return sync_count_.load(std::memory_order_relaxed);
+}
+
+PersistentOrderRing::Slot& PersistentOrderRing::slot_of(std::uint64_t seq) const noexcept {
+    return slots_[seq % capacity_];
+}
+
+#if defined(_WIN32)
+
+void PersistentOrderRing::map_file(const std::string& path) {
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) fail(path, "cannot open");
+    file_ = file;
+
+    LARGE_INTEGER size{};
+    if (!::GetFileSizeEx(file, &size)) {
+        unmap_file();
+        fail(path, "cannot stat");
+    }
+    if (size.QuadPart != 0 && static_cast<std::uint64_t>(size.QuadPart) != bytes_) {
+        unmap_file();
+        fail(path, "existing ring has a different layout or capacity");
+    }
+
+    // Mapping a larger size than the file extends it with zeros.
+    const auto bytes = static_cast<std::uint64_t>(bytes_);
+    mapping_ = ::CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes & 0xFFFFFFFFu), nullptr);
+    if (!mapping_) {
+        unmap_file();
+        fail(path, "cannot map");
+    }
+
+    base_ = ::MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, bytes_);
+    if (!base_) {
+        unmap_file();
+        fail(path, "cannot map");
+    }
+}
+
+void PersistentOrderRing::unmap_file() noexcept {
+    if (base_) ::UnmapViewOfFile(base_);
+    if (mapping_) ::CloseHandle(mapping_);
+    if (file_) ::CloseHandle(file_);
+    base_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+}
+
+void PersistentOrderRing::sync_bytes(std::size_t offset, std::size_t bytes) noexcept {
+    ::FlushViewOfFile(static_cast<char*>(base_) + offset, bytes);
+    ::FlushFileBuffers(file_);
+}
+
+#else
+
+void PersistentOrderRing::map_file(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) fail(path, "cannot open");
+
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0) {
+        unmap_file();
+        fail(path, "cannot stat");
+    }
+    if (st.st_size == 0 && ::ftruncate(fd_, static_cast<off_t>(bytes_)) != 0) {
+        unmap_file();
+        fail(path, "cannot resize");
+    }
+    if (st.st_size != 0 && static_cast<std::size_t>(st.st_size) != bytes_) {
+        unmap_file();
+        fail(path, "existing ring has a different layout or capacity");
+    }
+
+    void* base = ::mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+        unmap_file();
+        fail(path, "cannot map");
+    }
+    base_ = base;
+}
+
+void PersistentOrderRing::unmap_file() noexcept {
+    if (base_) ::munmap(base_, bytes_);
+    if (fd_ >= 0) ::close(fd_);
+    base_ = nullptr;
+    fd_ = -1;
+}
+
+// msync wants a page-aligned start.
+void PersistentOrderRing::sync_bytes(std::size_t offset, std::size_t bytes) noexcept {
+    static const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t start = offset / page * page;
+    ::msync(static_cast<char*>(base_) + start, offset + bytes - start, MS_SYNC);
+}
+
+#endif
@@ -0,0 +1,1734 @@
+#include "pipeline.hpp"
+
+#include "cluster_wire.hpp"
+#include "deadline_waker.hpp"
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+    Pipeline::Config normalized(Pipeline::Config cfg) {
+        cfg.prepare_workers = std::max<std::size_t>(cfg.prepare_workers, 1);
+        cfg.pack_workers = std::max<std::size_t>(cfg.pack_workers, 1);
+        cfg.deliver_workers = std::max<std::size_t>(cfg.deliver_workers, 1);
+        cfg.shared_workers = std::max<std::size_t>(cfg.shared_workers, 1);
+        cfg.carrier_window = std::max<std::size_t>(cfg.carrier_window, 1);
+        if (cfg.cores == 0) cfg.cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        return cfg;
+    }
+
+    bool is_shared(const Pipeline::Config& cfg) {
+        return cfg.scheduling != SchedulingPolicy::Dedicated;
+    }
+
+    // Threads serving every stage under the non-dedicated policies.
+    std::size_t pool_size(const Pipeline::Config& cfg) {
+        return cfg.scheduling == SchedulingPolicy::ThreadPerCore ? cfg.cores : cfg.shared_workers;
+    }
+
+    ConsumerHandoff handoff_of(const Pipeline::Config& cfg) {
+        return cfg.direct_handoff ? ConsumerHandoff::Direct : ConsumerHandoff::ViaQueue;
+    }
+
+    std::unique_ptr<PersistentOrderRing> open_intake_file(const Pipeline::Config& cfg) {
+        if (cfg.q_in_path.empty()) return nullptr;
+        if (cfg.scheduling == SchedulingPolicy::ThreadPerCore) {
+            throw std::invalid_argument("Pipeline: q_in_path is not supported with ThreadPerCore");
+        }
+        if (cfg.queue_order != PopOrder::Fifo) {
+            throw std::invalid_argument("Pipeline: q_in_path needs PopOrder::Fifo");
+        }
+        return std::make_unique<PersistentOrderRing>(cfg.q_in_path, cfg.q_in_capacity, cfg.q_in_sync, cfg.q_in_sync_batch);
+    }
+
+    std::atomic<std::uint16_t> next_flight_source{ 1 };
+
+    void raise_max(std::atomic<std::size_t>& max, std::size_t value) noexcept {
+        std::size_t seen = max.load(std::memory_order_relaxed);
+        while (seen < value && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // For counters with a single writer: no locked read-modify-write needed.
+    template <typename T>
+    void bump(std::atomic<T>& counter, T by) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_release);
+    }
+
+    // Pins the calling thread to the `slot`-th CPU it is allowed to run on
+    // (wrapping around); returns that CPU, or -1 if pinning is unavailable.
+    int pin_to_cpu(std::size_t slot) noexcept {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+        const int count = CPU_COUNT(&allowed);
+        if (count <= 0) return -1;
+
+        auto skip = slot % static_cast<std::size_t>(count);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed) || skip-- > 0) continue;
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            return ::pthread_setaffinity_np(::pthread_self(), sizeof(one), &one) == 0 ? cpu : -1;
+        }
+        return -1;
+#else
+        (void)slot;
+        return -1;
+#endif
+    }
+
+    struct PageField {
+        const char* name;
+        MetricsPageKind kind;
+    };
+
+    // Order of the values publish_metrics_page() writes. Append only: older
+    // readers find fields by name.
+    constexpr PageField kPageFields[] = {
+        { "accepted", MetricsPageKind::Counter },
+        { "prepared", MetricsPageKind::Counter },
+        { "packed", MetricsPageKind::Counter },
+        { "delivered", MetricsPageKind::Counter },
+        { "submit_timeouts", MetricsPageKind::Counter },
+        { "wip_waits", MetricsPageKind::Counter },
+        { "lead_time_ns", MetricsPageKind::Counter },
+        { "q_in_push", MetricsPageKind::Counter },
+        { "q_in_pop", MetricsPageKind::Counter },
+        { "q_prepare_push", MetricsPageKind::Counter },
+        { "q_prepare_pop", MetricsPageKind::Counter },
+        { "q_prepare_handoff", MetricsPageKind::Counter },
+        { "q_pack_push", MetricsPageKind::Counter },
+        { "q_pack_pop", MetricsPageKind::Counter },
+        { "q_pack_handoff", MetricsPageKind::Counter },
+        { "q_in_sync", MetricsPageKind::Counter },
+        { "in_flight", MetricsPageKind::Gauge },
+        { "q_in_depth", MetricsPageKind::Gauge },
+        { "q_prepare_depth", MetricsPageKind::Gauge },
+        { "q_pack_depth", MetricsPageKind::Gauge },
+        { "q_in_max", MetricsPageKind::Gauge },
+        { "q_prepare_max", MetricsPageKind::Gauge },
+        { "q_pack_max", MetricsPageKind::Gauge },
+        { "prepare_workers", MetricsPageKind::Gauge },
+        { "pack_workers", MetricsPageKind::Gauge },
+        { "deliver_workers", MetricsPageKind::Gauge },
+        { "state", MetricsPageKind::Gauge }, // PipelineState
+        { "paused", MetricsPageKind::Gauge },
+        { "reorder_released", MetricsPageKind::Counter },
+        { "reorder_depth", MetricsPageKind::Gauge },
+        { "coalesced_orders", MetricsPageKind::Counter },
+        { "coalesce_held", MetricsPageKind::Gauge },
+    };
+
+    std::unique_ptr<ReorderBuffer> open_reorder_buffer(const Pipeline::Config& cfg) {
+        if (cfg.reorder_window == 0) return nullptr;
+        if (cfg.scheduling == SchedulingPolicy::ThreadPerCore || !cfg.q_in_path.empty()) {
+            throw std::invalid_argument("Pipeline: reorder_window is not supported with ThreadPerCore or q_in_path");
+        }
+        return std::make_unique<ReorderBuffer>(cfg.reorder_window, cfg.ordered_sink);
+    }
+
+    std::unique_ptr<OrderCoalescer> open_coalescer(const Pipeline::Config& cfg) {
+        if (cfg.coalesce_window.count() <= 0) return nullptr;
+        if (cfg.scheduling == SchedulingPolicy::ThreadPerCore || !cfg.q_in_path.empty() || cfg.reorder_window != 0) {
+            throw std::invalid_argument("Pipeline: coalesce_window is not supported with ThreadPerCore, q_in_path or reorder_window");
+        }
+        return std::make_unique<OrderCoalescer>(cfg.coalesce_window, cfg.coalesce_max_group);
+    }
+
+    std::unique_ptr<MetricsPageWriter> open_metrics_page(const Pipeline::Config& cfg) {
+        if (cfg.metrics_page_path.empty()) return nullptr;
+
+        std::vector<MetricsPageField> fields;
+        for (const auto& f : kPageFields) fields.push_back(MetricsPageField{ f.name, f.kind });
+        return std::make_unique<MetricsPageWriter>(cfg.metrics_page_path, fields);
+    }
+
+    // Deliver runs (and slowest_orders shards): one per thread that may deliver.
+    std::size_t delivering_threads(const Pipeline::Config& cfg) {
+        if (is_shared(cfg)) return pool_size(cfg);
+        return std::max(cfg.deliver_workers, cfg.max_stage_workers);
+    }
+
+} // namespace
+
+Pipeline::Pipeline()
+    : Pipeline(Config{}) {
+}
+
+Pipeline::Pipeline(Config cfg)
+    : cfg_(normalized(cfg)),
+      flight_source_(next_flight_source.fetch_add(1, std::memory_order_relaxed)),
+      q_in_file_(open_intake_file(cfg_)),
+      q_in_(cfg_.q_in_capacity,
+          cfg_.fair_submit ? PushAdmission::Fifo : PushAdmission::Unordered,
+          ConsumerHandoff::ViaQueue,
+          cfg_.queue_backend,
+          cfg_.queue_order,
+          cfg_.work_aging),
+      q_prepare_(cfg_.q_prepare_capacity, PushAdmission::Unordered, handoff_of(cfg_), cfg_.queue_backend,
+          cfg_.queue_order, cfg_.work_aging),
+      q_pack_(cfg_.q_pack_capacity, PushAdmission::Unordered, handoff_of(cfg_), cfg_.queue_backend,
+          cfg_.queue_order, cfg_.work_aging),
+      delivered_segments_(delivering_threads(cfg_)) {
+    if (cfg_.carrier_port != 0 && is_shared(cfg_)) {
+        throw std::invalid_argument("Pipeline: carrier_port needs SchedulingPolicy::Dedicated");
+    }
+    if (cfg_.carrier_port != 0) {
+        for (std::size_t i = 0; i < delivered_segments_.size(); ++i) carrier_bells_.push_back(std::make_unique<CarrierBell>());
+    }
+    for (auto* q : { &q_in_, &q_prepare_, &q_pack_ }) q->record_wakeups(cfg_.wakeup_stats);
+    if (cfg_.slowest_orders != 0) {
+        slowest_ = std::make_unique<SlowestOrders>(cfg_.slowest_orders, delivered_segments_.size());
+    }
+    metrics_page_ = open_metrics_page(cfg_);
+    reorder_ = open_reorder_buffer(cfg_);
+    coalescer_ = open_coalescer(cfg_);
+    if (cfg_.scheduling == SchedulingPolicy::ThreadPerCore) {
+        cores_.reserve(cfg_.cores);
+        for (std::size_t i = 0; i < cfg_.cores; ++i) cores_.push_back(std::make_unique<Core>(cfg_.q_in_capacity));
+    }
+}
+
+Pipeline::~Pipeline() noexcept {
+    try {
+        shutdown_now();
+    }
+    catch (...) {
+    }
+}
+
+void Pipeline::start() {
+    std::lock_guard lock(lifecycle_mutex_);
+
+    const auto s = state_.load();
+    if (s == PipelineState::Running) return;
+    if (s != PipelineState::Created) {
+        throw std::logic_error("Pipeline: start is only allowed in Created state");
+    }
+
+    if (q_in_file_) resume_persisted_intake();
+
+    // A shared worker serves every stage, so it counts as a worker of each.
+    const bool shared = is_shared(cfg_);
+    const std::size_t pool = pool_size(cfg_);
+    const std::array<std::size_t, kStages> counts = shared
+        ? std::array<std::size_t, kStages>{ pool, pool, pool }
+        : std::array<std::size_t, kStages>{ cfg_.prepare_workers, cfg_.pack_workers, cfg_.deliver_workers };
+
+    {
+        std::lock_guard wl(workers_mutex_);
+        active_workers_ = counts;
+        live_workers_ = shared ? pool : counts[0] + counts[1] + counts[2];
+    }
+
+    try {
+        workers_.reserve(live_workers_);
+        for (std::size_t s_idx = 0; s_idx < kStages && !shared; ++s_idx) {
+            for (std::size_t i = 0; i < counts[s_idx]; ++i) {
+                WorkerContext ctx;
+                ctx.stage = static_cast<Stage>(s_idx);
+                ctx.index = i;
+                spawn_worker(std::move(ctx));
+            }
+        }
+        for (std::size_t i = 0; i < pool && shared; ++i) {
+            WorkerContext ctx;
+            ctx.index = i;
+            ctx.shared = true;
+            spawn_worker(std::move(ctx));
+        }
+    }
+    catch (...) {
+        // Threads that never started must not be waited for.
+        {
+            std::lock_guard wl(workers_mutex_);
+            live_workers_ = workers_.size();
+        }
+        failed_.store(true);
+        escalate();
+        join_workers();
+        report_ = make_report();
+        set_state(PipelineState::Failed);
+        throw;
+    }
+
+    {
+        std::lock_guard ml(metrics_mutex_);
+        metrics_.prepare_workers_used = counts[0];
+        metrics_.pack_workers_used = counts[1];
+        metrics_.deliver_workers_used = counts[2];
+    }
+
+    // A worker that already failed has moved the state to Failed; keep it.
+    (void)advance_state(PipelineState::Created, PipelineState::Running);
+
+    if (coalescer_) {
+        coalescer_thread_ = std::jthread([this](std::stop_token st) { run_coalescer(st); });
+    }
+    if (metrics_page_) {
+        publish_metrics_page();
+        metrics_publisher_ = std::jthread([this](std::stop_token st) { run_metrics_publisher(st); });
+    }
+}
+
+void Pipeline::shutdown() {
+    (void)stop(std::nullopt);
+}
+
+void Pipeline::shutdown_now() {
+    // Signal first, outside the lifecycle lock, so a graceful shutdown that is
+    // already draining on another thread is cut short instead of waited out.
+    escalate();
+    (void)stop(Clock::now());
+}
+
+ShutdownReport Pipeline::shutdown_for(std::chrono::milliseconds deadline) {
+    return stop(Clock::now() + deadline);
+}
+
+ShutdownReport Pipeline::stop(std::optional<Clock::time_point> deadline) {
+    std::lock_guard lock(lifecycle_mutex_);
+
+    const auto s = state_.load();
+    if (s == PipelineState::Stopped) return report_;
+    if (s == PipelineState::Failed && workers_.empty()) return report_;
+
+    if (s == PipelineState::Created) {
+        escalate();
+        report_ = make_report();
+        set_state(PipelineState::Stopped);
+        return report_;
+    }
+
+    if (advance_state(PipelineState::Running, PipelineState::Draining)) {
+        wake_wip_waiters(); // nobody will be admitted any more
+    }
+    if (reorder_) reorder_->close();
+    paused_.store(false);
+    post_all(WorkerControl::kCheck);
+    drain_coalescer(deadline);
+
+    // Graceful part: closing q_in lets every stage drain and close the next.
+    q_in_.close();
+    close_intake();
+    FlightRecorder::record(FlightEvent::QueueClosed, flight_source_, 0);
+
+    // Submits that got past the state check finish before the report: with
+    // intake closed and WIP waiters woken they have nothing left to wait on.
+    wait_gate_empty(deadline);
+
+    {
+        std::unique_lock wl(workers_mutex_);
+        const auto all_exited = [&] { return live_workers_ == 0; };
+        if (!deadline) {
+            workers_cv_.wait(wl, all_exited);
+        }
+        else if (!workers_cv_.wait_until(wl, *deadline, all_exited)) {
+            wl.unlock();
+            escalate();
+        }
+    }
+
+    join_workers();
+    cancel_queued();
+    if (reorder_) (void)reorder_->flush(); // a forced stop leaves holes; pass over them
+    if (metrics_publisher_.joinable()) {
+        metrics_publisher_.request_stop();
+        metrics_publisher_.join();
+    }
+
+    report_ = make_report();
+    set_state(failed_.load() ? PipelineState::Failed : PipelineState::Stopped);
+    if (metrics_page_) publish_metrics_page(); // the final counts and state
+    return report_;
+}
+
+void Pipeline::escalate() noexcept {
+    FlightRecorder::record(FlightEvent::Escalate, flight_source_);
+    stop_source_.request_stop();
+    q_in_.close();
+    q_prepare_.close();
+    q_pack_.close();
+    wake_carriers(true);
+    close_intake();
+    wake_wip_waiters();
+    if (reorder_) reorder_->close();
+    if (coalescer_) coalescer_->close();
+    post_all(WorkerControl::kCheck); // paused workers see the stop
+}
+
+// After a forced stop, orders still queued were never picked up. Cancel them
+// as their stage would have, so WIP, the census and the report account for
+// them. A persistent q_in keeps its orders for the next process; only their
+// WIP is released (coalescing is off with q_in_path, so one slot each).
+void Pipeline::cancel_queued() {
+    WorkerContext sweep;
+    Order order{ OrderId{ 0 } };
+
+    if (q_in_file_) {
+        const std::size_t left = q_in_.size();
+        release_wip(left);
+        std::lock_guard lock(metrics_mutex_);
+        bump(finished_, std::uint64_t{ left }); // for this process
+    }
+    else while (q_in_.try_pop(order)) abandon(sweep, Stage::Prepare, order);
+    for (auto& core : cores_) {
+        while (core->ring.try_pop(order)) abandon(sweep, Stage::Prepare, order);
+    }
+    while (q_prepare_.try_pop(order)) abandon(sweep, Stage::Pack, order);
+    while (q_pack_.try_pop(order)) abandon(sweep, Stage::Deliver, order);
+
+    flush_status(sweep);
+}
+
+void Pipeline::join_workers() noexcept {
+    for (auto& w : workers_) {
+        if (w.joinable()) w.join();
+    }
+    workers_.clear();
+
+    std::lock_guard wl(workers_mutex_);
+    controls_.clear();
+}
+
+// Caller holds lifecycle_mutex_. Joins workers that retired since the last
+// call and drops their controls, so resizing back and forth does not pile up
+// finished threads. workers_[i] and controls_[i] belong to the same worker.
+void Pipeline::reap_workers() noexcept {
+    std::vector<std::jthread> done;
+    {
+        std::lock_guard wl(workers_mutex_);
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < controls_.size(); ++i) {
+            if (controls_[i]->exited) {
+                done.push_back(std::move(workers_[i]));
+                continue;
+            }
+            if (kept != i) {
+                controls_[kept] = std::move(controls_[i]);
+                workers_[kept] = std::move(workers_[i]);
+            }
+            ++kept;
+        }
+        controls_.resize(kept);
+        workers_.resize(kept);
+    }
+
+    // An exited worker is past on_worker_exit, so these joins are short.
+    for (auto& w : done) w.join();
+}
+
+ShutdownReport Pipeline::make_report() const {
+    ShutdownReport r;
+
+    std::lock_guard lock(metrics_mutex_);
+    Metrics counts = metrics_;
+    add_core_counts(counts);
+    r.delivered = counts.delivered_count;
+
+    r.prepare.completed = counts.prepared_count;
+    r.pack.completed = counts.packed_count;
+    r.deliver.completed = counts.delivered_count;
+
+    // After the join, whatever is still queued was never picked up by the
+    // stage behind that queue.
+    r.prepare.abandoned = abandoned_[0] + q_in_.size();
+    for (const auto& core : cores_) r.prepare.abandoned += core->ring.size();
+    r.pack.abandoned = abandoned_[1] + q_prepare_.size();
+    r.deliver.abandoned = abandoned_[2] + q_pack_.size();
+
+    r.drained = !failed_.load() && r.abandoned_total() == 0;
+    return r;
+}
+
+bool Pipeline::is_running() const noexcept {
+    return state_.load() == PipelineState::Running;
+}
+
+bool Pipeline::is_stopped() const noexcept {
+    const auto s = state_.load();
+    return s == PipelineState::Stopped || s == PipelineState::Failed;
+}
+
+PipelineState Pipeline::state() const noexcept {
+    return state_.load();
+}
+
+bool Pipeline::submit(Order order) {
+    struct Leave {
+        Pipeline& pipeline;
+        std::atomic<std::size_t>& inside;
+        ~Leave() { pipeline.leave_gate(inside); }
+    } leave{ *this, enter_gate() };
+
+    if (state_.load() != PipelineState::Running) {
+        order.status = OrderStatus::Rejected;
+        return false;
+    }
+
+    const OrderId id = order.id;
+    const auto deadline = Clock::now() + cfg_.push_timeout;
+
+    // A concurrent shutdown closes q_in, so the push itself is the final gate.
+    if (acquire_wip(deadline)) {
+        if (coalescer_ && order.customer != 0) {
+            // Held orders are bound for q_in, so what is held and what is
+            // queued there together stay within its capacity.
+            const std::size_t capacity = q_in_.capacity();
+            const std::size_t room = capacity - std::min(q_in_.depth(), capacity);
+            std::optional<Order> full;
+            if (!coalescer_->hold(std::move(order), room, full)) {
+                // Refused at once rather than after push_timeout, so it is
+                // not a timeout.
+                release_wip();
+                std::lock_guard lock(metrics_mutex_);
+                ++metrics_.coalesce_refused_count;
+                return false;
+            }
+            if (cfg_.status_census) census_.record(id, OrderStatus::Accepted);
+            if (full) (void)release_group(*full, deadline);
+            // A group that found no room in q_in by the deadline was canceled,
+            // this order with it, and cancel_group() let go of its WIP.
+            if (!full || full->status != OrderStatus::Canceled) return true;
+        }
+        else {
+            // Numbered last, so a refusal above does not leave a hole.
+            order.seq = reorder_ ? reorder_->admit(deadline) : 0;
+            const std::uint64_t seq = order.seq;
+            if (!reorder_ || seq != 0) {
+                const bool pushed = cores_.empty()
+                    ? q_in_.push_for(std::move(order), deadline - Clock::now())
+                    : submit_to_core(std::move(order), deadline);
+                if (pushed) {
+                    if (cfg_.status_census) census_.record(id, OrderStatus::Accepted);
+                    return true;
+                }
+                if (reorder_) reorder_->skip(seq);
+            }
+            release_wip();
+        }
+    }
+
+    FlightRecorder::record(FlightEvent::SubmitTimeout, flight_source_, id);
+
+    std::lock_guard lock(metrics_mutex_);
+    ++metrics_.submit_timeout_count;
+    return false;
+}
+
+bool Pipeline::submit(Order order, Pressure& pressure) {
+    const bool accepted = submit(std::move(order));
+    pressure = accepted ? this->pressure() : Pressure::Saturated;
+    return accepted;
+}
+
+// Score = occupancy of q_in (or of the WIP cap, whichever is fuller) plus a
+// bounded trend term: how far the depth is above its moving average, as a
+// fraction of capacity, so a queue that is filling fast is flagged before
+// it is full. Concurrent callers may lose an average update; that only
+// slows the average down.
+Pressure Pipeline::pressure() const noexcept {
+    const std::size_t depth = q_in_depth();
+    const std::size_t capacity = cores_.empty() ? q_in_.capacity() : cfg_.q_in_capacity * cores_.size();
+
+    double occupancy = static_cast<double>(depth) / static_cast<double>(capacity);
+    if (cfg_.wip_limit != 0) {
+        occupancy = std::max(occupancy, static_cast<double>(in_flight()) / static_cast<double>(cfg_.wip_limit));
+    }
+
+    const auto scaled = static_cast<std::int64_t>(depth) * 16;
+    const auto avg = depth_avg_.load(std::memory_order_relaxed);
+    depth_avg_.store(avg + (scaled - avg) / 8, std::memory_order_relaxed);
+
+    const double trend = static_cast<double>(scaled - avg) / 16.0 / static_cast<double>(capacity);
+    const double score = occupancy + std::clamp(2.0 * trend, -0.25, 0.25);
+
+    if (score >= 0.85) return Pressure::Saturated;
+    if (score >= 0.5) return Pressure::High;
+    if (score >= 0.25) return Pressure::Elevated;
+    return Pressure::Low;
+}
+
+// The increment and submit's read of state_ stay seq_cst: against stop()'s
+// state change and its read of the stripe, that is a store-then-load on
+// each side, which weaker orders would let both miss.
+std::atomic<std::size_t>& Pipeline::enter_gate() noexcept {
+    auto& stripe = gate_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % kGateStripes];
+    stripe.inside.fetch_add(1, std::memory_order_seq_cst);
+    return stripe.inside;
+}
+
+// The last submitter out of a stripe wakes a stop() that is waiting for it.
+// The decrement and the read of gate_waiting_ pair with wait_gate_empty()
+// the same way, so they are seq_cst too; the bump only has to be seen by a
+// waiter that read the stripe before the decrement, which release does.
+void Pipeline::leave_gate(std::atomic<std::size_t>& inside) noexcept {
+    if (inside.fetch_sub(1, std::memory_order_seq_cst) == 1 && gate_waiting_.load(std::memory_order_seq_cst)) {
+        gate_exits_.fetch_add(1, std::memory_order_release);
+        gate_exits_.notify_all();
+    }
+}
+
+// Gives up once `deadline` passes, but not before kGateGrace: with intake
+// closed the submitters still inside have nothing left to block on, and
+// one that left after the report could still count itself in it.
+void Pipeline::wait_gate_empty(std::optional<Clock::time_point> deadline) {
+    if (deadline) deadline = std::max(*deadline, Clock::now() + kGateGrace);
+
+    gate_waiting_.store(true, std::memory_order_seq_cst);
+    std::optional<DeadlineWaker::Timer> timer;
+    for (const auto& stripe : gate_) {
+        for (;;) {
+            // Read before `inside`: an exit after this read changes it.
+            const std::uint32_t seen = gate_exits_.load(std::memory_order_acquire);
+            if (stripe.inside.load(std::memory_order_seq_cst) == 0 || (deadline && Clock::now() >= *deadline)) break;
+            if (deadline && !timer) timer = DeadlineWaker::instance().arm(gate_exits_, *deadline);
+            gate_exits_.wait(seen, std::memory_order_acquire);
+        }
+    }
+    if (timer) DeadlineWaker::instance().disarm(*timer);
+    gate_waiting_.store(false, std::memory_order_relaxed);
+}
+
+// Orders left in the file by the previous run go back into q_in ahead of any
+// new submit; they are already in the ring, so the journal is attached after.
+void Pipeline::resume_persisted_intake() {
+    auto orders = q_in_file_->pending();
+    for (Order& order : orders) {
+        const OrderId id = order.id;
+        (void)q_in_.push(std::move(order));
+        if (cfg_.status_census) census_.record(id, OrderStatus::Accepted);
+    }
+    if (cfg_.wip_limit != 0) wip_.fetch_add(orders.size());
+    q_in_.attach_journal(q_in_file_.get());
+
+    std::lock_guard lock(metrics_mutex_);
+    metrics_.q_in_recovered = orders.size();
+}
+
+// Without a cap wip_ is not touched at all: in_flight() counts from the
+// stage counters instead, so submit shares no counter with the workers.
+bool Pipeline::acquire_wip(Clock::time_point deadline) {
+    if (cfg_.wip_limit == 0) return true;
+
+    const auto try_acquire = [&] {
+        auto cur = wip_.load(std::memory_order_relaxed);
+        while (cur < cfg_.wip_limit) {
+            if (wip_.compare_exchange_weak(cur, cur + 1)) return true;
+        }
+        return false;
+    };
+    if (try_acquire()) return true;
+
+    // Slow path. The waiter count is raised before re-checking and read by
+    // release_wip() after the decrement, so one of the two always sees the other.
+    std::unique_lock lock(wip_mutex_);
+    ++wip_waiters_;
+    bool acquired = false;
+    wip_cv_.wait_until(lock, deadline, [&] {
+        acquired = try_acquire();
+        return acquired || state_.load() != PipelineState::Running;
+    });
+    --wip_waiters_;
+    lock.unlock();
+
+    {
+        std::lock_guard ml(metrics_mutex_);
+        ++metrics_.wip_wait_count;
+    }
+    return acquired;
+}
+
+// n > 1 for a coalesced group, which holds one unit per order.
+void Pipeline::release_wip(std::size_t n) noexcept {
+    if (cfg_.wip_limit == 0) return;
+
+    wip_.fetch_sub(n);
+    if (wip_waiters_.load() > 0) {
+        std::lock_guard lock(wip_mutex_);
+        if (n == 1) wip_cv_.notify_one();
+        else wip_cv_.notify_all();
+    }
+}
+
+void Pipeline::wake_wip_waiters() noexcept {
+    {
+        std::lock_guard lock(wip_mutex_);
+    }
+    wip_cv_.notify_all();
+}
+
+std::size_t Pipeline::q_in_depth() const noexcept {
+    std::size_t depth = q_in_.depth();
+    for (const auto& core : cores_) depth += core->ring.size();
+    return depth;
+}
+
+// Without a cap: orders that entered q_in, a core ring or a coalescing
+// group, less those delivered or canceled. Finished is read first, and a
+// finish is published after its order's push, so the difference does not
+// go below zero except while a group is between the coalescer and q_in.
+std::size_t Pipeline::in_flight() const noexcept {
+    if (cfg_.wip_limit != 0) return wip_.load(std::memory_order_relaxed);
+
+    std::uint64_t finished = finished_.load(std::memory_order_acquire);
+    for (const auto& core : cores_) finished += core->delivered.load(std::memory_order_acquire);
+
+    std::uint64_t entered = q_in_.pushed();
+    for (const auto& core : cores_) entered += core->ring.pushed();
+    if (coalescer_) {
+        const auto c = coalescer_->stats();
+        entered += c.held + c.coalesced;
+    }
+    return entered > finished ? static_cast<std::size_t>(entered - finished) : 0;
+}
+
+std::vector<int> Pipeline::core_cpus() const {
+    std::vector<int> cpus;
+    for (const auto& core : cores_) cpus.push_back(core->cpu.load());
+    return cpus;
+}
+
+// ThreadPerCore: adds each core's own stage counters. Downstream first, like
+// the queues in metrics(), so delivered <= packed <= prepared holds.
+void Pipeline::add_core_counts(Metrics& m) const noexcept {
+    for (const auto& core : cores_) {
+        m.delivered_count += core->delivered.load(std::memory_order_acquire);
+        m.total_lead_time += std::chrono::nanoseconds{ core->lead_time_ns.load(std::memory_order_acquire) };
+    }
+    for (const auto& core : cores_) m.packed_count += core->packed.load(std::memory_order_acquire);
+    for (const auto& core : cores_) m.prepared_count += core->prepared.load(std::memory_order_acquire);
+}
+
+Metrics Pipeline::metrics() const {
+    Metrics m;
+    {
+        std::lock_guard lock(metrics_mutex_);
+        m = metrics_;
+    }
+    add_core_counts(m);
+
+    // Downstream first: every order counted by a stage above was pushed
+    // into the queues below before it, so the chains stay monotone.
+    const auto pack = q_pack_.stats();
+    const auto prepare = q_prepare_.stats();
+    const auto in = q_in_.stats();
+
+    m.q_pack_push = pack.push_count;
+    m.q_pack_pop = pack.pop_count;
+    m.q_pack_max_size = pack.max_size;
+    m.q_pack_handoff = pack.handoff_count;
+    m.q_pack_wakeup = pack.wakeup;
+
+    m.q_prepare_push = prepare.push_count;
+    m.q_prepare_pop = prepare.pop_count;
+    m.q_prepare_max_size = prepare.max_size;
+    m.q_prepare_handoff = prepare.handoff_count;
+    m.q_prepare_wakeup = prepare.wakeup;
+
+    m.q_in_push = in.push_count;
+    m.q_in_pop = in.pop_count;
+    m.q_in_max_size = in.max_size;
+    m.q_in_wakeup = in.wakeup;
+    m.aged_pop_count = in.aged_pops + prepare.aged_pops + pack.aged_pops;
+    if (q_in_file_) m.q_in_sync_count = q_in_file_->sync_count();
+
+    // ThreadPerCore: the intake rings together play the role of q_in. Popped
+    // before pushed, so the pops never run ahead of the pushes.
+    for (const auto& core : cores_) m.q_in_pop += core->ring.popped();
+    for (const auto& core : cores_) {
+        m.q_in_push += core->ring.pushed();
+        m.q_in_max_size = std::max(m.q_in_max_size, core->max_size.load());
+    }
+
+    m.accepted_count = m.q_in_push;
+    m.wip_in_flight = in_flight();
+
+    if (reorder_) {
+        const auto r = reorder_->stats();
+        m.reorder_released = r.released;
+        m.reorder_skipped = r.skipped;
+        m.reorder_window_waits = r.window_waits;
+        m.reorder_depth = r.depth;
+        m.reorder_max_depth = r.max_depth;
+        m.reorder_wait = r.wait;
+    }
+    if (coalescer_) {
+        const auto c = coalescer_->stats();
+        m.coalesce_groups = c.groups;
+        m.coalesced_orders = c.coalesced;
+        m.coalesce_held = c.held;
+        m.coalesce_hold = c.hold;
+    }
+    m.carrier_requests = carrier_requests_.load();
+    m.carrier_max_outstanding = carrier_max_outstanding_.load();
+    m.carrier_rtt = carrier_rtt_.snapshot();
+    return m;
+}
+
+// The orders delivered when the call began, copied a chunk per lock hold so
+// that Deliver workers appending meanwhile wait for one chunk at most, and
+// by one caller at a time so that pollers do not crowd the workers out.
+// delivered_ is append-only: what is below the size read first stays put.
+std::vector<Order> Pipeline::delivered_orders() const {
+    std::lock_guard turn(delivered_copy_mutex_);
+    std::unique_lock lock(metrics_mutex_);
+    const std::size_t n = delivered_.size();
+    lock.unlock();
+
+    std::vector<Order> out;
+    out.reserve(n);
+    while (out.size() < n) {
+        lock.lock();
+        const auto from = delivered_.begin() + static_cast<std::ptrdiff_t>(out.size());
+        out.insert(out.end(), from, from + static_cast<std::ptrdiff_t>(std::min(kDeliveredChunk, n - out.size())));
+        lock.unlock();
+    }
+    return out;
+}
+
+std::vector<SlowOrder> Pipeline::slowest_orders() const {
+    return slowest_ ? slowest_->snapshot() : std::vector<SlowOrder>{};
+}
+
+std::vector<std::vector<std::size_t>> Pipeline::delivered_segments() const {
+    std::lock_guard lock(metrics_mutex_);
+    return delivered_segments_;
+}
+
+std::vector<std::size_t> Pipeline::delivered_between(OrderKey key,
+    std::chrono::steady_clock::time_point from,
+    std::chrono::steady_clock::time_point to) const {
+    std::lock_guard lock(metrics_mutex_);
+    return find_in_range(delivered_, delivered_index_, key, time_key(from), time_key(to));
+}
+
+std::optional<std::size_t> Pipeline::find_delivered(OrderId id) const {
+    std::lock_guard lock(metrics_mutex_);
+    return find_by_id(delivered_, delivered_index_, id);
+}
+
+std::vector<Order> Pipeline::merged_orders(const Order& lead) const {
+    if (!coalescer_) return {};
+    {
+        std::lock_guard lock(metrics_mutex_);
+        const auto it = delivered_merged_.find(lead.id);
+        if (it != delivered_merged_.end()) return it->second;
+    }
+    return coalescer_->merged_of(lead);
+}
+
+StatusSnapshot Pipeline::status_snapshot() const {
+    return census_.snapshot();
+}
+
+std::uint16_t Pipeline::flight_source() const noexcept {
+    return flight_source_;
+}
+
+bool Pipeline::pause() {
+    if (!cores_.empty() || state_.load() != PipelineState::Running) return false;
+    paused_.store(true);
+    post_all(WorkerControl::kCheck);
+    return true;
+}
+
+bool Pipeline::resume() {
+    if (!cores_.empty()) return false;
+    paused_.store(false);
+    post_all(WorkerControl::kCheck);
+    return true;
+}
+
+bool Pipeline::paused() const noexcept {
+    return paused_.load();
+}
+
+// Retiring workers finish their current order and exit through the usual
+// path; a stage never drops below one worker, so retiring cannot close the
+// next queue early. A new worker takes the lowest index no live worker of
+// its stage holds, so per-index Deliver runs never have two writers.
+bool Pipeline::set_workers(std::size_t prepare, std::size_t pack, std::size_t deliver) {
+    if (is_shared(cfg_)) return false;
+
+    const std::array<std::size_t, kStages> want{ prepare, pack, deliver };
+    for (std::size_t s = 0; s < kStages; ++s) {
+        if (want[s] == 0 || want[s] > stage_worker_limit(static_cast<Stage>(s))) return false;
+    }
+
+    // stop() holds the lifecycle lock for its whole drain; do not queue
+    // up behind it.
+    std::unique_lock lock(lifecycle_mutex_, std::try_to_lock);
+    if (!lock || state_.load() != PipelineState::Running) return false;
+
+    reap_workers();
+
+    std::vector<WorkerContext> starting;
+    {
+        std::lock_guard wl(workers_mutex_);
+        std::array<std::vector<WorkerControl*>, kStages> serving;
+        std::array<std::vector<bool>, kStages> taken;
+        for (std::size_t s = 0; s < kStages; ++s) {
+            taken[s].assign(stage_worker_limit(static_cast<Stage>(s)), false);
+        }
+        for (const auto& c : controls_) {
+            const auto s = static_cast<std::size_t>(c->stage);
+            if (c->exited) continue;
+            taken[s][c->index] = true;
+            if (!c->retiring) serving[s].push_back(c.get());
+        }
+
+        // A retiring worker keeps its index until it exits; with too few
+        // indexes free, refuse the whole change rather than part of it.
+        for (std::size_t s = 0; s < kStages; ++s) {
+            const auto free = static_cast<std::size_t>(std::count(taken[s].begin(), taken[s].end(), false));
+            if (want[s] > serving[s].size() && want[s] - serving[s].size() > free) return false;
+        }
+
+        for (std::size_t s = 0; s < kStages; ++s) {
+            auto& stage_serving = serving[s];
+            std::sort(stage_serving.begin(), stage_serving.end(), [](const WorkerControl* a, const WorkerControl* b) {
+                return a->index < b->index;
+            });
+
+            for (; stage_serving.size() > want[s]; stage_serving.pop_back()) {
+                stage_serving.back()->retiring = true;
+                stage_serving.back()->post(WorkerControl::kRetire);
+            }
+            for (std::size_t i = 0, n = stage_serving.size(); n < want[s]; ++i) {
+                if (taken[s][i]) continue;
+                WorkerContext ctx;
+                ctx.stage = static_cast<Stage>(s);
+                ctx.index = i;
+                starting.push_back(std::move(ctx));
+                ++active_workers_[s];
+                ++live_workers_;
+                ++n;
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < starting.size(); ++i) {
+        try {
+            spawn_worker(std::move(starting[i]));
+        }
+        catch (...) {
+            // Counted above but never started.
+            std::lock_guard wl(workers_mutex_);
+            for (std::size_t j = i; j < starting.size(); ++j) {
+                --active_workers_[static_cast<std::size_t>(starting[j].stage)];
+                --live_workers_;
+            }
+            return false;
+        }
+    }
+
+    std::lock_guard ml(metrics_mutex_);
+    metrics_.prepare_workers_used = prepare;
+    metrics_.pack_workers_used = pack;
+    metrics_.deliver_workers_used = deliver;
+    return true;
+}
+
+bool Pipeline::set_capacities(std::size_t q_in, std::size_t q_prepare, std::size_t q_pack) {
+    if (!cores_.empty() || cfg_.queue_backend == WaitBackend::Semaphore) return false;
+    if (q_in == 0 || q_prepare == 0 || q_pack == 0) return false;
+    if (q_in_file_ && q_in > q_in_file_->capacity()) return false;
+
+    (void)q_in_.set_capacity(q_in);
+    (void)q_prepare_.set_capacity(q_prepare);
+    (void)q_pack_.set_capacity(q_pack);
+    return true;
+}
+
+std::array<std::size_t, 3> Pipeline::queue_depths() const noexcept {
+    return { q_in_depth(), q_prepare_.depth(), q_pack_.depth() };
+}
+
+bool Pipeline::begin_shutdown() {
+    std::unique_lock lock(lifecycle_mutex_, std::try_to_lock);
+    if (!lock) return false;
+    if (!advance_state(PipelineState::Running, PipelineState::Draining)) return true;
+
+    wake_wip_waiters();
+    if (reorder_) reorder_->close();
+    paused_.store(false);
+    post_all(WorkerControl::kCheck);
+    drain_coalescer(std::nullopt);
+
+    q_in_.close();
+    close_intake();
+    FlightRecorder::record(FlightEvent::QueueClosed, flight_source_, 0);
+    return true;
+}
+
+// Caller holds lifecycle_mutex_ and has counted the worker in live_workers_
+// and active_workers_.
+void Pipeline::spawn_worker(WorkerContext ctx) {
+    {
+        std::lock_guard wl(workers_mutex_);
+        controls_.push_back(std::make_unique<WorkerControl>());
+        ctx.control = controls_.back().get();
+        ctx.control->stage = ctx.stage;
+        ctx.control->index = ctx.index;
+    }
+
+    try {
+        workers_.emplace_back([this, ctx = std::move(ctx), token = stop_source_.get_token()]() mutable {
+            worker_loop(std::move(ctx), token);
+        });
+    }
+    catch (...) {
+        // Keeps controls_ aligned with workers_; nothing else has seen it.
+        std::lock_guard wl(workers_mutex_);
+        controls_.pop_back();
+        throw;
+    }
+}
+
+// A paused worker sleeps on its own mailbox until resume() or a stop posts
+// to it. Returns false when the worker is to retire.
+bool Pipeline::read_mail(WorkerContext& w, const std::stop_token& st) {
+    auto& mail = w.control->mail;
+    for (;;) {
+        if ((mail.exchange(0) & WorkerControl::kRetire) != 0) return false;
+        if (!paused_.load() || st.stop_requested()) return true;
+
+        flush_status(w);
+        mail.wait(0);
+    }
+}
+
+void Pipeline::post_all(std::uint32_t bits) noexcept {
+    std::lock_guard lock(workers_mutex_);
+    for (const auto& c : controls_) {
+        if (!c->exited) c->post(bits);
+    }
+}
+
+void Pipeline::publish_metrics_page() {
+    const Metrics m = metrics();
+    const auto depths = queue_depths();
+
+    const std::uint64_t values[] = {
+        m.accepted_count,
+        m.prepared_count,
+        m.packed_count,
+        m.delivered_count,
+        m.submit_timeout_count,
+        m.wip_wait_count,
+        static_cast<std::uint64_t>(m.total_lead_time.count()),
+        m.q_in_push,
+        m.q_in_pop,
+        m.q_prepare_push,
+        m.q_prepare_pop,
+        m.q_prepare_handoff,
+        m.q_pack_push,
+        m.q_pack_pop,
+        m.q_pack_handoff,
+        m.q_in_sync_count,
+        m.wip_in_flight,
+        depths[0],
+        depths[1],
+        depths[2],
+        m.q_in_max_size,
+        m.q_prepare_max_size,
+        m.q_pack_max_size,
+        m.prepare_workers_used,
+        m.pack_workers_used,
+        m.deliver_workers_used,
+        static_cast<std::uint64_t>(state_.load()),
+        paused_.load() ? 1u : 0u,
+        m.reorder_released,
+        m.reorder_depth,
+        m.coalesced_orders,
+        m.coalesce_held,
+    };
+    static_assert(std::size(values) == std::size(kPageFields));
+    metrics_page_->publish(values);
+}
+
+void Pipeline::run_metrics_publisher(const std::stop_token& st) {
+    std::unique_lock lock(publisher_mutex_);
+    for (;;) {
+        // Nothing notifies the cv: this is an interval sleep that a stop cuts short.
+        (void)publisher_cv_.wait_for(lock, st, cfg_.metrics_page_interval, [] { return false; });
+        if (st.stop_requested()) return;
+
+        lock.unlock();
+        publish_metrics_page();
+        lock.lock();
+    }
+}
+
+void Pipeline::run_coalescer(const std::stop_token& st) {
+    const auto tick = std::max<Clock::duration>(coalescer_->window() / 4, std::chrono::milliseconds{ 1 });
+
+    std::unique_lock lock(coalescer_mutex_);
+    for (;;) {
+        // Nothing notifies the cv: this is a tick sleep that a stop cuts short.
+        (void)coalescer_cv_.wait_for(lock, st, tick, [] { return false; });
+        if (st.stop_requested()) return;
+
+        lock.unlock();
+        auto due = coalescer_->take_due(Clock::now());
+        for (auto& group : due) {
+            // A stop while waiting for room leaves the rest to drain_coalescer().
+            if (!release_group(group, std::nullopt, st)) {
+                stranded_groups_.push_back(std::move(group));
+            }
+        }
+        lock.lock();
+    }
+}
+
+// Called before q_in closes, so the groups still held go through the stages
+// unless `deadline` passes first.
+void Pipeline::drain_coalescer(std::optional<Clock::time_point> deadline) {
+    if (!coalescer_) return;
+
+    coalescer_->close();
+    if (coalescer_thread_.joinable()) {
+        coalescer_thread_.request_stop();
+        coalescer_thread_.join();
+    }
+    auto groups = std::exchange(stranded_groups_, {});
+    for (auto& group : coalescer_->take_all()) groups.push_back(std::move(group));
+    for (auto& group : groups) (void)release_group(group, deadline);
+}
+
+// The orders of a group were accepted when they were held, so the group
+// waits for room in q_in instead of being refused. A closed q_in (a forced
+// stop) or a passed `deadline` cancels it. Returns false, with the group
+// untouched, if `st` asks to stop first.
+bool Pipeline::release_group(Order& group, std::optional<Clock::time_point> deadline, const std::stop_token& st) {
+    for (;;) {
+        Clock::duration wait = cfg_.push_timeout;
+        if (deadline) wait = std::clamp<Clock::duration>(*deadline - Clock::now(), Clock::duration::zero(), wait);
+        if (q_in_.push_for(group, wait)) return true;
+
+        if (q_in_.closed() || (deadline && Clock::now() >= *deadline)) break;
+        if (st.stop_requested()) return false;
+    }
+    cancel_group(group);
+    return true;
+}
+
+void Pipeline::cancel_group(Order& group) {
+    group.advance_to(OrderStatus::Canceled);
+    {
+        std::lock_guard lock(metrics_mutex_);
+        ++abandoned_[static_cast<std::size_t>(Stage::Prepare)];
+        bump(finished_, std::uint64_t{ group.group_size() } - 1); // the lead never entered q_in
+    }
+    release_wip(group.group_size());
+    if (cfg_.status_census) census_.record(group.id, group.status);
+    (void)coalescer_->follow(group, [&](const Order& m) {
+        if (cfg_.status_census) census_.record(m.id, m.status);
+    });
+}
+
+// The merged orders take the lead's step; the census hears about each.
+// Returns them once the lead is final.
+std::vector<Order> Pipeline::follow_group(WorkerContext& w, const Order& lead) {
+    return coalescer_->follow(lead, [&](const Order& m) {
+        if (cfg_.status_census) w.census.push_back(StatusCensus::Update{ m.id, m.status });
+    });
+}
+
+std::size_t Pipeline::stage_worker_limit(Stage stage) const noexcept {
+    const std::array<std::size_t, kStages> configured{ cfg_.prepare_workers, cfg_.pack_workers, cfg_.deliver_workers };
+    return std::max(configured[static_cast<std::size_t>(stage)], cfg_.max_stage_workers);
+}
+
+void Pipeline::worker_loop(WorkerContext w, std::stop_token st) noexcept {
+    const std::uint64_t role = w.shared || !cores_.empty() ? kStages : static_cast<std::uint64_t>(w.stage);
+    FlightRecorder::record(FlightEvent::WorkerStart, flight_source_, role, w.index);
+
+    try {
+        if (!cores_.empty()) run_core(w, st);
+        else if (w.shared) run_shared(w, st);
+        else run_stage(w, st);
+        flush_status(w);
+    }
+    catch (const std::exception& e) {
+        FlightRecorder::record(FlightEvent::WorkerException, flight_source_, w.index, FlightRecorder::text_word(e.what()));
+        fail();
+    }
+    catch (...) {
+        FlightRecorder::record(FlightEvent::WorkerException, flight_source_, w.index);
+        fail();
+    }
+
+    FlightRecorder::record(FlightEvent::WorkerExit, flight_source_, role, w.index);
+    on_worker_exit(w);
+}
+
+void Pipeline::run_stage(WorkerContext& w, const std::stop_token& st) {
+    if (w.stage == Stage::Deliver && cfg_.carrier_port != 0) {
+        run_carrier(w, st);
+        return;
+    }
+
+    auto& in = input_of(w.stage);
+    auto* out = output_of(w.stage);
+
+    Order order{ OrderId{ 0 } };
+
+    while (!st.stop_requested()) {
+        if (w.control->mail.load() != 0 && !read_mail(w, st)) return;
+
+        if (!in.wait_pop_for(order, cfg_.pop_timeout)) {
+            if (in.closed() && in.empty()) return;
+            flush_status(w); // idle: publish what is pending
+            continue;
+        }
+
+        if (st.stop_requested()) {
+            abandon(w, w.stage, order);
+            return;
+        }
+
+        complete(w, order);
+
+        if (out != nullptr && !forward(*out, order, st)) {
+            abandon(w, static_cast<Stage>(static_cast<std::size_t>(w.stage) + 1), order);
+            return;
+        }
+    }
+}
+
+// Deliver through the carrier: an order goes out as soon as it is popped
+// and the window has room, and is completed when its reply arrives, in
+// whatever order replies come. With nothing outstanding the worker sleeps
+// on q_pack; otherwise on the socket, and while the window has room also on
+// its own doorbell, which a push to q_pack rings. Retiring stops taking
+// orders and waits for the replies; a stop abandons what is outstanding.
+void Pipeline::run_carrier(WorkerContext& w, const std::stop_token& st) {
+    struct Connection {
+        int fd;
+        ~Connection() { ClusterWire::close(fd); }
+    } carrier{ ClusterWire::connect(cfg_.carrier_host, cfg_.carrier_port) };
+
+    struct Request {
+        Order order;
+        Clock::time_point sent;
+    };
+    std::unordered_map<std::uint64_t, Request> outstanding; // by tag
+    std::uint64_t next_tag = 0;
+
+    const auto abandon_outstanding = [&] {
+        for (auto& [tag, r] : outstanding) abandon(w, Stage::Deliver, r.order);
+        outstanding.clear();
+    };
+    const auto lost = [&] {
+        abandon_outstanding();
+        throw std::runtime_error("Pipeline: lost the carrier connection");
+    };
+
+    auto& in = input_of(w.stage);
+    CarrierBell& bell = *carrier_bells_[w.index];
+    Order order{ OrderId{ 0 } };
+    bool taking = true;
+
+    while (!st.stop_requested()) {
+        if (taking && w.control->mail.load() != 0 && !read_mail(w, st)) taking = false;
+
+        bool drained = false;
+        while (taking && outstanding.size() < cfg_.carrier_window) {
+            const bool popped = outstanding.empty() ? in.wait_pop_for(order, cfg_.pop_timeout) : in.try_pop(order);
+            if (!popped) {
+                drained = in.closed() && in.empty();
+                break;
+            }
+            if (st.stop_requested()) {
+                abandon(w, Stage::Deliver, order);
+                break;
+            }
+
+            const std::uint64_t tag = ++next_tag;
+            if (!ClusterWire::send(carrier.fd, ClusterMsg::Deliver, ClusterWire::encode_deliver(tag, order.id))) {
+                abandon(w, Stage::Deliver, order);
+                lost();
+            }
+            outstanding.emplace(tag, Request{ order, Clock::now() });
+            carrier_requests_.fetch_add(1, std::memory_order_relaxed);
+            raise_max(carrier_max_outstanding_, outstanding.size());
+        }
+
+        if (outstanding.empty()) {
+            if (!taking || drained) return;
+            flush_status(w); // idle: publish what is pending
+            continue;
+        }
+
+        const bool room = taking && !drained && outstanding.size() < cfg_.carrier_window;
+        bool replied = false;
+        if (!room) {
+            replied = ClusterWire::readable(carrier.fd, cfg_.pop_timeout);
+        }
+        else {
+            carrier_waiting_.fetch_add(1);
+            bell.waiting.store(true);
+            if (in.empty()) replied = ClusterWire::readable(carrier.fd, bell.doorbell.fd(), cfg_.pop_timeout);
+            bell.waiting.store(false);
+            carrier_waiting_.fetch_sub(1);
+            bell.doorbell.clear(); // a late ring only makes the next wait return early
+        }
+        if (!replied) continue;
+
+        do {
+            ClusterFrame reply;
+            std::uint64_t tag = 0;
+            OrderId id = 0;
+            if (!ClusterWire::receive(carrier.fd, reply) || reply.type != ClusterMsg::Deliver
+                || !ClusterWire::decode_deliver(reply.payload, tag, id)) {
+                lost();
+            }
+            const auto it = outstanding.find(tag);
+            if (it == outstanding.end() || it->second.order.id != id) lost();
+
+            carrier_rtt_.record(Clock::now() - it->second.sent);
+            complete(w, it->second.order);
+            outstanding.erase(it);
+        } while (ClusterWire::readable(carrier.fd, std::chrono::milliseconds{ 0 }));
+    }
+
+    abandon_outstanding();
+}
+
+void Pipeline::run_shared(WorkerContext& w, const std::stop_token& st) {
+    Order order{ OrderId{ 0 } };
+
+    while (!st.stop_requested()) {
+        if (w.control->mail.load() != 0 && !read_mail(w, st)) return;
+
+        if (!pick_shared(w, order)) {
+            // Nothing ready anywhere: block on the most upstream stage still
+            // served, which is where new work enters.
+            retire_drained(w);
+            const auto entry = std::find(w.retired.begin(), w.retired.end(), false);
+            if (entry == w.retired.end()) return;
+
+            w.stage = static_cast<Stage>(entry - w.retired.begin());
+            if (!input_of(w.stage).wait_pop_for(order, cfg_.pop_timeout)) {
+                flush_status(w); // idle: publish what is pending
+                continue;
+            }
+        }
+
+        if (st.stop_requested()) {
+            abandon(w, w.stage, order);
+            return;
+        }
+
+        if (!process_shared(w, order, st)) return;
+    }
+}
+
+bool Pipeline::pick_shared(WorkerContext& w, Order& order) {
+    static constexpr std::array<Stage, kStages> kUpstreamFirst{ Stage::Prepare, Stage::Pack, Stage::Deliver };
+    static constexpr std::array<Stage, kStages> kDownstreamFirst{ Stage::Deliver, Stage::Pack, Stage::Prepare };
+
+    const auto& priority = cfg_.scheduling == SchedulingPolicy::DownstreamFirst ? kDownstreamFirst : kUpstreamFirst;
+    const auto serves = [&](Stage s) { return !w.retired[static_cast<std::size_t>(s)]; };
+
+    // Starvation guard: after passing over waiting work starvation_limit
+    // times in a row, serve the lowest-priority stage that has some.
+    if (w.passed_over >= cfg_.starvation_limit) {
+        w.passed_over = 0;
+        for (auto it = priority.rbegin(); it != priority.rend(); ++it) {
+            if (serves(*it) && input_of(*it).try_pop(order)) {
+                w.stage = *it;
+                return true;
+            }
+        }
+    }
+
+    for (std::size_t k = 0; k < kStages; ++k) {
+        if (!serves(priority[k]) || !input_of(priority[k]).try_pop(order)) continue;
+        w.stage = priority[k];
+
+        bool skipped = false;
+        for (std::size_t j = k + 1; j < kStages && !skipped; ++j) {
+            skipped = serves(priority[j]) && !input_of(priority[j]).empty();
+        }
+        w.passed_over = skipped ? w.passed_over + 1 : 0;
+        return true;
+    }
+
+    return false;
+}
+
+bool Pipeline::process_shared(WorkerContext& w, Order& order, const std::stop_token& st) {
+    const Stage stage = w.stage;
+    complete(w, order);
+    if (stage == Stage::Deliver) return true;
+
+    const auto next = static_cast<Stage>(static_cast<std::size_t>(stage) + 1);
+    if (forward_shared(w, next, order, st)) return true;
+
+    abandon(w, next, order);
+    return false;
+}
+
+bool Pipeline::forward_shared(WorkerContext& w, Stage next, const Order& order, const std::stop_token& st) {
+    auto& out = input_of(next);
+
+    while (!st.stop_requested()) {
+        if (out.push_for(order, std::chrono::milliseconds{ 0 })) return true;
+        if (out.closed()) return false;
+
+        // The next stage is full and every worker that could drain it may be
+        // waiting right here: serve it inline instead of blocking.
+        Order other{ OrderId{ 0 } };
+        if (!out.try_pop(other)) {
+            // Drained between the two calls, so there is room again: block for
+            // it instead of spinning. If it refills first, the wait is bounded
+            // by push_timeout and the loop serves the next stage inline again.
+            if (out.push_for(order, cfg_.push_timeout)) return true;
+            continue;
+        }
+
+        const Stage current = w.stage;
+        w.stage = next;
+        const bool ok = process_shared(w, other, st);
+        w.stage = current;
+        if (!ok) return false;
+    }
+    return false;
+}
+
+void Pipeline::retire_drained(WorkerContext& w) {
+    for (std::size_t s = 0; s < kStages; ++s) {
+        if (w.retired[s]) continue;
+
+        // Closed first: once closed, an empty queue stays empty.
+        auto& in = input_of(static_cast<Stage>(s));
+        if (!in.closed() || !in.empty()) return;
+
+        std::lock_guard lock(workers_mutex_);
+        w.retired[s] = true;
+        retire_locked(static_cast<Stage>(s));
+    }
+}
+
+bool Pipeline::submit_to_core(Order&& order, Clock::time_point deadline) {
+    Core& core = *cores_[static_cast<std::size_t>(order.id % cores_.size())];
+
+    // Counted in before reading `closed`: close_intake() sets it first and the
+    // core only exits once no submitter is past the check.
+    core.pushing.fetch_add(1);
+    bool pushed = false;
+    if (!core.closed.load()) {
+        pushed = core.ring.try_push(std::move(order));
+        if (!pushed) {
+            // Full: wait for the core to free a slot. Raised before
+            // re-checking; the core reads it after every pop.
+            std::unique_lock lock(core.space_mutex);
+            core.producers_waiting.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            core.space_cv.wait_until(lock, deadline, [&] {
+                return core.closed.load() || (pushed = core.ring.try_push(std::move(order)));
+            });
+            core.producers_waiting.fetch_sub(1);
+        }
+        if (pushed) raise_max(core.max_size, core.ring.size());
+    }
+    core.pushing.fetch_sub(1);
+
+    // Pairs with park_core(): either it sees the order (or that we left), or
+    // we see it asleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (core.sleeping.load()) ring_doorbell(core);
+    return pushed;
+}
+
+void Pipeline::close_intake() noexcept {
+    for (auto& core : cores_) {
+        core->closed.store(true);
+        {
+            std::lock_guard lock(core->space_mutex);
+        }
+        core->space_cv.notify_all();
+        ring_doorbell(*core);
+    }
+}
+
+void Pipeline::ring_doorbell(Core& core) noexcept {
+    core.doorbell.fetch_add(1);
+    core.doorbell.notify_one();
+}
+
+void Pipeline::run_core(WorkerContext& w, const std::stop_token& st) {
+    Core& core = *cores_[w.index];
+    if (cfg_.pin_cores) core.cpu.store(pin_to_cpu(w.index));
+    Order order{ OrderId{ 0 } };
+
+    while (!st.stop_requested()) {
+        if (!core.ring.try_pop(order)) {
+            // Idle: publish what is pending, then sleep until the doorbell.
+            publish_tally(w);
+            flush_status(w);
+
+            // Closed first, then no submitter past the check: after that the
+            // ring can only drain.
+            if (core.closed.load() && core.pushing.load() == 0 && core.ring.empty()) return;
+            park_core(core);
+            continue;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (core.producers_waiting.load() > 0) {
+            std::lock_guard lock(core.space_mutex);
+            core.space_cv.notify_all();
+        }
+
+        run_to_completion(w, core, order, st);
+        if (w.tally.delivered.size() >= kCorePublishBatch) publish_tally(w);
+    }
+
+    publish_tally(w);
+}
+
+void Pipeline::park_core(Core& core) {
+    const auto bell = core.doorbell.load();
+    core.sleeping.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Submitters check `sleeping` after leaving, so either they see it set
+    // or this re-check sees their order (or that they have left).
+    const bool draining = core.closed.load() && core.pushing.load() == 0;
+    if (!core.ring.ready() && !draining) core.doorbell.wait(bell);
+    core.sleeping.store(false);
+}
+
+void Pipeline::run_to_completion(WorkerContext& w, Core& c, Order& order, const std::stop_token& st) {
+    const auto core = static_cast<std::uint16_t>(w.index);
+
+    if (cfg_.prepare_work) cfg_.prepare_work(order);
+    order.advance_to(OrderStatus::Prepared);
+    order.prepared_by = core;
+    bump(c.prepared, std::uint64_t{ 1 });
+    note_status(w, order);
+
+    if (st.stop_requested()) {
+        abandon(w, Stage::Pack, order);
+        return;
+    }
+    order.advance_to(OrderStatus::Packed);
+    order.packed_by = core;
+    bump(c.packed, std::uint64_t{ 1 });
+    note_status(w, order);
+
+    if (st.stop_requested()) {
+        abandon(w, Stage::Deliver, order);
+        return;
+    }
+    order.advance_to(OrderStatus::Delivered);
+    order.delivered_by = core;
+    if (slowest_) slowest_->offer(w.index, order);
+    bump(c.lead_time_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(order.delivered_time - order.accepted_time).count());
+    bump(c.delivered, std::uint64_t{ 1 });
+    w.tally.delivered.push_back(order);
+    release_wip();
+    note_status(w, order);
+}
+
+// One lock per batch instead of one per delivered order.
+void Pipeline::publish_tally(WorkerContext& w) {
+    CoreTally& t = w.tally;
+    if (t.delivered.empty()) return;
+
+    {
+        std::lock_guard lock(metrics_mutex_);
+        for (const auto& order : t.delivered) {
+            delivered_segments_[w.index].push_back(delivered_.size());
+            delivered_.push_back(order);
+            delivered_index_.append(order);
+        }
+    }
+    t.delivered.clear();
+}
+
+bool Pipeline::forward(BoundedBlockingQueue<Order>& out, const Order& order, const std::stop_token& st) {
+    while (!st.stop_requested()) {
+        if (out.push_for(order, cfg_.push_timeout)) {
+            if (&out == &q_pack_) wake_carriers();
+            return true;
+        }
+        if (out.closed()) return false;
+    }
+    return false;
+}
+
+// Carrier workers with requests outstanding sleep on their socket and on
+// their own doorbell together. They mark themselves waiting before their
+// last look at q_pack, so a push either is seen there or rings one of them;
+// the push claims the mark, so the next push rings another. Each worker
+// clears only its own doorbell, and one woken by a ring has room for at
+// least the order that rang it. A close rings them all.
+void Pipeline::wake_carriers(bool all) noexcept {
+    if (carrier_waiting_.load() == 0) return;
+
+    for (const auto& bell : carrier_bells_) {
+        if (!bell->waiting.exchange(false)) continue;
+        bell->doorbell.ring();
+        if (!all) return;
+    }
+}
+
+void Pipeline::complete(WorkerContext& w, Order& order) {
+    switch (w.stage) {
+    case Stage::Prepare: {
+        if (cfg_.prepare_work) cfg_.prepare_work(order);
+        order.advance_to(OrderStatus::Prepared);
+        order.prepared_by = static_cast<std::uint16_t>(w.index);
+        std::lock_guard lock(metrics_mutex_);
+        ++metrics_.prepared_count;
+        break;
+    }
+    case Stage::Pack: {
+        order.advance_to(OrderStatus::Packed);
+        order.packed_by = static_cast<std::uint16_t>(w.index);
+        std::lock_guard lock(metrics_mutex_);
+        ++metrics_.packed_count;
+        break;
+    }
+    case Stage::Deliver: {
+        order.advance_to(OrderStatus::Delivered);
+        order.delivered_by = static_cast<std::uint16_t>(w.index);
+        if (slowest_) slowest_->offer(w.index, order);
+        // Kept with the lead, so merged_orders() finds them once it is listed.
+        auto merged = order.merged != 0 ? follow_group(w, order) : std::vector<Order>{};
+        std::lock_guard lock(metrics_mutex_);
+        if (!merged.empty()) delivered_merged_.emplace(order.id, std::move(merged));
+        delivered_segments_[w.index].push_back(delivered_.size());
+        delivered_.push_back(order);
+        delivered_index_.append(order);
+        ++metrics_.delivered_count;
+        bump(finished_, std::uint64_t{ order.group_size() });
+        metrics_.total_lead_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            order.delivered_time - order.accepted_time);
+        break;
+    }
+    }
+
+    if (order.merged != 0 && w.stage != Stage::Deliver) (void)follow_group(w, order);
+    if (w.stage == Stage::Deliver) {
+        release_wip(order.group_size());
+        if (reorder_) reorder_->release(order);
+    }
+    note_status(w, order);
+}
+
+void Pipeline::abandon(WorkerContext& w, Stage stage, Order& order) {
+    order.advance_to(OrderStatus::Canceled);
+    {
+        std::lock_guard lock(metrics_mutex_);
+        ++abandoned_[static_cast<std::size_t>(stage)];
+        bump(finished_, std::uint64_t{ order.group_size() });
+    }
+    if (order.merged != 0) (void)follow_group(w, order);
+    release_wip(order.group_size());
+    if (reorder_) reorder_->skip(order.seq);
+    note_status(w, order);
+}
+
+void Pipeline::note_status(WorkerContext& w, const Order& order) {
+    if (!cfg_.status_census) return;
+
+    w.census.push_back(StatusCensus::Update{ order.id, order.status });
+    if (w.census.size() >= StatusCensus::kBatchSize) flush_status(w);
+}
+
+void Pipeline::flush_status(WorkerContext& w) {
+    census_.apply(w.census);
+    w.census.clear();
+}
+
+void Pipeline::retire_locked(Stage stage) noexcept {
+    if (--active_workers_[static_cast<std::size_t>(stage)] == 0) {
+        // Last worker of the stage: nothing more will reach the next queue.
+        if (auto* out = output_of(stage)) {
+            out->close();
+            if (out == &q_pack_) wake_carriers(true);
+            FlightRecorder::record(FlightEvent::QueueClosed, flight_source_, static_cast<std::uint64_t>(stage) + 1);
+        }
+    }
+}
+
+void Pipeline::on_worker_exit(WorkerContext& w) noexcept {
+    {
+        std::lock_guard lock(workers_mutex_);
+        for (std::size_t s = 0; s < kStages; ++s) {
+            const bool serves = w.shared ? !w.retired[s] : static_cast<Stage>(s) == w.stage;
+            if (serves) retire_locked(static_cast<Stage>(s));
+        }
+        --live_workers_;
+        w.control->exited = true;
+    }
+    workers_cv_.notify_all();
+}
+
+void Pipeline::fail() noexcept {
+    failed_.store(true);
+    set_state(PipelineState::Failed);
+    escalate();
+}
+
+// Every transition goes to the flight recorder; the first one into Failed
+// also dumps it, while the failing worker's last events are still there.
+void Pipeline::set_state(PipelineState s) noexcept {
+    record_transition(state_.exchange(s), s);
+}
+
+// Moves to `to` only from `from`, so a concurrent fail() is never overwritten.
+bool Pipeline::advance_state(PipelineState from, PipelineState to) noexcept {
+    if (!state_.compare_exchange_strong(from, to)) return false;
+    record_transition(from, to);
+    return true;
+}
+
+void Pipeline::record_transition(PipelineState old, PipelineState s) noexcept {
+    if (old == s) return;
+
+    FlightRecorder::record(FlightEvent::StateChange, flight_source_,
+        static_cast<std::uint64_t>(old), static_cast<std::uint64_t>(s));
+    if (s == PipelineState::Failed && !cfg_.flight_dump_path.empty()) {
+        FlightRecorder::record(FlightEvent::Dump, flight_source_);
+        (void)FlightRecorder::dump(cfg_.flight_dump_path);
+    }
+}
+
+BoundedBlockingQueue<Order>& Pipeline::input_of(Stage stage) noexcept {
+    switch (stage) {
+    case Stage::Prepare: return q_in_;
+    case Stage::Pack:    return q_prepare_;
+    case Stage::Deliver:
+    default:             return q_pack_;
+    }
+}
+
+BoundedBlockingQueue<Order>* Pipeline::output_of(Stage stage) noexcept {
+    switch (stage) {
+    case Stage::Prepare: return &q_prepare_;
+    case Stage::Pack:    return &q_pack_;
+    case Stage::Deliver:
+    default:             return nullptr;
+    }
+}
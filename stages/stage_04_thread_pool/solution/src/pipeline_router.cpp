@@ -0,0 +1,104 @@
+#include "pipeline_router.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    // splitmix64 finalizer: sequential ids and keys spread over all shards.
+    std::uint64_t mix(std::uint64_t x) noexcept {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // Per-thread xorshift: sampling must not contend on a shared generator.
+    std::uint64_t next_random() noexcept {
+        thread_local std::uint64_t state = mix(reinterpret_cast<std::uintptr_t>(&state));
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+} // namespace
+
+PipelineRouter::PipelineRouter()
+    : PipelineRouter(Config{}) {
+}
+
+PipelineRouter::PipelineRouter(Config cfg)
+    : cfg_(std::move(cfg)) {
+    if (cfg_.instances.empty()) throw std::invalid_argument("PipelineRouter: no instances");
+
+    shards_.reserve(cfg_.instances.size());
+    for (const auto& instance_cfg : cfg_.instances) shards_.push_back(std::make_unique<Shard>(instance_cfg));
+}
+
+void PipelineRouter::start() {
+    for (auto& shard : shards_) shard->pipeline.start();
+}
+
+// The other instances keep draining while one is being waited for.
+void PipelineRouter::shutdown() {
+    for (auto& shard : shards_) shard->pipeline.shutdown();
+}
+
+void PipelineRouter::shutdown_now() {
+    for (auto& shard : shards_) shard->pipeline.shutdown_now();
+}
+
+bool PipelineRouter::submit(Order order) {
+    const std::size_t i = cfg_.policy == RoutePolicy::Hash ? pick_hashed(order.id) : pick_two();
+    return submit_to(i, std::move(order));
+}
+
+bool PipelineRouter::submit(Order order, std::uint64_t key) {
+    return submit_to(pick_hashed(key), std::move(order));
+}
+
+std::size_t PipelineRouter::size() const noexcept {
+    return shards_.size();
+}
+
+Pipeline& PipelineRouter::instance(std::size_t i) {
+    return shards_.at(i)->pipeline;
+}
+
+const Pipeline& PipelineRouter::instance(std::size_t i) const {
+    return shards_.at(i)->pipeline;
+}
+
+std::vector<std::uint64_t> PipelineRouter::routed() const {
+    std::vector<std::uint64_t> out;
+    out.reserve(shards_.size());
+    for (const auto& shard : shards_) out.push_back(shard->routed.load(std::memory_order_relaxed));
+    return out;
+}
+
+std::size_t PipelineRouter::pick_hashed(std::uint64_t key) const noexcept {
+    return static_cast<std::size_t>(mix(key) % shards_.size());
+}
+
+// Two distinct instances, ties to the first sample so that equal loads still
+// spread at random.
+std::size_t PipelineRouter::pick_two() const noexcept {
+    const std::size_t n = shards_.size();
+    if (n == 1) return 0;
+
+    const std::uint64_t r = next_random();
+    const std::size_t a = static_cast<std::size_t>(r % n);
+    const std::size_t b = (a + 1 + static_cast<std::size_t>((r >> 32) % (n - 1))) % n;
+    return load_of(*shards_[b]) < load_of(*shards_[a]) ? b : a;
+}
+
+std::size_t PipelineRouter::load_of(const Shard& shard) const noexcept {
+    return cfg_.load == RouteLoad::QueueDepth ? shard.pipeline.q_in_depth() : shard.pipeline.in_flight();
+}
+
+bool PipelineRouter::submit_to(std::size_t i, Order&& order) {
+    Shard& shard = *shards_[i];
+    shard.routed.fetch_add(1, std::memory_order_relaxed);
+    return shard.pipeline.submit(std::move(order));
+}
@@ -0,0 +1,107 @@
+#include "reorder_buffer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+ReorderBuffer::ReorderBuffer(std::size_t window, Sink sink)
+    : sink_(std::move(sink)),
+      slots_(std::max<std::size_t>(window, 1)) {
+}
+
+std::uint64_t ReorderBuffer::admit(Clock::time_point deadline) {
+    std::unique_lock lock(mutex_);
+    const auto has_room = [&] { return closed_ || next_ - head_ < slots_.size(); };
+    if (!has_room()) {
+        ++stats_.window_waits;
+        window_cv_.wait_until(lock, deadline, has_room);
+    }
+    if (closed_ || next_ - head_ >= slots_.size()) return 0;
+
+    const std::uint64_t seq = next_++;
+    entry(seq).slot = Slot::Pending;
+    return seq;
+}
+
+void ReorderBuffer::release(const Order& order) {
+    std::unique_lock lock(mutex_);
+    if (order.seq < head_ || order.seq >= next_) return; // not numbered here, or flushed past
+
+    Entry& e = entry(order.seq);
+    e.slot = Slot::Delivered;
+    e.order = order;
+    stats_.max_depth = std::max(stats_.max_depth, ++stats_.depth);
+    emit(lock, false);
+}
+
+void ReorderBuffer::skip(std::uint64_t seq) {
+    std::unique_lock lock(mutex_);
+    if (seq < head_ || seq >= next_) return;
+
+    entry(seq).slot = Slot::Skipped;
+    ++stats_.skipped;
+    emit(lock, false);
+}
+
+void ReorderBuffer::close() noexcept {
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    window_cv_.notify_all();
+}
+
+std::size_t ReorderBuffer::flush() {
+    std::unique_lock lock(mutex_);
+    const std::uint64_t before = stats_.released;
+    emit(lock, true);
+    return static_cast<std::size_t>(stats_.released - before);
+}
+
+ReorderStats ReorderBuffer::stats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+// Takes the complete prefix under the lock and hands it to the sink without
+// it, until no more of the prefix is back. Only one thread emits at a time,
+// so the sink sees the orders in sequence even across emitting threads.
+void ReorderBuffer::emit(std::unique_lock<std::mutex>& lock, bool past_holes) {
+    if (emitting_) return;
+    emitting_ = true;
+
+    std::vector<Order> batch;
+    try {
+        for (;;) {
+            const std::uint64_t from = head_;
+            const auto now = Clock::now();
+            while (head_ < next_) {
+                Entry& e = entry(head_);
+                if (e.slot == Slot::Pending && !past_holes) break;
+                if (e.slot == Slot::Delivered) {
+                    ++stats_.wait.buckets[LatencyHistogram::bucket_of(now - e.order->delivered_time)];
+                    batch.push_back(std::move(*e.order));
+                    e.order.reset();
+                    --stats_.depth;
+                    ++stats_.released;
+                }
+                e.slot = Slot::Empty;
+                ++head_;
+            }
+            if (head_ == from) break;
+
+            lock.unlock();
+            window_cv_.notify_all();
+            if (sink_) {
+                for (const auto& order : batch) sink_(order);
+            }
+            batch.clear();
+            lock.lock();
+        }
+    }
+    catch (...) {
+        if (!lock.owns_lock()) lock.lock();
+        emitting_ = false;
+        throw;
+    }
+    emitting_ = false;
+}
@@ -0,0 +1,278 @@
+#include "roaring_bitmap.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+    constexpr std::size_t kBitsetWords = 65536 / 64;
+
+    std::uint64_t bit_of(std::uint16_t low) noexcept {
+        return std::uint64_t{ 1 } << (low & 63);
+    }
+
+} // namespace
+
+RoaringBitmap::RoaringBitmap(const RoaringBitmap& other)
+    : entries_(other.entries_),
+      cardinality_(other.cardinality_) {
+    // Shared containers are now frozen for both. The flag lives in the
+    // containers, so the source bitmap is left as it was.
+    for (const auto& e : entries_) e.container->frozen.store(true, std::memory_order_relaxed);
+}
+
+RoaringBitmap& RoaringBitmap::operator=(const RoaringBitmap& other) {
+    if (this != &other) {
+        entries_ = other.entries_;
+        cardinality_ = other.cardinality_;
+        for (const auto& e : entries_) e.container->frozen.store(true, std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+RoaringBitmap::Container::Container(const Container& other)
+    : array(other.array),
+      words(other.words),
+      cardinality(other.cardinality) {
+}
+
+RoaringBitmap::Container::Container(Container&& other) noexcept
+    : array(std::move(other.array)),
+      words(std::move(other.words)),
+      cardinality(other.cardinality) {
+}
+
+bool RoaringBitmap::Container::contains(std::uint16_t low) const noexcept {
+    if (is_bitset()) return (words[low >> 6] & bit_of(low)) != 0;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool RoaringBitmap::Container::add(std::uint16_t low) {
+    if (is_bitset()) {
+        auto& w = words[low >> 6];
+        if (w & bit_of(low)) return false;
+        w |= bit_of(low);
+        ++cardinality;
+        return true;
+    }
+
+    const auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) return false;
+    array.insert(it, low);
+    ++cardinality;
+
+    if (array.size() > kArrayMax) to_bitset();
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(std::uint16_t low) {
+    if (is_bitset()) {
+        auto& w = words[low >> 6];
+        if (!(w & bit_of(low))) return false;
+        w &= ~bit_of(low);
+        --cardinality;
+
+        // Hysteresis: do not flip back and forth around kArrayMax.
+        if (cardinality <= kArrayMax / 2) to_array();
+        return true;
+    }
+
+    const auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) return false;
+    array.erase(it);
+    --cardinality;
+    return true;
+}
+
+void RoaringBitmap::Container::to_bitset() {
+    words.assign(kBitsetWords, 0);
+    for (const auto low : array) words[low >> 6] |= bit_of(low);
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::to_array() {
+    std::vector<std::uint16_t> out;
+    out.reserve(cardinality);
+    auto push = [&](std::uint64_t v) { out.push_back(static_cast<std::uint16_t>(v)); };
+    for_each(0, push);
+    array = std::move(out);
+    words.clear();
+    words.shrink_to_fit();
+}
+
+std::size_t RoaringBitmap::find(std::uint64_t key) const noexcept {
+    const auto it = std::lower_bound(entries_.begin(), entries_.end(), key,
+        [](const Entry& e, std::uint64_t k) { return e.key < k; });
+    return static_cast<std::size_t>(it - entries_.begin());
+}
+
+RoaringBitmap::Container& RoaringBitmap::writable(std::size_t pos) {
+    auto& c = entries_[pos].container;
+    if (!c->frozen.load(std::memory_order_relaxed)) return *c;
+
+    // Every copy that shared it is gone: the last one let go with a release
+    // decrement, and writes to this bitmap are serialized with copying it,
+    // so no new sharer can appear. Write in place from now on.
+    if (c.use_count() == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        c->frozen.store(false, std::memory_order_relaxed);
+        return *c;
+    }
+    // Still shared with a copy, so copy before writing; the clone starts unfrozen.
+    c = std::make_shared<Container>(*c);
+    return *c;
+}
+
+bool RoaringBitmap::add(std::uint64_t id) {
+    const auto key = key_of(id);
+    const auto pos = find(key);
+
+    if (pos == entries_.size() || entries_[pos].key != key) {
+        auto c = std::make_shared<Container>();
+        c->add(low_of(id));
+        entries_.insert(entries_.begin() + static_cast<std::ptrdiff_t>(pos), Entry{ key, std::move(c) });
+        ++cardinality_;
+        return true;
+    }
+
+    if (entries_[pos].container->contains(low_of(id))) return false;
+    writable(pos).add(low_of(id));
+    ++cardinality_;
+    return true;
+}
+
+bool RoaringBitmap::remove(std::uint64_t id) {
+    const auto key = key_of(id);
+    const auto pos = find(key);
+    if (pos == entries_.size() || entries_[pos].key != key) return false;
+    if (!entries_[pos].container->contains(low_of(id))) return false;
+
+    if (entries_[pos].container->cardinality == 1) {
+        entries_.erase(entries_.begin() + static_cast<std::ptrdiff_t>(pos));
+    }
+    else {
+        writable(pos).remove(low_of(id));
+    }
+    --cardinality_;
+    return true;
+}
+
+bool RoaringBitmap::contains(std::uint64_t id) const noexcept {
+    const auto key = key_of(id);
+    const auto pos = find(key);
+    return pos < entries_.size() && entries_[pos].key == key && entries_[pos].container->contains(low_of(id));
+}
+
+void RoaringBitmap::clear() noexcept {
+    entries_.clear();
+    cardinality_ = 0;
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container& a, const Container& b) {
+    Container out;
+
+    if (a.is_bitset() && b.is_bitset()) {
+        out.words.resize(kBitsetWords);
+        for (std::size_t w = 0; w < kBitsetWords; ++w) {
+            out.words[w] = a.words[w] & b.words[w];
+            out.cardinality += static_cast<std::uint32_t>(std::popcount(out.words[w]));
+        }
+        if (out.cardinality <= kArrayMax) out.to_array();
+        return out;
+    }
+
+    if (a.is_bitset() || b.is_bitset()) {
+        const Container& arr = a.is_bitset() ? b : a;
+        const Container& bits = a.is_bitset() ? a : b;
+        for (const auto low : arr.array) {
+            if (bits.contains(low)) out.array.push_back(low);
+        }
+    }
+    else {
+        std::set_intersection(a.array.begin(), a.array.end(),
+            b.array.begin(), b.array.end(), std::back_inserter(out.array));
+    }
+
+    out.cardinality = static_cast<std::uint32_t>(out.array.size());
+    return out;
+}
+
+std::uint32_t RoaringBitmap::intersect_cardinality(const Container& a, const Container& b) {
+    std::uint32_t n = 0;
+
+    if (a.is_bitset() && b.is_bitset()) {
+        for (std::size_t w = 0; w < kBitsetWords; ++w) {
+            n += static_cast<std::uint32_t>(std::popcount(a.words[w] & b.words[w]));
+        }
+        return n;
+    }
+
+    if (a.is_bitset() || b.is_bitset()) {
+        const Container& arr = a.is_bitset() ? b : a;
+        const Container& bits = a.is_bitset() ? a : b;
+        for (const auto low : arr.array) n += bits.contains(low) ? 1 : 0;
+        return n;
+    }
+
+    auto i = a.array.begin();
+    auto j = b.array.begin();
+    while (i != a.array.end() && j != b.array.end()) {
+        if (*i < *j) ++i;
+        else if (*j < *i) ++j;
+        else { ++n; ++i; ++j; }
+    }
+    return n;
+}
+
+RoaringBitmap RoaringBitmap::intersect(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < a.entries_.size() && j < b.entries_.size()) {
+        const auto ka = a.entries_[i].key;
+        const auto kb = b.entries_[j].key;
+        if (ka < kb) { ++i; continue; }
+        if (kb < ka) { ++j; continue; }
+
+        auto c = intersect(*a.entries_[i].container, *b.entries_[j].container);
+        if (c.cardinality > 0) {
+            out.cardinality_ += c.cardinality;
+            out.entries_.push_back(Entry{ ka, std::make_shared<Container>(std::move(c)) });
+        }
+        ++i;
+        ++j;
+    }
+
+    return out;
+}
+
+std::uint64_t RoaringBitmap::intersect_cardinality(const RoaringBitmap& a, const RoaringBitmap& b) {
+    std::uint64_t n = 0;
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < a.entries_.size() && j < b.entries_.size()) {
+        const auto ka = a.entries_[i].key;
+        const auto kb = b.entries_[j].key;
+        if (ka < kb) { ++i; continue; }
+        if (kb < ka) { ++j; continue; }
+
+        n += intersect_cardinality(*a.entries_[i].container, *b.entries_[j].container);
+        ++i;
+        ++j;
+    }
+
+    return n;
+}
+
+std::vector<std::uint64_t> RoaringBitmap::to_vector() const {
+    std::vector<std::uint64_t> out;
+    out.reserve(static_cast<std::size_t>(cardinality_));
+    for_each([&](std::uint64_t id) { out.push_back(id); });
+    return out;
+}
@@ -0,0 +1,62 @@
+#include "slowest_orders.hpp"
+
+#include <algorithm>
+
+namespace {
+
+    // std heap algorithms build a max-heap for the comparator; "greater"
+    // keeps the fastest kept order at the front.
+    bool slower(const SlowOrder& a, const SlowOrder& b) noexcept {
+        return a.lead_time > b.lead_time;
+    }
+
+} // namespace
+
+SlowestOrders::SlowestOrders(std::size_t k, std::size_t shards)
+    : k_(std::max<std::size_t>(k, 1)) {
+    shards_.reserve(std::max<std::size_t>(shards, 1));
+    for (std::size_t i = 0; i < std::max<std::size_t>(shards, 1); ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+        shards_.back()->heap.reserve(k_);
+    }
+}
+
+void SlowestOrders::insert(Shard& s, const Order& order, std::chrono::steady_clock::duration lead) {
+    SlowOrder e;
+    e.id = order.id;
+    e.lead_time = std::chrono::duration_cast<std::chrono::nanoseconds>(lead);
+    e.accepted_time = order.accepted_time;
+    e.prepared_time = order.prepared_time;
+    e.packed_time = order.packed_time;
+    e.delivered_time = order.delivered_time;
+    e.prepared_by = order.prepared_by;
+    e.packed_by = order.packed_by;
+    e.delivered_by = order.delivered_by;
+
+    std::lock_guard lock(s.mutex);
+    if (s.heap.size() == k_) {
+        std::pop_heap(s.heap.begin(), s.heap.end(), slower);
+        s.heap.back() = e;
+    }
+    else {
+        s.heap.push_back(e);
+    }
+    std::push_heap(s.heap.begin(), s.heap.end(), slower);
+
+    s.full = s.heap.size() == k_;
+    s.threshold = s.heap.front().lead_time;
+}
+
+std::vector<SlowOrder> SlowestOrders::snapshot() const {
+    std::vector<SlowOrder> all;
+    all.reserve(k_ * shards_.size());
+    for (const auto& s : shards_) {
+        std::lock_guard lock(s->mutex);
+        all.insert(all.end(), s->heap.begin(), s->heap.end());
+    }
+
+    const std::size_t keep = std::min(k_, all.size());
+    std::partial_sort(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(keep), all.end(), slower);
+    all.resize(keep);
+    return all;
+}
@@ -0,0 +1,120 @@
+#include "status_census.hpp"
+
+#include <functional>
+#include <thread>
+#include <utility>
+
+namespace {
+
+    // Position along the order's life; a census entry only ever moves forward.
+    int rank_of(OrderStatus s) noexcept {
+        switch (s) {
+        case OrderStatus::Accepted:  return 0;
+        case OrderStatus::Prepared:  return 1;
+        case OrderStatus::Packed:    return 2;
+        case OrderStatus::Delivered:
+        case OrderStatus::Canceled:  return 3;
+        case OrderStatus::Rejected:
+        default:                     return -1;
+        }
+    }
+
+    constexpr std::array<OrderStatus, 4> kTracked{
+        OrderStatus::Accepted,
+        OrderStatus::Prepared,
+        OrderStatus::Packed,
+        OrderStatus::Canceled
+    };
+
+    constexpr std::uint8_t kRetired = 0x80; // counted as delivered, out of the bitmaps
+
+    // Bits for the steps of rank [from, to).
+    std::uint8_t steps(int from, int to) noexcept {
+        std::uint8_t mask = 0;
+        for (int r = from; r < to; ++r) mask |= static_cast<std::uint8_t>(1u << r);
+        return mask;
+    }
+
+} // namespace
+
+void StatusCensus::apply_locked(const Update& u) {
+    const int target = rank_of(u.status);
+    if (target < 0) return; // rejected orders never entered the pipeline
+
+    // A step that was overtaken: it only closes its gap.
+    const auto gap = missing_.find(u.id);
+    if (gap != missing_.end()) {
+        const std::uint8_t bit = steps(target, target + 1);
+        if ((gap->second & bit) != 0) {
+            gap->second &= static_cast<std::uint8_t>(~bit);
+            if ((gap->second & ~kRetired) == 0) missing_.erase(gap);
+            return;
+        }
+        if ((gap->second & kRetired) != 0) return;
+    }
+
+    int from = 0;
+    for (const auto s : kTracked) {
+        auto& bitmap = state_.by_status[static_cast<std::size_t>(s)];
+        if (!bitmap.contains(u.id)) continue;
+        if (rank_of(s) >= target) return; // a later update was already applied
+        bitmap.remove(u.id);
+        from = rank_of(s) + 1;
+        break;
+    }
+
+    if (u.status == OrderStatus::Canceled) {
+        // The bitmap now turns every late step away.
+        if (gap != missing_.end()) missing_.erase(gap);
+    }
+    else if (const std::uint8_t skipped = steps(from, target); skipped != 0) {
+        missing_[u.id] |= skipped;
+    }
+
+    if (u.status != OrderStatus::Delivered) {
+        state_.by_status[static_cast<std::size_t>(u.status)].add(u.id);
+        return;
+    }
+    ++state_.delivered;
+    const auto it = missing_.find(u.id);
+    if (it != missing_.end()) it->second |= kRetired;
+}
+
+void StatusCensus::apply(const Batch& batch) {
+    if (batch.empty()) return;
+
+    std::lock_guard lock(mutex_);
+    for (const auto& u : batch) apply_locked(u);
+}
+
+void StatusCensus::record(OrderId id, OrderStatus status) {
+    auto& stripe = stripes_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % kStripes];
+
+    Batch full;
+    {
+        std::lock_guard lock(stripe.mutex);
+        stripe.pending.push_back(Update{ id, status });
+        if (stripe.pending.size() < kBatchSize) return;
+        full.swap(stripe.pending);
+    }
+
+    apply(full);
+}
+
+void StatusCensus::flush_stripes() {
+    for (auto& stripe : stripes_) {
+        Batch pending;
+        {
+            std::lock_guard lock(stripe.mutex);
+            pending.swap(stripe.pending);
+        }
+        apply(pending);
+    }
+}
+
+StatusSnapshot StatusCensus::snapshot() {
+    flush_stripes();
+
+    std::lock_guard lock(mutex_);
+    return state_;
+}
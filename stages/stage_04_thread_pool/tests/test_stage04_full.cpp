@@ -0,0 +1,2498 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sched.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "test_framework.hpp"
+
+#include "admin_server.hpp"
+#include "archive_index.hpp"
+#include "cluster_client.hpp"
+#include "flight_recorder.hpp"
+#include "hash_ring.hpp"
+#include "order.hpp"
+#include "order_sort.hpp"
+#include "persistent_ring.hpp"
+#include "pipeline.hpp"
+#include "pipeline_router.hpp"
+#include "pressure.hpp"
+#include "latency_histogram.hpp"
+#include "metrics.hpp"
+#include "metrics_page.hpp"
+#include "mock_carrier.hpp"
+#include "mpsc_ring.hpp"
+#include "queue.hpp"
+#include "reorder_buffer.hpp"
+#include "roaring_bitmap.hpp"
+#include "slowest_orders.hpp"
+#include "status_census.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+    Pipeline::Config backlog_cfg() {
+        Pipeline::Config cfg{};
+        cfg.q_in_capacity = 50000;
+        cfg.q_prepare_capacity = 50000;
+        cfg.q_pack_capacity = 50000;
+
+        cfg.prepare_workers = 1;
+        cfg.pack_workers = 1;
+        cfg.deliver_workers = 1;
+
+        cfg.push_timeout = std::chrono::milliseconds{ 200 };
+        cfg.pop_timeout = std::chrono::milliseconds{ 10 };
+        return cfg;
+    }
+
+    std::uint64_t submit_n(Pipeline& p, std::uint64_t n) {
+        std::uint64_t ok = 0;
+        for (std::uint64_t i = 1; i <= n; ++i) {
+            if (p.submit(Order(static_cast<OrderId>(i)))) ++ok;
+        }
+        return ok;
+    }
+
+    Order delivered_order(OrderId id, std::uint64_t seq) {
+        Order o(id);
+        o.seq = seq;
+        o.delivered_time = std::chrono::steady_clock::now();
+        return o;
+    }
+
+    void require_report_matches_metrics(const ShutdownReport& r, const Metrics& m) {
+        OPS_REQUIRE(r.delivered == m.delivered_count);
+        OPS_REQUIRE(r.prepare.completed == m.prepared_count);
+        OPS_REQUIRE(r.pack.completed == m.packed_count);
+        OPS_REQUIRE(r.deliver.completed == m.delivered_count);
+
+        // Every accepted order is either delivered or abandoned at exactly one stage.
+        OPS_REQUIRE(r.delivered + r.abandoned_total() == m.accepted_count);
+    }
+
+    OrderIndex stable_sort_reference(const std::vector<std::uint64_t>& keys) {
+        OrderIndex perm(keys.size());
+        std::iota(perm.begin(), perm.end(), std::size_t{ 0 });
+        std::stable_sort(perm.begin(), perm.end(),
+            [&](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+        return perm;
+    }
+
+    std::vector<std::size_t> brute_force_range(const std::vector<Order>& archive,
+        OrderKey key, std::uint64_t lo, std::uint64_t hi) {
+        std::vector<std::size_t> out;
+        for (std::size_t i = 0; i < archive.size(); ++i) {
+            const auto k = order_key(archive[i], key);
+            if (k >= lo && k <= hi) out.push_back(i);
+        }
+        return out;
+    }
+
+    // Fresh path in the temp directory; any leftover from an earlier run is removed.
+    std::string temp_ring_path(const char* name) {
+        const auto path = std::filesystem::temp_directory_path() / (std::string("ops_stage04_") + name + ".ring");
+        std::filesystem::remove(path);
+        return path.string();
+    }
+
+    std::vector<OrderId> ids_of(const std::vector<Order>& orders) {
+        std::vector<OrderId> ids;
+        for (const auto& o : orders) ids.push_back(o.id);
+        return ids;
+    }
+
+    // The BoundedQueueBackend contract: FIFO order, push_for / wait_pop_for
+    // timeouts, close() waking blocked producers and consumers, and no item
+    // lost or duplicated under concurrent load. `make(capacity)` returns a
+    // std::unique_ptr to a fresh queue of ints.
+    template <typename Make>
+    void check_queue_conformance(Make make) {
+        using Q = typename decltype(make(std::size_t{ 1 }))::element_type;
+        static_assert(BoundedQueueBackend<Q, int>);
+
+        auto q = make(2);
+        OPS_REQUIRE(q->push(1));
+        OPS_REQUIRE(q->push_for(2, 0ms));
+        OPS_REQUIRE_MSG(!q->push_for(3, 10ms), "push_for must time out on a full queue");
+        OPS_REQUIRE(q->size() == 2);
+
+        int v = 0;
+        OPS_REQUIRE(q->wait_pop(v) && v == 1);
+        OPS_REQUIRE(q->wait_pop_for(v, 0ms) && v == 2);
+        OPS_REQUIRE_MSG(!q->wait_pop_for(v, 10ms), "wait_pop_for must time out on an empty queue");
+        OPS_REQUIRE(q->size() == 0);
+
+        // A blocked push completes once a consumer frees a slot.
+        OPS_REQUIRE(q->push(10) && q->push(11));
+        auto pusher = std::async(std::launch::async, [&q] { return q->push_for(12, 5s); });
+        std::this_thread::sleep_for(5ms);
+        OPS_REQUIRE(q->wait_pop(v) && v == 10);
+        OPS_REQUIRE(pusher.get());
+        OPS_REQUIRE(q->wait_pop(v) && v == 11);
+        OPS_REQUIRE(q->wait_pop(v) && v == 12);
+
+        // Many producers and consumers: every item arrives exactly once, and
+        // each consumer sees any one producer's items in push order.
+        constexpr int kProducers = 3;
+        constexpr int kPerProducer = 2000;
+        std::atomic<long long> sum{ 0 };
+        std::atomic<int> popped{ 0 };
+        std::atomic<bool> in_order{ true };
+        std::vector<std::thread> threads;
+        for (int c = 0; c < 3; ++c) {
+            threads.emplace_back([&] {
+                std::array<int, kProducers> last{};
+                int x = 0;
+                while (q->wait_pop(x)) {
+                    const int p = (x - 1) / kPerProducer;
+                    if (x <= last[p]) in_order = false;
+                    last[p] = x;
+                    sum += x;
+                    ++popped;
+                }
+            });
+        }
+        std::vector<std::thread> producers;
+        for (int p = 0; p < kProducers; ++p) {
+            producers.emplace_back([&q, p] {
+                for (int i = 1; i <= kPerProducer; ++i) {
+                    if (i % 2 == 0) (void)q->push(p * kPerProducer + i);
+                    else while (!q->push_for(p * kPerProducer + i, 1ms)) {}
+                }
+            });
+        }
+        for (auto& t : producers) t.join();
+        while (popped.load() < kProducers * kPerProducer) std::this_thread::yield();
+
+        // Close wakes the consumers blocked in untimed wait_pop.
+        q->close();
+        for (auto& t : threads) t.join();
+        const long long n = static_cast<long long>(kProducers) * kPerProducer;
+        OPS_REQUIRE(popped.load() == n);
+        OPS_REQUIRE(sum.load() == n * (n + 1) / 2);
+        OPS_REQUIRE_MSG(in_order.load(), "items of one producer must come out in push order");
+
+        // Close wakes a consumer blocked in wait_pop_for on an empty queue.
+        auto empty = make(1);
+        const auto t0 = std::chrono::steady_clock::now();
+        auto waiter = std::async(std::launch::async, [&empty] { int x = 0; return empty->wait_pop_for(x, 5s); });
+        std::this_thread::sleep_for(5ms);
+        empty->close();
+        OPS_REQUIRE(!waiter.get());
+        OPS_REQUIRE(std::chrono::steady_clock::now() - t0 < 2s);
+
+        // Close wakes a producer blocked on a full queue; queued items still drain.
+        auto full = make(1);
+        OPS_REQUIRE(full->push(5));
+        auto blocked = std::async(std::launch::async, [&full] { return full->push(6); });
+        auto timed = std::async(std::launch::async, [&full] { return full->push_for(7, 5s); });
+        std::this_thread::sleep_for(5ms);
+        full->close();
+        OPS_REQUIRE(!blocked.get());
+        OPS_REQUIRE(!timed.get());
+        OPS_REQUIRE(!full->push(8));
+        OPS_REQUIRE(!full->push_for(8, 0ms));
+        OPS_REQUIRE(full->wait_pop(v) && v == 5);
+        OPS_REQUIRE(!full->wait_pop(v));
+        OPS_REQUIRE(!full->wait_pop_for(v, 5s));
+        OPS_REQUIRE(full->size() == 0);
+    }
+
+    // The conformance suite plus what only BoundedBlockingQueue offers.
+    void check_backend_semantics(WaitBackend backend) {
+        check_queue_conformance([backend](std::size_t capacity) {
+            return std::make_unique<BoundedBlockingQueue<int>>(capacity, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, backend);
+        });
+
+        BoundedBlockingQueue<int> q(1, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, backend);
+        OPS_REQUIRE(q.backend() == backend);
+        int v = 0;
+        OPS_REQUIRE(!q.try_pop(v));
+        OPS_REQUIRE(q.push(1));
+        OPS_REQUIRE(q.try_pop(v) && v == 1);
+        OPS_REQUIRE(q.push(2));
+        q.close();
+        OPS_REQUIRE(!q.push(3));
+        OPS_REQUIRE(q.wait_pop(v) && v == 2);
+        OPS_REQUIRE(q.stats().push_count == 2 && q.stats().pop_count == 2);
+
+        // Timed waits end at their deadline, not early and not much later.
+        BoundedBlockingQueue<int> t(1, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, backend);
+        auto t0 = std::chrono::steady_clock::now();
+        OPS_REQUIRE(!t.wait_pop_for(v, 20ms));
+        auto waited = std::chrono::steady_clock::now() - t0;
+        OPS_REQUIRE(waited >= 20ms && waited < 500ms);
+        OPS_REQUIRE(t.push(1));
+        t0 = std::chrono::steady_clock::now();
+        OPS_REQUIRE(!t.push_for(2, 20ms));
+        waited = std::chrono::steady_clock::now() - t0;
+        OPS_REQUIRE(waited >= 20ms && waited < 500ms);
+
+        // A slot or an item appearing during a timed wait goes to the waiter.
+        int first = 0;
+        int second = 0;
+        std::thread other([&] {
+            std::this_thread::sleep_for(10ms);
+            (void)t.try_pop(first);
+            (void)t.wait_pop_for(second, 2s);
+        });
+        OPS_REQUIRE(t.push_for(3, 2s));
+        other.join();
+        OPS_REQUIRE(first == 1 && second == 3 && t.empty());
+    }
+
+#if !defined(_WIN32)
+    // An ops_node child process; its first output line names the port. One
+    // not waited for is killed, so a failing test leaves no child behind.
+    struct NodeProcess {
+        pid_t pid = -1;
+        std::uint16_t port = 0;
+        FILE* out = nullptr;
+
+        NodeProcess() = default;
+        NodeProcess(NodeProcess&& other) noexcept
+            : pid(std::exchange(other.pid, -1)),
+              port(other.port),
+              out(std::exchange(other.out, nullptr)) {
+        }
+        NodeProcess& operator=(NodeProcess&&) = delete;
+
+        ~NodeProcess() {
+            if (pid > 0) {
+                (void)::kill(pid, SIGKILL);
+                (void)::waitpid(pid, nullptr, 0);
+            }
+            if (out != nullptr) std::fclose(out);
+        }
+    };
+
+    NodeProcess spawn_node() {
+        int fds[2];
+        if (::pipe(fds) != 0) throw std::runtime_error("pipe failed");
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+        posix_spawn_file_actions_addclose(&actions, fds[0]);
+        posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+        std::string path = OPS_NODE_PATH;
+        std::string port = "0";
+        std::string workers = "2";
+        char* argv[] = { path.data(), port.data(), workers.data(), nullptr };
+
+        NodeProcess node;
+        const int rc = ::posix_spawn(&node.pid, path.c_str(), &actions, nullptr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[1]);
+        node.out = ::fdopen(fds[0], "r");
+        if (rc != 0 || node.out == nullptr) throw std::runtime_error("cannot start " + path);
+
+        char line[128] = {};
+        if (std::fgets(line, sizeof(line), node.out) == nullptr) throw std::runtime_error("ops_node did not start");
+        const std::string text(line);
+        node.port = static_cast<std::uint16_t>(std::stoul(text.substr(text.rfind(':') + 1)));
+        return node;
+    }
+
+    // Exit code once the node has finished on its own.
+    int wait_node(NodeProcess& node) {
+        int status = 0;
+        (void)::waitpid(std::exchange(node.pid, -1), &status, 0);
+        std::fclose(std::exchange(node.out, nullptr));
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+#endif
+
+} // namespace
+
+OPS_TEST("Stage04: shutdown_for with ample deadline drains all orders") {
+    Pipeline p(backlog_cfg());
+    p.start();
+
+    const auto accepted = submit_n(p, 5000);
+    const auto r = p.shutdown_for(10s);
+
+    OPS_REQUIRE(p.state() == PipelineState::Stopped);
+    OPS_REQUIRE(r.drained);
+    OPS_REQUIRE(r.abandoned_total() == 0);
+    OPS_REQUIRE(r.delivered == accepted);
+
+    const auto m = p.metrics();
+    require_report_matches_metrics(r, m);
+    OPS_REQUIRE(p.delivered_orders().size() == accepted);
+}
+
+OPS_TEST("Stage04: shutdown_for escalates at deadline and accounts for every accepted order") {
+    Pipeline p(backlog_cfg());
+    p.start();
+
+    const auto accepted = submit_n(p, 40000);
+
+    auto fut = std::async(std::launch::async, [&] { return p.shutdown_for(0ms); });
+    OPS_REQUIRE(fut.wait_for(2500ms) == std::future_status::ready);
+    const auto r = fut.get();
+
+    OPS_REQUIRE(p.state() == PipelineState::Stopped);
+    OPS_REQUIRE(!p.submit(Order(OrderId{ 999999 })));
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.accepted_count == accepted);
+    require_report_matches_metrics(r, m);
+    OPS_REQUIRE(r.drained == (r.abandoned_total() == 0));
+    OPS_REQUIRE(p.delivered_orders().size() == r.delivered);
+    OPS_REQUIRE_MSG(p.in_flight() == 0, "orders left queued must release their WIP");
+}
+
+OPS_TEST("Stage04: shutdown_for is idempotent and agrees with later shutdown calls") {
+    Pipeline p(backlog_cfg());
+    p.start();
+
+    (void)submit_n(p, 20000);
+
+    const auto r1 = p.shutdown_for(1ms);
+    p.shutdown();
+    p.shutdown_now();
+    const auto r2 = p.shutdown_for(10s);
+
+    OPS_REQUIRE(r2.drained == r1.drained);
+    OPS_REQUIRE(r2.delivered == r1.delivered);
+    OPS_REQUIRE(r2.prepare.abandoned == r1.prepare.abandoned);
+    OPS_REQUIRE(r2.pack.abandoned == r1.pack.abandoned);
+    OPS_REQUIRE(r2.deliver.abandoned == r1.deliver.abandoned);
+
+    require_report_matches_metrics(r2, p.metrics());
+}
+
+OPS_TEST("Stage04: shutdown_for before start stops with an empty drained report") {
+    Pipeline p(backlog_cfg());
+
+    const auto r = p.shutdown_for(0ms);
+
+    OPS_REQUIRE(p.state() == PipelineState::Stopped);
+    OPS_REQUIRE(r.drained);
+    OPS_REQUIRE(r.delivered == 0);
+    OPS_REQUIRE(r.abandoned_total() == 0);
+    OPS_REQUIRE(!p.submit(Order(OrderId{ 1 })));
+}
+
+OPS_TEST("Stage04: radix_sort_permutation matches stable_sort for any thread count") {
+    std::mt19937_64 rng(42);
+
+    for (const std::size_t n : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 1000 }, std::size_t{ 300000 } }) {
+        std::vector<std::uint64_t> wide(n);
+        std::vector<std::uint64_t> narrow(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            wide[i] = rng();
+            narrow[i] = rng() % 64; // many duplicates, most byte passes skipped
+        }
+
+        for (const std::size_t threads : { std::size_t{ 1 }, std::size_t{ 4 } }) {
+            OPS_REQUIRE(radix_sort_permutation(wide, threads) == stable_sort_reference(wide));
+            OPS_REQUIRE(radix_sort_permutation(narrow, threads) == stable_sort_reference(narrow));
+        }
+    }
+}
+
+OPS_TEST("Stage04: sort_orders and merge_sorted_runs order delivered views by id and time") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.deliver_workers = 3;
+
+    Pipeline p(cfg);
+    p.start();
+
+    std::mt19937_64 rng(7);
+    std::uint64_t accepted = 0;
+    for (std::size_t i = 0; i < 20000; ++i) {
+        if (p.submit(Order(static_cast<OrderId>(rng() >> 1)))) ++accepted;
+    }
+    p.shutdown();
+
+    const auto& delivered = p.delivered_orders();
+    OPS_REQUIRE(delivered.size() == accepted);
+
+    const auto by_id = sort_orders(delivered, OrderKey::Id, 4);
+    OPS_REQUIRE(by_id.size() == delivered.size());
+    for (std::size_t i = 1; i < by_id.size(); ++i) {
+        OPS_REQUIRE(delivered[by_id[i - 1]].id <= delivered[by_id[i]].id);
+    }
+
+    const auto segments = p.delivered_segments();
+    OPS_REQUIRE(segments.size() == cfg.deliver_workers);
+
+    const auto by_time = merge_sorted_runs(delivered, segments, OrderKey::DeliveredTime);
+    OPS_REQUIRE(by_time.size() == delivered.size());
+    for (std::size_t i = 1; i < by_time.size(); ++i) {
+        OPS_REQUIRE(delivered[by_time[i - 1]].delivered_time <= delivered[by_time[i]].delivered_time);
+    }
+
+    auto seen = by_time;
+    std::sort(seen.begin(), seen.end());
+    for (std::size_t i = 0; i < seen.size(); ++i) OPS_REQUIRE(seen[i] == i);
+
+    const auto radix_by_time = sort_orders(delivered, OrderKey::DeliveredTime);
+    for (std::size_t i = 0; i < by_time.size(); ++i) {
+        OPS_REQUIRE(delivered[radix_by_time[i]].delivered_time == delivered[by_time[i]].delivered_time);
+    }
+}
+
+OPS_TEST("Stage04: SparseBlockIndex range queries match a full scan") {
+    std::mt19937_64 rng(11);
+
+    // Near-sorted times (bounded jitter) and ids issued out of order.
+    const auto base = std::chrono::steady_clock::now();
+    std::vector<Order> archive;
+    for (std::size_t i = 0; i < 50000; ++i) {
+        Order o(static_cast<OrderId>(i % 7 == 0 ? rng() % 100000 : i));
+        o.accepted_time = base + std::chrono::microseconds(i * 10 + rng() % 300);
+        o.delivered_time = o.accepted_time + std::chrono::microseconds(rng() % 2000);
+        archive.push_back(o);
+    }
+
+    SparseBlockIndex index(256);
+    for (const auto& o : archive) index.append(o);
+
+    OPS_REQUIRE(index.size() == archive.size());
+    OPS_REQUIRE(index.block_count() == (archive.size() + 255) / 256);
+
+    for (int q = 0; q < 200; ++q) {
+        const auto from = base + std::chrono::microseconds(rng() % 500000);
+        const auto to = from + std::chrono::microseconds(rng() % 20000);
+
+        for (const auto key : { OrderKey::AcceptedTime, OrderKey::DeliveredTime }) {
+            const auto lo = time_key(from);
+            const auto hi = time_key(to);
+            OPS_REQUIRE(find_in_range(archive, index, key, lo, hi) == brute_force_range(archive, key, lo, hi));
+        }
+
+        const std::uint64_t id = rng() % 60000;
+        OPS_REQUIRE(find_in_range(archive, index, OrderKey::Id, id, id + 50)
+            == brute_force_range(archive, OrderKey::Id, id, id + 50));
+    }
+
+    OPS_REQUIRE(find_in_range(archive, index, OrderKey::Id, 10, 5).empty());
+
+    const auto pos = find_by_id(archive, index, archive[12345].id);
+    OPS_REQUIRE(pos.has_value());
+    OPS_REQUIRE(archive[*pos].id == archive[12345].id);
+}
+
+OPS_TEST("Stage04: delivered_between and find_delivered answer from the delivered index") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.deliver_workers = 2;
+
+    Pipeline p(cfg);
+    p.start();
+    (void)submit_n(p, 20000);
+    p.shutdown();
+
+    const auto& delivered = p.delivered_orders();
+    OPS_REQUIRE(!delivered.empty());
+
+    const auto mid = delivered[delivered.size() / 2].delivered_time;
+    const auto from = mid - std::chrono::microseconds(200);
+    const auto to = mid + std::chrono::microseconds(200);
+
+    const auto hits = p.delivered_between(OrderKey::DeliveredTime, from, to);
+    OPS_REQUIRE(!hits.empty());
+    OPS_REQUIRE(hits == brute_force_range(delivered, OrderKey::DeliveredTime, time_key(from), time_key(to)));
+
+    const auto accepted_hits = p.delivered_between(OrderKey::AcceptedTime, from, to);
+    OPS_REQUIRE(accepted_hits == brute_force_range(delivered, OrderKey::AcceptedTime, time_key(from), time_key(to)));
+
+    const auto pos = p.find_delivered(OrderId{ 777 });
+    OPS_REQUIRE(pos.has_value());
+    OPS_REQUIRE(delivered[*pos].id == OrderId{ 777 });
+    OPS_REQUIRE(!p.find_delivered(OrderId{ 999999 }).has_value());
+}
+
+OPS_TEST("Stage04: RoaringBitmap matches std::set across array and bitset containers") {
+    std::mt19937_64 rng(5);
+    RoaringBitmap bm;
+    std::set<std::uint64_t> ref;
+
+    // Dense block (forces bitset), sparse ids far apart, then random removals.
+    for (std::uint64_t i = 0; i < 20000; ++i) {
+        OPS_REQUIRE(bm.add(i * 2) == ref.insert(i * 2).second);
+    }
+    for (int i = 0; i < 5000; ++i) {
+        const std::uint64_t id = rng();
+        OPS_REQUIRE(bm.add(id) == ref.insert(id).second);
+    }
+    for (int i = 0; i < 30000; ++i) {
+        const std::uint64_t id = (rng() % 40000);
+        OPS_REQUIRE(bm.remove(id) == (ref.erase(id) == 1));
+    }
+
+    OPS_REQUIRE(bm.cardinality() == ref.size());
+    OPS_REQUIRE(bm.to_vector() == std::vector<std::uint64_t>(ref.begin(), ref.end()));
+    for (std::uint64_t id = 0; id < 1000; ++id) OPS_REQUIRE(bm.contains(id) == (ref.count(id) == 1));
+
+    RoaringBitmap other;
+    std::set<std::uint64_t> other_ref;
+    for (std::uint64_t i = 0; i < 40000; i += 3) {
+        other.add(i);
+        other_ref.insert(i);
+    }
+
+    std::vector<std::uint64_t> expected;
+    std::set_intersection(ref.begin(), ref.end(), other_ref.begin(), other_ref.end(), std::back_inserter(expected));
+
+    OPS_REQUIRE(RoaringBitmap::intersect(bm, other).to_vector() == expected);
+    OPS_REQUIRE(RoaringBitmap::intersect_cardinality(bm, other) == expected.size());
+}
+
+OPS_TEST("Stage04: RoaringBitmap copies are isolated snapshots") {
+    RoaringBitmap bm;
+    for (std::uint64_t i = 0; i < 10000; ++i) bm.add(i);
+
+    const RoaringBitmap snap = bm;
+    for (std::uint64_t i = 0; i < 10000; i += 2) bm.remove(i);
+    bm.add(1u << 20);
+
+    OPS_REQUIRE(snap.cardinality() == 10000);
+    OPS_REQUIRE(snap.contains(0));
+    OPS_REQUIRE(!snap.contains(1u << 20));
+    OPS_REQUIRE(bm.cardinality() == 5001);
+    OPS_REQUIRE(!bm.contains(0));
+
+    // Writes through a copy of a snapshot leave the snapshot alone as well.
+    RoaringBitmap copy = snap;
+    copy.remove(1);
+    copy.add(1u << 21);
+    OPS_REQUIRE(snap.contains(1) && !snap.contains(1u << 21));
+    OPS_REQUIRE(!copy.contains(1) && copy.cardinality() == 10000);
+
+    // With its copies gone a container is written in place again, and a
+    // new copy still sees none of the later writes.
+    {
+        const RoaringBitmap dropped = bm;
+    }
+    bm.add(0);
+    const RoaringBitmap later = bm;
+    bm.remove(1);
+    OPS_REQUIRE(later.contains(0) && later.contains(1) && later.cardinality() == 5002);
+    OPS_REQUIRE(!bm.contains(1) && bm.cardinality() == 5001);
+}
+
+OPS_TEST("Stage04: status census tracks every accepted order in exactly one status") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.status_census = true;
+    cfg.prepare_workers = 2;
+    cfg.deliver_workers = 2;
+
+    Pipeline p(cfg);
+    p.start();
+
+    auto fut = std::async(std::launch::async, [&] { return submit_n(p, 30000); });
+
+    for (int i = 0; i < 20; ++i) {
+        const auto snap = p.status_snapshot();
+        std::uint64_t tracked = 0;
+        for (const auto s : { OrderStatus::Accepted, OrderStatus::Prepared, OrderStatus::Packed,
+                              OrderStatus::Delivered, OrderStatus::Canceled }) {
+            tracked += snap.count(s);
+        }
+        OPS_REQUIRE(tracked <= p.metrics().accepted_count);
+        OPS_REQUIRE(RoaringBitmap::intersect_cardinality(snap[OrderStatus::Accepted], snap[OrderStatus::Delivered]) == 0);
+        std::this_thread::yield();
+    }
+
+    const auto accepted = fut.get();
+    p.shutdown();
+
+    const auto snap = p.status_snapshot();
+    OPS_REQUIRE(snap.count(OrderStatus::Delivered) == accepted);
+    OPS_REQUIRE(snap.count(OrderStatus::Accepted) == 0);
+    OPS_REQUIRE(snap.count(OrderStatus::Prepared) == 0);
+    OPS_REQUIRE(snap.count(OrderStatus::Packed) == 0);
+    OPS_REQUIRE(snap.count(OrderStatus::Canceled) == 0);
+    OPS_REQUIRE(snap[OrderStatus::Delivered].empty()); // counted only
+}
+
+OPS_TEST("Stage04: status census counts delivered ids and turns their late steps away") {
+    StatusCensus census;
+
+    // Order 2 is delivered before its Prepared arrives; order 3 is canceled
+    // before its Accepted does.
+    census.apply({ { 1, OrderStatus::Accepted }, { 1, OrderStatus::Prepared }, { 1, OrderStatus::Packed },
+        { 1, OrderStatus::Delivered } });
+    census.apply({ { 2, OrderStatus::Accepted }, { 2, OrderStatus::Packed }, { 2, OrderStatus::Delivered },
+        { 3, OrderStatus::Canceled } });
+    auto snap = census.snapshot();
+    OPS_REQUIRE(snap.count(OrderStatus::Delivered) == 2 && snap[OrderStatus::Delivered].empty());
+    OPS_REQUIRE(snap.count(OrderStatus::Accepted) == 0 && snap.count(OrderStatus::Packed) == 0);
+
+    census.apply({ { 2, OrderStatus::Prepared }, { 3, OrderStatus::Accepted } });
+    snap = census.snapshot();
+    OPS_REQUIRE(snap.count(OrderStatus::Prepared) == 0 && snap.count(OrderStatus::Accepted) == 0);
+    OPS_REQUIRE(snap.count(OrderStatus::Delivered) == 2);
+    OPS_REQUIRE(snap.count(OrderStatus::Canceled) == 1 && snap[OrderStatus::Canceled].contains(3));
+
+    // Order 2's last step has arrived, so a new order 2 is tracked afresh.
+    census.record(2, OrderStatus::Accepted);
+    snap = census.snapshot();
+    OPS_REQUIRE(snap[OrderStatus::Accepted].contains(2) && snap.count(OrderStatus::Delivered) == 2);
+}
+
+OPS_TEST("Stage04: status census accounts for canceled orders after shutdown_now") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.status_census = true;
+
+    Pipeline p(cfg);
+    p.start();
+    const auto accepted = submit_n(p, 30000);
+    p.shutdown_now();
+
+    const auto snap = p.status_snapshot();
+    const auto m = p.metrics();
+
+    const std::uint64_t tracked = snap.count(OrderStatus::Accepted) + snap.count(OrderStatus::Prepared)
+        + snap.count(OrderStatus::Packed) + snap.count(OrderStatus::Delivered) + snap.count(OrderStatus::Canceled);
+
+    OPS_REQUIRE(tracked == accepted);
+    OPS_REQUIRE(snap.count(OrderStatus::Delivered) == m.delivered_count);
+}
+
+OPS_TEST("Stage04: fifo admission serves blocked producers in arrival order") {
+    BoundedBlockingQueue<int> q(1, PushAdmission::Fifo);
+    OPS_REQUIRE(q.push(0));
+
+    std::vector<std::thread> producers;
+    for (int i = 1; i <= 6; ++i) {
+        producers.emplace_back([&q, i] { (void)q.push_for(i, 5s); });
+        while (q.waiting_producers() < static_cast<std::size_t>(i)) std::this_thread::yield();
+    }
+
+    // A newcomer must not overtake the parked producers even when a slot frees up.
+    for (int expected = 0; expected <= 6; ++expected) {
+        int v = -1;
+        OPS_REQUIRE(q.wait_pop_for(v, 5s));
+        OPS_REQUIRE_MSG(v == expected, "producers must be admitted in arrival order");
+        if (expected == 0) OPS_REQUIRE(!q.push_for(100, 0ms));
+    }
+
+    for (auto& t : producers) t.join();
+    OPS_REQUIRE(q.waiting_producers() == 0);
+    OPS_REQUIRE(q.stats().push_count == 7);
+}
+
+OPS_TEST("Stage04: fifo admission survives timeouts and close") {
+    BoundedBlockingQueue<int> q(1, PushAdmission::Fifo);
+    OPS_REQUIRE(q.push(0));
+
+    // The head of the line times out; the producer behind it keeps its place.
+    auto timed_out = std::async(std::launch::async, [&q] { return q.push_for(1, 30ms); });
+    while (q.waiting_producers() < 1) std::this_thread::yield();
+    auto patient = std::async(std::launch::async, [&q] { return q.push_for(2, 5s); });
+    while (q.waiting_producers() < 2) std::this_thread::yield();
+
+    OPS_REQUIRE(!timed_out.get());
+    OPS_REQUIRE(q.waiting_producers() == 1);
+
+    int v = -1;
+    OPS_REQUIRE(q.wait_pop(v) && v == 0);
+    OPS_REQUIRE(patient.get());
+    OPS_REQUIRE(q.wait_pop(v) && v == 2);
+
+    // Close releases every parked producer with a rejection.
+    OPS_REQUIRE(q.push(3));
+    std::vector<std::future<bool>> parked;
+    for (int i = 0; i < 4; ++i) {
+        parked.push_back(std::async(std::launch::async, [&q] { return q.push(4); }));
+    }
+    while (q.waiting_producers() < 4) std::this_thread::yield();
+    q.close();
+    for (auto& f : parked) OPS_REQUIRE(!f.get());
+    OPS_REQUIRE(q.waiting_producers() == 0);
+}
+
+OPS_TEST("Stage04: fair_submit keeps accounting intact under producer contention") {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = 4;
+    cfg.q_prepare_capacity = 4;
+    cfg.q_pack_capacity = 4;
+    cfg.push_timeout = 20ms;
+    cfg.pop_timeout = 5ms;
+    cfg.fair_submit = true;
+
+    Pipeline p(cfg);
+    p.start();
+
+    constexpr int kProducers = 8;
+    constexpr std::uint64_t kPerProducer = 500;
+    std::atomic<std::uint64_t> accepted{ 0 };
+    std::atomic<std::uint64_t> rejected{ 0 };
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < kProducers; ++t) {
+        producers.emplace_back([&, t] {
+            for (std::uint64_t i = 0; i < kPerProducer; ++i) {
+                const auto id = static_cast<OrderId>(t * kPerProducer + i + 1);
+                if (p.submit(Order(id))) ++accepted;
+                else ++rejected;
+            }
+        });
+    }
+    for (auto& t : producers) t.join();
+
+    p.shutdown();
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.accepted_count == accepted.load());
+    OPS_REQUIRE(m.submit_timeout_count == rejected.load());
+    OPS_REQUIRE(m.delivered_count == accepted.load());
+}
+
+OPS_TEST("Stage04: direct handoff moves items into an idle consumer's slot") {
+    BoundedBlockingQueue<int> q(4, PushAdmission::Unordered, ConsumerHandoff::Direct);
+
+    auto consumer = std::async(std::launch::async, [&q] {
+        int v = -1;
+        return q.wait_pop_for(v, 5s) ? v : -1;
+    });
+    while (q.idle_consumers() < 1) std::this_thread::yield();
+
+    OPS_REQUIRE(q.push(42));
+    OPS_REQUIRE(consumer.get() == 42);
+
+    auto st = q.stats();
+    OPS_REQUIRE(st.push_count == 1 && st.pop_count == 1);
+    OPS_REQUIRE(st.handoff_count == 1);
+    OPS_REQUIRE_MSG(st.max_size == 0, "a handed-off item must not touch the queue storage");
+
+    // Nobody waiting: the queue stores the item as usual.
+    OPS_REQUIRE(q.push(7));
+    int v = -1;
+    OPS_REQUIRE(q.wait_pop_for(v, 0ms) && v == 7);
+    OPS_REQUIRE(q.stats().max_size == 1);
+
+    // A timed-out consumer withdraws its slot.
+    OPS_REQUIRE(!q.wait_pop_for(v, 10ms));
+    OPS_REQUIRE(q.idle_consumers() == 0);
+
+    // Close releases every idle consumer empty-handed.
+    std::vector<std::future<bool>> idle;
+    for (int i = 0; i < 3; ++i) {
+        idle.push_back(std::async(std::launch::async, [&q] {
+            int x = 0;
+            return q.wait_pop(x);
+        }));
+    }
+    while (q.idle_consumers() < 3) std::this_thread::yield();
+    q.close();
+    for (auto& f : idle) OPS_REQUIRE(!f.get());
+    OPS_REQUIRE(!q.push(1));
+}
+
+OPS_TEST("Stage04: direct_handoff pipeline delivers every order and hands off when idle") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.pack_workers = 2;
+    cfg.deliver_workers = 2;
+    cfg.direct_handoff = true;
+
+    Pipeline p(cfg);
+    p.start();
+
+    // Trickle so that downstream workers are idle when orders arrive.
+    std::uint64_t ok = 0;
+    for (std::uint64_t i = 1; i <= 200; ++i) {
+        if (p.submit(Order(static_cast<OrderId>(i)))) ++ok;
+        if (i % 10 == 0) std::this_thread::sleep_for(1ms);
+    }
+    for (std::uint64_t i = 201; i <= 2200; ++i) {
+        if (p.submit(Order(static_cast<OrderId>(i)))) ++ok; // then a burst through the queues
+    }
+
+    p.shutdown();
+    const auto m = p.metrics();
+
+    OPS_REQUIRE(m.delivered_count == ok);
+    OPS_REQUIRE(m.q_prepare_push == m.q_prepare_pop);
+    OPS_REQUIRE(m.q_pack_push == m.q_pack_pop);
+    OPS_REQUIRE(m.q_prepare_handoff > 0);
+    OPS_REQUIRE(m.q_pack_handoff > 0);
+    OPS_REQUIRE(m.q_prepare_handoff <= m.q_prepare_push);
+}
+
+OPS_TEST("Stage04: downstream-first shared workers deliver everything and keep inner queues shallow") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.scheduling = SchedulingPolicy::DownstreamFirst;
+    cfg.shared_workers = 3;
+
+    Pipeline p(cfg);
+    p.start();
+    const auto ok = submit_n(p, 20000);
+    p.shutdown();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.delivered_count == ok);
+    OPS_REQUIRE(m.prepare_workers_used == 3 && m.deliver_workers_used == 3);
+    OPS_REQUIRE(p.delivered_segments().size() == 3);
+
+    // A worker only admits new work after seeing the inner queues empty, so
+    // each of them holds at most one order per worker.
+    OPS_REQUIRE_MSG(m.q_prepare_max_size <= cfg.shared_workers, "q_prepare must stay shallow");
+    OPS_REQUIRE_MSG(m.q_pack_max_size <= cfg.shared_workers, "q_pack must stay shallow");
+
+    require_report_matches_metrics(p.shutdown_for(0ms), m);
+}
+
+OPS_TEST("Stage04: shared workers do not deadlock on full inner queues and account for shutdown_now") {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = 64;
+    cfg.q_prepare_capacity = 1;
+    cfg.q_pack_capacity = 1;
+    cfg.push_timeout = 200ms;
+    cfg.pop_timeout = 5ms;
+    cfg.scheduling = SchedulingPolicy::UpstreamFirst; // fills the inner queues first
+    cfg.shared_workers = 4;
+    cfg.starvation_limit = 4;
+
+    {
+        Pipeline p(cfg);
+        p.start();
+        const auto ok = submit_n(p, 5000);
+        p.shutdown();
+        OPS_REQUIRE(p.metrics().delivered_count == ok);
+    }
+
+    Pipeline p(cfg);
+    p.start();
+    (void)submit_n(p, 2000);
+    p.shutdown_now();
+    require_report_matches_metrics(p.shutdown_for(0ms), p.metrics());
+}
+
+OPS_TEST("Stage04: wip_limit caps orders in flight across all queues") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.wip_limit = 4;
+    cfg.push_timeout = 1s;
+
+    Pipeline p(cfg);
+    p.start();
+
+    std::atomic<bool> done{ false };
+    std::atomic<std::uint64_t> worst{ 0 };
+    std::thread sampler([&] {
+        while (!done.load()) {
+            worst = std::max<std::uint64_t>(worst.load(), p.metrics().wip_in_flight);
+        }
+    });
+
+    std::vector<std::future<std::uint64_t>> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.push_back(std::async(std::launch::async, [&p, t] {
+            std::uint64_t ok = 0;
+            for (std::uint64_t i = 0; i < 2000; ++i) {
+                if (p.submit(Order(static_cast<OrderId>(t * 2000 + i + 1)))) ++ok;
+            }
+            return ok;
+        }));
+    }
+    std::uint64_t ok = 0;
+    for (auto& f : producers) ok += f.get();
+
+    p.shutdown();
+    done = true;
+    sampler.join();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.delivered_count == ok);
+    OPS_REQUIRE(m.wip_in_flight == 0);
+    OPS_REQUIRE(worst.load() <= cfg.wip_limit);
+    OPS_REQUIRE(m.wip_wait_count > 0);
+
+    // Wherever the orders sat, no queue ever held more than the cap.
+    OPS_REQUIRE(m.q_in_max_size <= cfg.wip_limit);
+    OPS_REQUIRE(m.q_prepare_max_size <= cfg.wip_limit);
+    OPS_REQUIRE(m.q_pack_max_size <= cfg.wip_limit);
+}
+
+OPS_TEST("Stage04: wip_limit rejects through the backpressure path and releases on abandon") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.wip_limit = 2;
+    cfg.push_timeout = 1ms;
+
+    Pipeline p(cfg);
+    p.start();
+    const auto ok = submit_n(p, 5000);
+    p.shutdown_now();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.accepted_count == ok);
+    OPS_REQUIRE(m.submit_timeout_count == 5000 - ok);
+    require_report_matches_metrics(p.shutdown_for(0ms), m);
+
+    // Orders abandoned by a worker released their slot; only those left
+    // sitting in a queue still count as in flight.
+    OPS_REQUIRE(m.wip_in_flight <= p.shutdown_for(0ms).abandoned_total());
+    OPS_REQUIRE(m.wip_in_flight <= cfg.wip_limit);
+}
+
+OPS_TEST("Stage04: in_flight counts accepted orders from the stage counters without a wip_limit") {
+    Pipeline::Config cfg = backlog_cfg();
+    std::atomic<bool> go{ false };
+    cfg.prepare_work = [&](const Order&) {
+        while (!go.load()) std::this_thread::sleep_for(1ms);
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    OPS_REQUIRE(submit_n(p, 50) == 50);
+
+    // The first order is held in Prepare, the rest wait in q_in.
+    OPS_REQUIRE(p.in_flight() == 50);
+    OPS_REQUIRE(p.metrics().wip_in_flight == 50);
+
+    go.store(true);
+    p.shutdown();
+    OPS_REQUIRE(p.in_flight() == 0);
+    OPS_REQUIRE(p.metrics().wip_in_flight == 0);
+    OPS_REQUIRE(p.metrics().wip_wait_count == 0);
+}
+
+OPS_TEST("Stage04: MpscRing keeps each producer's order and an exact capacity") {
+    MpscRing<std::uint64_t> ring(5); // not a power of two: capacity must still be exact
+
+    std::uint64_t v = 0;
+    for (std::uint64_t i = 0; i < 5; ++i) OPS_REQUIRE(ring.try_push(std::uint64_t{ i }));
+    OPS_REQUIRE(!ring.try_push(99));
+    OPS_REQUIRE(ring.size() == 5);
+    for (std::uint64_t i = 0; i < 5; ++i) OPS_REQUIRE(ring.try_pop(v) && v == i);
+    OPS_REQUIRE(!ring.try_pop(v) && !ring.ready());
+
+    // Values carry the producer in the high bits and its sequence below.
+    constexpr std::uint64_t kProducers = 4;
+    constexpr std::uint64_t kItems = 50000;
+    std::vector<std::thread> producers;
+    for (std::uint64_t t = 0; t < kProducers; ++t) {
+        producers.emplace_back([&, t] {
+            for (std::uint64_t i = 1; i <= kItems;) {
+                if (ring.try_push((t << 32) | i)) ++i;
+                else std::this_thread::yield();
+            }
+        });
+    }
+
+    std::array<std::uint64_t, kProducers> last{};
+    std::size_t max_size = 0;
+    for (std::uint64_t got = 0; got < kProducers * kItems;) {
+        max_size = std::max(max_size, ring.size());
+        if (!ring.try_pop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const auto t = v >> 32;
+        OPS_REQUIRE(t < kProducers && (v & 0xFFFFFFFFu) == last[t] + 1);
+        last[t] = v & 0xFFFFFFFFu;
+        ++got;
+    }
+    for (auto& t : producers) t.join();
+    OPS_REQUIRE(ring.empty());
+    OPS_REQUIRE(max_size <= 5);
+    OPS_REQUIRE(ring.pushed() == 5 + kProducers * kItems && ring.popped() == ring.pushed());
+}
+
+OPS_TEST("Stage04: thread-per-core engine delivers every order on its home core") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.scheduling = SchedulingPolicy::ThreadPerCore;
+    cfg.cores = 4;
+    cfg.status_census = true;
+
+    Pipeline p(cfg);
+    p.start();
+    const auto ok = submit_n(p, 20000);
+    p.shutdown();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(ok == 20000);
+    OPS_REQUIRE(m.accepted_count == ok);
+    OPS_REQUIRE(m.prepared_count == ok && m.packed_count == ok && m.delivered_count == ok);
+    OPS_REQUIRE(m.q_in_push == ok && m.q_in_pop == ok);
+    OPS_REQUIRE(p.delivered_orders().size() == ok);
+    OPS_REQUIRE(p.status_snapshot().count(OrderStatus::Delivered) == ok);
+
+    // Orders are sharded by id and each core keeps its own arrival order.
+    const auto& delivered = p.delivered_orders();
+    const auto segments = p.delivered_segments();
+    OPS_REQUIRE(segments.size() == 4);
+    for (std::size_t c = 0; c < segments.size(); ++c) {
+        OrderId prev = 0;
+        for (const auto idx : segments[c]) {
+            OPS_REQUIRE(delivered[idx].id % 4 == c);
+            OPS_REQUIRE(delivered[idx].id > prev);
+            prev = delivered[idx].id;
+        }
+    }
+
+    require_report_matches_metrics(p.shutdown_for(0ms), m);
+}
+
+OPS_TEST("Stage04: thread-per-core engine runs each core on the CPU it is pinned to") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.scheduling = SchedulingPolicy::ThreadPerCore;
+    cfg.cores = 2;
+
+    std::array<std::atomic<int>, 2> ran_on{};
+    for (auto& cpu : ran_on) cpu.store(-1);
+    std::atomic<std::uint64_t> moved{ 0 };
+    cfg.prepare_work = [&](const Order& order) {
+        const int cpu = ::sched_getcpu();
+        int expected = -1;
+        auto& seen = ran_on[order.id % 2];
+        if (!seen.compare_exchange_strong(expected, cpu) && expected != cpu) ++moved;
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    OPS_REQUIRE(submit_n(p, 2000) == 2000);
+    p.shutdown();
+
+    const auto cpus = p.core_cpus();
+    OPS_REQUIRE(cpus.size() == 2);
+    for (std::size_t c = 0; c < cpus.size(); ++c) {
+        OPS_REQUIRE_MSG(cpus[c] >= 0, "core threads must be pinned on Linux");
+        OPS_REQUIRE(ran_on[c].load() == cpus[c]);
+    }
+    OPS_REQUIRE_MSG(moved.load() == 0, "a pinned core must not migrate");
+
+    Pipeline::Config unpinned = cfg;
+    unpinned.pin_cores = false;
+    unpinned.prepare_work = nullptr;
+    Pipeline q(unpinned);
+    q.start();
+    OPS_REQUIRE(submit_n(q, 100) == 100);
+    q.shutdown();
+    OPS_REQUIRE(q.core_cpus() == std::vector<int>({ -1, -1 }));
+}
+
+OPS_TEST("Stage04: thread-per-core engine applies backpressure and accounts for shutdown_now") {
+    Pipeline::Config cfg{};
+    cfg.scheduling = SchedulingPolicy::ThreadPerCore;
+    cfg.cores = 2;
+    cfg.q_in_capacity = 2;
+    cfg.push_timeout = 1ms;
+
+    Pipeline p(cfg);
+    p.start();
+
+    std::atomic<std::uint64_t> accepted{ 0 };
+    std::atomic<std::uint64_t> rejected{ 0 };
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&, t] {
+            for (std::uint64_t i = 0; i < 5000; ++i) {
+                if (p.submit(Order(static_cast<OrderId>(t * 5000 + i + 1)))) ++accepted;
+                else ++rejected;
+            }
+        });
+    }
+    std::this_thread::sleep_for(5ms);
+    p.shutdown_now();
+    for (auto& t : producers) t.join();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.accepted_count == accepted.load());
+    OPS_REQUIRE(m.submit_timeout_count <= rejected.load()); // the rest came after shutdown
+    OPS_REQUIRE(m.q_in_max_size <= 2);
+    require_report_matches_metrics(p.shutdown_for(0ms), m);
+}
+
+OPS_TEST("Stage04: every wait backend keeps timeout and close semantics") {
+    check_backend_semantics(WaitBackend::CondVar);
+    check_backend_semantics(WaitBackend::Semaphore);
+    check_backend_semantics(WaitBackend::AtomicWait);
+
+    // Fifo admission and Direct handoff are condition-variable features.
+    BoundedBlockingQueue<int> q(1, PushAdmission::Fifo, ConsumerHandoff::Direct, WaitBackend::Semaphore);
+    OPS_REQUIRE(q.admission() == PushAdmission::Unordered);
+    OPS_REQUIRE(q.handoff() == ConsumerHandoff::ViaQueue);
+}
+
+OPS_TEST("Stage04: every bounded queue backend passes the conformance suite") {
+    for (const auto backend : { WaitBackend::CondVar, WaitBackend::Semaphore, WaitBackend::AtomicWait }) {
+        check_queue_conformance([backend](std::size_t capacity) {
+            return std::make_unique<BoundedBlockingQueue<int>>(capacity, PushAdmission::Unordered,
+                ConsumerHandoff::ViaQueue, backend, PopOrder::ShortestWork);
+        });
+    }
+    check_queue_conformance([](std::size_t capacity) {
+        return std::make_unique<BoundedBlockingQueue<int>>(capacity, PushAdmission::Fifo);
+    });
+    check_queue_conformance([](std::size_t capacity) {
+        return std::make_unique<BoundedBlockingQueue<int>>(capacity, PushAdmission::Unordered, ConsumerHandoff::Direct);
+    });
+    check_queue_conformance([](std::size_t capacity) {
+        return std::make_unique<BoundedBlockingQueue<int>>(capacity, PushAdmission::Fifo, ConsumerHandoff::Direct);
+    });
+    check_queue_conformance([](std::size_t capacity) {
+        return std::make_unique<BoundedQueue<int>>(capacity);
+    });
+}
+
+OPS_TEST("Stage04: pipeline runs on the semaphore and atomic wait backends") {
+    for (const auto backend : { WaitBackend::Semaphore, WaitBackend::AtomicWait }) {
+        Pipeline::Config cfg = backlog_cfg();
+        cfg.q_in_capacity = 8;
+        cfg.q_prepare_capacity = 4;
+        cfg.q_pack_capacity = 4;
+        cfg.pack_workers = 2;
+        cfg.deliver_workers = 2;
+        cfg.queue_backend = backend;
+
+        Pipeline p(cfg);
+        p.start();
+        const auto accepted = submit_n(p, 3000);
+        p.shutdown();
+
+        const auto m = p.metrics();
+        OPS_REQUIRE(m.accepted_count == accepted);
+        OPS_REQUIRE(m.delivered_count == accepted);
+        OPS_REQUIRE(m.q_in_max_size <= 8);
+        OPS_REQUIRE(m.q_prepare_max_size <= 4 && m.q_pack_max_size <= 4);
+    }
+}
+
+OPS_TEST("Stage04: persistent ring keeps pending orders across reopen and a torn tail") {
+    const auto path = temp_ring_path("reopen");
+    std::vector<Order> kept;
+    for (OrderId id = 1; id <= 6; ++id) {
+        Order o(id);
+        o.customer = 1000 + id;
+        o.work = static_cast<std::uint32_t>(10 * id);
+        o.seq = 7 * id;
+        o.merged = static_cast<std::uint32_t>(id % 3);
+        kept.push_back(o);
+    }
+    {
+        PersistentOrderRing ring(path, 4, PersistSync::None);
+        OPS_REQUIRE(ring.pending().empty());
+
+        BoundedBlockingQueue<Order> q(4);
+        q.attach_journal(&ring);
+        for (OrderId id = 1; id <= 4; ++id) OPS_REQUIRE(q.push(kept[id - 1]));
+        OPS_REQUIRE(!q.push_for(Order(99), 0ms));
+
+        Order o(0);
+        OPS_REQUIRE(q.wait_pop(o) && o.id == 1);
+        OPS_REQUIRE(q.wait_pop(o) && o.id == 2);
+        OPS_REQUIRE(q.push(kept[4]) && q.push(kept[5])); // wraps around
+        OPS_REQUIRE(ring.size() == 4);
+    } // the queue is gone, as after a crash; only the file remains
+
+    // The whole record comes back, not just the id.
+    {
+        PersistentOrderRing ring(path, 4, PersistSync::PerBatch, 2);
+        const auto pending = ring.pending();
+        OPS_REQUIRE(ids_of(pending) == std::vector<OrderId>({ 3, 4, 5, 6 }));
+        for (const auto& o : pending) {
+            const Order& before = kept[o.id - 1];
+            OPS_REQUIRE(o.status == OrderStatus::Accepted);
+            OPS_REQUIRE(o.customer == before.customer && o.work == before.work);
+            OPS_REQUIRE(o.seq == before.seq && o.merged == before.merged);
+            OPS_REQUIRE(o.accepted_time == before.accepted_time);
+        }
+    }
+
+    // Crash after two commits but before their tail stores: tail (the second
+    // cache line of the header) still says 4, the commit words say 6.
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        const std::uint64_t stale_tail = 4;
+        f.seekp(128);
+        f.write(reinterpret_cast<const char*>(&stale_tail), sizeof stale_tail);
+    }
+    {
+        PersistentOrderRing ring(path, 4);
+        OPS_REQUIRE(ids_of(ring.pending()) == std::vector<OrderId>({ 3, 4, 5, 6 }));
+    }
+
+    bool rejected = false;
+    try {
+        PersistentOrderRing other(path, 8);
+    }
+    catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    OPS_REQUIRE_MSG(rejected, "reopening with another capacity must fail");
+
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: persistent q_in resumes orders left by the previous run") {
+    const auto path = temp_ring_path("pipeline");
+
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.q_in_path = path;
+    cfg.status_census = true;
+
+    // Orders left in the file are delivered by the next start().
+    {
+        PersistentOrderRing ring(path, cfg.q_in_capacity);
+        BoundedBlockingQueue<Order> q(cfg.q_in_capacity);
+        q.attach_journal(&ring);
+        for (OrderId id = 1; id <= 100; ++id) OPS_REQUIRE(q.push(Order(id)));
+    }
+    {
+        Pipeline p(cfg);
+        p.start();
+        p.shutdown();
+
+        const auto m = p.metrics();
+        OPS_REQUIRE(m.q_in_recovered == 100);
+        OPS_REQUIRE(m.accepted_count == 100);
+        OPS_REQUIRE(m.delivered_count == 100);
+        OPS_REQUIRE(m.q_in_sync_count > 0);
+        OPS_REQUIRE(p.status_snapshot().count(OrderStatus::Delivered) == 100);
+    }
+
+    // A forced stop leaves the undelivered part of q_in for the next run.
+    std::set<OrderId> delivered_first;
+    std::uint64_t left_in_q_in = 0;
+    {
+        Pipeline p(cfg);
+        p.start();
+        (void)submit_n(p, 20000);
+        p.shutdown_now();
+
+        const auto m = p.metrics();
+        OPS_REQUIRE(m.q_in_recovered == 0);
+        left_in_q_in = m.q_in_push - m.q_in_pop;
+        for (const auto& o : p.delivered_orders()) delivered_first.insert(o.id);
+    }
+    {
+        Pipeline p(cfg);
+        p.start();
+        p.shutdown();
+
+        const auto m = p.metrics();
+        OPS_REQUIRE(m.q_in_recovered == left_in_q_in);
+        OPS_REQUIRE(m.delivered_count == left_in_q_in);
+        for (const auto& o : p.delivered_orders()) OPS_REQUIRE(!delivered_first.contains(o.id));
+    }
+    {
+        PersistentOrderRing ring(path, cfg.q_in_capacity);
+        OPS_REQUIRE_MSG(ring.size() == 0, "a drained pipeline leaves an empty ring");
+    }
+
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: router hashes keyed orders to one instance and publishes load without locks") {
+    PipelineRouter::Config cfg;
+    cfg.instances.assign(3, backlog_cfg());
+    PipelineRouter router(cfg);
+    router.start();
+
+    for (OrderId id = 1; id <= 300; ++id) OPS_REQUIRE(router.submit(Order(id), id % 2 == 0 ? 7 : 8));
+    router.shutdown();
+
+    // Two keys, so at most two instances saw orders, and each key stayed whole.
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < router.size(); ++i) {
+        const auto& delivered = router.instance(i).delivered_orders();
+        if (delivered.empty()) continue;
+        ++used;
+        const bool even = delivered.front().id % 2 == 0;
+        for (const auto& o : delivered) OPS_REQUIRE((o.id % 2 == 0) == even);
+        OPS_REQUIRE(delivered.size() == 150 || delivered.size() == 300);
+        OPS_REQUIRE(router.instance(i).in_flight() == 0);
+        OPS_REQUIRE(router.instance(i).q_in_depth() == 0);
+    }
+    OPS_REQUIRE(used >= 1 && used <= 2);
+
+    const auto routed = router.routed();
+    OPS_REQUIRE(std::accumulate(routed.begin(), routed.end(), std::uint64_t{ 0 }) == 300);
+}
+
+OPS_TEST("Stage04: power-of-two router steers orders away from a slow instance") {
+    for (const auto load : { RouteLoad::InFlight, RouteLoad::QueueDepth }) {
+        PipelineRouter::Config cfg;
+        cfg.instances.assign(2, backlog_cfg());
+        cfg.instances[0].prepare_work = [](const Order&) { std::this_thread::sleep_for(2ms); };
+        cfg.load = load;
+
+        PipelineRouter router(cfg);
+        router.start();
+        for (OrderId id = 1; id <= 400; ++id) {
+            OPS_REQUIRE(router.submit(Order(id)));
+            if (id % 20 == 0) std::this_thread::sleep_for(1ms);
+        }
+        router.shutdown();
+
+        const auto routed = router.routed();
+        OPS_REQUIRE(routed[0] + routed[1] == 400);
+        OPS_REQUIRE_MSG(routed[1] > 2 * routed[0], "the fast instance must take most of the load");
+        OPS_REQUIRE(router.instance(0).metrics().delivered_count == routed[0]);
+        OPS_REQUIRE(router.instance(1).metrics().delivered_count == routed[1]);
+    }
+}
+
+OPS_TEST("Stage04: pressure rises with q_in occupancy and a refused submit reports Saturated") {
+    std::atomic<bool> release{ false };
+
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.q_in_capacity = 20;
+    cfg.push_timeout = 1ms;
+    cfg.prepare_work = [&release](const Order&) {
+        while (!release.load()) std::this_thread::sleep_for(100us);
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    OPS_REQUIRE(p.pressure() == Pressure::Low);
+
+    Pressure level = Pressure::Saturated;
+    OPS_REQUIRE(p.submit(Order(1), level));
+    OPS_REQUIRE(level == Pressure::Low);
+
+    // Prepare holds one order, so q_in keeps every later one.
+    std::vector<Pressure> levels;
+    for (OrderId id = 2; id <= 21; ++id) {
+        OPS_REQUIRE(p.submit(Order(id), level));
+        levels.push_back(level);
+    }
+    OPS_REQUIRE(std::is_sorted(levels.begin(), levels.end()));
+    OPS_REQUIRE(levels.back() == Pressure::Saturated);
+
+    OPS_REQUIRE(!p.submit(Order(22), level));
+    OPS_REQUIRE(level == Pressure::Saturated);
+
+    release = true;
+    p.shutdown();
+    OPS_REQUIRE(p.metrics().delivered_count == 21);
+
+    // Empty again; the moving average catches up within a few queries.
+    for (int i = 0; i < 64; ++i) (void)p.pressure();
+    OPS_REQUIRE(p.pressure() == Pressure::Low);
+}
+
+OPS_TEST("Stage04: AIMD pacer adds on Low, cuts on High once per interval and respects its bounds") {
+    AimdPacer::Config cfg;
+    cfg.initial_rate = 100;
+    cfg.min_rate = 10;
+    cfg.max_rate = 150;
+    cfg.increase = 10;
+    cfg.decrease = 0.5;
+    cfg.saturated_decrease = 0.25;
+    cfg.decrease_interval = std::chrono::hours{ 1 };
+
+    AimdPacer pacer(cfg);
+    for (int i = 0; i < 3; ++i) pacer.on_pressure(Pressure::Low);
+    OPS_REQUIRE(pacer.rate() == 130);
+    for (int i = 0; i < 5; ++i) pacer.on_pressure(Pressure::Low);
+    OPS_REQUIRE(pacer.rate() == 150);
+    pacer.on_pressure(Pressure::Elevated);
+    OPS_REQUIRE(pacer.rate() == 150);
+
+    pacer.on_pressure(Pressure::High);
+    OPS_REQUIRE(pacer.rate() == 75);
+    pacer.on_pressure(Pressure::Saturated);
+    OPS_REQUIRE_MSG(pacer.rate() == 75, "a second cut within the interval is the same congestion event");
+
+    cfg.decrease_interval = 0ms;
+    AimdPacer eager(cfg);
+    eager.on_pressure(Pressure::Saturated);
+    OPS_REQUIRE(eager.rate() == 25);
+    eager.on_pressure(Pressure::Saturated);
+    OPS_REQUIRE(eager.rate() == 10);
+
+    // pace() spaces sends 1/rate apart.
+    cfg.initial_rate = 1000;
+    cfg.max_rate = 1000;
+    AimdPacer paced(cfg);
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 21; ++i) paced.pace();
+    OPS_REQUIRE(std::chrono::steady_clock::now() - t0 >= 19ms);
+}
+
+OPS_TEST("Stage04: slowest orders tracker merges per-worker heaps into the global top K") {
+    constexpr std::size_t kShards = 4;
+    SlowestOrders tracker(5, kShards);
+
+    // Lead time of order i is a permutation of 1..4000 microseconds.
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t s = 0; s < kShards; ++s) {
+        workers.emplace_back([&, s] {
+            for (std::uint64_t i = s; i < 4000; i += kShards) {
+                Order o(static_cast<OrderId>(i));
+                o.accepted_time = t0;
+                o.delivered_time = t0 + std::chrono::microseconds{ (i * 7919) % 4000 + 1 };
+                o.delivered_by = static_cast<std::uint16_t>(s);
+                tracker.offer(s, o);
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    const auto top = tracker.snapshot();
+    OPS_REQUIRE(top.size() == 5);
+    for (std::size_t r = 0; r < top.size(); ++r) {
+        OPS_REQUIRE(top[r].lead_time == std::chrono::microseconds{ 4000 - r });
+        OPS_REQUIRE(top[r].delivered_by == top[r].id % kShards);
+        OPS_REQUIRE(top[r].delivered_time - top[r].accepted_time == top[r].lead_time);
+    }
+
+    SlowestOrders few(10, 2);
+    Order o(1);
+    few.offer(1, o);
+    OPS_REQUIRE(few.snapshot().size() == 1);
+}
+
+OPS_TEST("Stage04: pipeline reports the slowest orders with stage breakdown and workers") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.prepare_workers = 2;
+    cfg.deliver_workers = 2;
+    cfg.slowest_orders = 4;
+    cfg.prepare_work = [](const Order& o) {
+        if (o.id % 100 == 0) std::this_thread::sleep_for(5ms);
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    OPS_REQUIRE(submit_n(p, 400) == 400);
+    p.shutdown();
+
+    const auto top = p.slowest_orders();
+    OPS_REQUIRE(top.size() == 4);
+    for (std::size_t r = 0; r < top.size(); ++r) {
+        const auto& e = top[r];
+        OPS_REQUIRE(e.accepted_time <= e.prepared_time);
+        OPS_REQUIRE(e.prepared_time <= e.packed_time);
+        OPS_REQUIRE(e.packed_time <= e.delivered_time);
+        OPS_REQUIRE(e.lead_time == e.delivered_time - e.accepted_time);
+        OPS_REQUIRE(e.prepared_by < 2 && e.packed_by < 1 && e.delivered_by < 2);
+        if (r > 0) OPS_REQUIRE(top[r - 1].lead_time >= e.lead_time);
+    }
+
+    // Every order queued behind a slow Prepare is slow too, so only check
+    // that the slowest one waited at least one 5ms Prepare.
+    OPS_REQUIRE(top.front().lead_time >= 5ms);
+
+    Pipeline off(backlog_cfg());
+    off.start();
+    (void)submit_n(off, 10);
+    off.shutdown();
+    OPS_REQUIRE(off.slowest_orders().empty());
+}
+
+OPS_TEST("Stage04: latency histogram buckets by powers of two microseconds") {
+    OPS_REQUIRE(LatencyHistogram::bucket_of(0ns) == 0);
+    OPS_REQUIRE(LatencyHistogram::bucket_of(999ns) == 0);
+    OPS_REQUIRE(LatencyHistogram::bucket_of(1us) == 1);
+    OPS_REQUIRE(LatencyHistogram::bucket_of(3us) == 2);
+    OPS_REQUIRE(LatencyHistogram::bucket_of(4us) == 3);
+    OPS_REQUIRE(LatencyHistogram::bucket_of(1h) == LatencyHistogram::kBuckets - 1);
+
+    AtomicLatencyHistogram a;
+    for (int i = 0; i < 99; ++i) a.record(3us);
+    a.record(100ms);
+    const auto h = a.snapshot();
+    OPS_REQUIRE(h.count() == 100);
+    OPS_REQUIRE(h.percentile(0.50) == 4us);
+    OPS_REQUIRE(h.percentile(1.0) >= 100ms);
+    OPS_REQUIRE(LatencyHistogram{}.percentile(0.99) == 0us);
+}
+
+OPS_TEST("Stage04: queues record the wake-up delay of consumers woken by a push") {
+    for (const auto handoff : { ConsumerHandoff::ViaQueue, ConsumerHandoff::Direct }) {
+        BoundedBlockingQueue<int> q(4, PushAdmission::Unordered, handoff);
+        q.record_wakeups(true);
+
+        // A timeout and a pop that never slept are not wake-ups.
+        int v = 0;
+        OPS_REQUIRE(!q.wait_pop_for(v, 2ms));
+        OPS_REQUIRE(q.push(1) && q.wait_pop(v));
+        OPS_REQUIRE(q.stats().wakeup.count() == 0);
+
+        for (int round = 0; round < 3; ++round) {
+            auto consumer = std::async(std::launch::async, [&q] {
+                int x = 0;
+                return q.wait_pop_for(x, 5s) ? x : -1;
+            });
+            std::this_thread::sleep_for(5ms); // let it fall asleep
+            OPS_REQUIRE(q.push(round));
+            OPS_REQUIRE(consumer.get() == round);
+        }
+
+        const auto h = q.stats().wakeup;
+        OPS_REQUIRE(h.count() == 3);
+        OPS_REQUIRE_MSG(h.percentile(1.0) < 5s, "the delay runs from the push, not from the start of the wait");
+    }
+
+    // Exported per queue with the pipeline metrics, when asked for.
+    for (const bool on : { false, true }) {
+        Pipeline::Config cfg = backlog_cfg();
+        cfg.wakeup_stats = on;
+        Pipeline p(cfg);
+        p.start();
+        for (OrderId id = 1; id <= 20; ++id) {
+            OPS_REQUIRE(p.submit(Order(id)));
+            std::this_thread::sleep_for(1ms);
+        }
+        p.shutdown();
+
+        const auto m = p.metrics();
+        OPS_REQUIRE((m.q_in_wakeup.count() > 0) == on);
+        OPS_REQUIRE(m.q_in_wakeup.count() <= m.q_in_pop);
+        OPS_REQUIRE(m.q_prepare_wakeup.count() <= m.q_prepare_pop);
+        OPS_REQUIRE(m.q_pack_wakeup.count() <= m.q_pack_pop);
+        if (!on) OPS_REQUIRE(m.q_prepare_wakeup.count() == 0 && m.q_pack_wakeup.count() == 0);
+    }
+}
+
+OPS_TEST("Stage04: flight recorder keeps the newest records of every thread") {
+    constexpr std::uint16_t kSource = 9000; // no pipeline gets this far
+    constexpr std::size_t kEvents = FlightRecorder::kRingRecords * 2;
+    const auto path = (std::filesystem::temp_directory_path() / "ops_stage04_flight.bin").string();
+
+    // The writers stay alive until the dump: a new thread reuses an exited one's ring.
+    std::atomic<int> recorded{ 0 };
+    std::promise<void> dumped;
+    const auto dumped_future = dumped.get_future().share();
+    std::vector<std::thread> threads;
+    for (std::uint64_t t = 0; t < 3; ++t) {
+        threads.emplace_back([&, t] {
+            for (std::uint64_t i = 0; i < kEvents; ++i) FlightRecorder::record(FlightEvent::SubmitTimeout, kSource, i, t);
+            recorded.fetch_add(1);
+            dumped_future.wait();
+        });
+    }
+    while (recorded.load() < 3) std::this_thread::yield();
+
+    const bool written = FlightRecorder::dump(path);
+    dumped.set_value();
+    for (auto& t : threads) t.join();
+    OPS_REQUIRE(written);
+    std::array<std::vector<std::uint64_t>, 3> seen;
+    std::set<std::uint32_t> writers;
+    for (const auto& r : FlightRecorder::read_dump(path)) {
+        if (r.source != kSource) continue;
+        OPS_REQUIRE(r.event == FlightEvent::SubmitTimeout && r.b < 3);
+        seen[r.b].push_back(r.a);
+        writers.insert(r.thread);
+    }
+    OPS_REQUIRE(writers.size() == 3);
+    for (auto& a : seen) {
+        OPS_REQUIRE(a.size() == FlightRecorder::kRingRecords);
+        std::sort(a.begin(), a.end());
+        OPS_REQUIRE(a.front() == kEvents - FlightRecorder::kRingRecords && a.back() == kEvents - 1);
+    }
+
+#if defined(SIGUSR1)
+    std::filesystem::remove(path);
+    OPS_REQUIRE(FlightRecorder::dump_on_signal(path));
+    std::raise(SIGUSR1);
+    OPS_REQUIRE(!FlightRecorder::read_dump(path).empty());
+    std::signal(SIGUSR1, SIG_DFL);
+#endif
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: a failing pipeline dumps its flight record") {
+    const auto path = (std::filesystem::temp_directory_path() / "ops_stage04_failed.bin").string();
+    std::filesystem::remove(path);
+
+    Pipeline::Config cfg;
+    cfg.prepare_workers = 2;
+    cfg.flight_dump_path = path;
+    cfg.prepare_work = [](const Order& o) {
+        if (o.id == 3) throw std::runtime_error("boom: order 3");
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    for (OrderId id = 1; id <= 10; ++id) (void)p.submit(Order(id));
+    p.shutdown();
+    OPS_REQUIRE(p.state() == PipelineState::Failed);
+
+    std::vector<FlightRecord> mine;
+    for (const auto& r : FlightRecorder::read_dump(path)) {
+        if (r.source == p.flight_source()) mine.push_back(r);
+    }
+    std::stable_sort(mine.begin(), mine.end(), [](const FlightRecord& a, const FlightRecord& b) {
+        return a.time_ns < b.time_ns;
+    });
+
+    const auto find = [&](FlightEvent e) {
+        return std::find_if(mine.begin(), mine.end(), [e](const FlightRecord& r) { return r.event == e; });
+    };
+    const auto thrown = find(FlightEvent::WorkerException);
+    OPS_REQUIRE(thrown != mine.end());
+    OPS_REQUIRE(FlightRecorder::describe(*thrown).find("\"boom: or\"") != std::string::npos);
+
+    const auto failed = std::find_if(mine.begin(), mine.end(), [](const FlightRecord& r) {
+        return r.event == FlightEvent::StateChange && r.b == static_cast<std::uint64_t>(PipelineState::Failed);
+    });
+    OPS_REQUIRE(failed != mine.end() && failed > thrown);
+    OPS_REQUIRE(find(FlightEvent::Dump) > failed && find(FlightEvent::Dump) != mine.end());
+    OPS_REQUIRE(std::count_if(mine.begin(), mine.end(), [](const FlightRecord& r) {
+        return r.event == FlightEvent::WorkerStart;
+    }) <= 4);
+
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: queue capacity can be changed while producers wait") {
+    for (const auto backend : { WaitBackend::CondVar, WaitBackend::AtomicWait }) {
+        BoundedBlockingQueue<int> q(2, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, backend);
+        OPS_REQUIRE(q.push(1) && q.push(2));
+        OPS_REQUIRE(!q.push_for(3, std::chrono::milliseconds{ 5 }));
+
+        auto blocked = std::async(std::launch::async, [&] { return q.push_for(3, std::chrono::seconds{ 5 }); });
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+        OPS_REQUIRE(q.set_capacity(3));
+        OPS_REQUIRE(blocked.get());
+        OPS_REQUIRE(q.capacity() == 3 && q.size() == 3);
+
+        // Lowered below the current size: nothing is dropped, pushes wait.
+        OPS_REQUIRE(q.set_capacity(1));
+        OPS_REQUIRE(q.size() == 3);
+        OPS_REQUIRE(!q.push_for(4, std::chrono::milliseconds{ 5 }));
+    }
+
+    BoundedBlockingQueue<int> sem(2, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, WaitBackend::Semaphore);
+    OPS_REQUIRE(!sem.set_capacity(4));
+    OPS_REQUIRE(sem.capacity() == 2);
+}
+
+OPS_TEST("Stage04: admin commands pause, rebound and resume a running pipeline") {
+    Pipeline::Config cfg;
+    cfg.pop_timeout = std::chrono::milliseconds{ 5 };
+    Pipeline p(cfg);
+    AdminServer admin(p, "unused.sock"); // execute() needs no socket
+    p.start();
+
+    OPS_REQUIRE(admin.execute("pause") == "OK");
+    OPS_REQUIRE(p.paused());
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 30 }); // every worker has read its mailbox
+
+    OPS_REQUIRE(submit_n(p, 20) == 20);
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 30 });
+    OPS_REQUIRE(admin.execute("depths") == "OK q_in=20 q_prepare=0 q_pack=0");
+    OPS_REQUIRE(p.metrics().prepared_count == 0);
+
+    OPS_REQUIRE(admin.execute("capacity 20 8 8") == "OK");
+    OPS_REQUIRE(!p.submit(Order(OrderId{ 21 }))); // q_in is now full
+
+    OPS_REQUIRE(admin.execute("capacity 0 8 8").rfind("ERR", 0) == 0);
+    OPS_REQUIRE(admin.execute("workers 1 1").rfind("ERR", 0) == 0);
+    OPS_REQUIRE(admin.execute("frobnicate").rfind("ERR", 0) == 0);
+
+    OPS_REQUIRE(admin.execute("resume") == "OK");
+    OPS_REQUIRE(admin.execute("shutdown") == "OK");
+    OPS_REQUIRE(!p.submit(Order(OrderId{ 22 })));
+    p.shutdown();
+
+    OPS_REQUIRE(p.state() == PipelineState::Stopped);
+    OPS_REQUIRE(admin.execute("metrics").find(" delivered=20 ") != std::string::npos);
+}
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: admin socket reconfigures stage workers at runtime") {
+    const auto path = (std::filesystem::temp_directory_path() / "ops_stage04_admin.sock").string();
+
+    Pipeline::Config cfg;
+    cfg.prepare_workers = 3;
+    cfg.max_stage_workers = 4;
+    cfg.pop_timeout = std::chrono::milliseconds{ 5 };
+    Pipeline p(cfg);
+    p.start();
+    AdminServer admin(p, path);
+    admin.start();
+
+    OPS_REQUIRE(AdminServer::request(path, "workers 1 1 3") == "OK");
+    OPS_REQUIRE(AdminServer::request(path, "workers 1 1 5").rfind("ERR", 0) == 0); // above max_stage_workers
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 50 }); // retiring Prepare workers saw the command
+
+    OPS_REQUIRE(submit_n(p, 300) == 300);
+    OPS_REQUIRE(AdminServer::request(path, "shutdown") == "OK");
+    p.shutdown();
+    admin.stop();
+    OPS_REQUIRE(!std::filesystem::exists(path));
+
+    const auto& delivered = p.delivered_orders();
+    OPS_REQUIRE(delivered.size() == 300);
+    std::set<std::uint16_t> preparers;
+    std::set<std::uint16_t> deliverers;
+    for (const auto& o : delivered) {
+        preparers.insert(o.prepared_by);
+        deliverers.insert(o.delivered_by);
+    }
+    OPS_REQUIRE(preparers == std::set<std::uint16_t>{ 0 });
+    OPS_REQUIRE(*deliverers.rbegin() <= 2);
+    OPS_REQUIRE(p.delivered_segments().size() == 4);
+    OPS_REQUIRE(p.metrics().deliver_workers_used == 3);
+}
+#endif
+
+OPS_TEST("Stage04: metrics page readers always see one whole publish") {
+    const auto path = (std::filesystem::temp_directory_path() / "ops_stage04_seqlock.page").string();
+    std::vector<MetricsPageField> fields;
+    for (int i = 0; i < 16; ++i) fields.push_back(MetricsPageField{ "f" + std::to_string(i), MetricsPageKind::Counter });
+    fields.back().kind = MetricsPageKind::Gauge;
+
+    MetricsPageWriter writer(path, fields);
+    const MetricsPageReader reader(path);
+    OPS_REQUIRE(reader.read().publishes == 0);
+
+    // Every publish stores the same number in all fields, so a torn copy
+    // would show two different numbers.
+    std::atomic<bool> done{ false };
+    std::thread publisher([&] {
+        std::array<std::uint64_t, 16> v{};
+        for (std::uint64_t n = 1; n <= 20000; ++n) {
+            v.fill(n);
+            writer.publish(v.data());
+        }
+        done = true;
+    });
+
+    std::uint64_t last = 0;
+    std::size_t reads = 0;
+    while (!done.load() || reads == 0) {
+        const auto s = reader.read();
+        OPS_REQUIRE(s.values.size() == 16);
+        OPS_REQUIRE(std::all_of(s.values.begin(), s.values.end(), [&](std::uint64_t x) { return x == s.values[0]; }));
+        OPS_REQUIRE(s.values[0] == s.publishes && s.publishes >= last);
+        last = s.publishes;
+        ++reads;
+    }
+    publisher.join();
+
+    const auto s = reader.read();
+    OPS_REQUIRE(s.publishes == 20000 && s.value("f3") == 20000 && s.value("missing") == 0);
+    OPS_REQUIRE(s.fields[15].name == "f15" && s.fields[15].kind == MetricsPageKind::Gauge);
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: pipeline publishes its metrics to the shared page") {
+    const auto path = (std::filesystem::temp_directory_path() / "ops_stage04_pipeline.page").string();
+
+    Pipeline::Config cfg;
+    cfg.metrics_page_path = path;
+    cfg.metrics_page_interval = std::chrono::milliseconds{ 5 };
+    Pipeline p(cfg);
+    p.start();
+
+    const MetricsPageReader reader(path);
+    OPS_REQUIRE(reader.read().value("state") == static_cast<std::uint64_t>(PipelineState::Running));
+
+    OPS_REQUIRE(submit_n(p, 500) == 500);
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 30 });
+    OPS_REQUIRE(reader.read().publishes >= 2);
+
+    p.shutdown();
+    const auto s = reader.read();
+    const auto m = p.metrics();
+    OPS_REQUIRE(s.value("state") == static_cast<std::uint64_t>(PipelineState::Stopped));
+    OPS_REQUIRE(s.value("accepted") == 500 && s.value("delivered") == 500);
+    OPS_REQUIRE(s.value("q_pack_pop") == m.q_pack_pop && s.value("q_in_depth") == 0);
+    OPS_REQUIRE(s.value("prepare_workers") == 1);
+    std::filesystem::remove(path);
+}
+
+OPS_TEST("Stage04: shutdown waits for submits already past the state check") {
+    Pipeline::Config cfg{};
+    cfg.q_in_capacity = 4;
+    cfg.q_prepare_capacity = 4;
+    cfg.q_pack_capacity = 4;
+    cfg.push_timeout = 200ms;
+    cfg.pop_timeout = 5ms;
+
+    // shutdown_now() has no deadline left to wait in; it still waits out
+    // the submitters it closed intake on.
+    for (const bool now : { false, true }) {
+        Pipeline p(cfg);
+        p.start();
+
+        constexpr int kProducers = 8;
+        std::atomic<bool> stop{ false };
+        std::atomic<std::uint64_t> accepted{ 0 };
+        std::atomic<std::uint64_t> next{ 1 };
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < kProducers; ++t) {
+            producers.emplace_back([&] {
+                while (!stop.load()) {
+                    if (p.submit(Order(static_cast<OrderId>(next++)))) ++accepted;
+                }
+            });
+        }
+        while (p.metrics().delivered_count < 200) std::this_thread::yield();
+
+        // Producers are still submitting, some blocked on the full q_in.
+        if (now) p.shutdown_now();
+        else p.shutdown();
+        const auto at_shutdown = p.metrics();
+
+        stop.store(true);
+        for (auto& t : producers) t.join();
+        const auto after = p.metrics();
+
+        // Nothing an in-flight submit does lands after shutdown has returned.
+        OPS_REQUIRE(after.accepted_count == at_shutdown.accepted_count);
+        OPS_REQUIRE(after.accepted_count == accepted.load());
+        OPS_REQUIRE(after.submit_timeout_count == at_shutdown.submit_timeout_count);
+        if (now) require_report_matches_metrics(p.shutdown_for(0ms), after);
+        else OPS_REQUIRE(after.delivered_count == accepted.load());
+        OPS_REQUIRE(p.state() == PipelineState::Stopped);
+    }
+}
+
+OPS_TEST("Stage04: reorder buffer releases the complete prefix in sequence and skips holes") {
+    std::vector<OrderId> out;
+    ReorderBuffer buf(4, [&](const Order& o) { out.push_back(o.id); });
+
+    const auto now = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 1; i <= 4; ++i) OPS_REQUIRE(buf.admit(now) == i);
+    OPS_REQUIRE_MSG(buf.admit(now + 5ms) == 0, "a full window must refuse a new number");
+    OPS_REQUIRE(buf.stats().window_waits == 1);
+
+    buf.release(delivered_order(30, 3));
+    buf.skip(2);
+    buf.release(delivered_order(40, 4));
+    OPS_REQUIRE(out.empty() && buf.stats().depth == 2);
+
+    buf.release(delivered_order(10, 1));
+    OPS_REQUIRE((out == std::vector<OrderId>{ 10, 30, 40 }));
+    auto st = buf.stats();
+    OPS_REQUIRE(st.released == 3 && st.skipped == 1 && st.depth == 0 && st.max_depth == 3);
+    OPS_REQUIRE(st.wait.count() == 3);
+
+    // A submitter waiting on the full window gets the number freed by the head.
+    for (std::uint64_t i = 5; i <= 8; ++i) OPS_REQUIRE(buf.admit(now) == i);
+    auto waiter = std::async(std::launch::async, [&buf] { return buf.admit(std::chrono::steady_clock::now() + 5s); });
+    std::this_thread::sleep_for(5ms);
+    buf.release(delivered_order(50, 5));
+    OPS_REQUIRE(waiter.get() == 9);
+
+    buf.close();
+    OPS_REQUIRE(buf.admit(std::chrono::steady_clock::now() + 5s) == 0);
+
+    // flush() passes over numbers that never came back; late ones are ignored.
+    buf.release(delivered_order(80, 8));
+    buf.release(delivered_order(70, 7));
+    OPS_REQUIRE(buf.flush() == 2);
+    buf.release(delivered_order(60, 6));
+    OPS_REQUIRE((out == std::vector<OrderId>{ 10, 30, 40, 50, 70, 80 }));
+}
+
+OPS_TEST("Stage04: reorder window hands deliveries to the sink in submit order") {
+    std::vector<OrderId> out;
+
+    Pipeline::Config cfg{};
+    cfg.prepare_workers = 2;
+    cfg.pack_workers = 2;
+    cfg.deliver_workers = 4;
+    cfg.reorder_window = 32;
+    cfg.push_timeout = 2s;
+    cfg.pop_timeout = 5ms;
+    cfg.prepare_work = [](const Order& o) {
+        if (o.id % 7 == 0) std::this_thread::sleep_for(std::chrono::microseconds{ 200 });
+    };
+    cfg.ordered_sink = [&](const Order& o) { out.push_back(o.id); };
+
+    Pipeline p(cfg);
+    p.start();
+    const auto accepted = submit_n(p, 3000);
+    p.shutdown();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(accepted == 3000 && m.delivered_count == accepted);
+    OPS_REQUIRE(out.size() == accepted);
+    OPS_REQUIRE(std::is_sorted(out.begin(), out.end()));
+    OPS_REQUIRE(m.reorder_released == accepted && m.reorder_skipped == 0 && m.reorder_depth == 0);
+    OPS_REQUIRE(m.reorder_max_depth <= 32);
+    OPS_REQUIRE(m.reorder_wait.count() == accepted);
+
+    Pipeline::Config bad{};
+    bad.reorder_window = 8;
+    bad.scheduling = SchedulingPolicy::ThreadPerCore;
+    bool rejected = false;
+    try {
+        Pipeline q(bad);
+    }
+    catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    OPS_REQUIRE_MSG(rejected, "reorder_window must be refused with ThreadPerCore");
+}
+
+OPS_TEST("Stage04: hash ring moves only the ids of the added or removed node") {
+    constexpr OrderId kIds = 100000;
+
+    HashRing ring;
+    for (const char* n : { "a", "b", "c", "d" }) OPS_REQUIRE(ring.add(n));
+    OPS_REQUIRE(!ring.add("a") && ring.size() == 4);
+
+    // Same node set in another order: same owners.
+    HashRing other;
+    for (const char* n : { "d", "b", "a", "c" }) other.add(n);
+
+    std::vector<std::string> before(kIds + 1);
+    std::map<std::string, std::size_t> share;
+    for (OrderId id = 1; id <= kIds; ++id) {
+        before[id] = ring.owner(id);
+        ++share[before[id]];
+        OPS_REQUIRE(other.owner(id) == before[id]);
+    }
+    for (const auto& [node, n] : share) OPS_REQUIRE(n > kIds / 8 && n < kIds / 2);
+
+    // A fifth node takes about a fifth, and only from the others' ids.
+    ring.add("e");
+    std::size_t moved = 0;
+    for (OrderId id = 1; id <= kIds; ++id) {
+        const auto& now = ring.owner(id);
+        if (now == before[id]) continue;
+        OPS_REQUIRE(now == "e");
+        ++moved;
+    }
+    OPS_REQUIRE(moved > kIds / 8 && moved < kIds / 3);
+
+    // Removing it gives every id back to its previous owner.
+    OPS_REQUIRE(ring.remove("e") && !ring.remove("e"));
+    for (OrderId id = 1; id <= kIds; ++id) OPS_REQUIRE(ring.owner(id) == before[id]);
+
+    // Removing "b" moves only b's ids.
+    ring.remove("b");
+    for (OrderId id = 1; id <= kIds; ++id) {
+        if (before[id] != "b") OPS_REQUIRE(ring.owner(id) == before[id]);
+        else OPS_REQUIRE(ring.owner(id) != "b");
+    }
+}
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: cluster client batches orders to node processes and rebalances") {
+    constexpr std::size_t kBatch = 64;
+    std::vector<NodeProcess> nodes;
+    std::vector<ClusterEndpoint> eps;
+    for (const char* name : { "a", "b", "c" }) {
+        nodes.push_back(spawn_node());
+        ClusterEndpoint ep;
+        ep.name = name;
+        ep.port = nodes.back().port;
+        eps.push_back(ep);
+    }
+
+    ClusterClient control; // keeps talking to "a" after the producer drops it
+    for (const auto& ep : eps) control.add_node(ep);
+
+    // What "a" should get: the ring it was on at each phase.
+    HashRing ab;
+    ab.add("a");
+    ab.add("b");
+    HashRing abc = ab;
+    abc.add("c");
+    std::size_t expect_a = 0;
+
+    ClusterClient client(kBatch);
+    client.add_node(eps[0]);
+    client.add_node(eps[1]);
+    for (OrderId id = 1; id <= 3000; ++id) {
+        client.submit(id);
+        if (ab.owner(id) == "a") ++expect_a;
+    }
+    client.flush();
+
+    client.add_node(eps[2]);
+    for (OrderId id = 3001; id <= 6000; ++id) {
+        client.submit(id);
+        if (abc.owner(id) == "a") ++expect_a;
+    }
+
+    // Ids still batched for "a" move to their new owners, not to "a".
+    client.remove_node("a");
+    for (OrderId id = 6001; id <= 9000; ++id) client.submit(id);
+    client.flush();
+
+    OPS_REQUIRE(client.accepted() == 9000 && client.take_refused().empty());
+    OPS_REQUIRE(client.batches_sent() >= 9000 / kBatch);
+
+    std::uint64_t total = 0;
+    std::vector<ClusterNodeStats> final_stats;
+    for (const auto& ep : eps) final_stats.push_back(control.shutdown_node(ep.name));
+    for (const auto& s : final_stats) {
+        OPS_REQUIRE(s.delivered == s.accepted && s.submit_timeouts == 0);
+        OPS_REQUIRE(s.state == static_cast<std::uint64_t>(PipelineState::Stopped));
+        total += s.accepted;
+    }
+    OPS_REQUIRE(total == 9000);
+    OPS_REQUIRE(final_stats[0].accepted <= expect_a && final_stats[0].accepted + kBatch > expect_a);
+    OPS_REQUIRE(final_stats[2].accepted > 0);
+
+    for (auto& n : nodes) OPS_REQUIRE(wait_node(n) == 0);
+}
+#endif
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: cluster client refuses re-routed ids that a dead node cannot take") {
+    constexpr std::size_t kBatch = 128;
+    constexpr std::size_t kPerNode = 100;
+    std::vector<NodeProcess> nodes;
+    ClusterClient client(kBatch);
+    for (const char* name : { "a", "b" }) {
+        nodes.push_back(spawn_node());
+        ClusterEndpoint ep;
+        ep.name = name;
+        ep.port = nodes.back().port;
+        client.add_node(ep);
+    }
+
+    // kPerNode ids batched for each node; none sent yet.
+    std::map<std::string, std::size_t> batched;
+    for (OrderId id = 1; batched["a"] < kPerNode || batched["b"] < kPerNode; ++id) {
+        const std::string& owner = client.ring().owner(id);
+        if (batched[owner] == kPerNode) continue;
+        client.submit(id);
+        ++batched[owner];
+    }
+
+    // "a"'s ids move to "b", which is gone: the batch they fill fails, "b"
+    // leaves the ring, and the ids after it are refused rather than dropped.
+    (void)::kill(nodes[1].pid, SIGKILL);
+    bool threw = false;
+    try {
+        client.remove_node("a");
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    OPS_REQUIRE(threw);
+    OPS_REQUIRE(client.ring().size() == 0);
+    OPS_REQUIRE(client.take_refused().size() == 2 * kPerNode);
+
+    client.flush(); // nothing is left batched
+    OPS_REQUIRE(client.accepted() == 0);
+}
+#endif
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: cluster client drops a node that misses the reply deadline from the ring") {
+    using namespace std::chrono_literals;
+    constexpr std::size_t kBatch = 16;
+    std::vector<NodeProcess> nodes;
+    ClusterClient client(kBatch, HashRing::kDefaultVnodes, 300ms);
+    for (const char* name : { "a", "b" }) {
+        nodes.push_back(spawn_node());
+        ClusterEndpoint ep;
+        ep.name = name;
+        ep.port = nodes.back().port;
+        client.add_node(ep);
+    }
+
+    // "a" keeps its connection but never answers.
+    (void)::kill(nodes[0].pid, SIGSTOP);
+    const auto t0 = std::chrono::steady_clock::now();
+    OrderId id = 1;
+    for (bool threw = false; !threw; ++id) {
+        try {
+            client.submit(id);
+        }
+        catch (const std::runtime_error&) {
+            threw = true;
+        }
+    }
+    const auto waited = std::chrono::steady_clock::now() - t0;
+    OPS_REQUIRE(waited >= 300ms && waited < 5s);
+    OPS_REQUIRE(!client.ring().contains("a") && client.ring().size() == 1);
+    OPS_REQUIRE(client.take_refused().size() == kBatch);
+
+    // Every later id goes to "b".
+    const OrderId last = id + 200;
+    for (; id < last; ++id) client.submit(id);
+    client.flush();
+    OPS_REQUIRE(client.take_refused().empty());
+    OPS_REQUIRE(client.accepted() == last - 1 - kBatch);
+
+    client.remove_node("a");
+    OPS_REQUIRE(client.shutdown_node("b").accepted == client.accepted());
+    OPS_REQUIRE(wait_node(nodes[1]) == 0);
+}
+#endif
+
+OPS_TEST("Stage04: shortest-work queue pops light orders first and ages heavy ones") {
+    const auto weighted = [](OrderId id, std::uint32_t work) {
+        Order o(id);
+        o.work = work;
+        return o;
+    };
+
+    BoundedBlockingQueue<Order> q(16, PushAdmission::Unordered, ConsumerHandoff::ViaQueue,
+        WaitBackend::CondVar, PopOrder::ShortestWork, 20ms);
+    OPS_REQUIRE(q.pop_order() == PopOrder::ShortestWork);
+
+    // Same bucket keeps arrival order: weights 3 and 2 share [2,3], 50 and 60 share [32,63].
+    for (const auto& [id, work] : std::vector<std::pair<OrderId, std::uint32_t>>{
+             { 1, 100 }, { 2, 3 }, { 3, 50 }, { 4, 1 }, { 5, 2 }, { 6, 60 } }) {
+        OPS_REQUIRE(q.push(weighted(id, work)));
+    }
+    std::vector<OrderId> popped;
+    Order o{ OrderId{ 0 } };
+    while (q.try_pop(o)) popped.push_back(o.id);
+    OPS_REQUIRE((popped == std::vector<OrderId>{ 4, 2, 5, 3, 6, 1 }));
+    OPS_REQUIRE(q.stats().aged_pops == 0);
+
+    // A heavy order that has waited past the aging limit overtakes light ones.
+    OPS_REQUIRE(q.push(weighted(10, 1000)));
+    std::this_thread::sleep_for(30ms);
+    OPS_REQUIRE(q.push(weighted(11, 1)));
+    OPS_REQUIRE(q.wait_pop(o) && o.id == 10);
+    OPS_REQUIRE(q.wait_pop(o) && o.id == 11);
+    OPS_REQUIRE(q.stats().aged_pops == 1);
+
+    // Every backend honours the order; items without a weight stay FIFO.
+    for (const auto backend : { WaitBackend::Semaphore, WaitBackend::AtomicWait }) {
+        BoundedBlockingQueue<Order> b(4, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, backend, PopOrder::ShortestWork);
+        OPS_REQUIRE(b.push(weighted(1, 64)) && b.push(weighted(2, 1)));
+        OPS_REQUIRE(b.wait_pop_for(o, 1s) && o.id == 2);
+    }
+    BoundedBlockingQueue<int> ints(4, PushAdmission::Unordered, ConsumerHandoff::ViaQueue, WaitBackend::CondVar, PopOrder::ShortestWork);
+    int v = 0;
+    OPS_REQUIRE(ints.push(7) && ints.push(8));
+    OPS_REQUIRE(ints.try_pop(v) && v == 7);
+}
+
+OPS_TEST("Stage04: shortest-work pipeline delivers every weighted order") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.queue_order = PopOrder::ShortestWork;
+    cfg.work_aging = std::chrono::milliseconds{ 5 };
+    cfg.prepare_work = [](const Order& o) {
+        if (o.work > 1) std::this_thread::sleep_for(std::chrono::microseconds{ 10 * o.work });
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    std::uint64_t accepted = 0;
+    for (OrderId id = 1; id <= 2000; ++id) {
+        Order o(id);
+        o.work = id % 50 == 0 ? 100 : 1;
+        if (p.submit(std::move(o))) ++accepted;
+    }
+    p.shutdown();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(accepted == 2000 && m.delivered_count == accepted);
+    OPS_REQUIRE(m.q_in_pop == accepted && m.q_pack_pop == accepted);
+
+    // The persistent q_in pops in FIFO order, so it refuses ShortestWork.
+    Pipeline::Config bad{};
+    bad.q_in_path = temp_ring_path("shortest_work");
+    bad.queue_order = PopOrder::ShortestWork;
+    bool rejected = false;
+    try {
+        Pipeline q(bad);
+    }
+    catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    OPS_REQUIRE_MSG(rejected, "q_in_path must be refused with ShortestWork");
+}
+
+OPS_TEST("Stage04: coalescing merges same-customer orders into one pass per group") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.status_census = true;
+    cfg.coalesce_window = std::chrono::milliseconds{ 10000 }; // released by shutdown
+    std::atomic<int> prepares{ 0 };
+    cfg.prepare_work = [&](const Order&) { prepares.fetch_add(1); };
+
+    Pipeline p(cfg);
+    p.start();
+
+    const auto submit_for = [&](OrderId id, std::uint64_t customer) {
+        Order o(id);
+        o.customer = customer;
+        return p.submit(std::move(o));
+    };
+    OPS_REQUIRE(submit_for(1, 7) && submit_for(2, 7) && submit_for(3, 7));
+    OPS_REQUIRE(submit_for(4, 9) && submit_for(5, 9));
+    OPS_REQUIRE(submit_for(6, 0)); // no key: straight to q_in
+    OPS_REQUIRE(p.metrics().coalesce_held == 5);
+    OPS_REQUIRE(p.in_flight() >= 5); // held orders count as in flight
+
+    p.shutdown();
+
+    const auto m = p.metrics();
+    OPS_REQUIRE(prepares.load() == 3);
+    OPS_REQUIRE(m.prepared_count == 3 && m.delivered_count == 3);
+    OPS_REQUIRE(m.coalesce_groups == 2 && m.coalesced_orders == 3 && m.coalesce_held == 0);
+    OPS_REQUIRE(m.coalesce_hold.count() == 5);
+    OPS_REQUIRE(p.in_flight() == 0);
+    OPS_REQUIRE(p.status_snapshot().count(OrderStatus::Delivered) == 6);
+
+    const auto at = p.find_delivered(1);
+    OPS_REQUIRE(at.has_value());
+    const Order lead = p.delivered_orders()[*at];
+    OPS_REQUIRE(lead.group_size() == 3 && lead.work == 3);
+    const auto merged = p.merged_orders(lead);
+    OPS_REQUIRE(merged.size() == 2 && merged[0].id == 2 && merged[1].id == 3);
+    for (const auto& o : merged) {
+        OPS_REQUIRE(o.status == OrderStatus::Delivered);
+        OPS_REQUIRE(o.accepted_time >= lead.accepted_time);
+        OPS_REQUIRE(o.delivered_time == lead.delivered_time);
+    }
+
+    Pipeline::Config bad{};
+    bad.scheduling = SchedulingPolicy::ThreadPerCore;
+    bad.coalesce_window = std::chrono::milliseconds{ 5 };
+    bool rejected = false;
+    try {
+        Pipeline q(bad);
+    }
+    catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    OPS_REQUIRE_MSG(rejected, "coalesce_window must be refused with ThreadPerCore");
+}
+
+OPS_TEST("Stage04: coalescing releases full groups at once and the rest after the window") {
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.coalesce_window = std::chrono::milliseconds{ 200 };
+    cfg.coalesce_max_group = 4;
+
+    Pipeline p(cfg);
+    p.start();
+    for (OrderId id = 1; id <= 10; ++id) {
+        Order o(id);
+        o.customer = 42;
+        OPS_REQUIRE(p.submit(std::move(o)));
+    }
+
+    // 1..4 and 5..8 filled up on submit; 9 and 10 wait for the window.
+    const auto m_full = p.metrics();
+    OPS_REQUIRE(m_full.coalesce_groups == 2 && m_full.coalesce_held == 2);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+    while (p.metrics().delivered_count < 3 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 5 });
+    }
+    const auto m = p.metrics();
+    OPS_REQUIRE(m.delivered_count == 3 && m.coalesced_orders == 7 && m.coalesce_held == 0);
+    OPS_REQUIRE(m.coalesce_hold.percentile(1.0) >= std::chrono::milliseconds{ 200 });
+
+    p.shutdown();
+    const auto at = p.find_delivered(9);
+    OPS_REQUIRE(at.has_value() && p.delivered_orders()[*at].group_size() == 2);
+}
+
+OPS_TEST("Stage04: coalescing holds no more than q_in takes and a shutdown deadline cancels the rest") {
+    using namespace std::chrono_literals;
+
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.q_in_capacity = 2;
+    cfg.status_census = true;
+    cfg.coalesce_window = 10s; // released by shutdown
+    std::atomic<bool> blocked{ true };
+    std::atomic<int> started{ 0 };
+    cfg.prepare_work = [&](const Order&) {
+        started.fetch_add(1);
+        while (blocked.load()) std::this_thread::sleep_for(1ms);
+    };
+
+    Pipeline p(cfg);
+    p.start();
+    const auto submit_for = [&](OrderId id, std::uint64_t customer) {
+        Order o(id);
+        o.customer = customer;
+        return p.submit(std::move(o));
+    };
+
+    // The Prepare worker is stuck on order 1, so q_in is empty.
+    OPS_REQUIRE(submit_for(1, 0));
+    while (started.load() == 0) std::this_thread::sleep_for(1ms);
+
+    // Held orders count against q_in's two slots; the refusal is not a timeout.
+    OPS_REQUIRE(submit_for(2, 7) && submit_for(3, 8));
+    OPS_REQUIRE(!submit_for(4, 9));
+    const auto refused = p.metrics();
+    OPS_REQUIRE(refused.coalesce_held == 2);
+    OPS_REQUIRE(refused.coalesce_refused_count == 1 && refused.submit_timeout_count == 0);
+
+    // q_in fills up behind them; the shutdown deadline cancels the held
+    // groups rather than waiting for the worker to make room.
+    OPS_REQUIRE(submit_for(5, 0) && submit_for(6, 0));
+    ShutdownReport report;
+    std::thread stopper([&] { report = p.shutdown_for(100ms); });
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (p.status_snapshot().count(OrderStatus::Canceled) < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(5ms);
+    }
+    const bool canceled_while_blocked = p.status_snapshot().count(OrderStatus::Canceled) >= 2;
+    blocked.store(false);
+    stopper.join();
+
+    OPS_REQUIRE(canceled_while_blocked);
+    OPS_REQUIRE(!report.drained);
+    OPS_REQUIRE(p.in_flight() == 0);
+    OPS_REQUIRE(p.metrics().coalesce_held == 0);
+}
+
+OPS_TEST("Stage04: mock carrier latency shapes keep their mean") {
+    using std::chrono::microseconds;
+    constexpr int kSamples = 20000;
+
+    const auto sample = [](LatencyShape shape, double spread) {
+        CarrierLatency latency{ shape, microseconds{ 1000 }, spread };
+        std::mt19937_64 rng(7);
+        std::vector<std::int64_t> us(kSamples);
+        for (auto& x : us) x = latency.sample(rng).count();
+        std::sort(us.begin(), us.end());
+        return us;
+    };
+    const auto mean_of = [](const std::vector<std::int64_t>& us) {
+        return static_cast<double>(std::accumulate(us.begin(), us.end(), std::int64_t{ 0 })) / static_cast<double>(us.size());
+    };
+    const auto p99_of = [](const std::vector<std::int64_t>& us) { return us[us.size() * 99 / 100]; };
+
+    const auto fixed = sample(LatencyShape::Fixed, 0.5);
+    OPS_REQUIRE(fixed.front() == 1000 && fixed.back() == 1000);
+
+    const auto uniform = sample(LatencyShape::Uniform, 0.5);
+    OPS_REQUIRE(uniform.front() >= 500 && uniform.back() <= 1500);
+    OPS_REQUIRE(std::abs(mean_of(uniform) - 1000) < 20);
+
+    // The long-tailed shapes: same mean, a p99 several times the mean.
+    const auto expo = sample(LatencyShape::Exponential, 0.5);
+    OPS_REQUIRE(std::abs(mean_of(expo) - 1000) < 50);
+    OPS_REQUIRE(p99_of(expo) > 3000);
+
+    const auto lognormal = sample(LatencyShape::LogNormal, 1.0);
+    OPS_REQUIRE(std::abs(mean_of(lognormal) - 1000) < 80);
+    OPS_REQUIRE(p99_of(lognormal) > 3000);
+
+    Pipeline::Config bad{};
+    bad.scheduling = SchedulingPolicy::UpstreamFirst;
+    bad.carrier_port = 9;
+    bool rejected = false;
+    try {
+        Pipeline q(bad);
+    }
+    catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    OPS_REQUIRE_MSG(rejected, "carrier_port must be refused under a shared scheduling policy");
+}
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: carrier deliver keeps a window of requests per worker") {
+    using namespace std::chrono_literals;
+
+    MockCarrier carrier(CarrierLatency{ LatencyShape::Fixed, 20ms });
+    carrier.start();
+
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.carrier_port = carrier.port();
+    cfg.carrier_window = 32;
+
+    // Several Deliver workers each sleep on their own doorbell.
+    for (const std::size_t workers : { 1, 3 }) {
+        cfg.deliver_workers = workers;
+        const auto replied = carrier.stats().replies;
+
+        Pipeline p(cfg);
+        p.start();
+        const auto t0 = std::chrono::steady_clock::now();
+        const auto accepted = submit_n(p, 320);
+        p.shutdown();
+        const auto elapsed = std::chrono::steady_clock::now() - t0;
+
+        // One request at a time would take 320 x 20ms.
+        const auto m = p.metrics();
+        OPS_REQUIRE(accepted == 320 && m.delivered_count == accepted);
+        OPS_REQUIRE(m.carrier_requests == accepted && carrier.stats().replies - replied == accepted);
+        OPS_REQUIRE(m.carrier_max_outstanding > 1 && m.carrier_max_outstanding <= 32);
+        OPS_REQUIRE(m.carrier_rtt.percentile(0.5) >= 20ms);
+        OPS_REQUIRE(elapsed < 3s);
+        for (const auto& o : p.delivered_orders()) OPS_REQUIRE(o.delivered_time - o.packed_time >= 20ms);
+    }
+    cfg.deliver_workers = 1;
+
+    // A forced stop abandons the outstanding requests instead of waiting.
+    MockCarrier slow(CarrierLatency{ LatencyShape::Fixed, 10s });
+    slow.start();
+    cfg.carrier_port = slow.port();
+
+    Pipeline p(cfg);
+    p.start();
+    OPS_REQUIRE(submit_n(p, 10) == 10);
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (p.metrics().carrier_requests < 10 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(5ms);
+    }
+    const auto report = p.shutdown_for(100ms);
+    OPS_REQUIRE(!report.drained && report.deliver.abandoned == 10);
+    OPS_REQUIRE(p.in_flight() == 0);
+}
+#endif
+
+#if !defined(_WIN32)
+OPS_TEST("Stage04: admin commands answer busy while a shutdown drains") {
+    using namespace std::chrono_literals;
+
+    MockCarrier carrier(CarrierLatency{ LatencyShape::Fixed, 300ms });
+    carrier.start();
+
+    Pipeline::Config cfg = backlog_cfg();
+    cfg.carrier_port = carrier.port();
+    cfg.max_stage_workers = 4;
+    Pipeline p(cfg);
+    AdminServer admin(p, "unused.sock");
+    p.start();
+
+    // Growing again needs the retired workers' indexes back: it is refused
+    // until they exit, and they are reaped on the next resize.
+    int applied = 0;
+    const auto resize_deadline = std::chrono::steady_clock::now() + 10s;
+    while (applied < 8 && std::chrono::steady_clock::now() < resize_deadline) {
+        const std::string reply = admin.execute(applied % 2 == 0 ? "workers 4 4 4" : "workers 1 1 1");
+        if (reply == "OK") ++applied;
+        else OPS_REQUIRE(reply == "ERR workers rejected");
+        std::this_thread::sleep_for(1ms);
+    }
+    OPS_REQUIRE(applied == 8);
+
+    OPS_REQUIRE(submit_n(p, 10) == 10);
+    std::thread stopper([&] { p.shutdown(); }); // waits out the carrier
+    while (p.state() == PipelineState::Running) std::this_thread::sleep_for(1ms);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const std::string workers = admin.execute("workers 2 2 2");
+    const std::string shutdown = admin.execute("shutdown");
+    const auto elapsed = std::chrono::steady_clock::now() - t0;
+    const bool draining = p.state() == PipelineState::Draining;
+    stopper.join();
+
+    OPS_REQUIRE_MSG(draining, "the drain must still be running while admin commands are answered");
+    OPS_REQUIRE(workers == "ERR busy" && shutdown == "ERR busy");
+    OPS_REQUIRE(elapsed < 100ms);
+    OPS_REQUIRE(p.metrics().delivered_count == 10);
+}
+#endif